@@ -0,0 +1,168 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  compare.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "compare.h"
+
+// Largest group size for the exact test; the count table grows as n^4.
+#define EXACT_MAX 20
+
+// Copies a JSON string value that follows key, stopping at the closing quote.
+// The writer only escapes quotes and backslashes.
+static int read_string(const char* text, const char* key, char* out, size_t size) {
+    const char* p = strstr(text, key);
+    if (!p) return -1;
+    p += strlen(key);
+    size_t n = 0;
+    for (; *p && *p != '"'; p++) {
+        if (*p == '\\' && p[1]) p++;
+        if (n + 1 < size) out[n++] = *p;
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+// Why parse line by line? The file is the bench's own output, with one result
+// per line, and the bench has no JSON library to lean on.
+int baseline_load(const char* path, Baseline* baseline) {
+    memset(baseline, 0, sizeof(*baseline));
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    snprintf(baseline->cpu, sizeof(baseline->cpu), "unknown");
+    int capacity = 0;
+    char line[8192];
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, "\"cpu\": \"")) read_string(line, "\"cpu\": \"", baseline->cpu, sizeof(baseline->cpu));
+        const char* version = strstr(line, "\"engine_version\": ");
+        if (version) baseline->engine_version = atoi(version + strlen("\"engine_version\": "));
+        const char* samples = strstr(line, "\"samples_ns\": [");
+        if (!samples || !strstr(line, "\"name\": \"")) continue;
+
+        if (baseline->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            BaselineEntry* grown = (BaselineEntry*)realloc(baseline->entries, (size_t)capacity * sizeof(BaselineEntry));
+            if (!grown) break;
+            baseline->entries = grown;
+        }
+        BaselineEntry* e = &baseline->entries[baseline->count];
+        memset(e, 0, sizeof(*e));
+        read_string(line, "\"name\": \"", e->name, sizeof(e->name));
+        read_string(line, "\"variant\": \"", e->variant, sizeof(e->variant));
+        const char* p = samples + strlen("\"samples_ns\": [");
+        while (e->runs < BASELINE_MAX_SAMPLES) {
+            char* end;
+            double v = strtod(p, &end);
+            if (end == p) break;
+            e->samples_ns[e->runs++] = v;
+            p = end;
+            while (*p == ',' || *p == ' ') p++;
+        }
+        if (e->runs > 0) baseline->count++;
+    }
+    fclose(f);
+    if (baseline->count == 0) {
+        baseline_free(baseline);
+        return -1;
+    }
+    return 0;
+}
+
+void baseline_free(Baseline* baseline) {
+    free(baseline->entries);
+    baseline->entries = NULL;
+    baseline->count = 0;
+}
+
+const BaselineEntry* baseline_find(const Baseline* baseline, const char* name, const char* variant) {
+    for (int i = 0; i < baseline->count; i++) {
+        const BaselineEntry* e = &baseline->entries[i];
+        if (strcmp(e->name, name) == 0 && strcmp(e->variant, variant) == 0) return e;
+    }
+    return NULL;
+}
+
+typedef struct {
+    double value;
+    int from_b;
+} RankedSample;
+
+static int compare_ranked(const void* x, const void* y) {
+    double a = ((const RankedSample*)x)->value, b = ((const RankedSample*)y)->value;
+    return (a > b) - (a < b);
+}
+
+// P(U >= u) when every ordering of na + nb values is equally likely. counts
+// holds, for i a's and j b's, how many orderings give each U, where U counts
+// the (a, b) pairs with b above a. The largest value is either a b, which is
+// above all i a's, or an a, which adds nothing.
+static double exact_tail(int na, int nb, double u) {
+    int max_u = na * nb;
+    size_t plane = (size_t)max_u + 1;
+    double* counts = (double*)calloc((size_t)(na + 1) * (nb + 1) * plane, sizeof(double));
+    if (!counts) return 1.0;
+#define COUNT(i, j, k) counts[((size_t)(i) * (nb + 1) + (j)) * plane + (k)]
+    for (int i = 0; i <= na; i++) {
+        for (int j = 0; j <= nb; j++) {
+            if (i == 0 || j == 0) {
+                COUNT(i, j, 0) = 1.0;
+                continue;
+            }
+            for (int k = 0; k <= i * j; k++) {
+                double v = COUNT(i - 1, j, k);
+                if (k >= i) v += COUNT(i, j - 1, k - i);
+                COUNT(i, j, k) = v;
+            }
+        }
+    }
+    double total = 0.0, tail = 0.0;
+    for (int k = 0; k <= max_u; k++) {
+        total += COUNT(na, nb, k);
+        if (k >= (int)ceil(u - 1e-9)) tail += COUNT(na, nb, k);
+    }
+#undef COUNT
+    free(counts);
+    return total > 0.0 ? tail / total : 1.0;
+}
+
+double mann_whitney_greater(const double* a, int na, const double* b, int nb) {
+    if (na < 1 || nb < 1) return 1.0;
+    int n = na + nb;
+    RankedSample* all = (RankedSample*)malloc((size_t)n * sizeof(RankedSample));
+    if (!all) return 1.0;
+    for (int i = 0; i < na; i++) all[i] = (RankedSample){ a[i], 0 };
+    for (int i = 0; i < nb; i++) all[na + i] = (RankedSample){ b[i], 1 };
+    qsort(all, (size_t)n, sizeof(RankedSample), compare_ranked);
+
+    // Tied values share the mean of the ranks they span.
+    double rank_sum_b = 0.0, tie_term = 0.0;
+    for (int i = 0; i < n;) {
+        int j = i;
+        while (j + 1 < n && all[j + 1].value == all[i].value) j++;
+        double rank = (i + j) / 2.0 + 1.0;
+        for (int k = i; k <= j; k++) {
+            if (all[k].from_b) rank_sum_b += rank;
+        }
+        double t = (double)(j - i + 1);
+        tie_term += t * t * t - t;
+        i = j + 1;
+    }
+    free(all);
+    double u = rank_sum_b - nb * (nb + 1) / 2.0;
+
+    if (tie_term == 0.0 && na <= EXACT_MAX && nb <= EXACT_MAX) return exact_tail(na, nb, u);
+
+    double mean = na * (double)nb / 2.0;
+    double var = na * (double)nb / 12.0 * ((n + 1) - tie_term / ((double)n * (n - 1)));
+    if (var <= 0.0) return 1.0;
+    double z = (u - mean - 0.5) / sqrt(var);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
@@ -0,0 +1,45 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  compare.h
+ *
+ * Description:  Loading a saved kernel_bench --json result as a baseline, and
+ * the rank test used to compare a new run against it.
+ *
+ * =====================================================================================
+ */
+
+#ifndef BENCH_COMPARE_H
+#define BENCH_COMPARE_H
+
+#define BASELINE_MAX_SAMPLES 64
+
+typedef struct {
+    char name[32];
+    char variant[32];
+    int runs;
+    double samples_ns[BASELINE_MAX_SAMPLES];
+} BaselineEntry;
+
+typedef struct {
+    char cpu[128];
+    int engine_version;
+    int count;
+    BaselineEntry* entries;
+} Baseline;
+
+// Reads a file written by kernel_bench --json. Returns 0, or -1 if it cannot
+// be read or holds no results.
+int baseline_load(const char* path, Baseline* baseline);
+void baseline_free(Baseline* baseline);
+const BaselineEntry* baseline_find(const Baseline* baseline, const char* name, const char* variant);
+
+// Why Mann-Whitney rather than comparing means? Run times are skewed: a run
+// that was preempted or hit a frequency dip is far slower, never faster. A
+// rank test ignores how far out such a run lies, and it assumes no
+// distribution. Returns the one-sided p-value for "b tends to be larger than
+// a". Small samples without ties use the exact distribution; larger ones use
+// the normal approximation with tie and continuity corrections.
+double mann_whitney_greater(const double* a, int na, const double* b, int nb);
+
+#endif // BENCH_COMPARE_H
@@ -0,0 +1,632 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  kernel_bench.c
+ *
+ * Description:  Microbenchmarks for the engine's hot paths on synthetic frames.
+ *
+ * =====================================================================================
+ */
+
+// Why internal hooks rather than the public API? The hot paths (the cell
+// kernel, the glyph rasteriser, the frame arena) have no public entry point,
+// and timing them through engine_process_* would fold RGB conversion and
+// thread start-up into every number. engine_bench.h reaches them inside the
+// real ascii_engine.o, so what is measured is exactly what ships. The hooks
+// are not exported, which leaves the library's surface untouched.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ascii_engine.h"
+#include "engine_bench.h"
+#include "arena.h"
+#include "compare.h"
+#include "json_writer.h"
+
+// Why a fallback? The TSC gives cycles per pixel without a frequency guess,
+// but only x86 has one. Elsewhere the column counts nanoseconds instead.
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycle_count(void) {
+    return __rdtsc();
+}
+#else
+static uint64_t cycle_count(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#define BENCH_MAX_RUNS 64
+#define BENCH_PAGE 4096
+
+typedef struct {
+    const char* name;
+    int width;
+    int height;
+} BenchResolution;
+
+static const BenchResolution kResolutions[] = {
+    { "480p", 854, 480 },
+    { "1080p", 1920, 1080 },
+    { "4k", 3840, 2160 },
+};
+static const int kWidths[] = { 80, 160, 320 };
+
+#define COUNT_OF(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+typedef struct {
+    int runs;
+    double min_run_ms;  // Each run repeats the operation until it lasts this long.
+    double warmup_ms;
+    const char* filter; // Only benchmarks whose name contains this run.
+    const char* json_path;
+    const char* baseline_path; // Compare against this earlier --json result.
+    double threshold_pct;      // Slowdown that counts as a regression.
+    double alpha;              // Significance level for the rank test.
+} BenchOptions;
+
+// What one call of a benchmark touches; the derived rates divide by these.
+typedef struct {
+    double cells;
+    double pixels;
+    double bytes;
+} BenchWork;
+
+typedef struct {
+    char name[32];
+    char variant[32];
+    BenchWork work;
+    int runs;
+    long iterations;       // Calls per run.
+    double samples_ns[BENCH_MAX_RUNS]; // Per-call time of each run.
+    double cycles_per_call;            // Median, in TSC ticks (nanoseconds without a TSC).
+    double median_ns, mean_ns, stddev_ns, min_ns;
+    char note[48];
+} BenchResult;
+
+typedef void (*BenchFn)(void* state);
+
+static BenchResult* g_results = NULL;
+static int g_result_count = 0;
+static int g_result_capacity = 0;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median_of(const double* values, int n) {
+    double sorted[BENCH_MAX_RUNS];
+    memcpy(sorted, values, (size_t)n * sizeof(double));
+    qsort(sorted, (size_t)n, sizeof(double), compare_doubles);
+    return (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+// Why warm up, calibrate, then repeat? The first calls pay for page faults,
+// cold caches and frequency ramp-up. Calibrating the iteration count makes each
+// run long enough that the clock's resolution does not matter. Repeating the
+// run gives a spread, so a reader can tell a real difference from noise; the
+// median is reported because one preempted run must not move it.
+static void measure(const BenchOptions* options, const char* name, const char* variant,
+                    BenchFn fn, void* state, BenchWork work) {
+    if (options->filter && !strstr(name, options->filter)) return;
+
+    double start = now_ns();
+    long calls = 0;
+    do {
+        fn(state);
+        calls++;
+    } while (now_ns() - start < options->warmup_ms * 1e6);
+    double per_call = (now_ns() - start) / (double)calls;
+    long iterations = (long)(options->min_run_ms * 1e6 / (per_call > 1.0 ? per_call : 1.0)) + 1;
+
+    BenchResult result;
+    memset(&result, 0, sizeof(result));
+    snprintf(result.name, sizeof(result.name), "%s", name);
+    snprintf(result.variant, sizeof(result.variant), "%s", variant);
+    result.work = work;
+    result.runs = options->runs;
+    result.iterations = iterations;
+
+    double cycles[BENCH_MAX_RUNS];
+    for (int r = 0; r < options->runs; r++) {
+        double t0 = now_ns();
+        uint64_t c0 = cycle_count();
+        for (long i = 0; i < iterations; i++) fn(state);
+        uint64_t c1 = cycle_count();
+        double t1 = now_ns();
+        result.samples_ns[r] = (t1 - t0) / (double)iterations;
+        cycles[r] = (double)(c1 - c0) / (double)iterations;
+    }
+
+    double sum = 0.0, min = result.samples_ns[0];
+    for (int r = 0; r < options->runs; r++) {
+        sum += result.samples_ns[r];
+        if (result.samples_ns[r] < min) min = result.samples_ns[r];
+    }
+    result.mean_ns = sum / options->runs;
+    double var = 0.0;
+    for (int r = 0; r < options->runs; r++) {
+        double d = result.samples_ns[r] - result.mean_ns;
+        var += d * d;
+    }
+    result.stddev_ns = options->runs > 1 ? sqrt(var / (options->runs - 1)) : 0.0;
+    result.min_ns = min;
+    result.median_ns = median_of(result.samples_ns, options->runs);
+    result.cycles_per_call = median_of(cycles, options->runs);
+
+    if (g_result_count == g_result_capacity) {
+        g_result_capacity = g_result_capacity ? g_result_capacity * 2 : 64;
+        g_results = (BenchResult*)realloc(g_results, (size_t)g_result_capacity * sizeof(BenchResult));
+        if (!g_results) { perror("realloc"); exit(1); }
+    }
+    g_results[g_result_count++] = result;
+
+    char ns_cell[16] = "-", gbps[16] = "-", cpp[16] = "-";
+    if (work.cells > 0) snprintf(ns_cell, sizeof(ns_cell), "%.2f", result.median_ns / work.cells);
+    if (work.bytes > 0) snprintf(gbps, sizeof(gbps), "%.2f", work.bytes / result.median_ns);
+    if (work.pixels > 0) snprintf(cpp, sizeof(cpp), "%.3f", result.cycles_per_call / work.pixels);
+    printf("%-14s %-16s %12.1f %6.1f%% %10s %8s %10s\n", name, variant, result.median_ns / 1e3,
+           result.mean_ns > 0 ? 100.0 * result.stddev_ns / result.mean_ns : 0.0, ns_cell, gbps, cpp);
+    fflush(stdout);
+}
+
+static void annotate_last(const char* note) {
+    if (g_result_count > 0) snprintf(g_results[g_result_count - 1].note, sizeof(g_results[0].note), "%s", note);
+}
+
+// --- Synthetic frames ---
+// Why a mix of patterns? A flat frame would let the kernel's branches predict
+// perfectly and the PNG encoder compress to nothing. Gradients, hard-edged
+// rings and a band of noise give every glyph class and a realistic
+// compression ratio. The generator is seeded, so runs are comparable.
+
+static uint32_t lcg_next(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 24;
+}
+
+static void fill_rgb(uint8_t* data, int stride, int width, int height) {
+    uint32_t seed = 12345;
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = data + (size_t)y * stride;
+        for (int x = 0; x < width; x++) {
+            int dx = x - width / 2, dy = y - height / 2;
+            int ring = ((dx * dx + dy * dy) / (width / 16 + 1) / (width / 16 + 1)) & 1;
+            uint8_t r = (uint8_t)(x * 255 / width);
+            uint8_t g = (uint8_t)(y * 255 / height);
+            uint8_t b = ring ? 220 : 30;
+            if (y > height * 3 / 4) {
+                uint8_t n = (uint8_t)lcg_next(&seed);
+                r = g = b = n;
+            }
+            row[x * 3 + 0] = r;
+            row[x * 3 + 1] = g;
+            row[x * 3 + 2] = b;
+        }
+    }
+}
+
+static void fill_plane(uint8_t* data, int stride, int width, int height, uint32_t seed) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            data[(size_t)y * stride + x] = (uint8_t)((x ^ y) + lcg_next(&seed) / 8);
+        }
+    }
+}
+
+// --- Benchmarks ---
+
+typedef struct {
+    ProcessingContext* ctx;
+    EngineConfig config;
+    int cols, rows; // The cell grid.
+    unsigned char* buffer;
+    size_t buffer_size;
+    const uint8_t* planes[4];
+    int strides[4];
+} KernelState;
+
+static void bench_cell_kernel(void* arg) {
+    KernelState* s = (KernelState*)arg;
+    engine_bench_cell_kernel(s->ctx, &s->config);
+}
+
+static void bench_rgb_conversion(void* arg) {
+    KernelState* s = (KernelState*)arg;
+    engine_bench_convert(s->ctx, s->planes, s->strides);
+}
+
+static void bench_raster(void* arg) {
+    KernelState* s = (KernelState*)arg;
+    engine_bench_raster(s->ctx, s->buffer, &s->config);
+}
+
+static void bench_format(void* arg) {
+    KernelState* s = (KernelState*)arg;
+    engine_format_ansi(s->ctx, &s->config, (char*)s->buffer, s->buffer_size);
+}
+
+static void bench_png(void* arg) {
+    KernelState* s = (KernelState*)arg;
+    int w = s->cols * 8, h = s->rows * 8;
+    int len = 0;
+    unsigned char* png = engine_bench_png(s->buffer, w, h, &len);
+    free(png);
+}
+
+// The per-frame allocations of an image render: glyphs, colours, the console
+// text and the raster. One byte per page is touched, as the renderer would,
+// so fresh mmap'd pages are charged to malloc as they are in real use.
+typedef struct {
+    Arena arena;
+    size_t sizes[4];
+} AllocState;
+
+static void touch_pages(unsigned char* p, size_t size) {
+    for (size_t off = 0; off < size; off += BENCH_PAGE) p[off] = 1;
+}
+
+static void bench_alloc_arena(void* arg) {
+    AllocState* s = (AllocState*)arg;
+    arena_reset(&s->arena);
+    for (int i = 0; i < 4; i++) {
+        unsigned char* p = (unsigned char*)arena_alloc(&s->arena, s->sizes[i]);
+        if (p) touch_pages(p, s->sizes[i]);
+    }
+}
+
+static void bench_alloc_malloc(void* arg) {
+    AllocState* s = (AllocState*)arg;
+    unsigned char* p[4];
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char*)malloc(s->sizes[i]);
+        if (p[i]) touch_pages(p[i], s->sizes[i]);
+    }
+    for (int i = 0; i < 4; i++) free(p[i]);
+}
+
+static int open_context(const BenchResolution* res, int cells_wide, KernelState* s) {
+    EngineConfig* config = &s->config;
+    memset(config, 0, sizeof(*config));
+    config->output_width = cells_wide;
+    config->edge_strength = 0.4f;
+    config->aspect_correction = 0.5f;
+    config->brightness_factor = 1.0f;
+    config->saturation_factor = 1.0f;
+    config->use_color = 1;
+    config->num_threads = 1;
+    char* error = NULL;
+    s->ctx = engine_init_raw(res->width, res->height, ENGINE_PIX_YUV420P, config, &error);
+    if (!s->ctx) {
+        fprintf(stderr, "engine_init_raw failed at %s: %s\n", res->name, error ? error : "unknown error");
+        return -1;
+    }
+    int stride;
+    uint8_t* rgb = engine_bench_rgb(s->ctx, &stride);
+    fill_rgb(rgb, stride, res->width, res->height);
+    EngineCellGrid grid;
+    if (engine_bench_begin_frame(s->ctx) != 0 || engine_get_cell_grid(s->ctx, &grid) != 0) {
+        engine_cleanup(&s->ctx);
+        return -1;
+    }
+    s->cols = grid.width;
+    s->rows = grid.height;
+    return 0;
+}
+
+static int count_glyph_mismatches(KernelState* s) {
+    size_t cells = (size_t)s->cols * s->rows;
+    char* scalar = (char*)malloc(cells);
+    EngineCellGrid grid;
+    if (!scalar || engine_get_cell_grid(s->ctx, &grid) != 0) {
+        free(scalar);
+        return -1;
+    }
+    s->config.use_simd = 0;
+    bench_cell_kernel(s);
+    memcpy(scalar, grid.chars, cells);
+    s->config.use_simd = 1;
+    bench_cell_kernel(s);
+    int mismatches = 0;
+    for (size_t i = 0; i < cells; i++) mismatches += scalar[i] != grid.chars[i];
+    free(scalar);
+    return mismatches;
+}
+
+static void run_kernel_benches(const BenchOptions* options) {
+    for (int r = 0; r < COUNT_OF(kResolutions); r++) {
+        const BenchResolution* res = &kResolutions[r];
+        for (int w = 0; w < COUNT_OF(kWidths); w++) {
+            KernelState s;
+            memset(&s, 0, sizeof(s));
+            if (open_context(res, kWidths[w], &s) != 0) continue;
+            double cells = (double)s.cols * s.rows;
+            // Nine taps of three bytes in, one glyph and three colour bytes out.
+            BenchWork work = { cells, (double)res->width * res->height, cells * (9 * 3 + 4) };
+            char variant[32];
+            snprintf(variant, sizeof(variant), "%s/w%d", res->name, kWidths[w]);
+
+            s.config.use_simd = 0;
+            measure(options, "kernel-scalar", variant, bench_cell_kernel, &s, work);
+            s.config.use_simd = 1;
+            measure(options, "kernel-sse", variant, bench_cell_kernel, &s, work);
+            if (!options->filter || strstr("kernel-sse", options->filter)) {
+                char note[48];
+                snprintf(note, sizeof(note), "%d/%d glyphs differ from scalar", count_glyph_mismatches(&s), (int)cells);
+                annotate_last(note);
+            }
+            engine_cleanup(&s.ctx);
+        }
+    }
+}
+
+static void run_conversion_benches(const BenchOptions* options) {
+    for (int r = 0; r < COUNT_OF(kResolutions); r++) {
+        const BenchResolution* res = &kResolutions[r];
+        KernelState s;
+        memset(&s, 0, sizeof(s));
+        if (open_context(res, kWidths[0], &s) != 0) continue;
+        int cw = (res->width + 1) / 2, ch = (res->height + 1) / 2;
+        uint8_t* y = (uint8_t*)malloc((size_t)res->width * res->height);
+        uint8_t* u = (uint8_t*)malloc((size_t)cw * ch);
+        uint8_t* v = (uint8_t*)malloc((size_t)cw * ch);
+        if (y && u && v) {
+            fill_plane(y, res->width, res->width, res->height, 1);
+            fill_plane(u, cw, cw, ch, 2);
+            fill_plane(v, cw, cw, ch, 3);
+            s.planes[0] = y; s.planes[1] = u; s.planes[2] = v;
+            s.strides[0] = res->width; s.strides[1] = cw; s.strides[2] = cw;
+            double pixels = (double)res->width * res->height;
+            BenchWork work = { 0, pixels, pixels * 1.5 + pixels * 3 };
+            measure(options, "rgb-convert", res->name, bench_rgb_conversion, &s, work);
+        }
+        free(y); free(u); free(v);
+        engine_cleanup(&s.ctx);
+    }
+}
+
+// Raster, console text, allocation and PNG cost depend on the grid, not on the
+// source resolution, so they run once per width from a 1080p source.
+static void run_output_benches(const BenchOptions* options) {
+    const BenchResolution* res = &kResolutions[1];
+    for (int w = 0; w < COUNT_OF(kWidths); w++) {
+        KernelState s;
+        memset(&s, 0, sizeof(s));
+        if (open_context(res, kWidths[w], &s) != 0) continue;
+        bench_cell_kernel(&s);
+        double cells = (double)s.cols * s.rows;
+        size_t raster_bytes = (size_t)cells * 64 * 3;
+        size_t text_bytes = engine_format_ansi(s.ctx, &s.config, NULL, 0);
+        s.buffer_size = raster_bytes > text_bytes ? raster_bytes : text_bytes;
+        s.buffer = (unsigned char*)malloc(s.buffer_size);
+        if (!s.buffer) { engine_cleanup(&s.ctx); continue; }
+        char variant[32];
+        snprintf(variant, sizeof(variant), "w%d", kWidths[w]);
+
+        BenchWork raster_work = { cells, cells * 64, (double)raster_bytes };
+        measure(options, "raster", variant, bench_raster, &s, raster_work);
+
+        size_t used = engine_format_ansi(s.ctx, &s.config, (char*)s.buffer, s.buffer_size);
+        BenchWork format_work = { cells, 0, (double)used };
+        measure(options, "ansi-format", variant, bench_format, &s, format_work);
+
+        engine_bench_raster(s.ctx, s.buffer, &s.config);
+        measure(options, "png-write", variant, bench_png, &s, raster_work);
+
+        AllocState a;
+        memset(&a, 0, sizeof(a));
+        a.sizes[0] = (size_t)cells;
+        a.sizes[1] = (size_t)cells * 3;
+        a.sizes[2] = text_bytes;
+        a.sizes[3] = raster_bytes;
+        if (arena_init(&a.arena, 64 * 1024 * 1024)) {
+            double total = (double)(a.sizes[0] + a.sizes[1] + a.sizes[2] + a.sizes[3]);
+            BenchWork alloc_work = { cells, 0, total };
+            measure(options, "alloc-arena", variant, bench_alloc_arena, &a, alloc_work);
+            measure(options, "alloc-malloc", variant, bench_alloc_malloc, &a, alloc_work);
+            arena_free(&a.arena);
+        }
+
+        free(s.buffer);
+        engine_cleanup(&s.ctx);
+    }
+}
+
+// --- Reporting ---
+
+static void read_cpu_model(char* model, size_t size) {
+    snprintf(model, size, "unknown");
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (!f) return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) == 0) {
+            char* colon = strchr(line, ':');
+            if (colon) {
+                colon++;
+                while (*colon == ' ') colon++;
+                colon[strcspn(colon, "\n")] = '\0';
+                snprintf(model, size, "%s", colon);
+            }
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static int write_json(const char* path, const BenchOptions* options, const char* cpu) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "{\n  \"suite\": \"kernels\",\n  \"engine_version\": %d,\n  \"cpu\": ", engine_version());
+    json_write_string(f, cpu);
+    fprintf(f, ",\n  \"runs\": %d,\n  \"min_run_ms\": %.1f,\n  \"results\": [\n", options->runs, options->min_run_ms);
+    for (int i = 0; i < g_result_count; i++) {
+        const BenchResult* r = &g_results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"variant\": \"%s\", \"iterations\": %ld, ", r->name, r->variant, r->iterations);
+        fprintf(f, "\"median_ns\": %.1f, \"mean_ns\": %.1f, \"stddev_ns\": %.1f, \"min_ns\": %.1f, ",
+                r->median_ns, r->mean_ns, r->stddev_ns, r->min_ns);
+        fprintf(f, "\"cells\": %.0f, \"pixels\": %.0f, \"bytes\": %.0f, \"cycles\": %.0f, ",
+                r->work.cells, r->work.pixels, r->work.bytes, r->cycles_per_call);
+        if (r->note[0]) {
+            fprintf(f, "\"note\": ");
+            json_write_string(f, r->note);
+            fprintf(f, ", ");
+        }
+        fprintf(f, "\"samples_ns\": [");
+        for (int k = 0; k < r->runs; k++) fprintf(f, "%s%.1f", k ? ", " : "", r->samples_ns[k]);
+        fprintf(f, "]}%s\n", i + 1 < g_result_count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f);
+}
+
+// --- Baseline comparison ---
+
+// Why only these? They run once per frame (or per cell) in playback and
+// transcode. PNG writing is a one-off for stills, and malloc is the yardstick
+// for the arena rather than something the engine calls.
+static int is_hot_path(const char* name) {
+    static const char* const kHot[] = { "kernel-scalar", "kernel-sse", "rgb-convert", "raster", "ansi-format", "alloc-arena" };
+    for (int i = 0; i < COUNT_OF(kHot); i++) {
+        if (strcmp(name, kHot[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// A metric regresses only when the slowdown is both larger than the threshold
+// and unlikely to be noise. A big jump over a handful of noisy runs, or a
+// consistent 1% drift, is reported but does not fail the gate.
+static int compare_with_baseline(const BenchOptions* options, const char* cpu) {
+    Baseline baseline;
+    if (baseline_load(options->baseline_path, &baseline) != 0) {
+        fprintf(stderr, "Could not read a baseline from %s\n", options->baseline_path);
+        return -1;
+    }
+    printf("\nAgainst %s", options->baseline_path);
+    if (strcmp(baseline.cpu, cpu) != 0) printf(" (recorded on %s; timings may not be comparable)", baseline.cpu);
+    printf("\nRegression: median more than %.1f%% slower with one-sided Mann-Whitney p < %.3g\n\n",
+           options->threshold_pct, options->alpha);
+    printf("%-14s %-16s %12s %12s %8s %9s  %s\n", "benchmark", "case", "base us", "new us", "delta", "p", "verdict");
+
+    int regressions = 0;
+    for (int i = 0; i < g_result_count; i++) {
+        const BenchResult* r = &g_results[i];
+        const BaselineEntry* base = baseline_find(&baseline, r->name, r->variant);
+        if (!base) {
+            printf("%-14s %-16s %12s %12.1f %8s %9s  new\n", r->name, r->variant, "-", r->median_ns / 1e3, "-", "-");
+            continue;
+        }
+        double base_median = median_of(base->samples_ns, base->runs);
+        double delta = base_median > 0.0 ? 100.0 * (r->median_ns - base_median) / base_median : 0.0;
+        double p_slower = mann_whitney_greater(base->samples_ns, base->runs, r->samples_ns, r->runs);
+        double p_faster = mann_whitney_greater(r->samples_ns, r->runs, base->samples_ns, base->runs);
+        const char* verdict = "same";
+        double p = p_slower < p_faster ? p_slower : p_faster;
+        if (delta > options->threshold_pct && p_slower < options->alpha) {
+            verdict = is_hot_path(r->name) ? "REGRESSED" : "slower (not gated)";
+            if (is_hot_path(r->name)) regressions++;
+        } else if (delta < -options->threshold_pct && p_faster < options->alpha) {
+            verdict = "faster";
+        } else if (fabs(delta) > options->threshold_pct) {
+            verdict = "inconclusive";
+        }
+        printf("%-14s %-16s %12.1f %12.1f %+7.1f%% %9.4f  %s\n", r->name, r->variant, base_median / 1e3,
+               r->median_ns / 1e3, delta, p, verdict);
+    }
+    baseline_free(&baseline);
+    printf("\n%d hot-path regression(s)\n", regressions);
+    return regressions;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--quick] [--runs <n>] [--filter <name>] [--json <file>] [--compare <file>]\n"
+                    "       [--threshold <pct>] [--alpha <p>]\n", argv0);
+    fprintf(stderr, "  --quick          Fewer, shorter runs for a rough picture\n");
+    fprintf(stderr, "  --runs <n>       Timed runs per benchmark (default 15, max %d)\n", BENCH_MAX_RUNS);
+    fprintf(stderr, "  --filter <name>  Only run benchmarks whose name contains <name>\n");
+    fprintf(stderr, "  --json <file>    Also write every result, with per-run samples, as JSON\n");
+    fprintf(stderr, "  --compare <file> Compare with an earlier --json result; exit 3 on a hot-path regression\n");
+    fprintf(stderr, "  --threshold <pct> Slowdown that counts as a regression (default 5)\n");
+    fprintf(stderr, "  --alpha <p>      Significance level of the Mann-Whitney test (default 0.01)\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options = { 15, 20.0, 100.0, NULL, NULL, NULL, 5.0, 0.01 };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            options.runs = 5;
+            options.min_run_ms = 5.0;
+            options.warmup_ms = 20.0;
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            options.runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            options.baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            options.threshold_pct = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) {
+            options.alpha = strtod(argv[++i], NULL);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.runs < 1) options.runs = 1;
+    if (options.runs > BENCH_MAX_RUNS) options.runs = BENCH_MAX_RUNS;
+    // Fail before spending minutes on runs that cannot be compared.
+    if (options.baseline_path) {
+        FILE* f = fopen(options.baseline_path, "r");
+        if (!f) {
+            fprintf(stderr, "Could not open baseline %s\n", options.baseline_path);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    char cpu[128];
+    read_cpu_model(cpu, sizeof(cpu));
+    printf("CPU: %s\n", cpu);
+    printf("Single thread; %d runs per benchmark after warm-up; median per call. Cycles are TSC ticks.\n\n",
+           options.runs);
+    printf("%-14s %-16s %12s %7s %10s %8s %10s\n", "benchmark", "case", "median us", "+/-", "ns/cell", "GB/s", "cyc/pixel");
+
+    run_kernel_benches(&options);
+    run_conversion_benches(&options);
+    run_output_benches(&options);
+
+    for (int i = 0; i < g_result_count; i++) {
+        if (g_results[i].note[0]) printf("note: %s %s: %s\n", g_results[i].name, g_results[i].variant, g_results[i].note);
+    }
+    if (options.json_path) {
+        if (write_json(options.json_path, &options, cpu) != 0) {
+            fprintf(stderr, "Could not write %s\n", options.json_path);
+            free(g_results);
+            return 1;
+        }
+        printf("Results written to %s\n", options.json_path);
+    }
+    int status = 0;
+    if (options.baseline_path) {
+        int regressions = compare_with_baseline(&options, cpu);
+        // Why 3? 1 already means a bad invocation; a gate must tell "slower"
+        // apart from "could not run".
+        status = regressions < 0 ? 1 : (regressions > 0 ? 3 : 0);
+    }
+    free(g_results);
+    return status;
+}
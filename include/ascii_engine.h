@@ -10,9 +10,25 @@
 #define ASCII_ENGINE_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <pthread.h>
 
+#define ENGINE_VERSION_MAJOR 1
+#define ENGINE_VERSION_MINOR 0
+#define ENGINE_VERSION_PATCH 0
+#define ENGINE_VERSION ((ENGINE_VERSION_MAJOR << 16) | (ENGINE_VERSION_MINOR << 8) | ENGINE_VERSION_PATCH)
+
+// Why an explicit export macro? The library is built with -fvisibility=hidden,
+// so only what this header declares is visible to consumers of
+// libpixelripper.so. Every internal helper stays private and can change
+// freely without breaking anyone's dynamic linkage.
+#if defined(__GNUC__)
+#define ENGINE_API __attribute__((visibility("default")))
+#else
+#define ENGINE_API
+#endif
+
 // Why forward-declare? To keep this header clean and self-contained. It acts as
 // a contract for the engine's API without exposing the internal chaos of FFmpeg's
 // own headers to the consumer of our library.
@@ -25,7 +41,8 @@ struct AVPacket;
 typedef enum {
     MODE_IMAGE,
     MODE_VIDEO,
-    MODE_ANIMATED_GIF // Explicitly handle GIFs to accommodate their unique timing.
+    MODE_ANIMATED_GIF, // Explicitly handle GIFs to accommodate their unique timing.
+    MODE_SEQUENCE // Numbered stills or a directory of images, played at sequence_fps.
 } ProcessingMode;
 
 typedef enum {
@@ -33,6 +50,10 @@ typedef enum {
     DITHER_FLOYD
 } DitherMode;
 
+// Why append-only? Consumers built against an older header pass a smaller
+// struct. engine_init_versioned records its size and zero-fills every field
+// it did not know about, so new fields must go at the end and must treat 0 as
+// "previous behaviour".
 typedef struct {
     ProcessingMode mode;
     int output_width;
@@ -46,34 +67,264 @@ typedef struct {
     DitherMode dither_mode;
     int use_simd;
     int crf; // Constant Rate Factor: Direct control over the soul of the video encoder.
+    int shard_index; // Which GOP-aligned slice of the input to process (0-based).
+    int shard_count; // Total number of slices; 0 disables shard mode.
+    float checkpoint_secs; // Media time per committed segment; 0 writes one file directly.
+    int lowres; // Decode at 1/2^lowres size where the codec supports it (0 = full size).
+    int crop_x, crop_y, crop_w, crop_h; // Region of interest in source pixels; crop_w == 0 means the full frame.
+    int autocrop; // Detect and drop letterbox/pillarbox bars from the first frames.
+    float sequence_fps; // Frame rate assigned to image-sequence input (0 = 25 fps).
+    int band_rows; // Deal cell rows to the workers in bands of this height, round robin (0 = one contiguous slice each).
 } EngineConfig;
 
 typedef struct ProcessingContext ProcessingContext;
 
-ProcessingContext* engine_init(const char* input_source, const EngineConfig* config, char** error);
-void engine_cleanup(ProcessingContext** ctx);
+// A read-only view of the current cell grid. The pointers alias the engine's
+// own frame buffers: no copy is made, and they stay valid until the next
+// frame is processed on the same context or the context is destroyed.
+typedef struct {
+    const char* chars;           // One glyph per cell, row-major.
+    const unsigned char* colors; // Three bytes (R, G, B) per cell, row-major.
+    int width;                   // Cells per row.
+    int height;                  // Rows.
+    int char_stride;             // Bytes between rows in chars.
+    int color_stride;            // Bytes between rows in colors.
+} EngineCellGrid;
+
+typedef struct {
+    int64_t frame_index; // Frames converted on this context so far, starting at 0.
+    int64_t pts;         // Source PTS (or the pts given to engine_process_buffer).
+    double pts_secs;     // pts in seconds, or -1.0 when unknown.
+    double process_ms;   // Wall time spent on RGB conversion and the cell kernel.
+} EngineFrameInfo;
+
+// Called on the converting thread right after each frame's grid is complete.
+typedef void (*EngineFrameCallback)(const EngineFrameInfo* info, const EngineCellGrid* grid, void* user_data);
+
+// Pipeline stages timed by engine_enable_stats. OUTPUT is the one stage the
+// engine cannot see in full (the caller owns the terminal or socket), so
+// callers record their own writes with engine_record_stage.
+typedef enum {
+    ENGINE_STAGE_DEMUX,  // Reading the next packet.
+    ENGINE_STAGE_DECODE, // Video decode, or loading the next sequence image.
+    ENGINE_STAGE_RGB,    // sws_scale of the source into RGB24.
+    ENGINE_STAGE_KERNEL, // The cell kernel, one sample per worker per frame.
+    ENGINE_STAGE_FORMAT, // ANSI escape text for the console.
+    ENGINE_STAGE_RASTER, // Glyphs drawn into an RGB image.
+    ENGINE_STAGE_YUV,    // RGB24 to YUV420P for the encoder.
+    ENGINE_STAGE_ENCODE, // The video encoder, or PNG compression.
+    ENGINE_STAGE_MUX,    // Writing packets to the output container.
+    ENGINE_STAGE_OUTPUT, // Terminal writes.
+    ENGINE_STAGE_COUNT
+} EngineStage;
+
+typedef struct {
+    int64_t count;   // Samples recorded.
+    double total_ms;
+    double mean_ms;
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    int64_t bytes;   // Bytes the stage produced (packets, text, pixels).
+} EngineStageStats;
+
+// User-space hardware counter totals for one stage. A counter the CPU or
+// hypervisor does not provide reads -1.
+typedef struct {
+    int64_t samples;       // Stage calls that were counted.
+    int64_t cycles;
+    int64_t instructions;
+    int64_t cache_misses;  // Last-level cache misses.
+    int64_t branch_misses;
+} EngineStageCounters;
+
+// Pixel layouts accepted by engine_init_raw. Packed formats use plane 0 only;
+// YUV420P uses planes 0-2 and NV12 uses planes 0-1.
+typedef enum {
+    ENGINE_PIX_RGB24,
+    ENGINE_PIX_BGR24,
+    ENGINE_PIX_RGBA,
+    ENGINE_PIX_BGRA,
+    ENGINE_PIX_GRAY8,
+    ENGINE_PIX_YUV420P,
+    ENGINE_PIX_NV12
+} EnginePixelFormat;
+
+// Why pass the header's version and sizeof(EngineConfig)? The context keeps its
+// own copy of the config, normalised to the library's layout, so a library
+// that has grown new fields still works with binaries built against an older
+// header. engine_init and engine_init_raw are macros that fill both in for you.
+// Every call below that takes a config accepts NULL to mean "the copy made at
+// init"; a non-NULL pointer refreshes that copy first.
+ENGINE_API ProcessingContext* engine_init_versioned(const char* input_source, const EngineConfig* config,
+                                                    int abi_version, size_t config_size, char** error);
+#define engine_init(input_source, config, error) \
+    engine_init_versioned((input_source), (config), ENGINE_VERSION, sizeof(EngineConfig), (error))
+ENGINE_API void engine_cleanup(ProcessingContext** ctx);
+
+// Why a raw entry point? Embedders already hold frames in memory (capture
+// cards, compositors, network streams). A raw context is sized from the frame
+// geometry alone and never opens a file or a demuxer. Contexts share no state,
+// so any number of them may run concurrently, one per thread.
+ENGINE_API ProcessingContext* engine_init_raw_versioned(int width, int height, EnginePixelFormat format,
+                                                        const EngineConfig* config, int abi_version,
+                                                        size_t config_size, char** error);
+#define engine_init_raw(width, height, format, config, error) \
+    engine_init_raw_versioned((width), (height), (format), (config), ENGINE_VERSION, sizeof(EngineConfig), (error))
+// Converts one frame. planes/strides hold as many entries as the format has
+// planes; strides are in bytes and may include padding. pts is passed through
+// to the per-frame result metadata.
+ENGINE_API int engine_process_buffer(ProcessingContext* ctx, const uint8_t* const planes[], const int strides[],
+                          int64_t pts, const EngineConfig* config);
+
+ENGINE_API int engine_get_next_packet(ProcessingContext* ctx, struct AVPacket* packet);
+ENGINE_API int engine_decode_video_packet(ProcessingContext* ctx, struct AVPacket* packet, struct AVFrame** frame);
+ENGINE_API void engine_process_frame_to_ascii(ProcessingContext* ctx, const struct AVFrame* frame, const EngineConfig* config);
 
-int engine_get_next_packet(ProcessingContext* ctx, struct AVPacket* packet);
-int engine_decode_video_packet(ProcessingContext* ctx, struct AVPacket* packet, struct AVFrame** frame);
-void engine_process_frame_to_ascii(ProcessingContext* ctx, const struct AVFrame* frame, const EngineConfig* config);
+// Asynchronous conversion. engine_async_start spawns a pipeline thread that
+// converts submitted frames in order while the caller keeps decoding or
+// serving I/O. Up to max_in_flight frames may be outstanding (queued, being
+// converted, or done but not yet released); a submit beyond that returns
+// ENGINE_ASYNC_FULL. Each submit returns a ticket >= 0. engine_poll returns 1
+// when its grid is ready, 0 while pending, -1 on error; engine_wait blocks.
+// The grid stays valid until engine_release_ticket. The event fd (an eventfd)
+// becomes readable whenever a frame completes, so it can sit in the caller's
+// own epoll set. While tickets are outstanding, only packet reading and
+// decoding may be used alongside these calls, all from a single thread.
+#define ENGINE_ASYNC_FULL (-2)
+ENGINE_API int engine_async_start(ProcessingContext* ctx, int max_in_flight);
+ENGINE_API int engine_get_event_fd(const ProcessingContext* ctx);
+ENGINE_API int64_t engine_submit_frame(ProcessingContext* ctx, const struct AVFrame* frame, const EngineConfig* config);
+ENGINE_API int64_t engine_submit_buffer(ProcessingContext* ctx, const uint8_t* const planes[], const int strides[],
+                                        int64_t pts, const EngineConfig* config);
+ENGINE_API int engine_poll(ProcessingContext* ctx, int64_t ticket, EngineCellGrid* grid, EngineFrameInfo* info);
+ENGINE_API int engine_wait(ProcessingContext* ctx, int64_t ticket, EngineCellGrid* grid, EngineFrameInfo* info);
+ENGINE_API void engine_release_ticket(ProcessingContext* ctx, int64_t ticket);
 
-void engine_render_to_console(ProcessingContext* ctx, const EngineConfig* config);
-int engine_render_to_image_file(ProcessingContext* ctx, const EngineConfig* config);
+ENGINE_API int engine_get_cell_grid(const ProcessingContext* ctx, EngineCellGrid* grid);
+// Replaces the current grid with a copy of one produced earlier, for example
+// one read back from a cache, and resizes the output to match. The render
+// calls then work as if the frame had just been converted.
+ENGINE_API int engine_load_cell_grid(ProcessingContext* ctx, const EngineCellGrid* grid);
+ENGINE_API void engine_set_frame_callback(ProcessingContext* ctx, EngineFrameCallback callback, void* user_data);
 
-int engine_encode_video_frame(ProcessingContext* ctx, const struct AVFrame* original_frame, const EngineConfig* config);
-int engine_remux_packet(ProcessingContext* ctx, struct AVPacket* packet);
-void engine_finalize_video_encoder(ProcessingContext* ctx);
+// Why opt-in? Timing a stage costs two clock reads, which is noise for an
+// encode but not for a 20 ns packet read. While disabled, each stage costs a
+// single untaken branch. Every thread records into its own slot, without
+// locks: thread 0 is the one calling the engine, 1 the async pipeline, and
+// 2 onwards are the kernel workers. Pass -1 to merge them all. Enabling
+// again clears the counters.
+ENGINE_API int engine_enable_stats(ProcessingContext* ctx, int enable);
+ENGINE_API const char* engine_stage_name(EngineStage stage);
+ENGINE_API void engine_record_stage(ProcessingContext* ctx, EngineStage stage, int64_t elapsed_ns, int64_t bytes);
+ENGINE_API int engine_get_stats_threads(const ProcessingContext* ctx);
+ENGINE_API int engine_get_stage_stats(const ProcessingContext* ctx, int thread, EngineStage stage, EngineStageStats* stats);
+// Frames converted and wall time since stats were enabled.
+ENGINE_API int engine_get_stats_span(const ProcessingContext* ctx, int64_t* frames, double* wall_secs);
+// "main", "pipeline" or "worker N" for a thread index above.
+ENGINE_API void engine_stats_thread_name(int thread, char* name, size_t size);
+
+// Hardware counters (cycles, instructions, cache and branch misses) for the
+// kernel, raster and format stages, per thread, through perf_event_open.
+// Returns -1 when perf events are unavailable, which is common in containers
+// and with a strict perf_event_paranoid; everything else keeps working. Each
+// kernel worker opens its counter group per frame, a few syscalls outside the
+// timed span, which is why this is separate from engine_enable_stats.
+ENGINE_API int engine_enable_counters(ProcessingContext* ctx, int enable);
+ENGINE_API int engine_get_stage_counters(const ProcessingContext* ctx, int thread, EngineStage stage,
+                                         EngineStageCounters* counters);
+
+// Why a trace on top of the stats? Totals cannot show a bubble: the workers
+// idle while the encoder runs, then the encoder idles while they work. A
+// trace keeps every span (stage, frame, thread, start and end) and writes
+// Chrome trace-event JSON, which Perfetto (ui.perfetto.dev) and
+// chrome://tracing open as one track per thread. Recording uses the same
+// per-thread slots as the stats, each a ring of spans_per_thread entries
+// (32 bytes each). A long run keeps its latest spans, and memory stays fixed.
+// Pass 0 to turn tracing off. With async conversion, write the file only
+// once every submitted frame has completed.
+ENGINE_API int engine_enable_trace(ProcessingContext* ctx, size_t spans_per_thread);
+ENGINE_API int engine_write_trace(const ProcessingContext* ctx, const char* path, char** error);
+
+// Interactive tuning. With planes retained, every conversion also keeps each
+// cell's gradient magnitude, edge orientation and brightness level, and the
+// converted source picture stays in the context. engine_reclassify then
+// applies a new edge_strength from the planes alone, at a lookup per cell.
+// engine_reprocess reruns the cell kernel on the kept picture, for example
+// after engine_update_output_dims, without decoding or colour conversion.
+// Brightness and saturation need neither; they apply at render time.
+// Not for use while the async pipeline is running.
+ENGINE_API void engine_retain_planes(ProcessingContext* ctx, int enable);
+// A read-only view of the retained planes, aliasing the engine's buffers like
+// EngineCellGrid. Fails unless planes were retained for the current grid.
+typedef struct {
+    const float* magnitude;            // Squared gradient magnitude, normalised to 0..1 per tap.
+    const unsigned char* orientation;  // Edge direction class, 0-3.
+    const unsigned char* level;        // Gamma-corrected brightness, 0-255.
+    int width;
+    int height;
+} EngineCellPlanes;
+ENGINE_API int engine_get_cell_planes(const ProcessingContext* ctx, EngineCellPlanes* planes);
+ENGINE_API int engine_reclassify(ProcessingContext* ctx, const EngineConfig* config);
+ENGINE_API int engine_reprocess(ProcessingContext* ctx, const EngineConfig* config);
+
+ENGINE_API void engine_render_to_console(ProcessingContext* ctx, const EngineConfig* config);
+ENGINE_API int engine_render_to_image_file(ProcessingContext* ctx, const EngineConfig* config);
+// Writes the current grid as ANSI text (plain text when use_color is 0), one
+// line per row, NUL-terminated. With buffer == NULL returns the size needed;
+// otherwise returns the bytes written, excluding the NUL, or 0 if size is short.
+ENGINE_API size_t engine_format_ansi(ProcessingContext* ctx, const EngineConfig* config, char* buffer, size_t size);
+// Rasterises the grid with the 8x8 font into packed RGB24, (width * 8) x
+// (height * 8) pixels in cells. Fails if size is smaller than that.
+ENGINE_API int engine_render_to_rgb(ProcessingContext* ctx, const EngineConfig* config, unsigned char* rgb, size_t size);
+// Encodes the rendered grid as a PNG in memory. Release *png with free().
+ENGINE_API int engine_render_to_png_memory(ProcessingContext* ctx, const EngineConfig* config,
+                                           unsigned char** png, int* png_size);
+
+ENGINE_API int engine_encode_video_frame(ProcessingContext* ctx, const struct AVFrame* original_frame, const EngineConfig* config);
+ENGINE_API int engine_remux_packet(ProcessingContext* ctx, struct AVPacket* packet);
+ENGINE_API void engine_finalize_video_encoder(ProcessingContext* ctx);
 
 // Why return a double? Frame timings can be precise; we use microseconds for usleep,
 // but returning a double gives the caller flexibility. This is now more important
 // for handling variable frame rates in formats like GIF.
-double engine_get_frame_delay_secs(const ProcessingContext* ctx, const struct AVFrame* frame);
-int engine_get_video_stream_idx(const ProcessingContext* ctx);
-int engine_get_audio_stream_idx(const ProcessingContext* ctx);
-float engine_get_video_aspect(const ProcessingContext* ctx);
-void engine_update_output_dims(ProcessingContext* ctx, int new_ascii_width, int new_ascii_height);
+ENGINE_API double engine_get_frame_delay_secs(const ProcessingContext* ctx, const struct AVFrame* frame);
+ENGINE_API int engine_get_video_stream_idx(const ProcessingContext* ctx);
+ENGINE_API int engine_get_audio_stream_idx(const ProcessingContext* ctx);
+ENGINE_API float engine_get_video_aspect(const ProcessingContext* ctx);
+ENGINE_API void engine_get_output_dims(const ProcessingContext* ctx, int* ascii_width, int* ascii_height);
+ENGINE_API void engine_update_output_dims(ProcessingContext* ctx, int new_ascii_width, int new_ascii_height);
+// The region of the decoded frame actually converted, after crop/autocrop.
+ENGINE_API void engine_get_crop(const ProcessingContext* ctx, int* x, int* y, int* w, int* h);
+
+// Shard support. engine_frame_in_range returns -1 for frames before the shard,
+// 0 for frames inside it and 1 once decoding has passed its end. Outside shard
+// mode every frame is in range.
+ENGINE_API int engine_frame_in_range(const ProcessingContext* ctx, const struct AVFrame* frame);
+ENGINE_API int engine_get_range(const ProcessingContext* ctx, int64_t* start_pts, int64_t* end_pts, int* tb_num, int* tb_den);
+ENGINE_API long engine_get_encoded_frame_count(const ProcessingContext* ctx);
+
+// Segmented output for checkpointed transcodes. engine_close_segment flushes the
+// encoder and writes the trailer, so every closed segment is a playable file.
+ENGINE_API int engine_open_segment(ProcessingContext* ctx, const EngineConfig* config, const char* filename, char** error);
+ENGINE_API void engine_close_segment(ProcessingContext* ctx);
+ENGINE_API int engine_seek_to_pts(ProcessingContext* ctx, int64_t pts);
+ENGINE_API int engine_frame_is_keyframe(const struct AVFrame* frame);
+ENGINE_API int64_t engine_get_frame_pts(const struct AVFrame* frame);
+ENGINE_API void engine_get_time_base(const ProcessingContext* ctx, int* tb_num, int* tb_den);
+
+// Samples cols x rows keyframes evenly across the video and converts them as one
+// mosaic into the cell grid. Render the result with engine_render_to_console or
+// engine_render_to_image_file. Cost is one seek per tile, independent of length.
+// The tiles are seeked and decoded by up to num_threads workers, each with its
+// own demuxer and decoder; an input that cannot be opened twice (a pipe) is
+// sampled on the calling thread alone.
+ENGINE_API int engine_render_contact_sheet(ProcessingContext* ctx, const EngineConfig* config, int cols, int rows);
 
-int is_animated_file(const char* filename);
+ENGINE_API int is_animated_file(const char* filename);
+// The ENGINE_VERSION of the library actually loaded, which may be newer than
+// the header the caller was compiled against.
+ENGINE_API int engine_version(void);
 
 #endif // ASCII_ENGINE_H
 
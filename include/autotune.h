@@ -0,0 +1,37 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  autotune.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "ascii_engine.h"
+
+// Why measure rather than use every core? The best thread count, band height
+// and kernel differ between a laptop, a kiosk and a 64-core server, and more
+// workers than rows of detail only adds thread start-up to every frame. The
+// calibration converts a synthetic frame at the grid size of the run, times
+// each candidate, and keeps the fastest. The winner is cached per CPU model,
+// core count and grid size, so later runs start at no cost.
+
+typedef struct {
+    int threads;      // EngineConfig.num_threads
+    int band_rows;    // EngineConfig.band_rows
+    int use_simd;     // EngineConfig.use_simd
+    double frame_ms;  // Median time per frame of the winner, as measured.
+    int cached;       // 1 if read from the cache rather than measured now.
+} AutotuneResult;
+
+// config supplies the edge and colour settings. A num_threads > 0 or a
+// use_simd of 0 is a choice the user made, and is kept rather than tuned.
+// cols x rows is the grid to tune for and aspect the source's width/height.
+// cache_dir may be NULL for the default cache directory. Returns 0 on success,
+// or -1 with *error set to a static string.
+int autotune_resolve(const EngineConfig* config, int cols, int rows, float aspect, const char* cache_dir,
+                     AutotuneResult* result, char** error);
+
+#endif // AUTOTUNE_H
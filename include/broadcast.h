@@ -0,0 +1,47 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  broadcast.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stddef.h>
+
+#include "ascii_engine.h"
+
+// Why broadcast? Showing one playback on many terminals used to mean one full
+// decode-and-convert pipeline per viewer. A broadcaster converts each frame
+// once and encodes it once as a delta against the previous frame. The same
+// bytes then go to every connected viewer, so the per-viewer cost is a send().
+//
+// A viewer that cannot keep up is never waited for. While it still has bytes
+// of an earlier frame queued, new frames skip it. Once it has drained, it is
+// resynchronised with a keyframe, built at most once per frame however many
+// viewers need it.
+
+typedef struct Broadcaster Broadcaster;
+
+typedef struct {
+    int viewers;
+    long frames;
+    long keyframes_sent;  // Per viewer, including joins.
+    long frames_skipped;  // Per viewer, while it was still draining.
+    size_t last_delta_bytes;
+    size_t last_keyframe_bytes;
+} BroadcastStats;
+
+// address is a Unix socket path, or "tcp:<port>" to listen on 127.0.0.1.
+Broadcaster* broadcast_open(const char* address, char** error);
+// Encodes the grid once and hands it to every viewer without blocking.
+void broadcast_frame(Broadcaster* b, const EngineCellGrid* grid, int use_color);
+// Accepts viewers and flushes their queues for up to timeout_ms; the caller's
+// frame pacing sleep happens here.
+void broadcast_pump(Broadcaster* b, int timeout_ms);
+void broadcast_get_stats(const Broadcaster* b, BroadcastStats* stats);
+void broadcast_close(Broadcaster** b);
+
+#endif // BROADCAST_H
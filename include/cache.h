@@ -0,0 +1,69 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  cache.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "ascii_engine.h"
+
+// Why content addressing? The same assets are rendered with the same
+// settings again and again across deploys. Keys are SHA-256 digests of the
+// input's bytes plus every config field that can change the result, so a key
+// never goes stale. Renaming or touching a file does not cause a miss either.
+//
+// There are two levels. A finished output file is keyed on everything,
+// including the formatting (brightness, saturation, colour, CRF and the output
+// format); a hit is a file copy, with no decoding at all. A cell grid is keyed
+// only on what the analysis sees (width, aspect, edge threshold, dither, crop,
+// lowres). A run that changes nothing but the formatting starts from the
+// cached grid and only renders.
+//
+// Entries are stored under <dir>/<2 hex>/<digest>.<kind>. They are written to
+// a temporary name and renamed into place, so concurrent farm workers can
+// share one cache directory. A hit refreshes the entry's mtime. Once the
+// directory grows past its size limit, the least recently used entries are
+// deleted.
+
+typedef struct RenderCache RenderCache;
+
+typedef struct {
+    char hex[65];
+} CacheKey;
+
+typedef struct {
+    long hits;
+    long misses;
+    long stores;
+    long evictions;
+} CacheStats;
+
+// dir may be NULL for $XDG_CACHE_HOME/pixel-ripper (or ~/.cache/pixel-ripper).
+// max_bytes of 0 means 1 GiB.
+RenderCache* cache_open(const char* dir, long long max_bytes, char** error);
+// Resolves dir the same way and creates it. Other per-user state (the
+// --autotune results) lives beside the entries, outside the evicted subdirs.
+int cache_resolve_dir(const char* dir, char* out, size_t size, char** error);
+void cache_close(RenderCache** cache);
+void cache_get_stats(const RenderCache* cache, CacheStats* stats);
+
+// Digests a file's bytes. Fails for directories and sequence patterns.
+int cache_hash_input(const char* path, uint8_t digest[32]);
+void cache_grid_key(const uint8_t input_digest[32], const EngineConfig* config, CacheKey* key);
+// The output's extension is part of the key, because it picks the encoder.
+void cache_output_key(const uint8_t input_digest[32], const EngineConfig* config, const char* output_path, CacheKey* key);
+
+// Each fetch returns 0 on a hit and -1 on a miss.
+int cache_fetch_file(RenderCache* cache, const CacheKey* key, const char* dest_path);
+int cache_store_file(RenderCache* cache, const CacheKey* key, const char* src_path);
+// On a hit the grid is loaded into ctx with engine_load_cell_grid.
+int cache_fetch_grid(RenderCache* cache, const CacheKey* key, ProcessingContext* ctx);
+int cache_store_grid(RenderCache* cache, const CacheKey* key, const EngineCellGrid* grid);
+
+#endif // CACHE_H
@@ -0,0 +1,56 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  checkpoint.h
+ *
+ * Description:  Progress journal for checkpointed transcodes. The output is
+ * written as a series of closed, playable segments that start on source
+ * keyframes. Each finished segment is appended to a journal and fsync'd, so a
+ * crashed or preempted run can pick up from the last committed segment.
+ *
+ * =====================================================================================
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "shard.h"
+
+typedef struct {
+    char dir[SHARD_PATH_MAX];        // <output>.parts
+    char journal_path[SHARD_PATH_MAX + 16];
+    char input[SHARD_PATH_MAX];
+    char extension[16];              // Segments reuse the output's container.
+    FILE* journal;
+    ShardManifest* segments;         // Committed segments, in order.
+    int num_segments;
+    int capacity;
+    int complete;                    // The journal records a finished run.
+    char error_text[128];            // Backs *error when a journal line is rejected.
+} Checkpoint;
+
+// Opens (or, with resume, reloads) the journal that belongs to output_filename.
+// A damaged journal is refused with an error naming the line; only an
+// unfinished last line, cut short by a crash, is dropped with a warning.
+int checkpoint_open(Checkpoint* cp, const char* input, const char* output_filename, int resume, char** error);
+
+// PTS at which the next segment starts, or INT64_MIN when nothing is committed.
+int64_t checkpoint_resume_pts(const Checkpoint* cp);
+
+void checkpoint_segment_path(const Checkpoint* cp, int index, char* buf, size_t size);
+
+// Appends a closed segment to the journal and forces it to disk.
+int checkpoint_commit(Checkpoint* cp, const char* segment, int64_t start_pts, int64_t end_pts,
+                      long frames, int tb_num, int tb_den);
+
+// Stitches every committed segment plus the source audio into output_filename.
+int checkpoint_stitch(Checkpoint* cp, const char* output_filename, char** error);
+
+// Deletes the segments and the journal after a finished run.
+void checkpoint_remove(Checkpoint* cp);
+void checkpoint_close(Checkpoint* cp);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,40 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  engine_bench.h
+ *
+ * Description:  Entry points into the engine's hot paths for
+ * bench/kernel_bench.c. They are not ENGINE_API, so the shared library does
+ * not export them; the benchmark links ascii_engine.o directly.
+ *
+ * =====================================================================================
+ */
+
+#ifndef ENGINE_BENCH_H
+#define ENGINE_BENCH_H
+
+#include <stdint.h>
+
+#include "ascii_engine.h"
+
+// The RGB24 frame the cell kernel reads, with its row stride in *stride.
+uint8_t* engine_bench_rgb(ProcessingContext* ctx, int* stride);
+
+// Claims a fresh cell grid, as every frame does before the kernel runs.
+// Returns 0, or -1 if the frame arena is too small.
+int engine_bench_begin_frame(ProcessingContext* ctx);
+
+// Runs the cell kernel over every row on the calling thread.
+void engine_bench_cell_kernel(ProcessingContext* ctx, const EngineConfig* config);
+
+// Converts a frame in the context's source format into its RGB frame.
+void engine_bench_convert(ProcessingContext* ctx, const uint8_t* const planes[4], const int strides[4]);
+
+// Rasterises the cell grid into buffer: 8x8 pixels per cell, RGB24.
+void engine_bench_raster(ProcessingContext* ctx, unsigned char* buffer, const EngineConfig* config);
+
+// Encodes an RGB24 image as PNG in memory, as --format png does. Returns a
+// buffer to free(), or NULL.
+unsigned char* engine_bench_png(const unsigned char* rgb, int width, int height, int* size);
+
+#endif // ENGINE_BENCH_H
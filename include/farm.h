@@ -0,0 +1,50 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  farm.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef FARM_H
+#define FARM_H
+
+#include <signal.h>
+
+// Why processes? In a batch of thousands of files, one corrupt input that
+// crashes the decoder must not take the rest of the run with it. The farm
+// forks worker processes and hands them one job at a time. A worker that dies
+// or hangs is reaped and replaced, and its job is retried on the fresh process
+// up to a limit. Every other job carries on.
+//
+// Each worker starts with its own deque of jobs, largest inputs first. When
+// its deque runs dry it steals half of the fullest remaining one, so no core
+// idles while another still has a backlog.
+//
+// The coordinator talks to workers only through a stream socket, using the
+// same "key=value" block framing as the render daemon:
+//   coordinator -> worker: id, attempt, input, output, empty line
+//   worker -> coordinator: id, status=ok|error, ms, error, empty line
+// Closing the socket tells the worker to exit. farm_worker_serve runs that
+// loop on any connected socket, so a remote worker needs no other code.
+
+typedef struct {
+    const char* manifest_path; // One job per line: "<input><TAB><output>"; '#' starts a comment.
+    int workers;               // Worker processes (0 = one per core).
+    int max_attempts;          // Tries per job before it is recorded as failed (0 = 2).
+    double job_timeout_secs;   // A job running longer is killed and counts as a crash (0 = none).
+    const char* report_path;   // Optional tab-separated per-job report.
+} FarmOptions;
+
+// Converts one file. attempt is 1 on the first try. Returns 0 on success;
+// otherwise sets *error to a static string.
+typedef int (*FarmJobFn)(const char* input, const char* output, int attempt, void* user, char** error);
+
+// Runs the whole manifest and prints a summary. Returns 0 if every job
+// succeeded, 1 if some failed and -1 (with *error set) if the farm could not run.
+int farm_run(const FarmOptions* options, FarmJobFn run_job, void* user, volatile sig_atomic_t* stop, char** error);
+
+// The worker side: serves jobs arriving on fd until the coordinator closes it.
+int farm_worker_serve(int fd, FarmJobFn run_job, void* user);
+
+#endif // FARM_H
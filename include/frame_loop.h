@@ -0,0 +1,45 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  frame_loop.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef FRAME_LOOP_H
+#define FRAME_LOOP_H
+
+#include <signal.h>
+#include <stddef.h>
+
+// Why record the console output? A looped animation shows the same frames
+// forever. Re-demuxing, re-decoding and re-running the cell kernel on every
+// pass burns a core to redraw what was already drawn. During the first pass
+// each finished frame, escape codes and all, is kept with its delay. Later
+// passes write those bytes straight back to the terminal and sleep, at close
+// to zero CPU.
+//
+// The recording is bounded. If a pass would exceed the cap, the recording is
+// dropped for good, and the caller keeps decoding each pass instead. A resize
+// during a pass also drops that pass, because its frames no longer fit the
+// terminal; the next pass records again at the new size.
+
+typedef struct FrameLoop FrameLoop;
+
+FrameLoop* frame_loop_create(size_t max_bytes);
+// Starts recording a new pass, discarding any previous one.
+void frame_loop_begin_pass(FrameLoop* loop);
+// Returns room for the next frame, or NULL when this pass is not recorded
+// (capped or discarded). Follow with frame_loop_commit.
+char* frame_loop_reserve(FrameLoop* loop, size_t size);
+void frame_loop_commit(FrameLoop* loop, size_t used, long delay_us);
+void frame_loop_discard(FrameLoop* loop);
+// 1 when a whole pass was recorded and can be replayed.
+int frame_loop_complete(const FrameLoop* loop);
+int frame_loop_capped(const FrameLoop* loop);
+// Writes the recorded pass to stdout on its original timing, over and over,
+// until *stop or *resized is set.
+void frame_loop_replay(FrameLoop* loop, volatile sig_atomic_t* stop, volatile sig_atomic_t* resized);
+void frame_loop_free(FrameLoop** loop);
+
+#endif // FRAME_LOOP_H
@@ -0,0 +1,18 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  json_writer.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdio.h>
+
+// Writes s as a quoted JSON string, or null when s is NULL. Control
+// characters are left out rather than escaped.
+void json_write_string(FILE* f, const char* s);
+
+#endif // JSON_WRITER_H
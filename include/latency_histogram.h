@@ -0,0 +1,37 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  latency_histogram.h
+ *
+ * Description:  The log-linear latency histogram behind stage_stats, for
+ * other timing code in the tree. Implemented in stage_stats.c.
+ *
+ * =====================================================================================
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Sixteen sub-buckets per power of two of nanoseconds: 1 ns to over an hour
+// at a fixed 3% resolution.
+#define LATENCY_BUCKETS 640
+
+typedef struct {
+    int64_t count;
+    int64_t total_ns;
+    int64_t max_ns;
+    uint32_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+void latency_record(LatencyHistogram* h, int64_t ns);
+
+// Adds every sample of from into into.
+void latency_merge(LatencyHistogram* into, const LatencyHistogram* from);
+
+// The q-quantile (0..1) in nanoseconds: the midpoint of the bucket it falls
+// in, capped at the largest sample. 0 for an empty histogram.
+double latency_percentile_ns(const LatencyHistogram* h, double q);
+
+#endif // LATENCY_HISTOGRAM_H
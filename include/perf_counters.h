@@ -0,0 +1,47 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  perf_counters.h
+ *
+ * Description:  Hardware counter groups behind engine_enable_counters. Each
+ * stats slot owns one perf_event group (cycles, instructions, cache misses,
+ * branch misses) opened on the thread that records into it, and accumulates
+ * counter deltas per stage.
+ *
+ * =====================================================================================
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+#include "ascii_engine.h"
+
+enum {
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_CACHE_MISSES,
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+typedef struct PerfCounters PerfCounters;
+
+// Returns NULL when perf events are unavailable (no PMU, perf_event_paranoid,
+// a seccomp filter in a container). The probe runs on the calling thread.
+PerfCounters* perf_counters_create(int slots);
+void perf_counters_free(PerfCounters** counters);
+
+// Reads the calling thread's running totals for slot, opening its group first
+// if this thread has none. Returns 0, or -1 if the group cannot be opened.
+int perf_counters_read(PerfCounters* counters, int slot, uint64_t values[PERF_COUNTER_COUNT]);
+// Closes slot's group. For threads that exit after recording.
+void perf_counters_release(PerfCounters* counters, int slot);
+void perf_counters_add(PerfCounters* counters, int slot, int stage,
+                       const uint64_t before[PERF_COUNTER_COUNT], const uint64_t after[PERF_COUNTER_COUNT]);
+
+// One slot, or every slot merged when slot is -1.
+void perf_counters_summarize(const PerfCounters* counters, int slot, int stage, EngineStageCounters* out);
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,55 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  playback_timing.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef PLAYBACK_TIMING_H
+#define PLAYBACK_TIMING_H
+
+#include <stdint.h>
+#include <signal.h>
+
+// Why deadlines rather than a sleep after each frame? Sleeping the frame's
+// duration after writing it adds the decode, conversion and write time to
+// every frame, so playback drifts behind the source and never catches up.
+// Each frame is instead due at its PTS, measured from the first frame after a
+// (re)start, and a late frame is written at once without sleeping. A frame
+// already a whole duration past its deadline is skipped, as long as something
+// reached the screen within the last 250 ms.
+//
+// The same schedule measures the playback: how late each frame reached the
+// terminal (the write returned) against its deadline, how many frames were
+// skipped, and the longest gap between two frames on screen.
+
+typedef struct PlaybackTiming PlaybackTiming;
+
+PlaybackTiming* playback_timing_create(void);
+void playback_timing_free(PlaybackTiming** timing);
+
+// The next frame starts a new schedule and is due as soon as it is ready.
+// Call after a seek or anything else that breaks the run of timestamps.
+void playback_timing_restart(PlaybackTiming* timing);
+
+// Sleeps until the frame is due. pts is in tb_num/tb_den units; without one
+// (AV_NOPTS_VALUE) the frame is due one duration after the previous frame.
+// Returns early only when *stop is set. Returns 1 without sleeping when the
+// frame should be skipped, 0 otherwise (always 0 for a NULL timing).
+int playback_timing_wait(PlaybackTiming* timing, int64_t pts, int tb_num, int tb_den, double duration_secs,
+                         volatile sig_atomic_t* stop);
+
+// Records the frame passed to the last wait as on screen now.
+void playback_timing_presented(PlaybackTiming* timing);
+
+// Records the frame passed to the last wait as skipped.
+void playback_timing_skipped(PlaybackTiming* timing);
+
+// Writes the report as JSON to path ("-" for stderr). A file is replaced
+// atomically, so it can be read while playback keeps updating it. cols x rows
+// is the grid, recorded to tell runs apart. Returns 0, or -1 with *error set
+// to a static string.
+int playback_timing_write_json(const PlaybackTiming* timing, const char* path, int cols, int rows, char** error);
+
+#endif // PLAYBACK_TIMING_H
@@ -0,0 +1,37 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  sequence.h
+ *
+ * Description:  Image-sequence input. A numbered pattern (shot_%05d.png), a
+ * directory or a glob is expanded into an ordered list of stills. A small pool
+ * of threads decodes a few images ahead, so the main pipeline never waits for
+ * a single-threaded image decoder.
+ *
+ * =====================================================================================
+ */
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#define SEQUENCE_EOF (-1)
+#define SEQUENCE_DECODE_ERROR (-2)
+
+typedef struct SequenceReader SequenceReader;
+
+// Why a heuristic instead of a flag? Single stills, containers and sequences
+// are all told apart from the input string alone, just like is_animated_file.
+int is_sequence_input(const char* input);
+
+SequenceReader* sequence_open(const char* input, int prefetch_threads, int prefetch_depth, char** error);
+void sequence_close(SequenceReader** reader);
+
+int sequence_frame_count(const SequenceReader* reader);
+int sequence_has_more(const SequenceReader* reader);
+
+// Blocks until the next image in order is decoded. On success the RGB24 pixels
+// belong to the caller and must be released with sequence_free_pixels.
+int sequence_next(SequenceReader* reader, unsigned char** rgb, int* width, int* height);
+void sequence_free_pixels(unsigned char* rgb);
+
+#endif // SEQUENCE_H
@@ -0,0 +1,53 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  server.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <signal.h>
+#include <stddef.h>
+
+#include "ascii_engine.h"
+
+// Why a daemon? For a stream of small jobs, process start, FFmpeg init, LUT
+// construction and arena allocation cost more than the conversion itself. The
+// server pays them once and keeps converted-to contexts warm between jobs.
+//
+// Wire protocol, one job per connection. The client sends "key=value" lines
+// ending in an empty line, followed by `bytes` of inline image data if given:
+//   input=<path> | bytes=<n>   format=ansi|text|png   width=<n>   edge=<f>
+//   brightness=<f>   saturate=<f>   aspect=<f>   max_frames=<n>
+// The server answers with one block per frame ("status=frame", index, width,
+// height, convert_ms, bytes=<n>, empty line, payload) and a closing block with
+// "status=done" (or "status=error" / "status=busy" and a message) carrying the
+// job's timings.
+typedef struct {
+    const char* socket_path;
+    int max_jobs;            // Jobs converted concurrently (0 = 2).
+    int queue_depth;         // Accepted jobs waiting for a worker before new ones are refused (0 = 16).
+    int threads_per_job;     // Engine threads per job (0 = cores / max_jobs).
+    size_t max_inline_bytes; // Largest inline image accepted (0 = 64 MiB).
+} ServerOptions;
+
+int server_run(const ServerOptions* options, volatile sig_atomic_t* stop, char** error);
+
+// Makes path free for bind(). A socket left behind by a process that died is
+// removed. Anything else (a regular file, a directory, a socket someone is
+// still listening on) is left alone and -1 is returned with *error set.
+// Shared by the daemon and the broadcaster.
+int unix_socket_reclaim(const char* path, char** error);
+
+// Sends one job and streams the results: text frames go to stdout, a PNG to
+// output_path. Timings are reported on stderr. Returns 0 on success. When the
+// server rejects the job, its message is copied into message and *error
+// points there, so the caller owns the storage.
+int client_run(const char* socket_path, const char* input, const EngineConfig* config,
+               const char* format, int send_inline, long max_frames, const char* output_path,
+               char* message, size_t message_size, char** error);
+
+#endif // SERVER_H
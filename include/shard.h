@@ -0,0 +1,48 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  shard.h
+ *
+ * Description:  Shard manifests and the segment concat step. A shard run
+ * transcodes one GOP-aligned slice of the input into a video-only segment and
+ * records where that slice sits on the source timeline. The concat step reads
+ * the manifests back, stitches the segments in order and copies the original
+ * audio across, all without re-encoding.
+ *
+ * =====================================================================================
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include <limits.h>
+
+#define SHARD_PATH_MAX 4096
+
+typedef struct {
+    char input[SHARD_PATH_MAX];   // Source file the shard was cut from.
+    char segment[SHARD_PATH_MAX]; // Encoded video-only segment.
+    int index;
+    int count;
+    int tb_num;                   // Time base of start_pts/end_pts (the source video stream's).
+    int tb_den;
+    int64_t start_pts;            // INT64_MIN for the first shard.
+    int64_t end_pts;              // INT64_MAX for the last shard.
+    long frames;
+} ShardManifest;
+
+// Parses "i/N" into a 0-based index and a count. Returns 0 on success.
+int shard_parse_spec(const char* spec, int* index, int* count);
+
+int shard_write_manifest(const char* path, const ShardManifest* manifest);
+int shard_read_manifest(const char* path, ShardManifest* manifest);
+
+// Stitches the segments named by the manifests into output_filename, with the
+// source's audio remuxed alongside. The manifests may be given in any order.
+int shard_concat(const char* const* manifest_paths, int num_manifests, const char* output_filename, char** error);
+
+// Same as shard_concat, for manifests already in memory. Sorts them in place.
+int shard_concat_manifests(ShardManifest* manifests, int num_manifests, const char* output_filename, char** error);
+
+#endif // SHARD_H
@@ -0,0 +1,71 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  shm_ring.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ascii_engine.h"
+
+// Why shared memory? A consumer in another process (a compositor, a recorder)
+// otherwise has to parse a text stream that was formatted only to be parsed
+// again. Frames land in a POSIX shared-memory ring instead. Any number of
+// local readers map it and read the cells in place.
+//
+// The ring has one writer and many readers, and readers never block the writer.
+// Each slot carries a sequence number that is odd while the slot is being
+// overwritten, so a reader that falls a full lap behind detects it and skips
+// ahead instead of reading a torn frame. New frames are announced through a
+// futex word in the shared header.
+
+#define SHM_RING_VERSION 2
+
+typedef enum {
+    SHM_FRAME_CELLS = 1, // width*height glyphs followed by width*height RGB triplets.
+    SHM_FRAME_RGB24 = 2  // The rasterised frame: width x height pixels, 3 bytes each.
+} ShmFrameFormat;
+
+typedef struct ShmRingWriter ShmRingWriter;
+typedef struct ShmRingReader ShmRingReader;
+
+typedef struct {
+    uint64_t seq;             // 1 for the first frame published, then consecutive.
+    int64_t pts;
+    ShmFrameFormat format;
+    int width;                // Cells or pixels, depending on format.
+    int height;
+    size_t size;              // Payload bytes.
+    int64_t published_ns;     // CLOCK_MONOTONIC time of the commit, for latency measurements.
+    const unsigned char* data; // Points into the shared mapping; see shm_ring_reader_check.
+} ShmFrame;
+
+// Creates (or replaces) the segment /name sized for slot_count frames of at
+// most slot_bytes each. The calling process is recorded as the writer, and
+// readers treat its exit as the end of the stream.
+ENGINE_API ShmRingWriter* shm_ring_create(const char* name, int slot_count, size_t slot_bytes, char** error);
+// Reserves the next slot and returns where its payload goes, so the renderer
+// can write the frame in place. Publish with shm_ring_commit.
+ENGINE_API unsigned char* shm_ring_begin(ShmRingWriter* w, size_t size);
+ENGINE_API void shm_ring_commit(ShmRingWriter* w, ShmFrameFormat format, int width, int height, size_t size, int64_t pts);
+// Marks the stream finished, wakes every reader and unlinks the segment.
+ENGINE_API void shm_ring_close(ShmRingWriter** w);
+
+ENGINE_API ShmRingReader* shm_ring_open(const char* name, char** error);
+// Waits up to timeout_ms (-1 = forever) for the next frame. Returns 1 with
+// *frame filled, 0 on timeout and -1 once the writer has closed the ring or
+// exited without closing it.
+// *dropped counts frames overwritten before this reader got to them.
+ENGINE_API int shm_ring_next(ShmRingReader* r, ShmFrame* frame, int timeout_ms, uint64_t* dropped);
+// Returns 1 if the frame's slot still holds it. Call after consuming data in
+// place; 0 means the writer lapped the reader and the copy may be torn.
+ENGINE_API int shm_ring_reader_check(const ShmRingReader* r, const ShmFrame* frame);
+ENGINE_API void shm_ring_reader_close(ShmRingReader** r);
+
+#endif // SHM_RING_H
@@ -54,5 +54,15 @@ static inline void convert_uint8_to_float(__m128i in, __m128* out_lo, __m128* ou
     *out_hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
 }
 
+// Luma of four scattered RGB pixels, one per lane, with the same weights and
+// order of operations as the scalar kernel.
+static inline __m128 luma_of_4_pixels(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d) {
+    __m128 r = _mm_cvtepi32_ps(_mm_setr_epi32(a[0], b[0], c[0], d[0]));
+    __m128 g = _mm_cvtepi32_ps(_mm_setr_epi32(a[1], b[1], c[1], d[1]));
+    __m128 bl = _mm_cvtepi32_ps(_mm_setr_epi32(a[2], b[2], c[2], d[2]));
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.299f), r), _mm_mul_ps(_mm_set1_ps(0.587f), g)),
+                      _mm_mul_ps(_mm_set1_ps(0.114f), bl));
+}
+
 #endif // SIMD_OPS_H
 
@@ -0,0 +1,34 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  stage_stats.h
+ *
+ * Description:  Per-thread, per-stage timing accumulators behind engine_enable_stats.
+ * Each recording thread owns one slot, so recording takes no lock and shares
+ * no cache line with another thread. Slots are merged only when read.
+ *
+ * =====================================================================================
+ */
+
+#ifndef STAGE_STATS_H
+#define STAGE_STATS_H
+
+#include <stdint.h>
+
+#include "ascii_engine.h"
+
+typedef struct StageStats StageStats;
+
+StageStats* stage_stats_create(int slots);
+void stage_stats_free(StageStats** stats);
+int stage_stats_slots(const StageStats* stats);
+
+// Only the thread that owns slot may record into it.
+void stage_stats_record(StageStats* stats, int slot, int stage, int64_t elapsed_ns, int64_t bytes);
+
+// Summarises one slot, or every slot merged when slot is -1. Percentiles come
+// from log-linear histograms with 16 sub-buckets per power of two, so they are
+// exact to within about 3%.
+void stage_stats_summarize(const StageStats* stats, int slot, int stage, EngineStageStats* out);
+
+#endif // STAGE_STATS_H
@@ -0,0 +1,31 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  stats_report.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef STATS_REPORT_H
+#define STATS_REPORT_H
+
+#include <stdio.h>
+
+#include "ascii_engine.h"
+
+// Why a per-stage table rather than one fps figure? "Slow" says nothing about
+// where to look. For each stage the report gives the call count, the
+// latencies, the share of wall time, and "fps alone": the frame rate the run
+// would reach if that stage were the only work. The stage with the lowest
+// fps alone is the bottleneck. Kernel time is also listed per worker, since
+// a frame waits for its slowest slice. When hardware counters were enabled,
+// a second table gives IPC and cache and branch misses for the counted stages.
+
+// Prints the table for a context that had engine_enable_stats turned on.
+void stats_report_print(const ProcessingContext* ctx, FILE* out);
+
+// Writes the same figures, per thread as well as merged. Returns 0 on success,
+// or -1 with *error set to a static string.
+int stats_report_write_json(const ProcessingContext* ctx, const char* path, char** error);
+
+#endif // STATS_REPORT_H
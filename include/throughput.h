@@ -0,0 +1,54 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  throughput.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef THROUGHPUT_H
+#define THROUGHPUT_H
+
+#include <signal.h>
+
+#include "ascii_engine.h"
+
+// Why generate the media? The JPEGs in samples/ say nothing about video
+// throughput, and a benchmark fed whatever clip is lying around is not
+// comparable between machines. The clip is written by the engine's own H.264
+// encoder from a seeded moving pattern, so every machine decodes equivalent
+// content: the same frames at the same size, rate and encoder settings. The
+// bytes themselves depend on the local encoder build. The clip is kept in the
+// media directory and reused, so two builds on one machine are timed on
+// identical input.
+//
+// Two pipelines are timed end to end, from the first packet to the last byte
+// out: a transcode to MP4, and console playback with the frames written to
+// /dev/null instead of a terminal, with no frame pacing. Both run at each
+// thread count from 1 to N:
+//   strong scaling - the same width at every thread count; ideal is N x fps.
+//   weak scaling   - the cell count grows with the threads; ideal is flat fps.
+
+enum {
+    THROUGHPUT_TRANSCODE = 1,
+    THROUGHPUT_PLAYBACK = 2
+};
+
+typedef struct {
+    int max_threads;        // Highest thread count (0 = online cores).
+    int source_width;       // Generated clip size (0 = 1920x1080).
+    int source_height;
+    int frames;             // Frames in the clip (0 = 120).
+    int runs;               // Timed repetitions per point; the median is reported (0 = 3).
+    int base_width;         // Cells per row at one thread (0 = 120).
+    int pipelines;          // THROUGHPUT_* bits (0 = both).
+    const char* media_dir;  // Where clips are generated and reused (NULL = ./bench-media).
+    const char* json_path;  // Optional machine-readable results.
+} ThroughputOptions;
+
+// config supplies everything else (edge, colour, CRF, SIMD). Returns 0 on
+// success, or -1 with *error set to a static string.
+int throughput_run(const ThroughputOptions* options, const EngineConfig* config,
+                   volatile sig_atomic_t* stop, char** error);
+
+#endif // THROUGHPUT_H
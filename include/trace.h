@@ -0,0 +1,34 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  trace.h
+ *
+ * Description:  Per-thread span rings behind engine_enable_trace, written out
+ * as Chrome trace-event JSON. Each recording thread owns one slot; a slot is a
+ * fixed ring, so a long run keeps its most recent spans in bounded memory.
+ *
+ * =====================================================================================
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct TraceBuffer TraceBuffer;
+
+TraceBuffer* trace_create(int slots, size_t spans_per_slot);
+void trace_free(TraceBuffer** trace);
+
+// Only the thread that owns slot may record into it.
+void trace_record(TraceBuffer* trace, int slot, int stage, int64_t frame, int64_t start_ns, int64_t end_ns);
+
+// Writes every retained span, oldest first per thread. Must not race with
+// trace_record. stage_names has one entry per stage; slot_name labels the
+// thread tracks. origin_ns becomes timestamp zero. Returns 0 on success, or -1
+// with *error set to a static string.
+int trace_write_json(const TraceBuffer* trace, const char* path, const char* const* stage_names,
+                     void (*slot_name)(int slot, char* name, size_t size), int64_t origin_ns, char** error);
+
+#endif // TRACE_H
@@ -0,0 +1,31 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  tune.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <signal.h>
+
+#include "ascii_engine.h"
+
+// Why a tuning mode? Finding the right --edge, --brightness and --saturate for
+// a still means running the whole pipeline again for every guess, decode
+// included. Here the still is decoded once, and each keypress redoes only the
+// work that setting affects:
+//   e / E   edge threshold down / up  -> reclassify cells from retained planes
+//   b / B   brightness down / up      -> render only
+//   s / S   saturation down / up      -> render only
+//   w / W   width down / up           -> rerun the cell kernel on the kept picture
+//   r       reset to the starting values
+//   q       quit and print the matching command-line flags
+//
+// ctx must have had engine_retain_planes enabled before the still was
+// processed. config is updated in place with the final values.
+int tune_run(ProcessingContext* ctx, EngineConfig* config, volatile sig_atomic_t* stop, char** error);
+
+#endif // TUNE_H
@@ -0,0 +1,44 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  verify.h
+ *
+ * =====================================================================================
+ */
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <signal.h>
+
+#include "ascii_engine.h"
+
+// Why a self-check mode? The cell kernel and the rasteriser are where the
+// speed work happens, and a wrong glyph does not crash anything. Every input
+// is converted with the scalar kernel on one thread as the reference, then
+// with each kernel (scalar, SSE) at every thread count from 1 to N, and the
+// cell grid, colours, planes and raster of each result must match the
+// reference byte for byte. SSE gets no float tolerance: it adds the same
+// terms in the same order as the scalar loop, so any difference is a bug.
+// Inputs are the given images plus seeded synthetic patterns (ramps,
+// checkerboards, rings, noise, hairlines) at odd sizes, so the SIMD tails and
+// uneven row splits get exercised too. A golden file pins the patterns'
+// reference renders themselves, so a change to the scalar kernel is caught too.
+
+typedef struct {
+    const char* const* inputs;  // Image files to check as well.
+    int input_count;
+    int max_threads;            // Highest thread count (0 = online cores, at most 8).
+    int width;                  // Cells per row (0 = 61, 80 and 157).
+    int synthetic;              // Include the generated patterns.
+    const char* golden_path;    // Optional: reference hashes of the patterns to compare with.
+    int record_golden;          // Write golden_path from this run instead of comparing.
+} VerifyOptions;
+
+// config supplies the edge threshold and colour settings. Returns 0 when every
+// comparison passed, 1 when any failed, or -1 with *error set to a static
+// string.
+int verify_run(const VerifyOptions* options, const EngineConfig* config,
+               volatile sig_atomic_t* stop, char** error);
+
+#endif // VERIFY_H
@@ -0,0 +1,58 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  wire.h
+ *
+ * Description:  The "key=value" block framing shared by the render daemon and
+ * the worker farm. A block is newline-terminated key=value lines ended by an
+ * empty line; a daemon block may be followed by a raw payload whose length
+ * the block announces.
+ *
+ * =====================================================================================
+ */
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define WIRE_BUFFER_SIZE 16384
+
+// Bytes received but not yet consumed. Bytes past the end of a block stay
+// here for the next block or for the payload that follows it.
+typedef struct {
+    char buf[WIRE_BUFFER_SIZE];
+    size_t len;
+    size_t pos;
+} WireBuffer;
+
+double wire_now_ms(void);
+
+// Returns 0 once every byte is sent, -1 on error.
+int wire_send_all(int fd, const void* data, size_t size);
+
+// Moves the first complete block already in the buffer into block, without
+// its empty line. Returns 1 for a block, 0 if none is complete yet and -1 if
+// it does not fit in size.
+int wire_take_block(WireBuffer* in, char* block, size_t size);
+
+// One recv into the free end of the buffer. Returns what recv returned, or
+// -1 with errno EMSGSIZE when the buffer is full without a complete block.
+ssize_t wire_fill(int fd, WireBuffer* in);
+
+// Blocks until a whole block arrives. Returns 1 for a block, 0 once the peer
+// has closed and -1 on error.
+int wire_read_block(int fd, WireBuffer* in, char* block, size_t size);
+
+// Reads exactly size payload bytes, buffered ones first. Returns 0 or -1.
+int wire_read_payload(int fd, WireBuffer* in, unsigned char* out, size_t size);
+
+// The value of key in block, running to the end of its line, or NULL.
+const char* wire_block_value(const char* block, const char* key);
+
+// Copies a value returned by wire_block_value up to its newline, truncated
+// to fit in size.
+void wire_copy_value(char* out, size_t size, const char* value);
+
+#endif
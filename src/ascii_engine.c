@@ -15,6 +15,8 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/eventfd.h>
+#include <time.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
@@ -23,6 +25,8 @@
 #include <libavutil/opt.h>
 #include <libavutil/error.h>
 #include <libavutil/rational.h> // For av_q2d
+#include <libavutil/mathematics.h> // For av_rescale_q
+#include <libavutil/pixdesc.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -32,50 +36,14 @@
 #include "font8x8_basic.h"
 #include "ascii_engine.h"
 #include "simd_ops.h"
+#include "sequence.h"
+#include "stage_stats.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "arena.h"
+#include "engine_bench.h"
 
 
-// --- Memory Arena ---
-// Why an arena? Standard malloc/free incurs overhead and can fragment memory. For
-// per-frame processing, where we allocate and discard numerous buffers, an arena
-// is king. We allocate a large block once, then simply bump a pointer for each
-// allocation. A reset is a trivial pointer move. This is a data-oriented approach
-// that respects the cache and minimizes system call overhead.
-typedef struct {
-    void* start;
-    size_t size;
-    size_t used;
-} Arena;
-
-static int arena_init(Arena* a, size_t size) {
-    a->start = malloc(size);
-    if (!a->start) return 0;
-    a->size = size;
-    a->used = 0;
-    return 1;
-}
-
-static void* arena_alloc(Arena* a, size_t size) {
-    // Why align? SIMD operations and many other CPU-level instructions perform
-    // better on aligned data. Aligning to 16 bytes is a safe bet for SSE and
-    // general performance. The bitwise trick is faster than division/modulo.
-    size = (size + 15) & ~15;
-    if (a->used + size > a->size) return NULL;
-    void* p = (char*)a->start + a->used;
-    a->used += size;
-    return p;
-}
-
-static void arena_reset(Arena* a) {
-    a->used = 0;
-}
-
-static void arena_free(Arena* a) {
-    free(a->start);
-    a->start = NULL;
-    a->size = 0;
-    a->used = 0;
-}
-
 // --- Threading & Work ---
 typedef struct {
     ProcessingContext* ctx;
@@ -83,8 +51,45 @@ typedef struct {
     const AVFrame* frame;
     int start_row;
     int end_row;
+    int band_rows; // 0 = the single slice [start_row, end_row).
+    int band_step; // Rows from the start of one of this worker's bands to the next.
 } ThreadArgs;
 
+// --- Asynchronous Submission ---
+typedef enum {
+    SLOT_FREE,
+    SLOT_CLAIMED, // Being filled by a submit; back to free if that fails.
+    SLOT_QUEUED, // Submitted; waiting for or undergoing conversion.
+    SLOT_DONE    // Grid ready; owned by the caller until released.
+} AsyncSlotState;
+
+typedef struct {
+    AsyncSlotState state;
+    int64_t ticket;
+    AVFrame* frame;  // A reference to the submitted frame, or a copy of a raw buffer.
+    int is_buffer;
+    int status;
+    EngineConfig config;
+    char* chars;     // The grid, copied out of the arena once conversion ends.
+    unsigned char* colors;
+    size_t capacity; // Cells the buffers above can hold.
+    EngineCellGrid grid;
+    EngineFrameInfo info;
+} AsyncSlot;
+
+typedef struct {
+    AsyncSlot* slots;
+    int depth;
+    int64_t next_ticket; // Handed out by the next submit.
+    int64_t next_to_run; // Next ticket the pipeline thread converts.
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int stop;
+    int event_fd;
+    EngineConfig base_config; // Used when a submit passes no config.
+} AsyncPipeline;
 
 struct ProcessingContext {
     AVFormatContext* dec_fmt_ctx;
@@ -93,12 +98,29 @@ struct ProcessingContext {
     int video_stream_idx;
     int audio_stream_idx;
     AVRational time_base; // Why AVRational? Frame PTS are in terms of this time_base. Storing it is essential for correct timing calculations.
+    AVRational frame_rate;
+    AVRational sample_aspect_ratio;
+
+    // Image-sequence input. The prefetch pool hands us stbi buffers, which
+    // decoded_frame points at directly instead of copying them.
+    SequenceReader* sequence;
+    unsigned char* sequence_pixels;
+    int sequence_primed; // The first image was pulled early to size the pipeline.
+    int64_t sequence_frames;
 
     AVFormatContext* enc_fmt_ctx;
     AVStream* out_video_stream;
     AVStream* out_audio_stream;
     const AVCodec* enc_codec;
     AVCodecContext* enc_codec_ctx;
+    long frames_encoded;
+
+    // Why a PTS window? Shard mode processes only one GOP-aligned slice of the
+    // input. Both ends sit on keyframes of the source stream, so each shard can
+    // start decoding cleanly and the slices tile the timeline with no overlap.
+    int64_t range_start_pts;
+    int64_t range_end_pts;
+    int has_range;
 
     AVFrame *decoded_frame;
     AVFrame *rgb_frame;
@@ -107,6 +129,14 @@ struct ProcessingContext {
     struct SwsContext* sws_ctx_to_rgb;
     struct SwsContext* sws_ctx_to_yuv;
 
+    // Why a source region? With --crop or --autocrop only this rectangle of the
+    // decoded picture is converted to RGB and mapped onto the cell grid. Bars
+    // and uninteresting borders never cost a single sws_scale or Sobel cycle.
+    int src_x;
+    int src_y;
+    int src_width;
+    int src_height;
+
     char* char_buffer;
     unsigned char* color_buffer;
     int ascii_width;
@@ -134,12 +164,128 @@ struct ProcessingContext {
     // transforms an expensive floating-point power calculation into a single,
     // lightning-fast array lookup per pixel component.
     uint8_t gamma_lut[256];
+
+    int is_raw; // Created by engine_init_raw; frames arrive through engine_process_buffer.
+    int64_t current_pts;
+    int64_t frames_processed;
+    int64_t frame_start_ns;
+
+    EngineFrameCallback frame_callback;
+    void* frame_callback_data;
+
+    // The caller's config in this library's layout. config_size is how much of
+    // it the caller's header knew about; the rest stays zero.
+    EngineConfig config;
+    size_t config_size;
+
+    AsyncPipeline* async; // NULL until engine_async_start.
+
+    // Why keep per-cell planes? Interactive tuning changes the edge threshold
+    // far more often than the picture. The kernel's expensive part (sampling
+    // the 3x3 neighbourhood, luma, Sobel) does not depend on the threshold.
+    // With planes retained, the gradient magnitude, edge orientation and
+    // brightness level of every cell are kept, so a new threshold is a
+    // table lookup per cell. rgb_valid marks rgb_frame as holding the last
+    // converted picture, which a width change can resample without decoding.
+    int retain_planes;
+    float* plane_magnitude;
+    uint8_t* plane_orientation;
+    uint8_t* plane_level;
+    size_t plane_cells;
+    int rgb_valid;
+
+    StageStats* stats; // NULL unless engine_enable_stats turned timing on.
+    int64_t stats_start_ns;
+    int64_t stats_frames_base;
+    TraceBuffer* trace; // NULL unless engine_enable_trace turned spans on.
+    int64_t trace_start_ns;
+    PerfCounters* counters; // NULL unless engine_enable_counters succeeded.
 };
 
+static int64_t monotonic_ns(void);
+
+// Which stats slot the current thread records into: 0 for the caller, 1 for
+// the async pipeline thread. Kernel workers are told theirs explicitly.
+static __thread int stats_slot = 0;
+
+static inline int stage_timing(const ProcessingContext* ctx) {
+    return ctx->stats || ctx->trace;
+}
+
+static inline int64_t stage_begin(const ProcessingContext* ctx) {
+    return stage_timing(ctx) ? monotonic_ns() : 0;
+}
+
+// Stages up to the kernel work on the frame being converted; the later ones
+// on the frame just published.
+static inline int64_t stage_frame(const ProcessingContext* ctx, EngineStage stage) {
+    int64_t converted = __atomic_load_n(&ctx->frames_processed, __ATOMIC_ACQUIRE);
+    return stage <= ENGINE_STAGE_KERNEL ? converted : converted - 1;
+}
+
+// excluded_ns is time spent in a nested stage (the mux inside an encode). The
+// stats leave it out, so no time is counted twice; the trace keeps the outer
+// span whole, so it still encloses the nested one.
+static void record_span(ProcessingContext* ctx, EngineStage stage, int64_t start_ns, int64_t end_ns,
+                        int64_t excluded_ns, int64_t bytes) {
+    if (ctx->stats) stage_stats_record(ctx->stats, stats_slot, stage, end_ns - start_ns - excluded_ns, bytes);
+    if (ctx->trace) trace_record(ctx->trace, stats_slot, stage, stage_frame(ctx, stage), start_ns, end_ns);
+}
+
+static inline void stage_end(ProcessingContext* ctx, EngineStage stage, int64_t start_ns, int64_t bytes) {
+    if (stage_timing(ctx)) record_span(ctx, stage, start_ns, monotonic_ns(), 0, bytes);
+}
 
-static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* config);
+// A stage that is also hardware-counted. The counters are read outside the
+// clock reads, so the syscalls do not inflate the timing; with
+// exclude_kernel, the counters do not see them either.
+typedef struct {
+    int64_t start_ns;
+    int counting;
+    uint64_t counters[PERF_COUNTER_COUNT];
+} StageMark;
+
+static inline void mark_begin(ProcessingContext* ctx, StageMark* mark) {
+    mark->counting = ctx->counters && perf_counters_read(ctx->counters, stats_slot, mark->counters) == 0;
+    mark->start_ns = stage_begin(ctx);
+}
+
+static inline void mark_end(ProcessingContext* ctx, EngineStage stage, const StageMark* mark, int64_t bytes) {
+    stage_end(ctx, stage, mark->start_ns, bytes);
+    uint64_t after[PERF_COUNTER_COUNT];
+    if (mark->counting && perf_counters_read(ctx->counters, stats_slot, after) == 0) {
+        perf_counters_add(ctx->counters, stats_slot, stage, mark->counters, after);
+    }
+}
+
+
+static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* config, const char* filename);
+static void release_encoder(ProcessingContext* ctx);
 static void* process_slice_worker(void* arg);
 
+// powf(i / 255, 1 / 2.2) * 255, truncated. Why spelled out rather than
+// computed at start-up? powf is not correctly rounded in every libm, and one
+// entry off by one on another platform would change glyphs and colours, so
+// the same frame would no longer render the same everywhere.
+static const uint8_t kGammaCurve[256] = {
+      0,  20,  28,  33,  38,  42,  46,  49,  52,  55,  58,  61,  63,  65,  68,  70,
+     72,  74,  76,  78,  80,  81,  83,  85,  87,  88,  90,  91,  93,  94,  96,  97,
+     99, 100, 102, 103, 104, 106, 107, 108, 109, 111, 112, 113, 114, 115, 117, 118,
+    119, 120, 121, 122, 123, 124, 125, 126, 128, 129, 130, 131, 132, 133, 134, 135,
+    136, 136, 137, 138, 139, 140, 141, 142, 143, 144, 145, 146, 147, 147, 148, 149,
+    150, 151, 152, 153, 153, 154, 155, 156, 157, 158, 158, 159, 160, 161, 162, 162,
+    163, 164, 165, 165, 166, 167, 168, 168, 169, 170, 171, 171, 172, 173, 174, 174,
+    175, 176, 176, 177, 178, 178, 179, 180, 181, 181, 182, 183, 183, 184, 185, 185,
+    186, 187, 187, 188, 189, 189, 190, 190, 191, 192, 192, 193, 194, 194, 195, 196,
+    196, 197, 197, 198, 199, 199, 200, 200, 201, 202, 202, 203, 203, 204, 205, 205,
+    206, 206, 207, 208, 208, 209, 209, 210, 210, 211, 212, 212, 213, 213, 214, 214,
+    215, 216, 216, 217, 217, 218, 218, 219, 219, 220, 220, 221, 222, 222, 223, 223,
+    224, 224, 225, 225, 226, 226, 227, 227, 228, 228, 229, 229, 230, 230, 231, 231,
+    232, 232, 233, 233, 234, 234, 235, 235, 236, 236, 237, 237, 238, 238, 239, 239,
+    240, 240, 241, 241, 242, 242, 243, 243, 244, 244, 245, 245, 246, 246, 247, 247,
+    248, 248, 249, 249, 249, 250, 250, 251, 251, 252, 252, 253, 253, 254, 254, 255
+};
+
 static void init_luts(ProcessingContext* ctx) {
     // Why these ramps? The selection and order of characters are critical for perceived
     // brightness and texture. This ramp was carefully chosen to provide a smooth
@@ -162,9 +308,7 @@ static void init_luts(ProcessingContext* ctx) {
         ctx->char_lut_diag1[i] = diagonal1_ramp[(int)(br * (diagonal1_ramp_len - 1))];
         ctx->char_lut_diag2[i] = diagonal2_ramp[(int)(br * (diagonal2_ramp_len - 1))];
 
-        // Pre-calculating the gamma curve. This is a one-time cost at initialization
-        // that pays dividends on every single frame processed.
-        ctx->gamma_lut[i] = (uint8_t)(powf((float)i / 255.0f, 1.0f / 2.2f) * 255.0f);
+        ctx->gamma_lut[i] = kGammaCurve[i];
     }
 }
 
@@ -180,7 +324,276 @@ int is_animated_file(const char* filename) {
             strcmp(ext, ".gif") == 0);
 }
 
-ProcessingContext* engine_init(const char* input_source, const EngineConfig* config, char** error) {
+// Why read packets after the seek? av_seek_frame with AVSEEK_FLAG_BACKWARD lands
+// on the keyframe at or before the target, but it does not tell us its PTS. The
+// first video keyframe we read back is that exact boundary.
+static int64_t find_keyframe_pts_before(ProcessingContext* ctx, int64_t target_pts) {
+    if (av_seek_frame(ctx->dec_fmt_ctx, ctx->video_stream_idx, target_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+        return AV_NOPTS_VALUE;
+    }
+    AVPacket* pkt = av_packet_alloc();
+    if (!pkt) return AV_NOPTS_VALUE;
+    int64_t found = AV_NOPTS_VALUE;
+    while (av_read_frame(ctx->dec_fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index == ctx->video_stream_idx && (pkt->flags & AV_PKT_FLAG_KEY)) {
+            found = (pkt->pts != AV_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+            av_packet_unref(pkt);
+            break;
+        }
+        av_packet_unref(pkt);
+    }
+    av_packet_free(&pkt);
+    return found;
+}
+
+static const char* init_shard_range(ProcessingContext* ctx, const EngineConfig* config) {
+    if (config->shard_index < 0 || config->shard_index >= config->shard_count) {
+        return "Shard index out of range";
+    }
+    AVStream* stream = ctx->dec_fmt_ctx->streams[ctx->video_stream_idx];
+    int64_t start_time = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+    int64_t duration = stream->duration;
+    if (duration == AV_NOPTS_VALUE || duration <= 0) {
+        if (ctx->dec_fmt_ctx->duration == AV_NOPTS_VALUE || ctx->dec_fmt_ctx->duration <= 0) {
+            return "Cannot shard a stream of unknown duration";
+        }
+        duration = av_rescale_q(ctx->dec_fmt_ctx->duration, AV_TIME_BASE_Q, stream->time_base);
+    }
+
+    int i = config->shard_index;
+    int n = config->shard_count;
+    ctx->range_start_pts = INT64_MIN;
+    ctx->range_end_pts = INT64_MAX;
+    if (i + 1 < n) {
+        ctx->range_end_pts = find_keyframe_pts_before(ctx, start_time + duration * (i + 1) / n);
+        if (ctx->range_end_pts == AV_NOPTS_VALUE) return "Failed to locate shard end keyframe";
+    }
+    if (i > 0) {
+        ctx->range_start_pts = find_keyframe_pts_before(ctx, start_time + duration * i / n);
+        if (ctx->range_start_pts == AV_NOPTS_VALUE) return "Failed to locate shard start keyframe";
+    }
+
+    int64_t seek_target = (i > 0) ? ctx->range_start_pts : start_time;
+    if (av_seek_frame(ctx->dec_fmt_ctx, ctx->video_stream_idx, seek_target, AVSEEK_FLAG_BACKWARD) < 0) {
+        return "Failed to seek to shard start";
+    }
+    ctx->has_range = 1;
+    return NULL;
+}
+
+// --- Region of Interest ---
+// Why offset the plane pointers instead of copying? A crop is just a different
+// starting address per plane with the same stride. Handing sws_scale those
+// pointers converts only the region, with no extra pass over the frame.
+static void offset_planes(const uint8_t* const data[4], const int linesize[4], int format, int x, int y, const uint8_t* planes[4]) {
+    for (int p = 0; p < 4; p++) planes[p] = data[p];
+    if (x == 0 && y == 0) return;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((enum AVPixelFormat)format);
+    if (!desc) return;
+    int done[4] = {0};
+    for (int c = 0; c < desc->nb_components; c++) {
+        int plane = desc->comp[c].plane;
+        if (done[plane] || !planes[plane]) continue;
+        int chroma = (c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int px = chroma ? (x >> desc->log2_chroma_w) : x;
+        int py = chroma ? (y >> desc->log2_chroma_h) : y;
+        planes[plane] += (ptrdiff_t)py * linesize[plane] + (ptrdiff_t)px * desc->comp[c].step;
+        done[plane] = 1;
+    }
+}
+
+static void offset_frame_planes(const AVFrame* frame, int x, int y, const uint8_t* planes[4]) {
+    offset_planes((const uint8_t* const*)frame->data, frame->linesize, frame->format, x, y, planes);
+}
+
+#define AUTOCROP_FRAMES 8
+#define AUTOCROP_BLACK_LUMA 24.0f
+
+static void accumulate_luma_profile(const uint8_t* gray, int stride, int width, int height,
+                                    float* row_peak, float* col_peak, uint32_t* col_sum) {
+    memset(col_sum, 0, (size_t)width * sizeof(uint32_t));
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = gray + (size_t)y * stride;
+        uint32_t row_sum = 0;
+        for (int x = 0; x < width; x++) {
+            row_sum += row[x];
+            col_sum[x] += row[x];
+        }
+        float mean = (float)row_sum / width;
+        if (mean > row_peak[y]) row_peak[y] = mean;
+    }
+    for (int x = 0; x < width; x++) {
+        float mean = (float)col_sum[x] / height;
+        if (mean > col_peak[x]) col_peak[x] = mean;
+    }
+}
+
+// Why the per-line peak over several frames? A letterbox bar is dark in every
+// frame, while a dark scene is not dark everywhere for long. A row or column
+// only counts as bar if its mean luma stays below the threshold in all of the
+// sampled frames.
+static int detect_letterbox(ProcessingContext* ctx, int* out_x, int* out_y, int* out_w, int* out_h) {
+    int width = ctx->dec_codec_ctx->width;
+    int height = ctx->dec_codec_ctx->height;
+    float* row_peak = (float*)calloc(height, sizeof(float));
+    float* col_peak = (float*)calloc(width, sizeof(float));
+    uint32_t* col_sum = (uint32_t*)malloc((size_t)width * sizeof(uint32_t));
+    uint8_t* gray = (uint8_t*)malloc((size_t)width * height);
+    struct SwsContext* to_gray = sws_getContext(width, height, ctx->dec_codec_ctx->pix_fmt, width, height,
+                                                AV_PIX_FMT_GRAY8, SWS_POINT, NULL, NULL, NULL);
+    AVFrame* frame = ctx->dec_fmt_ctx ? av_frame_alloc() : NULL;
+    AVPacket* pkt = ctx->dec_fmt_ctx ? av_packet_alloc() : NULL;
+    int analyzed = 0;
+    int ret = -1;
+
+    if (!row_peak || !col_peak || !col_sum || !gray || !to_gray || (ctx->dec_fmt_ctx && (!frame || !pkt))) goto done;
+
+    uint8_t* gray_planes[4] = { gray, NULL, NULL, NULL };
+    int gray_stride[4] = { width, 0, 0, 0 };
+    if (!ctx->dec_fmt_ctx) {
+        const AVFrame* image = ctx->decoded_frame;
+        sws_scale(to_gray, (const uint8_t* const*)image->data, image->linesize, 0, height, gray_planes, gray_stride);
+        accumulate_luma_profile(gray, width, width, height, row_peak, col_peak, col_sum);
+        analyzed = 1;
+    } else {
+        while (analyzed < AUTOCROP_FRAMES && av_read_frame(ctx->dec_fmt_ctx, pkt) >= 0) {
+            if (pkt->stream_index == ctx->video_stream_idx && avcodec_send_packet(ctx->dec_codec_ctx, pkt) >= 0) {
+                while (analyzed < AUTOCROP_FRAMES && avcodec_receive_frame(ctx->dec_codec_ctx, frame) == 0) {
+                    if (frame->width == width && frame->height == height) {
+                        sws_scale(to_gray, (const uint8_t* const*)frame->data, frame->linesize, 0, height, gray_planes, gray_stride);
+                        accumulate_luma_profile(gray, width, width, height, row_peak, col_peak, col_sum);
+                        analyzed++;
+                    }
+                    av_frame_unref(frame);
+                }
+            }
+            av_packet_unref(pkt);
+        }
+        // Rewind so the real pass starts from the first frame again.
+        AVStream* stream = ctx->dec_fmt_ctx->streams[ctx->video_stream_idx];
+        av_seek_frame(ctx->dec_fmt_ctx, ctx->video_stream_idx,
+                      stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0, AVSEEK_FLAG_BACKWARD);
+        avcodec_flush_buffers(ctx->dec_codec_ctx);
+    }
+    if (analyzed == 0) goto done;
+
+    int top = 0, bottom = height - 1, left = 0, right = width - 1;
+    while (top < height && row_peak[top] < AUTOCROP_BLACK_LUMA) top++;
+    while (bottom > top && row_peak[bottom] < AUTOCROP_BLACK_LUMA) bottom--;
+    while (left < width && col_peak[left] < AUTOCROP_BLACK_LUMA) left++;
+    while (right > left && col_peak[right] < AUTOCROP_BLACK_LUMA) right--;
+    if (top >= height || left >= width) goto done; // Entirely black: nothing sensible to keep.
+
+    int w = right - left + 1;
+    int h = bottom - top + 1;
+    // Why refuse big crops? Losing more than half the picture is far more likely
+    // a dark opening shot than a letterbox.
+    if (w == width && h == height) goto done;
+    if (w < width / 2 || h < height / 2) goto done;
+
+    *out_x = left; *out_y = top; *out_w = w; *out_h = h;
+    ret = 0;
+
+done:
+    free(row_peak);
+    free(col_peak);
+    free(col_sum);
+    free(gray);
+    if (to_gray) sws_freeContext(to_gray);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+static const char* init_crop_region(ProcessingContext* ctx, const EngineConfig* config) {
+    int width = ctx->dec_codec_ctx->width;
+    int height = ctx->dec_codec_ctx->height;
+    ctx->src_x = 0;
+    ctx->src_y = 0;
+    ctx->src_width = width;
+    ctx->src_height = height;
+
+    int x, y, w, h;
+    if (config->crop_w > 0 && config->crop_h > 0) {
+        // Crops are given in source pixels; lowres decoding shrinks the frame.
+        int shift = ctx->dec_codec_ctx->lowres;
+        x = config->crop_x >> shift;
+        y = config->crop_y >> shift;
+        w = config->crop_w >> shift;
+        h = config->crop_h >> shift;
+    } else if (config->autocrop) {
+        if (detect_letterbox(ctx, &x, &y, &w, &h) != 0) return NULL;
+    } else {
+        return NULL;
+    }
+
+    // Why snap to the chroma grid? In 4:2:0 one chroma sample covers 2x2 luma
+    // pixels. An odd offset would split that pair and shift colors by half a pixel.
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(ctx->dec_codec_ctx->pix_fmt);
+    if (desc) {
+        int mask_x = (1 << desc->log2_chroma_w) - 1;
+        int mask_y = (1 << desc->log2_chroma_h) - 1;
+        w += x & mask_x; x &= ~mask_x;
+        h += y & mask_y; y &= ~mask_y;
+    }
+    if (x < 0 || y < 0 || x + w > width || y + h > height) return "Crop rectangle lies outside the frame";
+    if (w < 8 || h < 8) return "Crop rectangle is too small";
+
+    ctx->src_x = x;
+    ctx->src_y = y;
+    ctx->src_width = w;
+    ctx->src_height = h;
+    return NULL;
+}
+
+static void attach_sequence_image(ProcessingContext* ctx, unsigned char* pixels, int width) {
+    sequence_free_pixels(ctx->sequence_pixels);
+    ctx->sequence_pixels = pixels;
+    ctx->decoded_frame->data[0] = pixels;
+    ctx->decoded_frame->linesize[0] = width * 3;
+    ctx->decoded_frame->pts = ctx->sequence_frames++;
+    ctx->decoded_frame->duration = 1;
+}
+
+// Why pull the first image here? Its dimensions size every buffer downstream,
+// exactly as the single-image path does. It is handed out again as frame 0.
+static const char* init_sequence_input(ProcessingContext* ctx, const char* input_source, const EngineConfig* config) {
+    int prefetch = ctx->num_threads < 4 ? ctx->num_threads : 4;
+    char* sequence_error = NULL;
+    ctx->sequence = sequence_open(input_source, prefetch, prefetch * 2, &sequence_error);
+    if (!ctx->sequence) return sequence_error;
+
+    unsigned char* pixels = NULL;
+    int width = 0, height = 0;
+    int ret;
+    while ((ret = sequence_next(ctx->sequence, &pixels, &width, &height)) == SEQUENCE_DECODE_ERROR) {}
+    if (ret != 0) return "No image in the sequence could be decoded";
+
+    ctx->dec_codec_ctx = avcodec_alloc_context3(NULL);
+    ctx->decoded_frame = av_frame_alloc();
+    if (!ctx->dec_codec_ctx || !ctx->decoded_frame) { sequence_free_pixels(pixels); return "Failed to alloc sequence context"; }
+    ctx->dec_codec_ctx->width = width;
+    ctx->dec_codec_ctx->height = height;
+    ctx->dec_codec_ctx->pix_fmt = AV_PIX_FMT_RGB24;
+    ctx->decoded_frame->width = width;
+    ctx->decoded_frame->height = height;
+    ctx->decoded_frame->format = AV_PIX_FMT_RGB24;
+    attach_sequence_image(ctx, pixels, width);
+    ctx->sequence_primed = 1;
+
+    // Why a time base of 1/fps? Each image is one tick, so the frame index is
+    // its PTS and the encoder and the playback clock need no special cases.
+    ctx->video_stream_idx = 0;
+    ctx->frame_rate = av_d2q(config->sequence_fps > 0.0f ? config->sequence_fps : 25.0, 1001000);
+    ctx->time_base = av_inv_q(ctx->frame_rate);
+    ctx->sample_aspect_ratio = (AVRational){1, 1};
+    return NULL;
+}
+
+// Why split init in three? Files, sequences and raw in-memory buffers differ
+// only in where pixels come from. Thread pool, LUTs, the RGB stage, the arena
+// and the encoder are set up the same way for all of them.
+static ProcessingContext* alloc_context(const EngineConfig* config, char** error) {
     ProcessingContext* ctx = (ProcessingContext*)calloc(1, sizeof(ProcessingContext));
     if (!ctx) { *error = "Failed to allocate context"; return NULL; }
 
@@ -201,6 +614,38 @@ ProcessingContext* engine_init(const char* input_source, const EngineConfig* con
         engine_cleanup(&ctx);
         return NULL;
     }
+    return ctx;
+}
+
+static ProcessingContext* finish_init(ProcessingContext* ctx, const EngineConfig* config, char** error);
+
+// Why memcpy only config_size bytes? Fields past that point did not exist in
+// the caller's header; reading them would run off the end of its struct.
+static const char* normalize_config(EngineConfig* out, const EngineConfig* config, int abi_version, size_t config_size) {
+    if ((abi_version >> 16) != ENGINE_VERSION_MAJOR) return "Engine ABI major version mismatch";
+    if (!config || config_size == 0) return "Missing engine config";
+    memset(out, 0, sizeof(*out));
+    memcpy(out, config, config_size < sizeof(*out) ? config_size : sizeof(*out));
+    return NULL;
+}
+
+static ProcessingContext* adopt_config(ProcessingContext* ctx, const EngineConfig* config, size_t config_size) {
+    if (!ctx) return NULL;
+    ctx->config = *config;
+    ctx->config_size = config_size < sizeof(EngineConfig) ? config_size : sizeof(EngineConfig);
+    return ctx;
+}
+
+// Every entry point that takes a config funnels it through here, so the rest
+// of the engine only ever reads a full-size, library-layout struct.
+static const EngineConfig* sync_config(ProcessingContext* ctx, const EngineConfig* config) {
+    if (config && config != &ctx->config) memcpy(&ctx->config, config, ctx->config_size);
+    return &ctx->config;
+}
+
+static ProcessingContext* init_from_source(const char* input_source, const EngineConfig* config, char** error) {
+    ProcessingContext* ctx = alloc_context(config, error);
+    if (!ctx) return NULL;
 
     if (config->mode == MODE_VIDEO || config->mode == MODE_ANIMATED_GIF) {
         if (avformat_open_input(&ctx->dec_fmt_ctx, input_source, NULL, NULL) != 0) {
@@ -226,10 +671,21 @@ ProcessingContext* engine_init(const char* input_source, const EngineConfig* con
         ctx->dec_codec_ctx = avcodec_alloc_context3(ctx->dec_codec);
         if (!ctx->dec_codec_ctx) { *error = "Failed to alloc decoder context"; engine_cleanup(&ctx); return NULL; }
         if (avcodec_parameters_to_context(ctx->dec_codec_ctx, pCodecPar) < 0) { *error = "Couldn't copy decoder context"; engine_cleanup(&ctx); return NULL; }
+        // Why lowres? Codecs like MJPEG can decode straight to 1/2, 1/4 or 1/8
+        // size by skipping the high-frequency coefficients. For thumbnails and
+        // narrow ASCII output, the detail thrown away was never going to show.
+        if (config->lowres > 0) {
+            ctx->dec_codec_ctx->lowres = config->lowres < ctx->dec_codec->max_lowres ? config->lowres : ctx->dec_codec->max_lowres;
+        }
         if (avcodec_open2(ctx->dec_codec_ctx, ctx->dec_codec, NULL) < 0) {
             *error = "Could not open decoder codec"; engine_cleanup(&ctx); return NULL;
         }
         ctx->time_base = video_stream->time_base;
+        ctx->frame_rate = video_stream->r_frame_rate;
+        ctx->sample_aspect_ratio = pCodecPar->sample_aspect_ratio;
+    } else if (config->mode == MODE_SEQUENCE) {
+        const char* sequence_error = init_sequence_input(ctx, input_source, config);
+        if (sequence_error) { *error = (char*)sequence_error; engine_cleanup(&ctx); return NULL; }
     } else { // MODE_IMAGE
         int width, height, channels;
         unsigned char* data = stbi_load(input_source, &width, &height, &channels, 3);
@@ -251,20 +707,91 @@ ProcessingContext* engine_init(const char* input_source, const EngineConfig* con
         stbi_image_free(data);
     }
 
+    return finish_init(ctx, config, error);
+}
+
+static enum AVPixelFormat to_av_pix_fmt(EnginePixelFormat format) {
+    switch (format) {
+        case ENGINE_PIX_RGB24:   return AV_PIX_FMT_RGB24;
+        case ENGINE_PIX_BGR24:   return AV_PIX_FMT_BGR24;
+        case ENGINE_PIX_RGBA:    return AV_PIX_FMT_RGBA;
+        case ENGINE_PIX_BGRA:    return AV_PIX_FMT_BGRA;
+        case ENGINE_PIX_GRAY8:   return AV_PIX_FMT_GRAY8;
+        case ENGINE_PIX_YUV420P: return AV_PIX_FMT_YUV420P;
+        case ENGINE_PIX_NV12:    return AV_PIX_FMT_NV12;
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+ProcessingContext* engine_init_versioned(const char* input_source, const EngineConfig* config,
+                                         int abi_version, size_t config_size, char** error) {
+    EngineConfig full;
+    const char* config_error = normalize_config(&full, config, abi_version, config_size);
+    if (config_error) { *error = (char*)config_error; return NULL; }
+    return adopt_config(init_from_source(input_source, &full, error), &full, config_size);
+}
+
+static ProcessingContext* init_raw(int width, int height, EnginePixelFormat format, const EngineConfig* config, char** error) {
+    if (width <= 0 || height <= 0) { *error = "Invalid frame dimensions"; return NULL; }
+    enum AVPixelFormat pix_fmt = to_av_pix_fmt(format);
+    if (pix_fmt == AV_PIX_FMT_NONE) { *error = "Unsupported pixel format"; return NULL; }
+
+    ProcessingContext* ctx = alloc_context(config, error);
+    if (!ctx) return NULL;
+
+    // Why borrow an AVCodecContext with no codec? Just as for still images, it
+    // is a convenient holder for the geometry and pixel format the RGB stage
+    // reads. Nothing is opened, and libavformat is never touched.
+    ctx->dec_codec_ctx = avcodec_alloc_context3(NULL);
+    if (!ctx->dec_codec_ctx) { *error = "Failed to alloc raw context"; engine_cleanup(&ctx); return NULL; }
+    ctx->dec_codec_ctx->width = width;
+    ctx->dec_codec_ctx->height = height;
+    ctx->dec_codec_ctx->pix_fmt = pix_fmt;
+    ctx->is_raw = 1;
+    ctx->frame_rate = av_d2q(config->sequence_fps > 0.0f ? config->sequence_fps : 25.0, 1001000);
+    ctx->time_base = av_inv_q(ctx->frame_rate);
+    ctx->sample_aspect_ratio = (AVRational){1, 1};
+    if (config->autocrop) {
+        *error = "Autocrop needs a file source; pass an explicit crop for raw buffers";
+        engine_cleanup(&ctx);
+        return NULL;
+    }
+
+    return finish_init(ctx, config, error);
+}
+
+ProcessingContext* engine_init_raw_versioned(int width, int height, EnginePixelFormat format,
+                                             const EngineConfig* config, int abi_version,
+                                             size_t config_size, char** error) {
+    EngineConfig full;
+    const char* config_error = normalize_config(&full, config, abi_version, config_size);
+    if (config_error) { *error = (char*)config_error; return NULL; }
+    return adopt_config(init_raw(width, height, format, &full, error), &full, config_size);
+}
+
+static ProcessingContext* finish_init(ProcessingContext* ctx, const EngineConfig* config, char** error) {
+    const char* crop_error = init_crop_region(ctx, config);
+    if (crop_error) { *error = (char*)crop_error; engine_cleanup(&ctx); return NULL; }
+
+    if (ctx->dec_fmt_ctx && config->shard_count > 0) {
+        const char* shard_error = init_shard_range(ctx, config);
+        if (shard_error) { *error = (char*)shard_error; engine_cleanup(&ctx); return NULL; }
+    }
+
     ctx->ascii_width = config->output_width;
-    ctx->ascii_height = (int)((float)ctx->ascii_width / ((float)ctx->dec_codec_ctx->width / ctx->dec_codec_ctx->height) * config->aspect_correction);
+    ctx->ascii_height = (int)((float)ctx->ascii_width / ((float)ctx->src_width / ctx->src_height) * config->aspect_correction);
 
 
-    ctx->sws_ctx_to_rgb = sws_getContext(ctx->dec_codec_ctx->width, ctx->dec_codec_ctx->height, ctx->dec_codec_ctx->pix_fmt,
-                                         ctx->dec_codec_ctx->width, ctx->dec_codec_ctx->height, AV_PIX_FMT_RGB24,
+    ctx->sws_ctx_to_rgb = sws_getContext(ctx->src_width, ctx->src_height, ctx->dec_codec_ctx->pix_fmt,
+                                         ctx->src_width, ctx->src_height, AV_PIX_FMT_RGB24,
                                          SWS_BILINEAR, NULL, NULL, NULL);
 
-    if (config->mode != MODE_IMAGE) ctx->decoded_frame = av_frame_alloc();
+    if (ctx->dec_fmt_ctx) ctx->decoded_frame = av_frame_alloc();
     ctx->rgb_frame = av_frame_alloc();
-    int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, ctx->dec_codec_ctx->width, ctx->dec_codec_ctx->height, 1);
+    int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, ctx->src_width, ctx->src_height, 1);
     uint8_t* buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
     if (!buffer) { *error = "Failed to alloc RGB buffer"; engine_cleanup(&ctx); return NULL; }
-    av_image_fill_arrays(ctx->rgb_frame->data, ctx->rgb_frame->linesize, buffer, AV_PIX_FMT_RGB24, ctx->dec_codec_ctx->width, ctx->dec_codec_ctx->height, 1);
+    av_image_fill_arrays(ctx->rgb_frame->data, ctx->rgb_frame->linesize, buffer, AV_PIX_FMT_RGB24, ctx->src_width, ctx->src_height, 1);
 
     if (!arena_init(&ctx->frame_arena, 64 * 1024 * 1024)) { // Increased arena size for larger resolutions
         *error = "Failed to initialize memory arena";
@@ -272,8 +799,10 @@ ProcessingContext* engine_init(const char* input_source, const EngineConfig* con
         return NULL;
     }
 
-    if (config->output_filename && is_animated_file(config->output_filename)) {
-        const char* encoder_error = init_encoder(ctx, config);
+    // Why skip the encoder when checkpointing? The output is then written as a
+    // series of segments, each opened by the caller through engine_open_segment.
+    if (config->output_filename && is_animated_file(config->output_filename) && config->checkpoint_secs <= 0.0f) {
+        const char* encoder_error = init_encoder(ctx, config, config->output_filename);
         if (encoder_error) {
             *error = (char*)encoder_error;
             engine_cleanup(&ctx);
@@ -284,43 +813,78 @@ ProcessingContext* engine_init(const char* input_source, const EngineConfig* con
     return ctx;
 }
 
+static void async_stop(ProcessingContext* ctx);
+
 void engine_cleanup(ProcessingContext** ctx_ptr) {
     if (!ctx_ptr || !*ctx_ptr) return;
     ProcessingContext* ctx = *ctx_ptr;
 
+    async_stop(ctx);
+
     arena_free(&ctx->frame_arena);
+    stage_stats_free(&ctx->stats);
+    trace_free(&ctx->trace);
+    perf_counters_free(&ctx->counters);
+    free(ctx->plane_magnitude);
+    free(ctx->plane_orientation);
+    free(ctx->plane_level);
     free(ctx->workers);
     free(ctx->worker_args);
 
     if (ctx->rgb_frame) { av_freep(&ctx->rgb_frame->data[0]); av_frame_free(&ctx->rgb_frame); }
-    if (ctx->yuv_frame) { av_freep(&ctx->yuv_frame->data[0]); av_frame_free(&ctx->yuv_frame); }
     if (ctx->decoded_frame) av_frame_free(&ctx->decoded_frame);
 
     if (ctx->dec_codec_ctx) avcodec_free_context(&ctx->dec_codec_ctx);
     if (ctx->dec_fmt_ctx) avformat_close_input(&ctx->dec_fmt_ctx);
+    sequence_close(&ctx->sequence);
+    sequence_free_pixels(ctx->sequence_pixels);
 
-    if (ctx->enc_codec_ctx) avcodec_free_context(&ctx->enc_codec_ctx);
-    if (ctx->enc_fmt_ctx) {
-        if (!(ctx->enc_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-            avio_closep(&ctx->enc_fmt_ctx->pb);
-        }
-        avformat_free_context(ctx->enc_fmt_ctx);
-    }
+    release_encoder(ctx);
 
     if (ctx->sws_ctx_to_rgb) sws_freeContext(ctx->sws_ctx_to_rgb);
-    if (ctx->sws_ctx_to_yuv) sws_freeContext(ctx->sws_ctx_to_yuv);
 
     free(ctx);
     *ctx_ptr = NULL;
 }
 
 int engine_get_next_packet(ProcessingContext* ctx, AVPacket* packet) {
+    // Why a placeholder packet for sequences? It keeps the demux/decode loop in
+    // main identical for every input; the image itself arrives at decode time.
+    if (ctx && ctx->sequence) {
+        if (!ctx->sequence_primed && !sequence_has_more(ctx->sequence)) return AVERROR_EOF;
+        packet->stream_index = ctx->video_stream_idx;
+        return 0;
+    }
     if (!ctx || !ctx->dec_fmt_ctx) return AVERROR_EOF;
-    return av_read_frame(ctx->dec_fmt_ctx, packet);
+    int64_t start = stage_begin(ctx);
+    int ret = av_read_frame(ctx->dec_fmt_ctx, packet);
+    stage_end(ctx, ENGINE_STAGE_DEMUX, start, ret >= 0 ? packet->size : 0);
+    return ret;
 }
 
-int engine_decode_video_packet(ProcessingContext* ctx, AVPacket* packet, struct AVFrame** frame) {
-    if (!ctx) return AVERROR_INVALIDDATA;
+static int decode_video_packet(ProcessingContext* ctx, AVPacket* packet, struct AVFrame** frame) {
+
+    if (ctx->sequence) {
+        if (ctx->sequence_primed) {
+            ctx->sequence_primed = 0;
+            *frame = ctx->decoded_frame;
+            return 0;
+        }
+        unsigned char* pixels = NULL;
+        int width = 0, height = 0;
+        int ret = sequence_next(ctx->sequence, &pixels, &width, &height);
+        if (ret == SEQUENCE_EOF) return AVERROR_EOF;
+        if (ret != 0) return AVERROR_INVALIDDATA;
+        if (width != ctx->decoded_frame->width || height != ctx->decoded_frame->height) {
+            fprintf(stderr, "WARNING: Skipping sequence image of size %dx%d (expected %dx%d)\n",
+                    width, height, ctx->decoded_frame->width, ctx->decoded_frame->height);
+            sequence_free_pixels(pixels);
+            return AVERROR_INVALIDDATA;
+        }
+        attach_sequence_image(ctx, pixels, width);
+        *frame = ctx->decoded_frame;
+        return 0;
+    }
     
     if (ctx->dec_fmt_ctx == NULL) {
         if (ctx->decoded_frame) {
@@ -338,7 +902,16 @@ int engine_decode_video_packet(ProcessingContext* ctx, AVPacket* packet, struct
     return ret;
 }
 
+int engine_decode_video_packet(ProcessingContext* ctx, AVPacket* packet, struct AVFrame** frame) {
+    if (!ctx) return AVERROR_INVALIDDATA;
+    int64_t start = stage_begin(ctx);
+    int ret = decode_video_packet(ctx, packet, frame);
+    stage_end(ctx, ENGINE_STAGE_DECODE, start, 0);
+    return ret;
+}
+
 double engine_get_frame_delay_secs(const ProcessingContext* ctx, const AVFrame* frame) {
+    if (ctx && ctx->sequence) return av_q2d(ctx->time_base);
     if (!ctx || !frame || !ctx->dec_fmt_ctx) return 1.0 / 24.0; // Default fallback
     
     AVStream* stream = ctx->dec_fmt_ctx->streams[ctx->video_stream_idx];
@@ -360,7 +933,17 @@ double engine_get_frame_delay_secs(const ProcessingContext* ctx, const AVFrame*
 }
 
 
-void engine_process_frame_to_ascii(ProcessingContext* ctx, const struct AVFrame* frame, const EngineConfig* config) {
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Why stamp the start here? Every path into the cell kernel begins by claiming
+// a fresh grid, so this is the one place that brackets RGB conversion plus
+// the kernel for all of them.
+static int alloc_cell_grid(ProcessingContext* ctx) {
+    if (ctx->frame_callback) ctx->frame_start_ns = monotonic_ns();
     arena_reset(&ctx->frame_arena);
     
     size_t char_buffer_size = (size_t)(ctx->ascii_width) * ctx->ascii_height;
@@ -369,21 +952,68 @@ void engine_process_frame_to_ascii(ProcessingContext* ctx, const struct AVFrame*
 
     if (!ctx->char_buffer || !ctx->color_buffer) {
         fprintf(stderr, "Arena allocation failed for frame buffers.\n");
-        return;
+        return -1;
     }
+    return 0;
+}
 
-    sws_scale(ctx->sws_ctx_to_rgb, (uint8_t const * const *)frame->data,
-              frame->linesize, 0, frame->height,
-              ctx->rgb_frame->data, ctx->rgb_frame->linesize);
+// Why atomic? With the async pipeline the count is bumped on the pipeline
+// thread while the caller reads it for stats.
+static void publish_frame(ProcessingContext* ctx) {
+    int64_t published = __atomic_add_fetch(&ctx->frames_processed, 1, __ATOMIC_RELEASE);
+    if (!ctx->frame_callback) return;
+
+    EngineCellGrid grid;
+    engine_get_cell_grid(ctx, &grid);
+    EngineFrameInfo info;
+    info.frame_index = published - 1;
+    info.pts = ctx->current_pts;
+    info.pts_secs = (ctx->current_pts != AV_NOPTS_VALUE && ctx->time_base.den > 0)
+                        ? ctx->current_pts * av_q2d(ctx->time_base) : -1.0;
+    info.process_ms = (double)(monotonic_ns() - ctx->frame_start_ns) / 1e6;
+    ctx->frame_callback(&info, &grid, ctx->frame_callback_data);
+}
+
+static int ensure_planes(ProcessingContext* ctx) {
+    size_t cells = (size_t)ctx->ascii_width * ctx->ascii_height;
+    if (cells <= ctx->plane_cells) return 0;
+    float* magnitude = (float*)realloc(ctx->plane_magnitude, cells * sizeof(float));
+    if (magnitude) ctx->plane_magnitude = magnitude;
+    uint8_t* orientation = (uint8_t*)realloc(ctx->plane_orientation, cells);
+    if (orientation) ctx->plane_orientation = orientation;
+    uint8_t* level = (uint8_t*)realloc(ctx->plane_level, cells);
+    if (level) ctx->plane_level = level;
+    if (!magnitude || !orientation || !level) return -1;
+    ctx->plane_cells = cells;
+    return 0;
+}
 
+// Runs the cell kernel over whatever currently sits in rgb_frame.
+//
+// Why bands? A contiguous slice per worker is the cheapest split, but detail
+// is rarely spread evenly: a face or a caption fills a few slices and the
+// rest of the workers wait for them. Dealing short bands round robin spreads
+// that detail across every worker, at the price of more slice boundaries.
+// Which side wins depends on the machine, so --autotune measures it.
+static void run_cell_workers(ProcessingContext* ctx, const EngineConfig* config, const AVFrame* frame) {
+    ctx->rgb_valid = 1;
+    if (ctx->retain_planes && ensure_planes(ctx) != 0) ctx->retain_planes = 0;
     int rows_per_thread = ctx->ascii_height / ctx->num_threads;
+    int band = config->band_rows > 0 ? config->band_rows : 0;
     for (int i = 0; i < ctx->num_threads; ++i) {
         ThreadArgs* args = &ctx->worker_args[i];
         args->ctx = ctx;
         args->config = config;
         args->frame = frame;
-        args->start_row = i * rows_per_thread;
-        args->end_row = (i == ctx->num_threads - 1) ? ctx->ascii_height : (i + 1) * rows_per_thread;
+        args->band_rows = band;
+        args->band_step = band * ctx->num_threads;
+        if (band) {
+            args->start_row = i * band;
+            args->end_row = ctx->ascii_height;
+        } else {
+            args->start_row = i * rows_per_thread;
+            args->end_row = (i == ctx->num_threads - 1) ? ctx->ascii_height : (i + 1) * rows_per_thread;
+        }
 
         pthread_create(&ctx->workers[i], NULL, process_slice_worker, args);
     }
@@ -393,107 +1023,719 @@ void engine_process_frame_to_ascii(ProcessingContext* ctx, const struct AVFrame*
     }
 }
 
-static void* process_slice_worker(void* arg) {
-    ThreadArgs* args = (ThreadArgs*)arg;
-    ProcessingContext* ctx = args->ctx;
-    const EngineConfig* config = args->config;
-    
-    int width = ctx->dec_codec_ctx->width;
-    int height = ctx->dec_codec_ctx->height;
+void engine_process_frame_to_ascii(ProcessingContext* ctx, const struct AVFrame* frame, const EngineConfig* config) {
+    config = sync_config(ctx, config);
+    if (alloc_cell_grid(ctx) != 0) return;
+
+    const uint8_t* src_planes[4];
+    offset_frame_planes(frame, ctx->src_x, ctx->src_y, src_planes);
+    int64_t start = stage_begin(ctx);
+    sws_scale(ctx->sws_ctx_to_rgb, src_planes,
+              frame->linesize, 0, ctx->src_height,
+              ctx->rgb_frame->data, ctx->rgb_frame->linesize);
+    stage_end(ctx, ENGINE_STAGE_RGB, start, (int64_t)ctx->src_width * ctx->src_height * 3);
+
+    ctx->current_pts = engine_get_frame_pts(frame);
+    run_cell_workers(ctx, config, frame);
+    publish_frame(ctx);
+}
+
+int engine_process_buffer(ProcessingContext* ctx, const uint8_t* const planes[], const int strides[],
+                          int64_t pts, const EngineConfig* config) {
+    if (!ctx || !ctx->is_raw || !planes || !strides) return -1;
+    config = sync_config(ctx, config);
+    if (alloc_cell_grid(ctx) != 0) return -1;
+
+    const uint8_t* data[4] = { NULL, NULL, NULL, NULL };
+    int linesize[4] = { 0, 0, 0, 0 };
+    int num_planes = av_pix_fmt_count_planes(ctx->dec_codec_ctx->pix_fmt);
+    for (int p = 0; p < num_planes && p < 4; p++) {
+        if (!planes[p]) return -1;
+        data[p] = planes[p];
+        linesize[p] = strides[p];
+    }
+
+    const uint8_t* src_planes[4];
+    offset_planes(data, linesize, ctx->dec_codec_ctx->pix_fmt, ctx->src_x, ctx->src_y, src_planes);
+    int64_t start = stage_begin(ctx);
+    sws_scale(ctx->sws_ctx_to_rgb, src_planes, linesize, 0, ctx->src_height,
+              ctx->rgb_frame->data, ctx->rgb_frame->linesize);
+    stage_end(ctx, ENGINE_STAGE_RGB, start, (int64_t)ctx->src_width * ctx->src_height * 3);
+
+    ctx->current_pts = pts;
+    run_cell_workers(ctx, config, NULL);
+    publish_frame(ctx);
+    return 0;
+}
+
+// --- Contact Sheet ---
+// Why AVDISCARD_NONKEY? A thumbnail only needs one picture near the requested
+// time, and the keyframe the seek lands on is self-contained. Telling the
+// decoder to drop everything else means each tile costs one seek and one
+// intra decode, no matter how long the video is.
+static int decode_keyframe_at(AVFormatContext* fmt, AVCodecContext* dec, int stream_idx, int64_t target_pts,
+                              AVPacket* pkt, AVFrame* frame) {
+    if (av_seek_frame(fmt, stream_idx, target_pts, AVSEEK_FLAG_BACKWARD) < 0) return -1;
+    avcodec_flush_buffers(dec);
+
+    while (av_read_frame(fmt, pkt) >= 0) {
+        if (pkt->stream_index != stream_idx || !(pkt->flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        int ret = avcodec_send_packet(dec, pkt);
+        av_packet_unref(pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) return ret;
+        ret = avcodec_receive_frame(dec, frame);
+        if (ret == 0) return 0;
+        if (ret != AVERROR(EAGAIN)) return ret;
+    }
+    // Frame-threaded decoders hold on to the picture until drained.
+    avcodec_send_packet(dec, NULL);
+    return avcodec_receive_frame(dec, frame);
+}
+
+// The tiles of one contact sheet, shared by the thumbnail workers.
+typedef struct {
+    ProcessingContext* ctx;
+    int cols, rows;
+    int tile_w, tile_h, gap;
+    int64_t start_time, duration;
+    int next_tile;   // Next tile to claim, taken with an atomic increment.
+} SheetJob;
+
+// Why a demuxer and decoder per worker? Seeking and decoding are the whole
+// cost of a sheet, and an AVFormatContext or AVCodecContext can serve only one
+// thread. Worker 0 borrows the context's own pair; the others open the input
+// again. A worker that cannot (a pipe, say) simply claims no tiles.
+typedef struct {
+    SheetJob* job;
+    AVFormatContext* fmt;
+    AVCodecContext* dec;
+    AVFrame* frame;
+    int owned;       // fmt, dec and frame were opened for this worker.
+    int drawn;
+} SheetWorker;
+
+static int open_sheet_decoder(const ProcessingContext* ctx, SheetWorker* w) {
+    const char* url = ctx->dec_fmt_ctx->url;
+    if (!url || !url[0] || avformat_open_input(&w->fmt, url, NULL, NULL) != 0) return -1;
+    if (avformat_find_stream_info(w->fmt, NULL) < 0 || (unsigned)ctx->video_stream_idx >= w->fmt->nb_streams) return -1;
+    w->dec = avcodec_alloc_context3(ctx->dec_codec);
+    if (!w->dec) return -1;
+    if (avcodec_parameters_to_context(w->dec, w->fmt->streams[ctx->video_stream_idx]->codecpar) < 0) return -1;
+    w->dec->lowres = ctx->dec_codec_ctx->lowres;
+    w->dec->thread_count = 1; // Each worker is one core already.
+    w->dec->skip_frame = AVDISCARD_NONKEY;
+    if (avcodec_open2(w->dec, ctx->dec_codec, NULL) < 0) return -1;
+    w->frame = av_frame_alloc();
+    return w->frame ? 0 : -1;
+}
+
+// Tiles never overlap, so every worker scales straight into the mosaic.
+static void* contact_sheet_worker(void* arg) {
+    SheetWorker* w = (SheetWorker*)arg;
+    SheetJob* job = w->job;
+    ProcessingContext* ctx = job->ctx;
+    if (w->owned && open_sheet_decoder(ctx, w) != 0) return NULL;
+
+    int width = ctx->src_width;
+    int height = ctx->src_height;
+    int dst_w = job->tile_w - 2 * job->gap;
+    int dst_h = job->tile_h - 2 * job->gap;
+    uint8_t* rgb = ctx->rgb_frame->data[0];
+    int stride = ctx->rgb_frame->linesize[0];
+    int tiles = job->cols * job->rows;
+    AVPacket* pkt = av_packet_alloc();
+    struct SwsContext* tile_sws = NULL;
+
+    for (int i; pkt && (i = __atomic_fetch_add(&job->next_tile, 1, __ATOMIC_RELAXED)) < tiles;) {
+        int64_t target = job->start_time + job->duration * (2 * i + 1) / (2 * (int64_t)tiles);
+        if (decode_keyframe_at(w->fmt, w->dec, ctx->video_stream_idx, target, pkt, w->frame) != 0) continue;
+
+        AVFrame* thumb = w->frame;
+        if (thumb->width < ctx->src_x + width || thumb->height < ctx->src_y + height) { av_frame_unref(thumb); continue; }
+        tile_sws = sws_getCachedContext(tile_sws, width, height, (enum AVPixelFormat)thumb->format,
+                                        dst_w, dst_h, AV_PIX_FMT_RGB24, SWS_AREA, NULL, NULL, NULL);
+        if (!tile_sws) { av_frame_unref(thumb); continue; }
+
+        int tile_y = (i / job->cols) * job->tile_h + job->gap;
+        int tile_x = (i % job->cols) * job->tile_w + job->gap;
+        uint8_t* dst[4] = { rgb + (size_t)tile_y * stride + (size_t)tile_x * 3, NULL, NULL, NULL };
+        int dst_stride[4] = { stride, 0, 0, 0 };
+        const uint8_t* src_planes[4];
+        offset_frame_planes(thumb, ctx->src_x, ctx->src_y, src_planes);
+        sws_scale(tile_sws, src_planes, thumb->linesize, 0, height, dst, dst_stride);
+        av_frame_unref(thumb);
+        w->drawn++;
+    }
+
+    sws_freeContext(tile_sws);
+    av_packet_free(&pkt);
+    return NULL;
+}
+
+// Why one pipeline thread? The cell kernel already spreads each frame over
+// every core, so converting two frames at once would only make them fight for
+// the same cores. What the caller needs is to get its own thread back: frames
+// queue here and are converted back to back while it decodes or does I/O.
+static void* async_pipeline_worker(void* arg) {
+    ProcessingContext* ctx = (ProcessingContext*)arg;
+    AsyncPipeline* ap = ctx->async;
+    stats_slot = 1;
+    for (;;) {
+        pthread_mutex_lock(&ap->lock);
+        while (!ap->stop && ap->next_to_run == ap->next_ticket) {
+            pthread_cond_wait(&ap->work, &ap->lock);
+        }
+        if (ap->stop) { pthread_mutex_unlock(&ap->lock); return NULL; }
+        AsyncSlot* slot = &ap->slots[ap->next_to_run % ap->depth];
+        pthread_mutex_unlock(&ap->lock);
+
+        int64_t start_ns = monotonic_ns();
+        if (slot->is_buffer) {
+            slot->status = engine_process_buffer(ctx, (const uint8_t* const*)slot->frame->data,
+                                                 slot->frame->linesize, slot->frame->pts, &slot->config);
+        } else {
+            engine_process_frame_to_ascii(ctx, slot->frame, &slot->config);
+            slot->status = 0;
+        }
+
+        EngineCellGrid grid;
+        if (slot->status == 0 && engine_get_cell_grid(ctx, &grid) == 0) {
+            size_t cells = (size_t)grid.width * grid.height;
+            if (cells > slot->capacity) {
+                free(slot->chars);
+                free(slot->colors);
+                slot->chars = (char*)malloc(cells);
+                slot->colors = (unsigned char*)malloc(cells * 3);
+                slot->capacity = (slot->chars && slot->colors) ? cells : 0;
+            }
+            if (slot->capacity >= cells) {
+                memcpy(slot->chars, grid.chars, cells);
+                memcpy(slot->colors, grid.colors, cells * 3);
+                slot->grid = grid;
+                slot->grid.chars = slot->chars;
+                slot->grid.colors = slot->colors;
+            } else {
+                slot->status = -1;
+            }
+        } else {
+            slot->status = -1;
+        }
+        slot->info.frame_index = __atomic_load_n(&ctx->frames_processed, __ATOMIC_ACQUIRE) - 1;
+        slot->info.pts = ctx->current_pts;
+        slot->info.pts_secs = (ctx->current_pts != AV_NOPTS_VALUE && ctx->time_base.den > 0)
+                                  ? ctx->current_pts * av_q2d(ctx->time_base) : -1.0;
+        slot->info.process_ms = (double)(monotonic_ns() - start_ns) / 1e6;
+        av_frame_unref(slot->frame); // Let the decoder recycle the surface right away.
+
+        pthread_mutex_lock(&ap->lock);
+        slot->state = SLOT_DONE;
+        ap->next_to_run++;
+        pthread_cond_broadcast(&ap->done);
+        pthread_mutex_unlock(&ap->lock);
+
+        // Why ignore the result? The write can only fail once 2^64 - 1
+        // completions went unread, and the done condvar wakes waiters anyway.
+        uint64_t one = 1;
+        ssize_t written = write(ap->event_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+static void async_stop(ProcessingContext* ctx) {
+    AsyncPipeline* ap = ctx->async;
+    if (!ap) return;
+    if (ap->thread) {
+        pthread_mutex_lock(&ap->lock);
+        ap->stop = 1;
+        pthread_cond_broadcast(&ap->work);
+        pthread_mutex_unlock(&ap->lock);
+        pthread_join(ap->thread, NULL);
+    }
+    pthread_mutex_destroy(&ap->lock);
+    pthread_cond_destroy(&ap->work);
+    pthread_cond_destroy(&ap->done);
+    if (ap->event_fd >= 0) close(ap->event_fd);
+    for (int i = 0; i < ap->depth; i++) {
+        av_frame_free(&ap->slots[i].frame);
+        free(ap->slots[i].chars);
+        free(ap->slots[i].colors);
+    }
+    free(ap->slots);
+    free(ap);
+    ctx->async = NULL;
+}
+
+int engine_async_start(ProcessingContext* ctx, int max_in_flight) {
+    if (!ctx || ctx->async) return -1;
+    AsyncPipeline* ap = (AsyncPipeline*)calloc(1, sizeof(AsyncPipeline));
+    if (!ap) return -1;
+    ctx->async = ap;
+    ap->depth = max_in_flight > 0 ? max_in_flight : 4;
+    ap->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ap->base_config = ctx->config;
+    pthread_mutex_init(&ap->lock, NULL);
+    pthread_cond_init(&ap->work, NULL);
+    pthread_cond_init(&ap->done, NULL);
+
+    ap->slots = (AsyncSlot*)calloc(ap->depth, sizeof(AsyncSlot));
+    if (!ap->slots || ap->event_fd < 0) { async_stop(ctx); return -1; }
+    for (int i = 0; i < ap->depth; i++) {
+        ap->slots[i].ticket = -1;
+        ap->slots[i].frame = av_frame_alloc();
+        if (!ap->slots[i].frame) { async_stop(ctx); return -1; }
+    }
+    if (pthread_create(&ap->thread, NULL, async_pipeline_worker, ctx) != 0) {
+        ap->thread = 0;
+        async_stop(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+int engine_get_event_fd(const ProcessingContext* ctx) {
+    return (ctx && ctx->async) ? ctx->async->event_fd : -1;
+}
+
+// Why claim the slot before filling it? Ticket i always lands in slot
+// i % depth, exactly as in the sequence prefetch ring. A slot is reused only
+// after the caller released its previous ticket, so a full ring is reported
+// to the caller instead of overwriting a grid it may still be reading.
+static AsyncSlot* claim_slot(ProcessingContext* ctx, const EngineConfig* config) {
+    AsyncPipeline* ap = ctx->async;
+    if (!ap) return NULL;
+    pthread_mutex_lock(&ap->lock);
+    AsyncSlot* slot = &ap->slots[ap->next_ticket % ap->depth];
+    int available = slot->state == SLOT_FREE;
+    if (available) slot->state = SLOT_CLAIMED;
+    pthread_mutex_unlock(&ap->lock);
+    if (!available) return NULL;
+
+    // Why not sync_config? The pipeline thread owns ctx->config while frames
+    // are in flight; each slot carries its own normalised snapshot instead.
+    if (config) {
+        memset(&slot->config, 0, sizeof(slot->config));
+        memcpy(&slot->config, config, ctx->config_size);
+    } else {
+        slot->config = ap->base_config;
+    }
+    return slot;
+}
+
+// Every failure between claim_slot and queue_slot ends here, or the slot
+// would stay claimed and the ring would shrink by one for good.
+static int64_t release_slot(ProcessingContext* ctx, AsyncSlot* slot) {
+    AsyncPipeline* ap = ctx->async;
+    av_frame_unref(slot->frame);
+    pthread_mutex_lock(&ap->lock);
+    slot->state = SLOT_FREE;
+    pthread_mutex_unlock(&ap->lock);
+    return -1;
+}
+
+static int64_t queue_slot(ProcessingContext* ctx, AsyncSlot* slot) {
+    AsyncPipeline* ap = ctx->async;
+    pthread_mutex_lock(&ap->lock);
+    int64_t ticket = ap->next_ticket++;
+    slot->ticket = ticket;
+    slot->state = SLOT_QUEUED;
+    pthread_cond_signal(&ap->work);
+    pthread_mutex_unlock(&ap->lock);
+    return ticket;
+}
+
+int64_t engine_submit_frame(ProcessingContext* ctx, const struct AVFrame* frame, const EngineConfig* config) {
+    if (!ctx || !frame || ctx->is_raw) return -1;
+    if (!ctx->async) return -1;
+    AsyncSlot* slot = claim_slot(ctx, config);
+    if (!slot) return ENGINE_ASYNC_FULL;
+    // Why a reference? Decoders recycle their output frame on the next call.
+    // For refcounted frames this is a counter bump; plain buffers (stills and
+    // image sequences) are copied.
+    if (av_frame_ref(slot->frame, frame) < 0) return release_slot(ctx, slot);
+    slot->is_buffer = 0;
+    return queue_slot(ctx, slot);
+}
+
+int64_t engine_submit_buffer(ProcessingContext* ctx, const uint8_t* const planes[], const int strides[],
+                             int64_t pts, const EngineConfig* config) {
+    if (!ctx || !ctx->is_raw || !planes || !strides) return -1;
+    if (!ctx->async) return -1;
+    AsyncSlot* slot = claim_slot(ctx, config);
+    if (!slot) return ENGINE_ASYNC_FULL;
+
+    enum AVPixelFormat pix_fmt = ctx->dec_codec_ctx->pix_fmt;
+    const uint8_t* src[4] = { NULL, NULL, NULL, NULL };
+    int src_linesize[4] = { 0, 0, 0, 0 };
+    int num_planes = av_pix_fmt_count_planes(pix_fmt);
+    for (int p = 0; p < num_planes && p < 4; p++) {
+        if (!planes[p]) return release_slot(ctx, slot);
+        src[p] = planes[p];
+        src_linesize[p] = strides[p];
+    }
+    slot->frame->format = pix_fmt;
+    slot->frame->width = ctx->dec_codec_ctx->width;
+    slot->frame->height = ctx->dec_codec_ctx->height;
+    if (av_frame_get_buffer(slot->frame, 0) < 0) return release_slot(ctx, slot);
+    av_image_copy(slot->frame->data, slot->frame->linesize, src, src_linesize,
+                  pix_fmt, slot->frame->width, slot->frame->height);
+    slot->frame->pts = pts;
+    slot->is_buffer = 1;
+    return queue_slot(ctx, slot);
+}
+
+static int collect_slot(AsyncSlot* slot, EngineCellGrid* grid, EngineFrameInfo* info) {
+    if (grid) *grid = slot->grid;
+    if (info) *info = slot->info;
+    return slot->status == 0 ? 1 : -1;
+}
+
+static AsyncSlot* find_ticket(AsyncPipeline* ap, int64_t ticket) {
+    if (ticket < 0) return NULL;
+    AsyncSlot* slot = &ap->slots[ticket % ap->depth];
+    return (slot->ticket == ticket && (slot->state == SLOT_QUEUED || slot->state == SLOT_DONE)) ? slot : NULL;
+}
+
+int engine_poll(ProcessingContext* ctx, int64_t ticket, EngineCellGrid* grid, EngineFrameInfo* info) {
+    if (!ctx || !ctx->async) return -1;
+    AsyncPipeline* ap = ctx->async;
+    pthread_mutex_lock(&ap->lock);
+    AsyncSlot* slot = find_ticket(ap, ticket);
+    int ret = !slot ? -1 : (slot->state == SLOT_DONE ? collect_slot(slot, grid, info) : 0);
+    pthread_mutex_unlock(&ap->lock);
+    return ret;
+}
+
+int engine_wait(ProcessingContext* ctx, int64_t ticket, EngineCellGrid* grid, EngineFrameInfo* info) {
+    if (!ctx || !ctx->async) return -1;
+    AsyncPipeline* ap = ctx->async;
+    pthread_mutex_lock(&ap->lock);
+    AsyncSlot* slot = find_ticket(ap, ticket);
+    while (slot && slot->state == SLOT_QUEUED) {
+        pthread_cond_wait(&ap->done, &ap->lock);
+    }
+    int ret = slot ? collect_slot(slot, grid, info) : -1;
+    pthread_mutex_unlock(&ap->lock);
+    return ret;
+}
+
+void engine_release_ticket(ProcessingContext* ctx, int64_t ticket) {
+    if (!ctx || !ctx->async) return;
+    AsyncPipeline* ap = ctx->async;
+    pthread_mutex_lock(&ap->lock);
+    AsyncSlot* slot = find_ticket(ap, ticket);
+    if (slot && slot->state == SLOT_DONE) slot->state = SLOT_FREE;
+    pthread_mutex_unlock(&ap->lock);
+}
+
+int engine_render_contact_sheet(ProcessingContext* ctx, const EngineConfig* config, int cols, int rows) {
+    if (!ctx || !ctx->dec_fmt_ctx || cols <= 0 || rows <= 0) return -1;
+    config = sync_config(ctx, config);
+
+    AVStream* stream = ctx->dec_fmt_ctx->streams[ctx->video_stream_idx];
+    int64_t start_time = (stream->start_time != AV_NOPTS_VALUE) ? stream->start_time : 0;
+    int64_t duration = stream->duration;
+    if (duration == AV_NOPTS_VALUE || duration <= 0) {
+        if (ctx->dec_fmt_ctx->duration == AV_NOPTS_VALUE || ctx->dec_fmt_ctx->duration <= 0) return -1;
+        duration = av_rescale_q(ctx->dec_fmt_ctx->duration, AV_TIME_BASE_Q, stream->time_base);
+    }
+
+    // Why build one mosaic? Once every thumbnail sits in its own tile of the RGB
+    // frame, the sheet is just another picture. The regular worker pool then
+    // converts all tiles in one parallel pass, and the PNG and console paths
+    // work unchanged.
+    int width = ctx->src_width;
+    int height = ctx->src_height;
+    SheetJob job = { ctx, cols, rows, width / cols, height / rows, 0, start_time, duration, 0 };
+    job.gap = job.tile_w / 24 > 2 ? job.tile_w / 24 : 2;
+    if (job.tile_w <= 2 * job.gap || job.tile_h <= 2 * job.gap) return -1;
+
+    uint8_t* rgb = ctx->rgb_frame->data[0];
+    int stride = ctx->rgb_frame->linesize[0];
+    for (int y = 0; y < height; y++) memset(rgb + (size_t)y * stride, 0, (size_t)width * 3);
+
+    int workers = ctx->num_threads < cols * rows ? ctx->num_threads : cols * rows;
+    SheetWorker* pool = (SheetWorker*)calloc((size_t)workers, sizeof(SheetWorker));
+    pthread_t* threads = (pthread_t*)calloc((size_t)workers, sizeof(pthread_t));
+    if (!pool || !threads) { free(pool); free(threads); return -1; }
+
+    enum AVDiscard saved_skip = ctx->dec_codec_ctx->skip_frame;
+    ctx->dec_codec_ctx->skip_frame = AVDISCARD_NONKEY;
+    pool[0] = (SheetWorker){ &job, ctx->dec_fmt_ctx, ctx->dec_codec_ctx, ctx->decoded_frame, 0, 0 };
+    int started = 1;
+    for (; started < workers; started++) {
+        pool[started].job = &job;
+        pool[started].owned = 1;
+        if (pthread_create(&threads[started], NULL, contact_sheet_worker, &pool[started]) != 0) break;
+    }
+    contact_sheet_worker(&pool[0]);
+
+    int drawn = pool[0].drawn;
+    for (int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        drawn += pool[i].drawn;
+        av_frame_free(&pool[i].frame);
+        avcodec_free_context(&pool[i].dec);
+        avformat_close_input(&pool[i].fmt);
+    }
+    free(pool);
+    free(threads);
+    ctx->dec_codec_ctx->skip_frame = saved_skip;
+    if (drawn == 0) return -1;
+
+    if (alloc_cell_grid(ctx) != 0) return -1;
+    ctx->current_pts = AV_NOPTS_VALUE;
+    run_cell_workers(ctx, config, NULL);
+    publish_frame(ctx);
+    return 0;
+}
+
+enum { EDGE_VERTICAL, EDGE_HORIZONTAL, EDGE_DIAGONAL1, EDGE_DIAGONAL2 };
+
+// Why this logic? The ratio of gx to gy tells us the angle of the
+// gradient. A large gy/gx ratio means a near-vertical edge. A large
+// gx/gy ratio means a near-horizontal one. The sign of gx*gy tells
+// us the diagonal direction. This allows us to select a character
+// that visually matches the edge's orientation.
+static inline int edge_orientation(float gx, float gy) {
+    const float D_THRESH = 2.41421356f; // tan(67.5 degrees)
+    if (fabsf(gy) > fabsf(gx) * D_THRESH) return EDGE_VERTICAL;
+    if (fabsf(gx) > fabsf(gy) * D_THRESH) return EDGE_HORIZONTAL;
+    return (gx * gy > 0) ? EDGE_DIAGONAL1 : EDGE_DIAGONAL2;
+}
+
+static inline char classify_cell(const ProcessingContext* ctx, int is_edge, int orientation, uint8_t level) {
+    if (!is_edge) return ctx->char_lut_flat[level];
+    switch (orientation) {
+        case EDGE_VERTICAL: return ctx->char_lut_vert[level];
+        case EDGE_HORIZONTAL: return ctx->char_lut_horz[level];
+        case EDGE_DIAGONAL1: return ctx->char_lut_diag1[level];
+        default: return ctx->char_lut_diag2[level];
+    }
+}
+
+// Classifies one cell from its Sobel response and stores glyph, planes and colour.
+// Both kernels end here, so they agree on everything past the arithmetic.
+static inline void finish_cell(ProcessingContext* ctx, int art_idx, float gx, float gy, float center_luma,
+                               float edge_strength_sq, int retain, const uint8_t* p_color) {
+    float mag_sq = (gx * gx + gy * gy) / (255.0f * 255.0f);
+
+    // This is the optimization. Instead of a costly powf() call for every
+    // pixel, we use a single, fast lookup into our pre-calculated table.
+    uint8_t brightness_idx = ctx->gamma_lut[(uint8_t)center_luma];
+
+    int is_edge = mag_sq >= edge_strength_sq;
+    int orientation = (is_edge || retain) ? edge_orientation(gx, gy) : EDGE_VERTICAL;
+    ctx->char_buffer[art_idx] = classify_cell(ctx, is_edge, orientation, brightness_idx);
+    if (retain) {
+        ctx->plane_magnitude[art_idx] = mag_sq;
+        ctx->plane_orientation[art_idx] = (uint8_t)orientation;
+        ctx->plane_level[art_idx] = brightness_idx;
+    }
+    ctx->color_buffer[art_idx * 3 + 0] = p_color[0];
+    ctx->color_buffer[art_idx * 3 + 1] = p_color[1];
+    ctx->color_buffer[art_idx * 3 + 2] = p_color[2];
+}
+
+static inline void process_cell_scalar(ProcessingContext* ctx, int x, int y, float edge_strength_sq, int retain) {
+    int width = ctx->src_width;
+    int height = ctx->src_height;
     uint8_t* data = ctx->rgb_frame->data[0];
     int stride = ctx->rgb_frame->linesize[0];
 
-    const float edge_strength_sq = config->edge_strength * config->edge_strength;
+    int source_x = (int)((float)x / ctx->ascii_width * width);
+    int source_y = (int)((float)y / ctx->ascii_height * height);
 
-    for (int y = args->start_row; y < args->end_row; y++) {
-        for (int x = 0; x < ctx->ascii_width; x++) {
-            int source_x = (int)((float)x / ctx->ascii_width * width);
-            int source_y = (int)((float)y / ctx->ascii_height * height);
-
-            float gx = 0.0f, gy = 0.0f;
-            float center_luma = 0.0f;
-
-            // Why Sobel? It's a fundamental, efficient way to calculate the image
-            // gradient. By sampling a 3x3 grid, we approximate the derivative in
-            // both X and Y directions, giving us the information needed to detect
-            // edges and their orientation. It's a classic for a reason.
-            const int sobel_y[3][3] = {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}};
-            const int sobel_x[3][3] = {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}};
-
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    int sx = source_x + kx;
-                    int sy = source_y + ky;
-                    sx = (sx < 0) ? 0 : (sx >= width ? width - 1 : sx);
-                    sy = (sy < 0) ? 0 : (sy >= height ? height - 1 : sy);
+    float gx = 0.0f, gy = 0.0f;
+    float center_luma = 0.0f;
 
-                    uint8_t* p = data + (sy * stride + sx * 3);
-                    float luma = (0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+    // Why Sobel? It's a fundamental, efficient way to calculate the image
+    // gradient. By sampling a 3x3 grid, we approximate the derivative in
+    // both X and Y directions, giving us the information needed to detect
+    // edges and their orientation. It's a classic for a reason.
+    const int sobel_y[3][3] = {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}};
+    const int sobel_x[3][3] = {{1, 0, -1}, {2, 0, -2}, {1, 0, -1}};
 
-                    gx += luma * sobel_x[ky + 1][kx + 1];
-                    gy += luma * sobel_y[ky + 1][kx + 1];
+    for (int ky = -1; ky <= 1; ky++) {
+        for (int kx = -1; kx <= 1; kx++) {
+            int sx = source_x + kx;
+            int sy = source_y + ky;
+            sx = (sx < 0) ? 0 : (sx >= width ? width - 1 : sx);
+            sy = (sy < 0) ? 0 : (sy >= height ? height - 1 : sy);
 
-                    if (kx == 0 && ky == 0) {
-                        center_luma = luma;
-                    }
+            uint8_t* p = data + (sy * stride + sx * 3);
+            float luma = (0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+
+            gx += luma * sobel_x[ky + 1][kx + 1];
+            gy += luma * sobel_y[ky + 1][kx + 1];
+
+            if (kx == 0 && ky == 0) {
+                center_luma = luma;
+            }
+        }
+    }
+
+    finish_cell(ctx, y * ctx->ascii_width + x, gx, gy, center_luma, edge_strength_sq, retain,
+                data + (source_y * stride + source_x * 3));
+}
+
+// Why four cells at a time rather than four pixels? The cells sample sparse
+// points of the source, so there is no contiguous run of pixels to load. The
+// nine taps of four neighbouring cells are gathered into lanes instead, and
+// the luma, the six non-zero Sobel terms and the sums run four-wide. Each row
+// of cells shares its three clamped source rows, so the row clamping is
+// hoisted out of the loop. Leftover cells at the end of a row go scalar.
+static void process_rows_simd(ProcessingContext* ctx, const EngineConfig* config, int start_row, int end_row) {
+    int width = ctx->src_width;
+    int height = ctx->src_height;
+    const uint8_t* data = ctx->rgb_frame->data[0];
+    int stride = ctx->rgb_frame->linesize[0];
+    const float edge_strength_sq = config->edge_strength * config->edge_strength;
+    const int retain = ctx->retain_planes;
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    for (int y = start_row; y < end_row; y++) {
+        int source_y = (int)((float)y / ctx->ascii_height * height);
+        const uint8_t* rows[3];
+        for (int k = 0; k < 3; k++) {
+            int sy = source_y + k - 1;
+            sy = (sy < 0) ? 0 : (sy >= height ? height - 1 : sy);
+            rows[k] = data + (size_t)sy * stride;
+        }
+
+        int x = 0;
+        for (; x + 4 <= ctx->ascii_width; x += 4) {
+            int cols[3][4]; // Byte offsets of the left, centre and right taps per lane.
+            for (int lane = 0; lane < 4; lane++) {
+                int source_x = (int)((float)(x + lane) / ctx->ascii_width * width);
+                for (int k = 0; k < 3; k++) {
+                    int sx = source_x + k - 1;
+                    sx = (sx < 0) ? 0 : (sx >= width ? width - 1 : sx);
+                    cols[k][lane] = sx * 3;
                 }
             }
-            
-            float mag_sq = (gx * gx + gy * gy) / (255.0f * 255.0f);
-            
-            // This is the optimization. Instead of a costly powf() call for every
-            // pixel, we use a single, fast lookup into our pre-calculated table.
-            uint8_t brightness_idx = ctx->gamma_lut[(uint8_t)center_luma];
-
-            char selected_char;
-            if (mag_sq < edge_strength_sq) {
-                selected_char = ctx->char_lut_flat[brightness_idx];
-            } else {
-                // Why this logic? The ratio of gx to gy tells us the angle of the
-                // gradient. A large gy/gx ratio means a near-vertical edge. A large
-                // gx/gy ratio means a near-horizontal one. The sign of gx*gy tells
-                // us the diagonal direction. This allows us to select a character
-                // that visually matches the edge's orientation.
-                const float D_THRESH = 2.41421356f; // tan(67.5 degrees)
-                if (fabsf(gy) > fabsf(gx) * D_THRESH) {
-                    selected_char = ctx->char_lut_vert[brightness_idx];
-                } else if (fabsf(gx) > fabsf(gy) * D_THRESH) {
-                    selected_char = ctx->char_lut_horz[brightness_idx];
-                } else {
-                    selected_char = (gx * gy > 0) ? ctx->char_lut_diag1[brightness_idx]
-                                                  : ctx->char_lut_diag2[brightness_idx];
+
+            __m128 l[3][3];
+            for (int ky = 0; ky < 3; ky++) {
+                for (int kx = 0; kx < 3; kx++) {
+                    const uint8_t* r = rows[ky];
+                    l[ky][kx] = luma_of_4_pixels(r + cols[kx][0], r + cols[kx][1], r + cols[kx][2], r + cols[kx][3]);
                 }
             }
+            // The terms are summed in the scalar loop's tap order (its zero
+            // taps add nothing), so both kernels round identically.
+            __m128 gx_v = _mm_sub_ps(l[0][0], l[0][2]);
+            gx_v = _mm_add_ps(gx_v, _mm_mul_ps(two, l[1][0]));
+            gx_v = _mm_sub_ps(gx_v, _mm_mul_ps(two, l[1][2]));
+            gx_v = _mm_add_ps(gx_v, l[2][0]);
+            gx_v = _mm_sub_ps(gx_v, l[2][2]);
+            __m128 gy_v = _mm_add_ps(l[0][0], _mm_mul_ps(two, l[0][1]));
+            gy_v = _mm_add_ps(gy_v, l[0][2]);
+            gy_v = _mm_sub_ps(gy_v, l[2][0]);
+            gy_v = _mm_sub_ps(gy_v, _mm_mul_ps(two, l[2][1]));
+            gy_v = _mm_sub_ps(gy_v, l[2][2]);
+
+            float gx[4], gy[4], center[4];
+            _mm_storeu_ps(gx, gx_v);
+            _mm_storeu_ps(gy, gy_v);
+            _mm_storeu_ps(center, l[1][1]);
+            for (int lane = 0; lane < 4; lane++) {
+                finish_cell(ctx, y * ctx->ascii_width + x + lane, gx[lane], gy[lane], center[lane],
+                            edge_strength_sq, retain, rows[1] + cols[1][lane]);
+            }
+        }
+        for (; x < ctx->ascii_width; x++) {
+            process_cell_scalar(ctx, x, y, edge_strength_sq, retain);
+        }
+    }
+}
 
-            int art_idx = y * ctx->ascii_width + x;
-            ctx->char_buffer[art_idx] = selected_char;
-            uint8_t* p_color = data + (source_y * stride + source_x * 3);
-            ctx->color_buffer[art_idx * 3 + 0] = p_color[0];
-            ctx->color_buffer[art_idx * 3 + 1] = p_color[1];
-            ctx->color_buffer[art_idx * 3 + 2] = p_color[2];
+static void process_slice(ProcessingContext* ctx, const EngineConfig* config, int start_row, int end_row) {
+    if (config->use_simd) {
+        process_rows_simd(ctx, config, start_row, end_row);
+        return;
+    }
+
+    const float edge_strength_sq = config->edge_strength * config->edge_strength;
+    const int retain = ctx->retain_planes;
+    for (int y = start_row; y < end_row; y++) {
+        for (int x = 0; x < ctx->ascii_width; x++) {
+            process_cell_scalar(ctx, x, y, edge_strength_sq, retain);
         }
     }
+}
+
+static void* process_slice_worker(void* arg) {
+    ThreadArgs* args = (ThreadArgs*)arg;
+    ProcessingContext* ctx = args->ctx;
+    stats_slot = 2 + (int)(args - ctx->worker_args);
+    StageMark mark;
+    mark_begin(ctx, &mark);
+    int rows = 0;
+    if (args->band_rows > 0) {
+        for (int y = args->start_row; y < args->end_row; y += args->band_step) {
+            int end = y + args->band_rows < args->end_row ? y + args->band_rows : args->end_row;
+            process_slice(ctx, args->config, y, end);
+            rows += end - y;
+        }
+    } else {
+        process_slice(ctx, args->config, args->start_row, args->end_row);
+        rows = args->end_row - args->start_row;
+    }
+    mark_end(ctx, ENGINE_STAGE_KERNEL, &mark, (int64_t)rows * ctx->ascii_width * 4);
+    // This thread ends with the frame; its group must not outlive it.
+    if (mark.counting) perf_counters_release(ctx->counters, stats_slot);
     return NULL;
 }
 
 
-void engine_render_to_console(ProcessingContext* ctx, const EngineConfig* config) {
-    // Why use an arena-allocated buffer? Building the entire frame string in memory
-    // before printing avoids thousands of tiny printf calls, which would cause
-    // flickering and be incredibly slow. We do one single, massive write to stdout,
-    // ensuring the frame appears atomically.
-    size_t full_buffer_size = (size_t)(ctx->ascii_width * 20 + 2) * ctx->ascii_height;
-    char* full_frame_buffer = (char*)arena_alloc(&ctx->frame_arena, full_buffer_size);
-    if (!full_frame_buffer) return;
+// Why do saturation math in floating point? It provides more precision
+// and avoids clipping/overflow issues inherent in integer math. We convert
+// to HSV-like space (by finding luma), apply the saturation factor,
+// and then convert back, clamping only at the very end.
+static inline void grade_color(const EngineConfig* config, const unsigned char* rgb,
+                               unsigned char* r, unsigned char* g, unsigned char* b) {
+    unsigned char r_in = rgb[0];
+    unsigned char g_in = rgb[1];
+    unsigned char b_in = rgb[2];
+    if (config->saturation_factor != 1.0f) {
+        float luma = (0.299f * r_in + 0.587f * g_in + 0.114f * b_in);
+        float r_f = luma + config->saturation_factor * (r_in - luma);
+        float g_f = luma + config->saturation_factor * (g_in - luma);
+        float b_f = luma + config->saturation_factor * (b_in - luma);
+        r_in = (r_f > 255.0f) ? 255 : ((r_f < 0) ? 0 : (unsigned char)r_f);
+        g_in = (g_f > 255.0f) ? 255 : ((g_f < 0) ? 0 : (unsigned char)g_f);
+        b_in = (b_f > 255.0f) ? 255 : ((b_f < 0) ? 0 : (unsigned char)b_f);
+    }
+
+    float r_f = r_in * config->brightness_factor;
+    float g_f = g_in * config->brightness_factor;
+    float b_f = b_in * config->brightness_factor;
+
+    *r = (r_f > 255.0f) ? 255 : (unsigned char)r_f;
+    *g = (g_f > 255.0f) ? 255 : (unsigned char)g_f;
+    *b = (b_f > 255.0f) ? 255 : (unsigned char)b_f;
+}
 
-    char* buf_ptr = full_frame_buffer;
+// Why 20 bytes per cell? "\x1b[38;2;255;255;255m" plus the glyph is the
+// longest a colored cell can get; each row adds a newline.
+size_t engine_format_ansi(ProcessingContext* ctx, const EngineConfig* config, char* buffer, size_t size) {
+    config = sync_config(ctx, config);
+    size_t required = (size_t)(ctx->ascii_width * 20 + 1) * ctx->ascii_height + 1;
+    if (!buffer) return required;
+    if (size < required || !ctx->char_buffer) return 0;
+
+    StageMark mark;
+    mark_begin(ctx, &mark);
+    char* buf_ptr = buffer;
     for (int y = 0; y < ctx->ascii_height; y++) {
         for (int x = 0; x < ctx->ascii_width; x++) {
             int idx = y * ctx->ascii_width + x;
             if (config->use_color) {
-                unsigned char r = ctx->color_buffer[idx * 3 + 0];
-                unsigned char g = ctx->color_buffer[idx * 3 + 1];
-                unsigned char b = ctx->color_buffer[idx * 3 + 2];
+                unsigned char r, g, b;
+                grade_color(config, &ctx->color_buffer[idx * 3], &r, &g, &b);
                 buf_ptr += sprintf(buf_ptr, "\x1b[38;2;%d;%d;%dm%c", r, g, b, ctx->char_buffer[idx]);
             } else {
                 *buf_ptr++ = ctx->char_buffer[idx];
@@ -502,16 +1744,35 @@ void engine_render_to_console(ProcessingContext* ctx, const EngineConfig* config
         *buf_ptr++ = '\n';
     }
     *buf_ptr = '\0';
+    mark_end(ctx, ENGINE_STAGE_FORMAT, &mark, buf_ptr - buffer);
+    return (size_t)(buf_ptr - buffer);
+}
+
+void engine_render_to_console(ProcessingContext* ctx, const EngineConfig* config) {
+    config = sync_config(ctx, config);
+    // Why use an arena-allocated buffer? Building the entire frame string in memory
+    // before printing avoids thousands of tiny printf calls, which would cause
+    // flickering and be incredibly slow. We do one single, massive write to stdout,
+    // ensuring the frame appears atomically.
+    size_t full_buffer_size = engine_format_ansi(ctx, config, NULL, 0);
+    char* full_frame_buffer = (char*)arena_alloc(&ctx->frame_arena, full_buffer_size);
+    if (!full_frame_buffer) return;
+    if (engine_format_ansi(ctx, config, full_frame_buffer, full_buffer_size) == 0) return;
+
     // Why \x1b[H? This is an ANSI escape code that moves the cursor to the home
     // position (top-left). This allows us to overwrite the previous frame in-place
     // in the terminal, creating a smooth animation instead of a scrolling mess.
-    printf("\x1b[H%s", full_frame_buffer);
+    int64_t start = stage_begin(ctx);
+    int written = printf("\x1b[H%s", full_frame_buffer);
     fflush(stdout);
+    stage_end(ctx, ENGINE_STAGE_OUTPUT, start, written > 0 ? written : 0);
 }
 
 static void render_ascii_to_buffer(ProcessingContext* ctx, unsigned char* buffer, const EngineConfig* config) {
     int out_img_width = ctx->ascii_width * 8;
     int out_img_height = ctx->ascii_height * 8;
+    StageMark mark;
+    mark_begin(ctx, &mark);
     memset(buffer, 0, (size_t)out_img_width * out_img_height * 3);
 
     for (int y = 0; y < ctx->ascii_height; y++) {
@@ -520,31 +1781,8 @@ static void render_ascii_to_buffer(ProcessingContext* ctx, unsigned char* buffer
             unsigned char char_code = (unsigned char)ctx->char_buffer[art_idx];
             unsigned char* glyph = (unsigned char*)font8x8_basic[char_code];
 
-            unsigned char r_in = ctx->color_buffer[art_idx * 3 + 0];
-            unsigned char g_in = ctx->color_buffer[art_idx * 3 + 1];
-            unsigned char b_in = ctx->color_buffer[art_idx * 3 + 2];
-
-            // Why do saturation math in floating point? It provides more precision
-            // and avoids clipping/overflow issues inherent in integer math. We convert
-            // to HSV-like space (by finding luma), apply the saturation factor,
-            // and then convert back, clamping only at the very end.
-            if (config->saturation_factor != 1.0f) {
-                float luma = (0.299f * r_in + 0.587f * g_in + 0.114f * b_in);
-                float r_f = luma + config->saturation_factor * (r_in - luma);
-                float g_f = luma + config->saturation_factor * (g_in - luma);
-                float b_f = luma + config->saturation_factor * (b_in - luma);
-                r_in = (r_f > 255.0f) ? 255 : ((r_f < 0) ? 0 : (unsigned char)r_f);
-                g_in = (g_f > 255.0f) ? 255 : ((g_f < 0) ? 0 : (unsigned char)g_f);
-                b_in = (b_f > 255.0f) ? 255 : ((b_f < 0) ? 0 : (unsigned char)b_f);
-            }
-
-            float r_f = r_in * config->brightness_factor;
-            float g_f = g_in * config->brightness_factor;
-            float b_f = b_in * config->brightness_factor;
-
-            unsigned char r = (r_f > 255.0f) ? 255 : (unsigned char)r_f;
-            unsigned char g = (g_f > 255.0f) ? 255 : (unsigned char)g_f;
-            unsigned char b = (b_f > 255.0f) ? 255 : (unsigned char)b_f;
+            unsigned char r, g, b;
+            grade_color(config, &ctx->color_buffer[art_idx * 3], &r, &g, &b);
 
             for (int gy = 0; gy < 8; gy++) {
                 for (int gx = 0; gx < 8; gx++) {
@@ -560,9 +1798,11 @@ static void render_ascii_to_buffer(ProcessingContext* ctx, unsigned char* buffer
             }
         }
     }
+    mark_end(ctx, ENGINE_STAGE_RASTER, &mark, (int64_t)out_img_width * out_img_height * 3);
 }
 
 int engine_render_to_image_file(ProcessingContext* ctx, const EngineConfig* config) {
+    config = sync_config(ctx, config);
     int out_img_width = ctx->ascii_width * 8;
     int out_img_height = ctx->ascii_height * 8;
     unsigned char* out_img_data = (unsigned char*)calloc((size_t)out_img_width * out_img_height * 3, 1);
@@ -570,16 +1810,56 @@ int engine_render_to_image_file(ProcessingContext* ctx, const EngineConfig* conf
 
     render_ascii_to_buffer(ctx, out_img_data, config);
 
+    int64_t start = stage_begin(ctx);
     if (stbi_write_png(config->output_filename, out_img_width, out_img_height, 3, out_img_data, out_img_width * 3) == 0) {
         free(out_img_data);
         return -1;
     }
-    
+    struct stat st;
+    stage_end(ctx, ENGINE_STAGE_ENCODE, start, stat(config->output_filename, &st) == 0 ? st.st_size : 0);
+
     free(out_img_data);
     return 0;
 }
 
-static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* config) {
+int engine_render_to_rgb(ProcessingContext* ctx, const EngineConfig* config, unsigned char* rgb, size_t size) {
+    config = sync_config(ctx, config);
+    if (!ctx->char_buffer || size < (size_t)ctx->ascii_width * 8 * ctx->ascii_height * 8 * 3) return -1;
+    render_ascii_to_buffer(ctx, rgb, config);
+    return 0;
+}
+
+int engine_render_to_png_memory(ProcessingContext* ctx, const EngineConfig* config, unsigned char** png, int* png_size) {
+    config = sync_config(ctx, config);
+    int out_img_width = ctx->ascii_width * 8;
+    int out_img_height = ctx->ascii_height * 8;
+    unsigned char* out_img_data = (unsigned char*)calloc((size_t)out_img_width * out_img_height * 3, 1);
+    if (!out_img_data) { return -1; }
+
+    render_ascii_to_buffer(ctx, out_img_data, config);
+    int64_t start = stage_begin(ctx);
+    *png = stbi_write_png_to_mem(out_img_data, out_img_width * 3, out_img_width, out_img_height, 3, png_size);
+    stage_end(ctx, ENGINE_STAGE_ENCODE, start, *png ? *png_size : 0);
+    free(out_img_data);
+    return *png ? 0 : -1;
+}
+
+static void release_encoder(ProcessingContext* ctx) {
+    if (ctx->yuv_frame) { av_freep(&ctx->yuv_frame->data[0]); av_frame_free(&ctx->yuv_frame); }
+    if (ctx->enc_codec_ctx) avcodec_free_context(&ctx->enc_codec_ctx);
+    if (ctx->enc_fmt_ctx) {
+        if (!(ctx->enc_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&ctx->enc_fmt_ctx->pb);
+        }
+        avformat_free_context(ctx->enc_fmt_ctx);
+        ctx->enc_fmt_ctx = NULL;
+    }
+    if (ctx->sws_ctx_to_yuv) { sws_freeContext(ctx->sws_ctx_to_yuv); ctx->sws_ctx_to_yuv = NULL; }
+    ctx->out_video_stream = NULL;
+    ctx->out_audio_stream = NULL;
+}
+
+static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* config, const char* filename) {
     int out_width = ctx->ascii_width * 8;
     int out_height = ctx->ascii_height * 8;
 
@@ -590,13 +1870,12 @@ static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* conf
         fprintf(stderr, "WARNING: Requested resolution (%dx%d) is extremely high and may exceed standard H.264 limits, potentially creating an incompatible file.\n", out_width, out_height);
     }
 
-    avformat_alloc_output_context2(&ctx->enc_fmt_ctx, NULL, NULL, config->output_filename);
+    avformat_alloc_output_context2(&ctx->enc_fmt_ctx, NULL, NULL, filename);
     if (!ctx->enc_fmt_ctx) { return "Could not create output context"; }
 
     ctx->enc_codec = avcodec_find_encoder(AV_CODEC_ID_H264);
     if (!ctx->enc_codec) { return "H.264 encoder not found"; }
     
-    AVStream* in_stream = ctx->dec_fmt_ctx->streams[ctx->video_stream_idx];
     ctx->out_video_stream = avformat_new_stream(ctx->enc_fmt_ctx, ctx->enc_codec);
     if (!ctx->out_video_stream) { return "Failed to create new video stream"; }
     ctx->enc_codec_ctx = avcodec_alloc_context3(ctx->enc_codec);
@@ -604,10 +1883,10 @@ static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* conf
 
     ctx->enc_codec_ctx->height = out_height;
     ctx->enc_codec_ctx->width = out_width;
-    ctx->enc_codec_ctx->sample_aspect_ratio = in_stream->codecpar->sample_aspect_ratio;
+    ctx->enc_codec_ctx->sample_aspect_ratio = ctx->sample_aspect_ratio;
     ctx->enc_codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    ctx->enc_codec_ctx->time_base = in_stream->time_base;
-    ctx->enc_codec_ctx->framerate = in_stream->r_frame_rate;
+    ctx->enc_codec_ctx->time_base = ctx->time_base;
+    ctx->enc_codec_ctx->framerate = ctx->frame_rate;
 
     if (ctx->enc_fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
         ctx->enc_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
@@ -627,7 +1906,10 @@ static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* conf
     }
     ctx->out_video_stream->time_base = ctx->enc_codec_ctx->time_base;
 
-    if (ctx->audio_stream_idx >= 0) {
+    // Why no audio in a shard or checkpoint segment? Each segment covers an
+    // arbitrary slice of the timeline; the concat step copies the original
+    // audio once, untouched.
+    if (ctx->audio_stream_idx >= 0 && config->shard_count <= 0 && config->checkpoint_secs <= 0.0f) {
         AVStream* in_audio_stream = ctx->dec_fmt_ctx->streams[ctx->audio_stream_idx];
         ctx->out_audio_stream = avformat_new_stream(ctx->enc_fmt_ctx, NULL);
         if (!ctx->out_audio_stream) { return "Failed to create new audio stream"; }
@@ -638,7 +1920,7 @@ static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* conf
     }
 
     if (!(ctx->enc_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        if (avio_open(&ctx->enc_fmt_ctx->pb, config->output_filename, AVIO_FLAG_WRITE) < 0) { return "Could not open output file"; }
+        if (avio_open(&ctx->enc_fmt_ctx->pb, filename, AVIO_FLAG_WRITE) < 0) { return "Could not open output file"; }
     }
 
     if (avformat_write_header(ctx->enc_fmt_ctx, NULL) < 0) { return "Error occurred when opening output file"; }
@@ -658,7 +1940,19 @@ static const char* init_encoder(ProcessingContext* ctx, const EngineConfig* conf
     return NULL;
 }
 
+// Writes one packet and returns the nanoseconds it took (0 with stats off).
+static int64_t write_packet(ProcessingContext* ctx, AVPacket* pkt) {
+    int64_t start = stage_begin(ctx);
+    int64_t size = pkt->size;
+    av_interleaved_write_frame(ctx->enc_fmt_ctx, pkt);
+    if (!stage_timing(ctx)) return 0;
+    int64_t end = monotonic_ns();
+    record_span(ctx, ENGINE_STAGE_MUX, start, end, 0, size);
+    return end - start;
+}
+
 int engine_encode_video_frame(ProcessingContext* ctx, const struct AVFrame* original_frame, const EngineConfig* config) {
+    config = sync_config(ctx, config);
     int out_width = ctx->ascii_width * 8;
     int out_height = ctx->ascii_height * 8;
     unsigned char* rgb_buffer = (unsigned char*)arena_alloc(&ctx->frame_arena, (size_t)out_width * out_height * 3);
@@ -667,10 +1961,16 @@ int engine_encode_video_frame(ProcessingContext* ctx, const struct AVFrame* orig
 
     const uint8_t* const in_data[1] = { rgb_buffer };
     const int in_linesize[1] = { out_width * 3 };
+    int64_t start = stage_begin(ctx);
     sws_scale(ctx->sws_ctx_to_yuv, in_data, in_linesize, 0, out_height, ctx->yuv_frame->data, ctx->yuv_frame->linesize);
+    stage_end(ctx, ENGINE_STAGE_YUV, start, (int64_t)out_width * out_height * 3 / 2);
 
     ctx->yuv_frame->pts = original_frame->pts;
 
+    // Why subtract the mux time? The packets are written from inside the
+    // encoder's drain loop; without it, ENCODE would also count file I/O.
+    start = stage_begin(ctx);
+    int64_t mux_ns = 0, encoded_bytes = 0;
     int ret = avcodec_send_frame(ctx->enc_codec_ctx, ctx->yuv_frame);
     if (ret < 0) { 
         fprintf(stderr, "Error sending frame to encoder.\n");
@@ -684,10 +1984,13 @@ int engine_encode_video_frame(ProcessingContext* ctx, const struct AVFrame* orig
         if (ret < 0) { av_packet_free(&pkt); return -1; }
 
         pkt->stream_index = ctx->out_video_stream->index;
-        av_interleaved_write_frame(ctx->enc_fmt_ctx, pkt);
+        encoded_bytes += pkt->size;
+        mux_ns += write_packet(ctx, pkt);
         av_packet_unref(pkt);
     }
     av_packet_free(&pkt);
+    if (stage_timing(ctx)) record_span(ctx, ENGINE_STAGE_ENCODE, start, monotonic_ns(), mux_ns, encoded_bytes);
+    ctx->frames_encoded++;
     return 0;
 }
 
@@ -697,12 +2000,16 @@ int engine_remux_packet(ProcessingContext* ctx, AVPacket* packet) {
     // the compressed audio packets from the input container to the output
     // container, modifying only the timestamps to ensure they stay in sync with
     // our newly generated video stream. It's the most efficient path.
-    if (ctx->audio_stream_idx >= 0 && packet->stream_index == ctx->audio_stream_idx) {
+    if (ctx->audio_stream_idx >= 0 && ctx->out_audio_stream && packet->stream_index == ctx->audio_stream_idx) {
         packet->stream_index = ctx->out_audio_stream->index;
         av_packet_rescale_ts(packet,
                              ctx->dec_fmt_ctx->streams[ctx->audio_stream_idx]->time_base,
                              ctx->out_audio_stream->time_base);
-        return av_interleaved_write_frame(ctx->enc_fmt_ctx, packet);
+        int64_t start = stage_begin(ctx);
+        int64_t size = packet->size;
+        int ret = av_interleaved_write_frame(ctx->enc_fmt_ctx, packet);
+        stage_end(ctx, ENGINE_STAGE_MUX, start, size);
+        return ret;
     }
     return 0;
 }
@@ -713,19 +2020,69 @@ void engine_finalize_video_encoder(ProcessingContext* ctx) {
     // frame signals the end of the stream, forcing the encoder to output any
     // remaining buffered frames. Without this step, the last few frames of the
     // video would be lost.
+    if (!ctx || !ctx->enc_codec_ctx) return;
     avcodec_send_frame(ctx->enc_codec_ctx, NULL);
     AVPacket* pkt = av_packet_alloc();
     int ret;
     while(1) {
         ret = avcodec_receive_packet(ctx->enc_codec_ctx, pkt);
         if (ret == AVERROR_EOF || ret < 0) break;
-        av_interleaved_write_frame(ctx->enc_fmt_ctx, pkt);
+        write_packet(ctx, pkt);
         av_packet_unref(pkt);
     }
     av_packet_free(&pkt);
     av_write_trailer(ctx->enc_fmt_ctx);
 }
 
+int engine_open_segment(ProcessingContext* ctx, const EngineConfig* config, const char* filename, char** error) {
+    config = sync_config(ctx, config);
+    release_encoder(ctx);
+    const char* encoder_error = init_encoder(ctx, config, filename);
+    if (encoder_error) {
+        *error = (char*)encoder_error;
+        release_encoder(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+void engine_close_segment(ProcessingContext* ctx) {
+    if (!ctx || !ctx->enc_codec_ctx) return;
+    engine_finalize_video_encoder(ctx);
+    release_encoder(ctx);
+}
+
+int engine_seek_to_pts(ProcessingContext* ctx, int64_t pts) {
+    if (!ctx || !ctx->dec_fmt_ctx) return -1;
+    // Why seek backward and then filter? Resume points are rarely keyframes.
+    // We decode from the keyframe before and drop frames until we reach the
+    // first one that was not yet committed.
+    if (av_seek_frame(ctx->dec_fmt_ctx, ctx->video_stream_idx, pts, AVSEEK_FLAG_BACKWARD) < 0) return -1;
+    avcodec_flush_buffers(ctx->dec_codec_ctx);
+    ctx->range_start_pts = pts;
+    if (!ctx->has_range) ctx->range_end_pts = INT64_MAX;
+    ctx->has_range = 1;
+    return 0;
+}
+
+int engine_frame_is_keyframe(const struct AVFrame* frame) {
+#ifdef AV_FRAME_FLAG_KEY
+    return frame && (frame->flags & AV_FRAME_FLAG_KEY);
+#else
+    return frame && frame->key_frame;
+#endif
+}
+
+int64_t engine_get_frame_pts(const struct AVFrame* frame) {
+    if (!frame) return AV_NOPTS_VALUE;
+    return (frame->pts != AV_NOPTS_VALUE) ? frame->pts : frame->best_effort_timestamp;
+}
+
+void engine_get_time_base(const ProcessingContext* ctx, int* tb_num, int* tb_den) {
+    *tb_num = ctx->time_base.num;
+    *tb_den = ctx->time_base.den;
+}
+
 int engine_get_video_stream_idx(const ProcessingContext* ctx) {
     return ctx->video_stream_idx;
 }
@@ -735,10 +2092,216 @@ int engine_get_audio_stream_idx(const ProcessingContext* ctx) {
 }
 
 float engine_get_video_aspect(const ProcessingContext* ctx) {
-    if (!ctx || !ctx->dec_codec_ctx || ctx->dec_codec_ctx->height == 0) {
+    if (!ctx || ctx->src_height == 0) {
         return 16.0f / 9.0f;
     }
-    return (float)ctx->dec_codec_ctx->width / (float)ctx->dec_codec_ctx->height;
+    return (float)ctx->src_width / (float)ctx->src_height;
+}
+
+int engine_frame_in_range(const ProcessingContext* ctx, const struct AVFrame* frame) {
+    if (!ctx || !frame || !ctx->has_range) return 0;
+    int64_t pts = (frame->pts != AV_NOPTS_VALUE) ? frame->pts : frame->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE) return 0;
+    // Why is "past the end" terminal? The decoder emits frames in presentation
+    // order, so once one frame reaches the next shard's keyframe, every later
+    // frame belongs to that shard too.
+    if (pts < ctx->range_start_pts) return -1;
+    if (pts >= ctx->range_end_pts) return 1;
+    return 0;
+}
+
+int engine_get_range(const ProcessingContext* ctx, int64_t* start_pts, int64_t* end_pts, int* tb_num, int* tb_den) {
+    if (!ctx || !ctx->has_range) return -1;
+    *start_pts = ctx->range_start_pts;
+    *end_pts = ctx->range_end_pts;
+    *tb_num = ctx->time_base.num;
+    *tb_den = ctx->time_base.den;
+    return 0;
+}
+
+long engine_get_encoded_frame_count(const ProcessingContext* ctx) {
+    return ctx ? ctx->frames_encoded : 0;
+}
+
+int engine_version(void) {
+    return ENGINE_VERSION;
+}
+
+int engine_get_cell_grid(const ProcessingContext* ctx, EngineCellGrid* grid) {
+    if (!ctx || !grid || !ctx->char_buffer || !ctx->color_buffer) return -1;
+    grid->chars = ctx->char_buffer;
+    grid->colors = ctx->color_buffer;
+    grid->width = ctx->ascii_width;
+    grid->height = ctx->ascii_height;
+    grid->char_stride = ctx->ascii_width;
+    grid->color_stride = ctx->ascii_width * 3;
+    return 0;
+}
+
+int engine_load_cell_grid(ProcessingContext* ctx, const EngineCellGrid* grid) {
+    if (!ctx || !grid || !grid->chars || !grid->colors || grid->width <= 0 || grid->height <= 0) return -1;
+    ctx->ascii_width = grid->width;
+    ctx->ascii_height = grid->height;
+    ctx->rgb_valid = 0;
+    ctx->retain_planes = 0;
+    if (alloc_cell_grid(ctx) != 0) return -1;
+    for (int y = 0; y < grid->height; y++) {
+        memcpy(ctx->char_buffer + (size_t)y * grid->width, grid->chars + (size_t)y * grid->char_stride, (size_t)grid->width);
+        memcpy(ctx->color_buffer + (size_t)y * grid->width * 3, grid->colors + (size_t)y * grid->color_stride,
+               (size_t)grid->width * 3);
+    }
+    return 0;
+}
+
+static const char* const kStageNames[ENGINE_STAGE_COUNT] = {
+    "demux", "decode", "rgb", "kernel", "format", "raster", "yuv", "encode", "mux", "output"
+};
+
+int engine_enable_stats(ProcessingContext* ctx, int enable) {
+    if (!ctx) return -1;
+    stage_stats_free(&ctx->stats);
+    if (!enable) return 0;
+    ctx->stats = stage_stats_create(2 + ctx->num_threads);
+    if (!ctx->stats) return -1;
+    ctx->stats_start_ns = monotonic_ns();
+    ctx->stats_frames_base = __atomic_load_n(&ctx->frames_processed, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+const char* engine_stage_name(EngineStage stage) {
+    return (stage >= 0 && stage < ENGINE_STAGE_COUNT) ? kStageNames[stage] : "unknown";
+}
+
+void engine_record_stage(ProcessingContext* ctx, EngineStage stage, int64_t elapsed_ns, int64_t bytes) {
+    if (!ctx || !stage_timing(ctx) || stage < 0 || stage >= ENGINE_STAGE_COUNT) return;
+    int64_t end = monotonic_ns();
+    record_span(ctx, stage, end - elapsed_ns, end, 0, bytes);
+}
+
+void engine_stats_thread_name(int thread, char* name, size_t size) {
+    if (thread == 0) snprintf(name, size, "main");
+    else if (thread == 1) snprintf(name, size, "pipeline");
+    else snprintf(name, size, "worker %d", thread - 2);
+}
+
+int engine_enable_counters(ProcessingContext* ctx, int enable) {
+    if (!ctx) return -1;
+    perf_counters_free(&ctx->counters);
+    if (!enable) return 0;
+    ctx->counters = perf_counters_create(2 + ctx->num_threads);
+    return ctx->counters ? 0 : -1;
+}
+
+int engine_get_stage_counters(const ProcessingContext* ctx, int thread, EngineStage stage,
+                              EngineStageCounters* counters) {
+    if (!ctx || !ctx->counters || !counters || thread >= 2 + ctx->num_threads) return -1;
+    perf_counters_summarize(ctx->counters, thread, stage, counters);
+    return 0;
+}
+
+int engine_enable_trace(ProcessingContext* ctx, size_t spans_per_thread) {
+    if (!ctx) return -1;
+    trace_free(&ctx->trace);
+    if (spans_per_thread == 0) return 0;
+    ctx->trace = trace_create(2 + ctx->num_threads, spans_per_thread);
+    if (!ctx->trace) return -1;
+    ctx->trace_start_ns = monotonic_ns();
+    return 0;
+}
+
+int engine_write_trace(const ProcessingContext* ctx, const char* path, char** error) {
+    if (!ctx || !ctx->trace) {
+        *error = "tracing was not enabled";
+        return -1;
+    }
+    // The pipeline thread records only while a frame is queued; taking the
+    // lock also makes its finished spans visible here.
+    if (ctx->async) {
+        AsyncPipeline* ap = ctx->async;
+        int busy = 0;
+        pthread_mutex_lock(&ap->lock);
+        for (int i = 0; i < ap->depth; i++) busy |= ap->slots[i].state == SLOT_QUEUED;
+        pthread_mutex_unlock(&ap->lock);
+        if (busy) {
+            *error = "frames are still converting; wait for every ticket before writing the trace";
+            return -1;
+        }
+    }
+    return trace_write_json(ctx->trace, path, kStageNames, engine_stats_thread_name, ctx->trace_start_ns, error);
+}
+
+int engine_get_stats_threads(const ProcessingContext* ctx) {
+    return ctx ? stage_stats_slots(ctx->stats) : 0;
+}
+
+int engine_get_stage_stats(const ProcessingContext* ctx, int thread, EngineStage stage, EngineStageStats* stats) {
+    if (!ctx || !ctx->stats || !stats || thread >= stage_stats_slots(ctx->stats)) return -1;
+    stage_stats_summarize(ctx->stats, thread, stage, stats);
+    return 0;
+}
+
+int engine_get_stats_span(const ProcessingContext* ctx, int64_t* frames, double* wall_secs) {
+    if (!ctx || !ctx->stats) return -1;
+    if (frames) *frames = __atomic_load_n(&ctx->frames_processed, __ATOMIC_ACQUIRE) - ctx->stats_frames_base;
+    if (wall_secs) *wall_secs = (double)(monotonic_ns() - ctx->stats_start_ns) / 1e9;
+    return 0;
+}
+
+void engine_retain_planes(ProcessingContext* ctx, int enable) {
+    if (ctx) ctx->retain_planes = enable;
+}
+
+int engine_get_cell_planes(const ProcessingContext* ctx, EngineCellPlanes* planes) {
+    if (!ctx || !planes || !ctx->retain_planes || !ctx->plane_magnitude ||
+        ctx->plane_cells < (size_t)ctx->ascii_width * ctx->ascii_height) return -1;
+    planes->magnitude = ctx->plane_magnitude;
+    planes->orientation = ctx->plane_orientation;
+    planes->level = ctx->plane_level;
+    planes->width = ctx->ascii_width;
+    planes->height = ctx->ascii_height;
+    return 0;
+}
+
+int engine_reprocess(ProcessingContext* ctx, const EngineConfig* config) {
+    if (!ctx || !ctx->rgb_valid || ctx->async) return -1;
+    config = sync_config(ctx, config);
+    if (alloc_cell_grid(ctx) != 0) return -1;
+    // Not published: this is the same frame again, not a new one.
+    run_cell_workers(ctx, config, NULL);
+    return 0;
+}
+
+// Why no threads? A lookup per cell finishes long before a thread pool would
+// even have started.
+int engine_reclassify(ProcessingContext* ctx, const EngineConfig* config) {
+    if (!ctx || !ctx->retain_planes || !ctx->char_buffer) return -1;
+    size_t cells = (size_t)ctx->ascii_width * ctx->ascii_height;
+    if (cells > ctx->plane_cells) return -1;
+    config = sync_config(ctx, config);
+    const float edge_strength_sq = config->edge_strength * config->edge_strength;
+    for (size_t i = 0; i < cells; i++) {
+        ctx->char_buffer[i] = classify_cell(ctx, ctx->plane_magnitude[i] >= edge_strength_sq,
+                                            ctx->plane_orientation[i], ctx->plane_level[i]);
+    }
+    return 0;
+}
+
+void engine_set_frame_callback(ProcessingContext* ctx, EngineFrameCallback callback, void* user_data) {
+    if (!ctx) return;
+    ctx->frame_callback = callback;
+    ctx->frame_callback_data = user_data;
+}
+
+void engine_get_crop(const ProcessingContext* ctx, int* x, int* y, int* w, int* h) {
+    *x = ctx->src_x;
+    *y = ctx->src_y;
+    *w = ctx->src_width;
+    *h = ctx->src_height;
+}
+
+void engine_get_output_dims(const ProcessingContext* ctx, int* ascii_width, int* ascii_height) {
+    *ascii_width = ctx->ascii_width;
+    *ascii_height = ctx->ascii_height;
 }
 
 void engine_update_output_dims(ProcessingContext* ctx, int new_ascii_width, int new_ascii_height) {
@@ -747,3 +2310,33 @@ void engine_update_output_dims(ProcessingContext* ctx, int new_ascii_width, int
     ctx->ascii_height = new_ascii_height;
 }
 
+
+// --- Benchmark Hooks ---
+uint8_t* engine_bench_rgb(ProcessingContext* ctx, int* stride) {
+    *stride = ctx->rgb_frame->linesize[0];
+    return ctx->rgb_frame->data[0];
+}
+
+int engine_bench_begin_frame(ProcessingContext* ctx) {
+    return alloc_cell_grid(ctx);
+}
+
+void engine_bench_cell_kernel(ProcessingContext* ctx, const EngineConfig* config) {
+    // Why worker_args[0]? process_slice_worker finds its stats slot from its
+    // position in that array, so its arguments must live there.
+    ThreadArgs* args = &ctx->worker_args[0];
+    *args = (ThreadArgs){ ctx, config, NULL, 0, ctx->ascii_height, 0, 0 };
+    process_slice_worker(args);
+}
+
+void engine_bench_convert(ProcessingContext* ctx, const uint8_t* const planes[4], const int strides[4]) {
+    sws_scale(ctx->sws_ctx_to_rgb, planes, strides, 0, ctx->src_height, ctx->rgb_frame->data, ctx->rgb_frame->linesize);
+}
+
+void engine_bench_raster(ProcessingContext* ctx, unsigned char* buffer, const EngineConfig* config) {
+    render_ascii_to_buffer(ctx, buffer, config);
+}
+
+unsigned char* engine_bench_png(const unsigned char* rgb, int width, int height, int* size) {
+    return stbi_write_png_to_mem(rgb, width * 3, width, height, 3, size);
+}
@@ -0,0 +1,256 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  autotune.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autotune.h"
+#include "cache.h"
+
+#define AUTOTUNE_WARMUP 2
+#define AUTOTUNE_FRAMES 9
+#define AUTOTUNE_SOURCE_WIDTH 1920
+#define AUTOTUNE_PATH_MAX 4096
+#define AUTOTUNE_FILE "autotune.tsv"
+// Timings closer than this are treated as a tie.
+#define AUTOTUNE_NOISE 0.03
+
+static const int kBandRows[] = { 1, 2, 4, 8, 16 };
+
+typedef struct {
+    EngineConfig config;
+    uint8_t* rgb;
+    int width, height;   // Synthetic source.
+    int cols, rows;      // Grid being tuned for.
+    ProcessingContext* ctx;
+    int ctx_threads;
+} Tuner;
+
+static double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void read_cpu_model(char* model, size_t size) {
+    snprintf(model, size, "unknown");
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (!f) return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) == 0) {
+            char* colon = strchr(line, ':');
+            if (colon) {
+                colon++;
+                while (*colon == ' ') colon++;
+                colon[strcspn(colon, "\n")] = '\0';
+                snprintf(model, size, "%s", colon);
+            }
+            break;
+        }
+    }
+    fclose(f);
+    // The model is a field of a tab-separated line.
+    for (char* p = model; *p; p++) {
+        if (*p == '\t') *p = ' ';
+    }
+}
+
+// Why put the detail in the middle only? Real frames are uneven: a face or a
+// caption is full of edges while the sky around it is flat, and edge cells
+// cost more than flat ones. A uniformly busy pattern would hide exactly the
+// imbalance that banding exists to fix.
+static void fill_pattern(uint8_t* rgb, int width, int height) {
+    uint32_t seed = 0x9e3779b9u;
+    for (int y = 0; y < height; y++) {
+        uint8_t* p = rgb + (size_t)y * width * 3;
+        int busy = y > height / 3 && y < height * 2 / 3;
+        for (int x = 0; x < width; x++, p += 3) {
+            if (busy) {
+                seed = seed * 1664525u + 1013904223u;
+                uint8_t v = ((x / 6 + y / 6) & 1) ? 220 : 30;
+                p[0] = (uint8_t)(v ^ (seed >> 27));
+                p[1] = (uint8_t)(v ^ ((seed >> 19) & 31));
+                p[2] = (uint8_t)(v ^ ((seed >> 11) & 31));
+            } else {
+                p[0] = (uint8_t)(x * 255 / width);
+                p[1] = (uint8_t)(y * 255 / height);
+                p[2] = 96;
+            }
+        }
+    }
+}
+
+// Median milliseconds per frame for one candidate, or a negative value if the
+// engine could not be set up.
+static double measure(Tuner* tuner, int threads, int band_rows, int use_simd) {
+    if (!tuner->ctx || tuner->ctx_threads != threads) {
+        engine_cleanup(&tuner->ctx);
+        char* error = NULL;
+        tuner->config.num_threads = threads;
+        tuner->ctx = engine_init_raw(tuner->width, tuner->height, ENGINE_PIX_RGB24, &tuner->config, &error);
+        if (!tuner->ctx) return -1.0;
+        engine_update_output_dims(tuner->ctx, tuner->cols, tuner->rows);
+        tuner->ctx_threads = threads;
+    }
+    tuner->config.band_rows = band_rows;
+    tuner->config.use_simd = use_simd;
+
+    const uint8_t* const planes[4] = { tuner->rgb, NULL, NULL, NULL };
+    const int strides[4] = { tuner->width * 3, 0, 0, 0 };
+    double samples[AUTOTUNE_FRAMES];
+    for (int i = 0; i < AUTOTUNE_WARMUP + AUTOTUNE_FRAMES; i++) {
+        double start = now_secs();
+        if (engine_process_buffer(tuner->ctx, planes, strides, i, &tuner->config) != 0) return -1.0;
+        if (i >= AUTOTUNE_WARMUP) samples[i - AUTOTUNE_WARMUP] = (now_secs() - start) * 1000.0;
+    }
+    qsort(samples, AUTOTUNE_FRAMES, sizeof(double), compare_doubles);
+    return samples[AUTOTUNE_FRAMES / 2];
+}
+
+// Why not simply the fastest? Two timings within the noise say nothing about
+// which is better. On a tie, fewer threads wins (the cores are free for the
+// decoder and the encoder) and contiguous slices win (one boundary per
+// worker), so a choice only moves away from the defaults on a clear gain.
+static int try_candidate(Tuner* tuner, AutotuneResult* best, int threads, int band_rows, int use_simd) {
+    double ms = measure(tuner, threads, band_rows, use_simd);
+    if (ms < 0.0) return -1;
+    double limit = best->frame_ms;
+    if (threads < best->threads) limit *= 1.0 + AUTOTUNE_NOISE;
+    else if (band_rows > 0 && best->band_rows == 0) limit *= 1.0 - AUTOTUNE_NOISE;
+    if (ms < limit) {
+        best->threads = threads;
+        best->band_rows = band_rows;
+        best->use_simd = use_simd;
+        best->frame_ms = ms;
+    }
+    return 0;
+}
+
+// Coordinate descent rather than the full cross product: the kernel at the
+// starting thread count, then the thread count with that kernel, then the
+// band height. A 64-core machine tunes in a second rather than a minute.
+static int calibrate(Tuner* tuner, int fixed_threads, int simd_allowed, long cores, AutotuneResult* best) {
+    best->threads = fixed_threads > 0 ? fixed_threads : (int)cores;
+    best->band_rows = 0;
+    best->use_simd = simd_allowed;
+    best->frame_ms = measure(tuner, best->threads, 0, simd_allowed);
+    if (best->frame_ms < 0.0) return -1;
+
+    if (simd_allowed && try_candidate(tuner, best, best->threads, 0, 0) != 0) return -1;
+    if (fixed_threads <= 0) {
+        for (int threads = 1; threads < cores; threads *= 2) {
+            if (try_candidate(tuner, best, threads, 0, best->use_simd) != 0) return -1;
+        }
+    }
+    int threads = best->threads;
+    for (size_t i = 0; threads > 1 && i < sizeof(kBandRows) / sizeof(kBandRows[0]); i++) {
+        // With fewer bands than workers some workers sit idle.
+        if (kBandRows[i] * threads >= tuner->rows) break;
+        if (try_candidate(tuner, best, threads, kBandRows[i], best->use_simd) != 0) return -1;
+    }
+    return 0;
+}
+
+// One line per tuned setup:
+// model, cores, grid, fixed threads, SIMD allowed, then threads, band rows, SIMD, ms.
+// The last matching line wins, so a recalibration simply appends.
+static int lookup(const char* path, const char* model, long cores, int cols, int rows, int fixed_threads,
+                  int simd_allowed, AutotuneResult* result) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[512];
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char* tab = strchr(line, '\t');
+        if (!tab || (size_t)(tab - line) != strlen(model) || strncmp(line, model, (size_t)(tab - line)) != 0) continue;
+        long c;
+        int w, h, fixed, allowed, threads, band, simd;
+        double ms;
+        if (sscanf(tab + 1, "%ld\t%dx%d\t%d\t%d\t%d\t%d\t%d\t%lf", &c, &w, &h, &fixed, &allowed,
+                   &threads, &band, &simd, &ms) != 9) continue;
+        if (c != cores || w != cols || h != rows || fixed != fixed_threads || allowed != simd_allowed) continue;
+        if (threads <= 0 || band < 0 || (simd != 0 && simd != 1)) continue;
+        result->threads = threads;
+        result->band_rows = band;
+        result->use_simd = simd;
+        result->frame_ms = ms;
+        found = 1;
+    }
+    fclose(f);
+    return found ? 0 : -1;
+}
+
+static void store(const char* path, const char* model, long cores, int cols, int rows, int fixed_threads,
+                  int simd_allowed, const AutotuneResult* result) {
+    FILE* f = fopen(path, "a");
+    if (!f) return;
+    fprintf(f, "%s\t%ld\t%dx%d\t%d\t%d\t%d\t%d\t%d\t%.3f\n", model, cores, cols, rows, fixed_threads, simd_allowed,
+            result->threads, result->band_rows, result->use_simd, result->frame_ms);
+    fclose(f);
+}
+
+int autotune_resolve(const EngineConfig* config, int cols, int rows, float aspect, const char* cache_dir,
+                     AutotuneResult* result, char** error) {
+    if (cols <= 0 || rows <= 0) { *error = "Nothing to tune: the grid is empty"; return -1; }
+    char model[256];
+    read_cpu_model(model, sizeof(model));
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    int fixed_threads = config->num_threads > 0 ? config->num_threads : 0;
+    int simd_allowed = config->use_simd != 0;
+
+    // Why carry on without a cache? The calibration is still right for this
+    // run; it just has to be repeated next time.
+    char path[AUTOTUNE_PATH_MAX] = "";
+    char dir[AUTOTUNE_PATH_MAX - sizeof(AUTOTUNE_FILE) - 1];
+    char* dir_error = NULL;
+    if (cache_resolve_dir(cache_dir, dir, sizeof(dir), &dir_error) == 0) {
+        snprintf(path, sizeof(path), "%s/%s", dir, AUTOTUNE_FILE);
+        if (lookup(path, model, cores, cols, rows, fixed_threads, simd_allowed, result) == 0) {
+            result->cached = 1;
+            return 0;
+        }
+    }
+
+    Tuner tuner;
+    memset(&tuner, 0, sizeof(tuner));
+    tuner.config = *config;
+    tuner.config.mode = MODE_IMAGE;
+    tuner.config.output_filename = NULL;
+    tuner.config.shard_count = 0;
+    tuner.config.checkpoint_secs = 0.0f;
+    tuner.config.lowres = 0;
+    tuner.config.crop_w = tuner.config.crop_h = 0;
+    tuner.config.autocrop = 0;
+    tuner.cols = cols;
+    tuner.rows = rows;
+    tuner.width = AUTOTUNE_SOURCE_WIDTH;
+    tuner.height = aspect > 0.0f ? (int)(AUTOTUNE_SOURCE_WIDTH / aspect + 0.5f) : AUTOTUNE_SOURCE_WIDTH * 9 / 16;
+    if (tuner.height < 16) tuner.height = 16;
+    if (tuner.height > 4 * AUTOTUNE_SOURCE_WIDTH) tuner.height = 4 * AUTOTUNE_SOURCE_WIDTH;
+    tuner.rgb = (uint8_t*)malloc((size_t)tuner.width * tuner.height * 3);
+    if (!tuner.rgb) { *error = "Failed to allocate the calibration frame"; return -1; }
+    fill_pattern(tuner.rgb, tuner.width, tuner.height);
+
+    int status = calibrate(&tuner, fixed_threads, simd_allowed, cores, result);
+    engine_cleanup(&tuner.ctx);
+    free(tuner.rgb);
+    if (status != 0) { *error = "Calibration failed: the engine could not convert the synthetic frame"; return -1; }
+    result->cached = 0;
+    if (path[0]) store(path, model, cores, cols, rows, fixed_threads, simd_allowed, result);
+    return 0;
+}
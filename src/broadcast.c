@@ -0,0 +1,378 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  broadcast.c
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "broadcast.h"
+#include "server.h"
+
+// Why a colour tolerance? Video noise nudges almost every cell's colour by a
+// few levels each frame. Re-sending those cells would turn every delta into a
+// full frame, for changes no one can see. A cell is only re-sent once it
+// drifts past this distance from what viewers are showing.
+#define COLOR_TOLERANCE 6
+#define MAX_EVENTS 64
+
+typedef struct {
+    int fd;
+    char* pending;      // Unsent tail of the last frame handed to this viewer.
+    size_t pending_len;
+    size_t pending_sent;
+    size_t pending_cap;
+    int needs_keyframe;
+    int want_write;
+} Viewer;
+
+struct Broadcaster {
+    int listen_fd;
+    int epoll_fd;
+    char unix_path[108];
+
+    Viewer** viewers;
+    int num_viewers;
+    int viewer_cap;
+
+    // What every in-sync viewer is showing; deltas are taken against it.
+    char* shown_chars;
+    unsigned char* shown_colors;
+    int width;
+    int height;
+
+    char* delta;
+    size_t delta_len;
+    char* key;
+    size_t key_len;
+    int key_built;
+    size_t frame_cap;
+
+    BroadcastStats stats;
+};
+
+static int open_listener(Broadcaster* b, const char* address, char** error) {
+    int fd;
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(address + 4));
+        // Why loopback only? The stream is unauthenticated; it is meant for
+        // terminals on this machine (SSH sessions arrive here as local users).
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) { *error = "Could not create socket"; return -1; }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) { close(fd); *error = "Could not bind TCP port"; return -1; }
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(addr.sun_path)) { *error = "Socket path too long"; return -1; }
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", address);
+        if (unix_socket_reclaim(address, error) != 0) return -1;
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) { *error = "Could not create socket"; return -1; }
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) { close(fd); *error = "Could not bind socket"; return -1; }
+        snprintf(b->unix_path, sizeof(b->unix_path), "%s", address);
+    }
+    if (listen(fd, 64) != 0) { close(fd); *error = "Could not listen"; return -1; }
+    return fd;
+}
+
+Broadcaster* broadcast_open(const char* address, char** error) {
+    Broadcaster* b = (Broadcaster*)calloc(1, sizeof(Broadcaster));
+    if (!b) { *error = "Failed to allocate broadcaster"; return NULL; }
+    b->epoll_fd = -1;
+    b->listen_fd = open_listener(b, address, error);
+    if (b->listen_fd < 0) { free(b); return NULL; }
+    b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (b->epoll_fd < 0 || epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->listen_fd, &ev) != 0) {
+        *error = "Could not set up epoll";
+        broadcast_close(&b);
+        return NULL;
+    }
+    return b;
+}
+
+static void drop_viewer(Broadcaster* b, Viewer* v) {
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_DEL, v->fd, NULL);
+    close(v->fd);
+    free(v->pending);
+    for (int i = 0; i < b->num_viewers; i++) {
+        if (b->viewers[i] == v) {
+            b->viewers[i] = b->viewers[--b->num_viewers];
+            break;
+        }
+    }
+    free(v);
+    b->stats.viewers = b->num_viewers;
+}
+
+static void set_want_write(Broadcaster* b, Viewer* v, int want) {
+    if (v->want_write == want) return;
+    struct epoll_event ev = { .events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = v };
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_MOD, v->fd, &ev);
+    v->want_write = want;
+}
+
+// Sends as much as the socket takes right now; the rest is queued. Returns -1
+// if the viewer is gone.
+static int send_to_viewer(Broadcaster* b, Viewer* v, const char* data, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(v->fd, data + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) { sent += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return -1;
+    }
+    if (sent == len) return 0;
+    size_t rest = len - sent;
+    if (rest > v->pending_cap) {
+        char* grown = (char*)realloc(v->pending, rest);
+        if (!grown) return -1;
+        v->pending = grown;
+        v->pending_cap = rest;
+    }
+    memcpy(v->pending, data + sent, rest);
+    v->pending_len = rest;
+    v->pending_sent = 0;
+    set_want_write(b, v, 1);
+    return 0;
+}
+
+static void flush_viewer(Broadcaster* b, Viewer* v) {
+    while (v->pending_sent < v->pending_len) {
+        ssize_t n = send(v->fd, v->pending + v->pending_sent, v->pending_len - v->pending_sent,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) { v->pending_sent += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        drop_viewer(b, v);
+        return;
+    }
+    v->pending_len = v->pending_sent = 0;
+    set_want_write(b, v, 0);
+}
+
+static void accept_viewers(Broadcaster* b) {
+    for (;;) {
+        int fd = accept4(b->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        if (b->num_viewers == b->viewer_cap) {
+            int cap = b->viewer_cap ? b->viewer_cap * 2 : 16;
+            Viewer** grown = (Viewer**)realloc(b->viewers, cap * sizeof(Viewer*));
+            if (!grown) { close(fd); continue; }
+            b->viewers = grown;
+            b->viewer_cap = cap;
+        }
+        Viewer* v = (Viewer*)calloc(1, sizeof(Viewer));
+        if (!v) { close(fd); continue; }
+        v->fd = fd;
+        v->needs_keyframe = 1;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = v };
+        if (epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) { free(v); close(fd); continue; }
+        b->viewers[b->num_viewers++] = v;
+        b->stats.viewers = b->num_viewers;
+        static const char hello[] = "\x1b[?25l\x1b[0m\x1b[2J";
+        if (send_to_viewer(b, v, hello, sizeof(hello) - 1) != 0) drop_viewer(b, v);
+    }
+}
+
+void broadcast_pump(Broadcaster* b, int timeout_ms) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int remaining = timeout_ms;
+    for (;;) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(b->epoll_fd, events, MAX_EVENTS, remaining > 0 ? remaining : 0);
+        for (int i = 0; i < n; i++) {
+            Viewer* v = (Viewer*)events[i].data.ptr;
+            if (!v) { accept_viewers(b); continue; }
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) { drop_viewer(b, v); continue; }
+            if (events[i].events & EPOLLIN) {
+                // Viewers have nothing to say; reading only detects hang-ups.
+                char scratch[256];
+                ssize_t r = recv(v->fd, scratch, sizeof(scratch), MSG_DONTWAIT);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    drop_viewer(b, v);
+                    continue;
+                }
+            }
+            if (events[i].events & EPOLLOUT) flush_viewer(b, v);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int elapsed = (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+        remaining = timeout_ms - elapsed;
+        if (remaining <= 0) return;
+    }
+}
+
+static int color_differs(const unsigned char* a, const unsigned char* b) {
+    return abs(a[0] - b[0]) > COLOR_TOLERANCE || abs(a[1] - b[1]) > COLOR_TOLERANCE ||
+           abs(a[2] - b[2]) > COLOR_TOLERANCE;
+}
+
+// Why reposition explicitly and never carry colour across frames? A viewer that
+// was resynchronised with a keyframe and one that followed every delta show
+// the same cells but end a frame with different cursor and SGR state. Each
+// delta starts by positioning the cursor and restating the colour, so it
+// applies cleanly after either.
+static char* emit_cell(char* p, int x, int y, int* cursor_x, int* cursor_y,
+                       const unsigned char* color, int* have_color, unsigned char* last_color, char glyph, int use_color) {
+    if (*cursor_y != y || *cursor_x != x) p += sprintf(p, "\x1b[%d;%dH", y + 1, x + 1);
+    if (use_color && (!*have_color || memcmp(last_color, color, 3) != 0)) {
+        p += sprintf(p, "\x1b[38;2;%d;%d;%dm", color[0], color[1], color[2]);
+        memcpy(last_color, color, 3);
+        *have_color = 1;
+    }
+    *p++ = glyph;
+    *cursor_x = x + 1;
+    *cursor_y = y;
+    return p;
+}
+
+// Worst case per cell: a cursor move (up to 12 bytes), a colour (19) and the glyph.
+static int ensure_frame_buffers(Broadcaster* b, const EngineCellGrid* grid) {
+    size_t cells = (size_t)grid->width * grid->height;
+    size_t need = cells * 32 + 64;
+    if (grid->width != b->width || grid->height != b->height) {
+        free(b->shown_chars);
+        free(b->shown_colors);
+        b->shown_chars = (char*)calloc(cells, 1);
+        b->shown_colors = (unsigned char*)calloc(cells, 3);
+        if (!b->shown_chars || !b->shown_colors) {
+            // Forget the old shape too, so the next frame retries the
+            // allocation instead of encoding into the missing buffers.
+            free(b->shown_chars);
+            free(b->shown_colors);
+            b->shown_chars = NULL;
+            b->shown_colors = NULL;
+            b->width = b->height = 0;
+            return -1;
+        }
+        b->width = grid->width;
+        b->height = grid->height;
+        // The picture changed shape; every viewer starts over.
+        for (int i = 0; i < b->num_viewers; i++) b->viewers[i]->needs_keyframe = 1;
+    }
+    if (need > b->frame_cap) {
+        char* delta = (char*)realloc(b->delta, need);
+        if (delta) b->delta = delta;
+        char* key = (char*)realloc(b->key, need);
+        if (key) b->key = key;
+        if (!delta || !key) return -1;
+        b->frame_cap = need;
+    }
+    return 0;
+}
+
+static void encode_delta(Broadcaster* b, const EngineCellGrid* grid, int use_color) {
+    char* p = b->delta;
+    int cursor_x = -1, cursor_y = -1, have_color = 0;
+    unsigned char last_color[3];
+    for (int y = 0; y < grid->height; y++) {
+        const char* chars = grid->chars + (size_t)y * grid->char_stride;
+        const unsigned char* colors = grid->colors + (size_t)y * grid->color_stride;
+        char* shown_chars = b->shown_chars + (size_t)y * b->width;
+        unsigned char* shown_colors = b->shown_colors + (size_t)y * b->width * 3;
+        for (int x = 0; x < grid->width; x++) {
+            int changed = chars[x] != shown_chars[x] ||
+                          (use_color && color_differs(&colors[x * 3], &shown_colors[x * 3]));
+            if (!changed) continue;
+            shown_chars[x] = chars[x];
+            memcpy(&shown_colors[x * 3], &colors[x * 3], 3);
+            p = emit_cell(p, x, y, &cursor_x, &cursor_y, &shown_colors[x * 3], &have_color, last_color, chars[x], use_color);
+        }
+    }
+    b->delta_len = (size_t)(p - b->delta);
+}
+
+// A keyframe paints exactly what in-sync viewers show, so a resynchronised
+// viewer continues with the very next delta.
+static void encode_keyframe(Broadcaster* b, int use_color) {
+    char* p = b->key;
+    p += sprintf(p, "\x1b[0m\x1b[2J");
+    int cursor_x = -1, cursor_y = -1, have_color = 0;
+    unsigned char last_color[3];
+    for (int y = 0; y < b->height; y++) {
+        for (int x = 0; x < b->width; x++) {
+            size_t idx = (size_t)y * b->width + x;
+            p = emit_cell(p, x, y, &cursor_x, &cursor_y, &b->shown_colors[idx * 3], &have_color, last_color,
+                          b->shown_chars[idx], use_color);
+        }
+    }
+    b->key_len = (size_t)(p - b->key);
+    b->key_built = 1;
+    b->stats.last_keyframe_bytes = b->key_len;
+}
+
+void broadcast_frame(Broadcaster* b, const EngineCellGrid* grid, int use_color) {
+    if (ensure_frame_buffers(b, grid) != 0) return;
+    encode_delta(b, grid, use_color);
+    b->key_built = 0;
+    b->stats.frames++;
+    b->stats.last_delta_bytes = b->delta_len;
+
+    // Iterate backwards: drop_viewer moves the last viewer into the hole.
+    for (int i = b->num_viewers - 1; i >= 0; i--) {
+        Viewer* v = b->viewers[i];
+        if (v->pending_sent < v->pending_len) {
+            v->needs_keyframe = 1;
+            b->stats.frames_skipped++;
+            continue;
+        }
+        const char* data = b->delta;
+        size_t len = b->delta_len;
+        if (v->needs_keyframe) {
+            if (!b->key_built) encode_keyframe(b, use_color);
+            data = b->key;
+            len = b->key_len;
+            v->needs_keyframe = 0;
+            b->stats.keyframes_sent++;
+        }
+        if (len > 0 && send_to_viewer(b, v, data, len) != 0) drop_viewer(b, v);
+    }
+}
+
+void broadcast_get_stats(const Broadcaster* b, BroadcastStats* stats) {
+    *stats = b->stats;
+}
+
+void broadcast_close(Broadcaster** b_ptr) {
+    if (!b_ptr || !*b_ptr) return;
+    Broadcaster* b = *b_ptr;
+    static const char bye[] = "\x1b[0m\x1b[?25h\n";
+    while (b->num_viewers > 0) {
+        Viewer* v = b->viewers[b->num_viewers - 1];
+        send(v->fd, bye, sizeof(bye) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        drop_viewer(b, v);
+    }
+    if (b->listen_fd >= 0) close(b->listen_fd);
+    if (b->epoll_fd >= 0) close(b->epoll_fd);
+    if (b->unix_path[0]) unlink(b->unix_path);
+    free(b->viewers);
+    free(b->shown_chars);
+    free(b->shown_colors);
+    free(b->delta);
+    free(b->key);
+    free(b);
+    *b_ptr = NULL;
+}
@@ -0,0 +1,417 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  cache.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+
+#include "cache.h"
+
+// Bump whenever the meaning of a key or the grid file layout changes; old
+// entries then simply stop matching and age out.
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_DEFAULT_MAX_BYTES (1LL << 30)
+#define GRID_MAGIC 0x47525850u // "PXRG"
+// Room for "/xx/", a 64-digit key, its suffix and any name found while scanning.
+#define CACHE_DIR_MAX (PATH_MAX - 320)
+
+struct RenderCache {
+    char dir[CACHE_DIR_MAX];
+    long long max_bytes;
+    long long total_bytes; // As of the last scan, plus what this process stored since.
+    CacheStats stats;
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+} GridHeader;
+
+typedef struct {
+    char path[PATH_MAX];
+    long long size;
+    struct timespec mtime;
+} CacheEntry;
+
+static int make_dirs(const char* path) {
+    char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char* p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    return (mkdir(buf, 0755) != 0 && errno != EEXIST) ? -1 : 0;
+}
+
+static void entry_path(const RenderCache* cache, const CacheKey* key, const char* kind, char* out, size_t size) {
+    snprintf(out, size, "%s/%.2s/%s.%s", cache->dir, key->hex, key->hex, kind);
+}
+
+// Calls visit for every finished entry; temporaries of in-progress stores are skipped.
+static void walk_entries(const RenderCache* cache, void (*visit)(const char* path, const struct stat* st, void* user),
+                         void* user) {
+    DIR* top = opendir(cache->dir);
+    if (!top) return;
+    struct dirent* d;
+    while ((d = readdir(top)) != NULL) {
+        if (strlen(d->d_name) != 2) continue;
+        char sub[CACHE_DIR_MAX + 4];
+        snprintf(sub, sizeof(sub), "%s/%.2s", cache->dir, d->d_name);
+        DIR* dir = opendir(sub);
+        if (!dir) continue;
+        struct dirent* e;
+        while ((e = readdir(dir)) != NULL) {
+            if (e->d_name[0] == '.' || strstr(e->d_name, ".tmp")) continue;
+            char path[PATH_MAX];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%.255s", sub, e->d_name);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) visit(path, &st, user);
+        }
+        closedir(dir);
+    }
+    closedir(top);
+}
+
+static void add_size(const char* path, const struct stat* st, void* user) {
+    (void)path;
+    *(long long*)user += (long long)st->st_size;
+}
+
+typedef struct {
+    CacheEntry* entries;
+    int count;
+    int capacity;
+} EntryList;
+
+static void collect_entry(const char* path, const struct stat* st, void* user) {
+    EntryList* list = (EntryList*)user;
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        CacheEntry* grown = (CacheEntry*)realloc(list->entries, (size_t)capacity * sizeof(CacheEntry));
+        if (!grown) return;
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+    CacheEntry* entry = &list->entries[list->count++];
+    snprintf(entry->path, sizeof(entry->path), "%s", path);
+    entry->size = (long long)st->st_size;
+    entry->mtime = st->st_mtim;
+}
+
+static int by_mtime(const void* a, const void* b) {
+    const struct timespec* ta = &((const CacheEntry*)a)->mtime;
+    const struct timespec* tb = &((const CacheEntry*)b)->mtime;
+    if (ta->tv_sec != tb->tv_sec) return (ta->tv_sec > tb->tv_sec) - (ta->tv_sec < tb->tv_sec);
+    return (ta->tv_nsec > tb->tv_nsec) - (ta->tv_nsec < tb->tv_nsec);
+}
+
+// Why evict down to 90%? Trimming to exactly the limit would rescan the whole
+// directory on every following store.
+static void evict(RenderCache* cache) {
+    EntryList list = {0};
+    walk_entries(cache, collect_entry, &list);
+    long long total = 0;
+    for (int i = 0; i < list.count; i++) total += list.entries[i].size;
+    qsort(list.entries, (size_t)list.count, sizeof(CacheEntry), by_mtime);
+    long long target = cache->max_bytes / 10 * 9;
+    for (int i = 0; i < list.count && total > target; i++) {
+        if (unlink(list.entries[i].path) == 0) {
+            total -= list.entries[i].size;
+            cache->stats.evictions++;
+        }
+    }
+    cache->total_bytes = total;
+    free(list.entries);
+}
+
+static void account_store(RenderCache* cache, long long size) {
+    cache->stats.stores++;
+    cache->total_bytes += size;
+    if (cache->total_bytes > cache->max_bytes) evict(cache);
+}
+
+int cache_resolve_dir(const char* dir, char* out, size_t size, char** error) {
+    if (dir) {
+        snprintf(out, size, "%s", dir);
+    } else if (getenv("XDG_CACHE_HOME") && *getenv("XDG_CACHE_HOME")) {
+        snprintf(out, size, "%s/pixel-ripper", getenv("XDG_CACHE_HOME"));
+    } else if (getenv("HOME")) {
+        snprintf(out, size, "%s/.cache/pixel-ripper", getenv("HOME"));
+    } else {
+        *error = "No cache directory given and HOME is not set";
+        return -1;
+    }
+    if (strlen(out) + 1 >= size) {
+        *error = "Cache directory path is too long";
+        return -1;
+    }
+    if (make_dirs(out) != 0) {
+        *error = "Could not create cache directory";
+        return -1;
+    }
+    return 0;
+}
+
+RenderCache* cache_open(const char* dir, long long max_bytes, char** error) {
+    RenderCache* cache = (RenderCache*)calloc(1, sizeof(RenderCache));
+    if (!cache) { *error = "Failed to allocate cache"; return NULL; }
+    if (cache_resolve_dir(dir, cache->dir, sizeof(cache->dir), error) != 0) {
+        free(cache);
+        return NULL;
+    }
+    cache->max_bytes = max_bytes > 0 ? max_bytes : CACHE_DEFAULT_MAX_BYTES;
+    walk_entries(cache, add_size, &cache->total_bytes);
+    if (cache->total_bytes > cache->max_bytes) evict(cache);
+    return cache;
+}
+
+void cache_close(RenderCache** cache) {
+    if (!cache || !*cache) return;
+    free(*cache);
+    *cache = NULL;
+}
+
+void cache_get_stats(const RenderCache* cache, CacheStats* stats) {
+    *stats = cache->stats;
+}
+
+// --- Keys ---
+int cache_hash_input(const char* path, uint8_t digest[32]) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    struct AVSHA* sha = av_sha_alloc();
+    unsigned char* buf = (unsigned char*)malloc(1 << 20);
+    if (!sha || !buf) {
+        av_free(sha);
+        free(buf);
+        fclose(f);
+        return -1;
+    }
+    av_sha_init(sha, 256);
+    size_t n;
+    while ((n = fread(buf, 1, 1 << 20, f)) > 0) av_sha_update(sha, buf, n);
+    int failed = ferror(f);
+    av_sha_final(sha, digest);
+    av_free(sha);
+    free(buf);
+    fclose(f);
+    return failed ? -1 : 0;
+}
+
+// Why serialise field by field? Hashing the struct's memory would take in
+// padding bytes and the output_filename pointer, so equal settings would
+// produce different keys.
+static void hash_int(struct AVSHA* sha, int64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)((uint64_t)value >> (8 * i));
+    av_sha_update(sha, bytes, sizeof(bytes));
+}
+
+static void hash_float(struct AVSHA* sha, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    hash_int(sha, bits);
+}
+
+static void hash_analysis(struct AVSHA* sha, const char* kind, const uint8_t input_digest[32],
+                          const EngineConfig* config) {
+    av_sha_init(sha, 256);
+    av_sha_update(sha, (const uint8_t*)kind, strlen(kind) + 1);
+    hash_int(sha, CACHE_FORMAT_VERSION);
+    hash_int(sha, engine_version());
+    av_sha_update(sha, input_digest, 32);
+    hash_int(sha, config->mode);
+    hash_int(sha, config->output_width);
+    hash_float(sha, config->edge_strength);
+    hash_float(sha, config->aspect_correction);
+    hash_int(sha, config->dither_mode);
+    hash_int(sha, config->lowres);
+    hash_int(sha, config->crop_x);
+    hash_int(sha, config->crop_y);
+    hash_int(sha, config->crop_w);
+    hash_int(sha, config->crop_h);
+    hash_int(sha, config->autocrop);
+}
+
+static void finish_key(struct AVSHA* sha, CacheKey* key) {
+    uint8_t digest[32];
+    av_sha_final(sha, digest);
+    for (int i = 0; i < 32; i++) snprintf(&key->hex[i * 2], 3, "%02x", digest[i]);
+}
+
+void cache_grid_key(const uint8_t input_digest[32], const EngineConfig* config, CacheKey* key) {
+    struct AVSHA* sha = av_sha_alloc();
+    if (!sha) { key->hex[0] = '\0'; return; }
+    hash_analysis(sha, "grid", input_digest, config);
+    finish_key(sha, key);
+    av_free(sha);
+}
+
+void cache_output_key(const uint8_t input_digest[32], const EngineConfig* config, const char* output_path, CacheKey* key) {
+    struct AVSHA* sha = av_sha_alloc();
+    if (!sha) { key->hex[0] = '\0'; return; }
+    hash_analysis(sha, "output", input_digest, config);
+    hash_float(sha, config->brightness_factor);
+    hash_float(sha, config->saturation_factor);
+    hash_int(sha, config->use_color);
+    hash_int(sha, config->crf);
+    char ext[16] = "";
+    const char* dot = strrchr(output_path, '.');
+    if (dot && !strchr(dot, '/')) {
+        for (size_t i = 0; dot[i + 1] && i + 1 < sizeof(ext); i++) ext[i] = (char)tolower((unsigned char)dot[i + 1]);
+    }
+    av_sha_update(sha, (const uint8_t*)ext, strlen(ext) + 1);
+    finish_key(sha, key);
+    av_free(sha);
+}
+
+// --- Entries ---
+static int copy_file(const char* src, const char* dest) {
+    FILE* in = fopen(src, "rb");
+    if (!in) return -1;
+    FILE* out = fopen(dest, "wb");
+    if (!out) { fclose(in); return -1; }
+    char buf[1 << 16];
+    size_t n;
+    int failed = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) { failed = 1; break; }
+    }
+    if (ferror(in)) failed = 1;
+    fclose(in);
+    if (fclose(out) != 0) failed = 1;
+    return failed ? -1 : 0;
+}
+
+// Writes to a private temporary and renames it into place, so a reader in
+// another process never sees half an entry.
+static int publish_entry(RenderCache* cache, const char* tmp, const char* path) {
+    struct stat st;
+    if (rename(tmp, path) != 0 || stat(path, &st) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    account_store(cache, (long long)st.st_size);
+    return 0;
+}
+
+static int prepare_entry(const RenderCache* cache, const CacheKey* key, const char* kind,
+                         char* path, char* tmp, size_t size) {
+    if (!key->hex[0]) return -1;
+    char sub[CACHE_DIR_MAX + 4];
+    snprintf(sub, sizeof(sub), "%s/%.2s", cache->dir, key->hex);
+    if (mkdir(sub, 0755) != 0 && errno != EEXIST) return -1;
+    entry_path(cache, key, kind, path, size);
+    // A truncated name could collide with another writer's temporary file.
+    int n = snprintf(tmp, size, "%s.tmp%d", path, (int)getpid());
+    return n >= 0 && (size_t)n < size ? 0 : -1;
+}
+
+static void touch(const char* path) {
+    utimensat(AT_FDCWD, path, NULL, 0);
+}
+
+int cache_fetch_file(RenderCache* cache, const CacheKey* key, const char* dest_path) {
+    char path[PATH_MAX];
+    entry_path(cache, key, "out", path, sizeof(path));
+    if (!key->hex[0] || access(path, R_OK) != 0 || copy_file(path, dest_path) != 0) {
+        cache->stats.misses++;
+        return -1;
+    }
+    touch(path);
+    cache->stats.hits++;
+    return 0;
+}
+
+int cache_store_file(RenderCache* cache, const CacheKey* key, const char* src_path) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    if (prepare_entry(cache, key, "out", path, tmp, sizeof(path)) != 0) return -1;
+    if (copy_file(src_path, tmp) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return publish_entry(cache, tmp, path);
+}
+
+int cache_fetch_grid(RenderCache* cache, const CacheKey* key, ProcessingContext* ctx) {
+    char path[PATH_MAX];
+    entry_path(cache, key, "grid", path, sizeof(path));
+    FILE* f = key->hex[0] ? fopen(path, "rb") : NULL;
+    if (!f) {
+        cache->stats.misses++;
+        return -1;
+    }
+    GridHeader header;
+    unsigned char* data = NULL;
+    int ret = -1;
+    if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == GRID_MAGIC &&
+        header.version == CACHE_FORMAT_VERSION && header.width > 0 && header.height > 0 &&
+        header.width <= 65535 && header.height <= 65535) {
+        size_t cells = (size_t)header.width * header.height;
+        data = (unsigned char*)malloc(cells * 4);
+        if (data && fread(data, 1, cells * 4, f) == cells * 4) {
+            EngineCellGrid grid = {
+                .chars = (const char*)data,
+                .colors = data + cells,
+                .width = (int)header.width,
+                .height = (int)header.height,
+                .char_stride = (int)header.width,
+                .color_stride = (int)header.width * 3,
+            };
+            ret = engine_load_cell_grid(ctx, &grid);
+        }
+    }
+    free(data);
+    fclose(f);
+    if (ret != 0) {
+        cache->stats.misses++;
+        return -1;
+    }
+    touch(path);
+    cache->stats.hits++;
+    return 0;
+}
+
+int cache_store_grid(RenderCache* cache, const CacheKey* key, const EngineCellGrid* grid) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    if (prepare_entry(cache, key, "grid", path, tmp, sizeof(path)) != 0) return -1;
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return -1;
+    GridHeader header = { GRID_MAGIC, CACHE_FORMAT_VERSION, (uint32_t)grid->width, (uint32_t)grid->height };
+    int failed = fwrite(&header, sizeof(header), 1, f) != 1;
+    for (int y = 0; y < grid->height && !failed; y++) {
+        failed = fwrite(grid->chars + (size_t)y * grid->char_stride, 1, (size_t)grid->width, f) != (size_t)grid->width;
+    }
+    for (int y = 0; y < grid->height && !failed; y++) {
+        size_t row = (size_t)grid->width * 3;
+        failed = fwrite(grid->colors + (size_t)y * grid->color_stride, 1, row, f) != row;
+    }
+    if (fclose(f) != 0) failed = 1;
+    if (failed) {
+        unlink(tmp);
+        return -1;
+    }
+    return publish_entry(cache, tmp, path);
+}
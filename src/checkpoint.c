@@ -0,0 +1,182 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  checkpoint.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "checkpoint.h"
+
+static int push_segment(Checkpoint* cp, const ShardManifest* m) {
+    if (cp->num_segments == cp->capacity) {
+        int new_capacity = cp->capacity ? cp->capacity * 2 : 16;
+        ShardManifest* grown = (ShardManifest*)realloc(cp->segments, new_capacity * sizeof(ShardManifest));
+        if (!grown) return -1;
+        cp->segments = grown;
+        cp->capacity = new_capacity;
+    }
+    cp->segments[cp->num_segments++] = *m;
+    return 0;
+}
+
+static int journal_error(Checkpoint* cp, int line_number, const char* what, char** error) {
+    snprintf(cp->error_text, sizeof(cp->error_text), "Checkpoint journal line %d: %s", line_number, what);
+    *error = cp->error_text;
+    return -1;
+}
+
+// Why tolerate a torn last line? The journal is appended while the process may
+// be killed at any instant. Only lines that made it to disk with their newline
+// are trusted; anything after that is an uncommitted segment.
+//
+// Why refuse any other bad line? A line in the middle that does not parse, or a
+// segment out of order, means the journal was damaged. Skipping it would resume
+// from the wrong offset and stitch a file with a hole or a repeat in it.
+static int load_journal(Checkpoint* cp, FILE* f, char** error) {
+    char line[SHARD_PATH_MAX + 128];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_number++;
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n') {
+            if (!feof(f)) return journal_error(cp, line_number, "line too long", error);
+            fprintf(stderr, "Checkpoint journal: ignoring the unfinished line %d\n", line_number);
+            break;
+        }
+        line[len - 1] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+        if (strncmp(line, "input=", 6) == 0) {
+            if (strcmp(line + 6, cp->input) != 0) return journal_error(cp, line_number, "belongs to a different input", error);
+            continue;
+        }
+        ShardManifest m = {0};
+        int path_offset = 0;
+        if (sscanf(line, "segment %d %" SCNd64 " %" SCNd64 " %ld %d/%d %n",
+                   &m.index, &m.start_pts, &m.end_pts, &m.frames, &m.tb_num, &m.tb_den, &path_offset) != 6 ||
+            path_offset == 0 || line[path_offset] == '\0') {
+            return journal_error(cp, line_number, "not a segment record", error);
+        }
+        if (m.index != cp->num_segments) return journal_error(cp, line_number, "segment out of order", error);
+        if (cp->complete) return journal_error(cp, line_number, "segment after the final one", error);
+        snprintf(m.segment, sizeof(m.segment), "%s", line + path_offset);
+        snprintf(m.input, sizeof(m.input), "%s", cp->input);
+        m.count = 1;
+        if (push_segment(cp, &m) != 0) return journal_error(cp, line_number, "out of memory", error);
+        if (m.end_pts == INT64_MAX) cp->complete = 1;
+    }
+    return 0;
+}
+
+int checkpoint_open(Checkpoint* cp, const char* input, const char* output_filename, int resume, char** error) {
+    memset(cp, 0, sizeof(*cp));
+    snprintf(cp->input, sizeof(cp->input), "%s", input);
+    snprintf(cp->dir, sizeof(cp->dir), "%s.parts", output_filename);
+    snprintf(cp->journal_path, sizeof(cp->journal_path), "%s/journal", cp->dir);
+    const char* ext = strrchr(output_filename, '.');
+    snprintf(cp->extension, sizeof(cp->extension), "%s", ext ? ext : ".mp4");
+
+    if (mkdir(cp->dir, 0755) != 0 && errno != EEXIST) {
+        *error = "Could not create checkpoint directory"; return -1;
+    }
+
+    FILE* existing = fopen(cp->journal_path, "r");
+    if (existing) {
+        if (!resume) {
+            fclose(existing);
+            *error = "A checkpoint journal already exists; pass --resume to continue it or delete the .parts directory";
+            return -1;
+        }
+        int ok = load_journal(cp, existing, error);
+        fclose(existing);
+        if (ok != 0) { checkpoint_close(cp); return -1; }
+        cp->journal = fopen(cp->journal_path, "a");
+    } else {
+        cp->journal = fopen(cp->journal_path, "w");
+        if (cp->journal) {
+            fprintf(cp->journal, "# pixel-ripper journal v1\ninput=%s\n", cp->input);
+            fflush(cp->journal);
+            fsync(fileno(cp->journal));
+        }
+    }
+    if (!cp->journal) { *error = "Could not open checkpoint journal"; checkpoint_close(cp); return -1; }
+    return 0;
+}
+
+int64_t checkpoint_resume_pts(const Checkpoint* cp) {
+    if (cp->num_segments == 0) return INT64_MIN;
+    return cp->segments[cp->num_segments - 1].end_pts;
+}
+
+void checkpoint_segment_path(const Checkpoint* cp, int index, char* buf, size_t size) {
+    snprintf(buf, size, "%s/seg_%05d%s", cp->dir, index, cp->extension);
+}
+
+int checkpoint_commit(Checkpoint* cp, const char* segment, int64_t start_pts, int64_t end_pts,
+                      long frames, int tb_num, int tb_den) {
+    ShardManifest m = {0};
+    m.index = cp->num_segments;
+    m.count = 1;
+    m.start_pts = start_pts;
+    m.end_pts = end_pts;
+    m.frames = frames;
+    m.tb_num = tb_num;
+    m.tb_den = tb_den;
+    snprintf(m.segment, sizeof(m.segment), "%s", segment);
+    snprintf(m.input, sizeof(m.input), "%s", cp->input);
+
+    // Why push before writing? The journal must never record a segment this
+    // run does not know about, or a resume and the current run would disagree.
+    // If the write fails the segment is taken back off the list.
+    if (push_segment(cp, &m) != 0) return -1;
+
+    // Why fsync every commit? A commit is a promise that the segment survives a
+    // crash. Segments are seconds to minutes long, so the cost is negligible.
+    fprintf(cp->journal, "segment %d %" PRId64 " %" PRId64 " %ld %d/%d %s\n",
+            m.index, m.start_pts, m.end_pts, m.frames, m.tb_num, m.tb_den, m.segment);
+    if (fflush(cp->journal) != 0 || fsync(fileno(cp->journal)) != 0) {
+        cp->num_segments--;
+        return -1;
+    }
+    if (end_pts == INT64_MAX) cp->complete = 1;
+    return 0;
+}
+
+int checkpoint_stitch(Checkpoint* cp, const char* output_filename, char** error) {
+    if (cp->num_segments == 0) { *error = "No committed segments"; return -1; }
+    // Why a copy? shard_concat_manifests sorts in place; the journal order must
+    // stay intact for further commits.
+    ShardManifest* copy = (ShardManifest*)malloc(cp->num_segments * sizeof(ShardManifest));
+    if (!copy) { *error = "Failed to allocate manifests"; return -1; }
+    memcpy(copy, cp->segments, cp->num_segments * sizeof(ShardManifest));
+    int ret = shard_concat_manifests(copy, cp->num_segments, output_filename, error);
+    free(copy);
+    return ret;
+}
+
+void checkpoint_remove(Checkpoint* cp) {
+    for (int i = 0; i < cp->num_segments; i++) {
+        unlink(cp->segments[i].segment);
+    }
+    if (cp->journal) { fclose(cp->journal); cp->journal = NULL; }
+    unlink(cp->journal_path);
+    rmdir(cp->dir);
+}
+
+void checkpoint_close(Checkpoint* cp) {
+    if (cp->journal) fclose(cp->journal);
+    free(cp->segments);
+    cp->journal = NULL;
+    cp->segments = NULL;
+    cp->num_segments = 0;
+    cp->capacity = 0;
+}
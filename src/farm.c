@@ -0,0 +1,587 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  farm.c
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE // strsignal
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "farm.h"
+#include "wire.h"
+
+#define FARM_BLOCK_MAX 16384
+#define FARM_PATH_MAX 4096
+// A worker that dies this many times in a row without a job to blame is not
+// restarted again; whatever kills it is not something a retry will fix.
+#define MAX_IDLE_CRASHES 3
+
+// --- Worker side ---
+int farm_worker_serve(int fd, FarmJobFn run_job, void* user) {
+    static WireBuffer in;
+    static char block[FARM_BLOCK_MAX];
+    char input[FARM_PATH_MAX], output[FARM_PATH_MAX], id[32];
+    in.len = in.pos = 0;
+    for (;;) {
+        int got = wire_read_block(fd, &in, block, sizeof(block));
+        if (got <= 0) {
+            close(fd);
+            return got;
+        }
+        const char* id_value = wire_block_value(block, "id");
+        const char* input_value = wire_block_value(block, "input");
+        const char* output_value = wire_block_value(block, "output");
+        const char* attempt_value = wire_block_value(block, "attempt");
+        char* error = NULL;
+        double start = wire_now_ms();
+        int ret = -1;
+        wire_copy_value(id, sizeof(id), id_value ? id_value : "-1");
+        if (!input_value || !output_value) {
+            error = "Malformed job";
+        } else {
+            wire_copy_value(input, sizeof(input), input_value);
+            wire_copy_value(output, sizeof(output), output_value);
+            ret = run_job(input, output, attempt_value ? atoi(attempt_value) : 1, user, &error);
+        }
+        char reply[512];
+        int n = snprintf(reply, sizeof(reply), "id=%s\nstatus=%s\nms=%.3f\nerror=%s\n\n", id, ret == 0 ? "ok" : "error",
+                         wire_now_ms() - start, ret == 0 ? "" : (error ? error : "Unknown error"));
+        if (wire_send_all(fd, reply, (size_t)n) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+}
+
+// --- Coordinator side ---
+typedef enum { JOB_PENDING, JOB_RUNNING, JOB_OK, JOB_FAILED, JOB_SKIPPED } JobState;
+
+typedef struct {
+    char* input;
+    char* output;
+    long long size;
+    JobState state;
+    int attempts;
+    int worker;  // Worker slot that ran the last attempt.
+    double ms;   // Conversion time as measured by the worker.
+    char error[160];
+} Job;
+
+// A ring of job indices. Owners pop from the front, thieves take from the back.
+typedef struct {
+    int* items;
+    int capacity;
+    int head;
+    int count;
+} Deque;
+
+typedef struct {
+    pid_t pid; // 0 while the slot has no live process.
+    int fd;
+    int job;   // Job in flight, -1 when idle.
+    double started_ms;
+    int timed_out;
+    int idle_crashes;
+    WireBuffer in;
+    Deque queue;
+    int jobs_done;
+    int crashes;
+    int restarts;
+    int steals;
+    double busy_ms;
+} FarmWorker;
+
+typedef struct {
+    const FarmOptions* options;
+    FarmJobFn run_job;
+    void* user;
+    Job* jobs;
+    int job_count;
+    FarmWorker* workers;
+    int worker_count;
+    int max_attempts;
+    int remaining; // Jobs not yet in a final state.
+    int finished;
+} Farm;
+
+static void deque_push_back(Deque* d, int job) {
+    d->items[(d->head + d->count) % d->capacity] = job;
+    d->count++;
+}
+
+static void deque_push_front(Deque* d, int job) {
+    d->head = (d->head + d->capacity - 1) % d->capacity;
+    d->items[d->head] = job;
+    d->count++;
+}
+
+static int deque_pop_front(Deque* d) {
+    if (d->count == 0) return -1;
+    int job = d->items[d->head];
+    d->head = (d->head + 1) % d->capacity;
+    d->count--;
+    return job;
+}
+
+static int load_manifest(Farm* farm, const char* path, char** error) {
+    FILE* f = fopen(path, "r");
+    if (!f) { *error = "Could not open manifest"; return -1; }
+    char* line = NULL;
+    size_t line_size = 0;
+    int capacity = 0, line_number = 0;
+    while (getline(&line, &line_size, f) > 0) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        char* tab = strchr(line, '\t');
+        if (!tab || tab == line || tab[1] == '\0') {
+            fprintf(stderr, "%s:%d: expected <input><TAB><output>\n", path, line_number);
+            *error = "Malformed manifest line";
+            break;
+        }
+        *tab = '\0';
+        if (farm->job_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Job* grown = (Job*)realloc(farm->jobs, (size_t)capacity * sizeof(Job));
+            if (!grown) { *error = "Failed to allocate jobs"; break; }
+            farm->jobs = grown;
+        }
+        Job* job = &farm->jobs[farm->job_count];
+        memset(job, 0, sizeof(*job));
+        job->input = strdup(line);
+        job->output = strdup(tab + 1);
+        job->worker = -1;
+        farm->job_count++;
+        if (!job->input || !job->output) { *error = "Failed to allocate jobs"; break; }
+        struct stat st;
+        job->size = stat(job->input, &st) == 0 ? (long long)st.st_size : 0;
+    }
+    free(line);
+    fclose(f);
+    if (*error) return -1;
+    if (farm->job_count == 0) { *error = "Manifest lists no jobs"; return -1; }
+    return 0;
+}
+
+static const Job* sort_jobs;
+static int by_size_desc(const void* a, const void* b) {
+    long long sa = sort_jobs[*(const int*)a].size, sb = sort_jobs[*(const int*)b].size;
+    return (sa < sb) - (sa > sb);
+}
+
+// Why deal the largest inputs first? A long job started last stretches the
+// whole run; started first, it overlaps with everything else.
+static void distribute_jobs(Farm* farm) {
+    int* order = (int*)malloc((size_t)farm->job_count * sizeof(int));
+    if (!order) {
+        for (int i = 0; i < farm->job_count; i++) deque_push_back(&farm->workers[i % farm->worker_count].queue, i);
+        return;
+    }
+    for (int i = 0; i < farm->job_count; i++) order[i] = i;
+    sort_jobs = farm->jobs;
+    qsort(order, (size_t)farm->job_count, sizeof(int), by_size_desc);
+    for (int i = 0; i < farm->job_count; i++) deque_push_back(&farm->workers[i % farm->worker_count].queue, order[i]);
+    free(order);
+}
+
+static int spawn_worker(Farm* farm, FarmWorker* w) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) return -1;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        for (int i = 0; i < farm->worker_count; i++) {
+            if (farm->workers[i].fd >= 0) close(farm->workers[i].fd);
+        }
+        // Why ignore SIGINT? Ctrl-C reaches the whole process group. The
+        // coordinator decides what happens to running jobs and stops workers
+        // with SIGTERM.
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_DFL);
+        // Why silence stdout? Progress lines from many workers would interleave
+        // into noise; the coordinator reports each job instead.
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+        _exit(farm_worker_serve(sv[1], farm->run_job, farm->user) == 0 ? 0 : 1);
+    }
+    close(sv[1]);
+    w->pid = pid;
+    w->fd = sv[0];
+    w->job = -1;
+    w->timed_out = 0;
+    w->in.len = w->in.pos = 0;
+    return 0;
+}
+
+// Takes the worker's next job, stealing half of the fullest deque when its own
+// is empty. The thief takes the back half: the smaller inputs, which the
+// victim would have reached last.
+static int next_job(Farm* farm, FarmWorker* w) {
+    if (w->queue.count == 0) {
+        FarmWorker* victim = NULL;
+        for (int i = 0; i < farm->worker_count; i++) {
+            FarmWorker* v = &farm->workers[i];
+            if (v != w && v->queue.count > 0 && (!victim || v->queue.count > victim->queue.count)) victim = v;
+        }
+        if (!victim) return -1;
+        int take = (victim->queue.count + 1) / 2;
+        int first = victim->queue.head + victim->queue.count - take;
+        for (int i = 0; i < take; i++) {
+            deque_push_back(&w->queue, victim->queue.items[(first + i) % victim->queue.capacity]);
+        }
+        victim->queue.count -= take;
+        w->steals++;
+    }
+    return deque_pop_front(&w->queue);
+}
+
+static void print_progress(const Farm* farm, const char* tag, const Job* job, const char* detail) {
+    printf("[%d/%d] %-5s %s -> %s%s%s\n", farm->finished, farm->job_count, tag, job->input, job->output,
+           detail ? "  " : "", detail ? detail : "");
+    fflush(stdout);
+}
+
+static void worker_exited(Farm* farm, FarmWorker* w, volatile sig_atomic_t* stop);
+
+static void dispatch(Farm* farm, FarmWorker* w, volatile sig_atomic_t* stop) {
+    int index = next_job(farm, w);
+    if (index < 0) return;
+    Job* job = &farm->jobs[index];
+    job->state = JOB_RUNNING;
+    job->attempts++;
+    job->worker = (int)(w - farm->workers);
+    w->job = index;
+    w->started_ms = wire_now_ms();
+    char block[2 * FARM_PATH_MAX + 64];
+    int n = snprintf(block, sizeof(block), "id=%d\nattempt=%d\ninput=%s\noutput=%s\n\n", index, job->attempts,
+                     job->input, job->output);
+    if (n >= (int)sizeof(block) || wire_send_all(w->fd, block, (size_t)n) != 0) {
+        // The worker died before taking the job; this is handled like any crash.
+        kill(w->pid, SIGKILL);
+        worker_exited(farm, w, stop);
+    }
+}
+
+static void finish_job(Farm* farm, Job* job, JobState state, const char* error) {
+    job->state = state;
+    if (error) snprintf(job->error, sizeof(job->error), "%s", error);
+    farm->remaining--;
+    farm->finished++;
+}
+
+static void worker_exited(Farm* farm, FarmWorker* w, volatile sig_atomic_t* stop) {
+    int status = 0;
+    waitpid(w->pid, &status, 0);
+    close(w->fd);
+    w->fd = -1;
+    w->pid = 0;
+    w->crashes++;
+
+    char why[128];
+    if (w->timed_out) {
+        snprintf(why, sizeof(why), "timed out after %.0f s", farm->options->job_timeout_secs);
+    } else if (WIFSIGNALED(status)) {
+        snprintf(why, sizeof(why), "worker killed by signal %d (%s)", WTERMSIG(status), strsignal(WTERMSIG(status)));
+    } else {
+        snprintf(why, sizeof(why), "worker exited with status %d", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+
+    if (w->job >= 0) {
+        Job* job = &farm->jobs[w->job];
+        w->busy_ms += wire_now_ms() - w->started_ms;
+        w->job = -1;
+        w->idle_crashes = 0;
+        if (job->attempts < farm->max_attempts && !*stop) {
+            // Why the front of the queue? The retry then runs promptly, on a
+            // fresh process, instead of after everything else.
+            job->state = JOB_PENDING;
+            deque_push_front(&w->queue, (int)(job - farm->jobs));
+            print_progress(farm, "retry", job, why);
+        } else {
+            finish_job(farm, job, JOB_FAILED, why);
+            print_progress(farm, "FAIL", job, why);
+        }
+    } else {
+        w->idle_crashes++;
+    }
+
+    if (!*stop && farm->remaining > 0 && w->idle_crashes < MAX_IDLE_CRASHES) {
+        if (spawn_worker(farm, w) == 0) {
+            w->restarts++;
+        } else {
+            fprintf(stderr, "Could not restart worker %d\n", (int)(w - farm->workers));
+        }
+    }
+}
+
+static void handle_reply(Farm* farm, FarmWorker* w, const char* block) {
+    const char* id = wire_block_value(block, "id");
+    if (!id || w->job < 0 || atoi(id) != w->job) return;
+    Job* job = &farm->jobs[w->job];
+    const char* status = wire_block_value(block, "status");
+    const char* ms = wire_block_value(block, "ms");
+    const char* error = wire_block_value(block, "error");
+    job->ms = ms ? strtod(ms, NULL) : wire_now_ms() - w->started_ms;
+    w->busy_ms += wire_now_ms() - w->started_ms;
+    w->jobs_done++;
+    w->job = -1;
+    w->idle_crashes = 0;
+    char detail[192];
+    if (status && strncmp(status, "ok", 2) == 0) {
+        finish_job(farm, job, JOB_OK, NULL);
+        snprintf(detail, sizeof(detail), "%.1f ms, worker %d", job->ms, job->worker);
+        print_progress(farm, "ok", job, detail);
+    } else {
+        // Why no retry? A job that returned an error ran to completion; it
+        // would fail the same way again. Only crashes and hangs are retried.
+        char message[160];
+        wire_copy_value(message, sizeof(message), error && *error != '\n' ? error : "Unknown error");
+        finish_job(farm, job, JOB_FAILED, message);
+        print_progress(farm, "FAIL", job, message);
+    }
+}
+
+static void stop_workers(Farm* farm) {
+    for (int i = 0; i < farm->worker_count; i++) {
+        FarmWorker* w = &farm->workers[i];
+        if (w->pid > 0) kill(w->pid, SIGTERM);
+    }
+    for (int i = 0; i < farm->worker_count; i++) {
+        FarmWorker* w = &farm->workers[i];
+        if (w->pid > 0) waitpid(w->pid, NULL, 0);
+        w->pid = 0;
+        if (w->job >= 0) finish_job(farm, &farm->jobs[w->job], JOB_FAILED, "interrupted");
+        w->job = -1;
+    }
+    for (int i = 0; i < farm->job_count; i++) {
+        if (farm->jobs[i].state == JOB_PENDING) finish_job(farm, &farm->jobs[i], JOB_SKIPPED, "not started");
+    }
+}
+
+static void run_loop(Farm* farm, volatile sig_atomic_t* stop) {
+    struct pollfd* fds = (struct pollfd*)calloc((size_t)farm->worker_count, sizeof(struct pollfd));
+    int* owners = (int*)calloc((size_t)farm->worker_count, sizeof(int));
+    if (!fds || !owners) {
+        free(fds);
+        free(owners);
+        stop_workers(farm);
+        return;
+    }
+    double timeout_ms = farm->options->job_timeout_secs * 1000.0;
+    while (farm->remaining > 0) {
+        if (*stop) {
+            stop_workers(farm);
+            break;
+        }
+        for (int i = 0; i < farm->worker_count; i++) {
+            FarmWorker* w = &farm->workers[i];
+            if (w->pid > 0 && w->job < 0) dispatch(farm, w, stop);
+        }
+
+        int nfds = 0;
+        int wait_ms = 500;
+        double now = wire_now_ms();
+        for (int i = 0; i < farm->worker_count; i++) {
+            FarmWorker* w = &farm->workers[i];
+            if (w->pid <= 0) continue;
+            fds[nfds].fd = w->fd;
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = i;
+            if (timeout_ms > 0 && w->job >= 0 && !w->timed_out) {
+                double left = w->started_ms + timeout_ms - now;
+                if (left <= 0) {
+                    w->timed_out = 1;
+                    kill(w->pid, SIGKILL);
+                } else if (left < wait_ms) {
+                    wait_ms = (int)left + 1;
+                }
+            }
+        }
+        if (nfds == 0) {
+            // Every worker has been retired; nothing can run what is left.
+            for (int i = 0; i < farm->job_count; i++) {
+                if (farm->jobs[i].state == JOB_PENDING) finish_job(farm, &farm->jobs[i], JOB_FAILED, "no workers left");
+            }
+            break;
+        }
+        if (poll(fds, (nfds_t)nfds, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int k = 0; k < nfds; k++) {
+            if (!fds[k].revents) continue;
+            FarmWorker* w = &farm->workers[owners[k]];
+            ssize_t n = wire_fill(w->fd, &w->in);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            if (n <= 0) {
+                worker_exited(farm, w, stop);
+                continue;
+            }
+            char block[FARM_BLOCK_MAX];
+            while (wire_take_block(&w->in, block, sizeof(block)) > 0) handle_reply(farm, w, block);
+        }
+    }
+    free(fds);
+    free(owners);
+}
+
+static int by_double(const void* a, const void* b) {
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void print_summary(const Farm* farm, double wall_ms) {
+    int ok = 0, failed = 0, skipped = 0;
+    double* times = (double*)malloc((size_t)farm->job_count * sizeof(double));
+    double sum_ms = 0.0;
+    for (int i = 0; i < farm->job_count; i++) {
+        const Job* job = &farm->jobs[i];
+        if (job->state == JOB_OK) {
+            if (times) times[ok] = job->ms;
+            sum_ms += job->ms;
+            ok++;
+        } else if (job->state == JOB_SKIPPED) {
+            skipped++;
+        } else {
+            failed++;
+        }
+    }
+    printf("\nFarm: %d job(s): %d ok, %d failed, %d skipped in %.1f s on %d worker(s)\n", farm->job_count, ok, failed,
+           skipped, wall_ms / 1000.0, farm->worker_count);
+    if (ok > 0 && times) {
+        qsort(times, (size_t)ok, sizeof(double), by_double);
+        printf("  Job time: sum %.1f s, mean %.1f ms, p50 %.1f ms, p95 %.1f ms, max %.1f ms (%.2fx parallel speedup)\n",
+               sum_ms / 1000.0, sum_ms / ok, times[(ok - 1) / 2], times[(int)((ok - 1) * 0.95)], times[ok - 1],
+               wall_ms > 0 ? sum_ms / wall_ms : 0.0);
+    }
+    free(times);
+    for (int i = 0; i < farm->worker_count; i++) {
+        const FarmWorker* w = &farm->workers[i];
+        printf("  Worker %d: %d job(s), busy %.1f s (%.0f%%), %d crash(es), %d restart(s), %d steal(s)\n", i,
+               w->jobs_done, w->busy_ms / 1000.0, wall_ms > 0 ? 100.0 * w->busy_ms / wall_ms : 0.0, w->crashes,
+               w->restarts, w->steals);
+    }
+    if (failed > 0) {
+        printf("Failed:\n");
+        for (int i = 0; i < farm->job_count; i++) {
+            const Job* job = &farm->jobs[i];
+            if (job->state == JOB_FAILED) printf("  %s: %s (%d attempt(s))\n", job->input, job->error, job->attempts);
+        }
+    }
+}
+
+static void write_report(const Farm* farm, const char* path) {
+    static const char* names[] = { "pending", "running", "ok", "failed", "skipped" };
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not write farm report %s\n", path);
+        return;
+    }
+    fprintf(f, "input\toutput\tstatus\tattempts\tworker\tms\terror\n");
+    for (int i = 0; i < farm->job_count; i++) {
+        const Job* job = &farm->jobs[i];
+        fprintf(f, "%s\t%s\t%s\t%d\t%d\t%.3f\t%s\n", job->input, job->output, names[job->state], job->attempts,
+                job->worker, job->ms, job->error);
+    }
+    fclose(f);
+}
+
+static void free_farm(Farm* farm) {
+    for (int i = 0; i < farm->job_count; i++) {
+        free(farm->jobs[i].input);
+        free(farm->jobs[i].output);
+    }
+    free(farm->jobs);
+    if (farm->workers) {
+        for (int i = 0; i < farm->worker_count; i++) free(farm->workers[i].queue.items);
+    }
+    free(farm->workers);
+}
+
+int farm_run(const FarmOptions* options, FarmJobFn run_job, void* user, volatile sig_atomic_t* stop, char** error) {
+    Farm farm = { .options = options, .run_job = run_job, .user = user };
+    if (load_manifest(&farm, options->manifest_path, error) != 0) {
+        free_farm(&farm);
+        return -1;
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    farm.worker_count = options->workers > 0 ? options->workers : (cores > 0 ? (int)cores : 1);
+    if (farm.worker_count > farm.job_count) farm.worker_count = farm.job_count;
+    farm.max_attempts = options->max_attempts > 0 ? options->max_attempts : 2;
+    farm.remaining = farm.job_count;
+
+    farm.workers = (FarmWorker*)calloc((size_t)farm.worker_count, sizeof(FarmWorker));
+    if (!farm.workers) {
+        *error = "Failed to allocate workers";
+        free_farm(&farm);
+        return -1;
+    }
+    for (int i = 0; i < farm.worker_count; i++) {
+        FarmWorker* w = &farm.workers[i];
+        w->fd = -1;
+        w->job = -1;
+        w->queue.capacity = farm.job_count;
+        w->queue.items = (int*)malloc((size_t)farm.job_count * sizeof(int));
+        if (!w->queue.items) {
+            *error = "Failed to allocate job queues";
+            free_farm(&farm);
+            return -1;
+        }
+    }
+    distribute_jobs(&farm);
+
+    double start = wire_now_ms();
+    int live = 0;
+    for (int i = 0; i < farm.worker_count; i++) {
+        if (spawn_worker(&farm, &farm.workers[i]) == 0) live++;
+    }
+    if (live == 0) {
+        *error = "Could not start any worker process";
+        free_farm(&farm);
+        return -1;
+    }
+    printf("Farming %d job(s) from %s across %d worker process(es)\n", farm.job_count, options->manifest_path, live);
+
+    run_loop(&farm, stop);
+
+    // Closing the sockets is the workers' signal to exit.
+    for (int i = 0; i < farm.worker_count; i++) {
+        FarmWorker* w = &farm.workers[i];
+        if (w->fd >= 0) close(w->fd);
+        w->fd = -1;
+    }
+    for (int i = 0; i < farm.worker_count; i++) {
+        if (farm.workers[i].pid > 0) waitpid(farm.workers[i].pid, NULL, 0);
+    }
+    double wall_ms = wire_now_ms() - start;
+
+    print_summary(&farm, wall_ms);
+    if (options->report_path) write_report(&farm, options->report_path);
+    int all_ok = 1;
+    for (int i = 0; i < farm.job_count; i++) {
+        if (farm.jobs[i].state != JOB_OK) all_ok = 0;
+    }
+    free_farm(&farm);
+    return all_ok ? 0 : 1;
+}
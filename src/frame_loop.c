@@ -0,0 +1,140 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  frame_loop.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_loop.h"
+
+typedef struct {
+    char* text;
+    size_t size;
+    long delay_us;
+} LoopFrame;
+
+struct FrameLoop {
+    LoopFrame* frames;
+    int count;
+    int capacity;
+    size_t bytes;
+    size_t max_bytes;
+    int recording;
+    int capped;   // A pass once overflowed the cap; never record again.
+    char* pending; // Reserved but not yet committed.
+};
+
+static void drop_frames(FrameLoop* loop) {
+    for (int i = 0; i < loop->count; i++) free(loop->frames[i].text);
+    free(loop->pending);
+    loop->pending = NULL;
+    loop->count = 0;
+    loop->bytes = 0;
+}
+
+FrameLoop* frame_loop_create(size_t max_bytes) {
+    FrameLoop* loop = (FrameLoop*)calloc(1, sizeof(FrameLoop));
+    if (loop) loop->max_bytes = max_bytes;
+    return loop;
+}
+
+void frame_loop_begin_pass(FrameLoop* loop) {
+    if (!loop) return;
+    drop_frames(loop);
+    loop->recording = !loop->capped;
+}
+
+char* frame_loop_reserve(FrameLoop* loop, size_t size) {
+    if (!loop || !loop->recording) return NULL;
+    if (loop->bytes + size > loop->max_bytes) {
+        drop_frames(loop);
+        loop->recording = 0;
+        loop->capped = 1;
+        return NULL;
+    }
+    if (loop->count == loop->capacity) {
+        int capacity = loop->capacity ? loop->capacity * 2 : 64;
+        LoopFrame* grown = (LoopFrame*)realloc(loop->frames, (size_t)capacity * sizeof(LoopFrame));
+        if (!grown) {
+            frame_loop_discard(loop);
+            return NULL;
+        }
+        loop->frames = grown;
+        loop->capacity = capacity;
+    }
+    free(loop->pending);
+    loop->pending = (char*)malloc(size);
+    if (!loop->pending) frame_loop_discard(loop);
+    return loop->pending;
+}
+
+void frame_loop_commit(FrameLoop* loop, size_t used, long delay_us) {
+    if (!loop || !loop->recording || !loop->pending) return;
+    // Why shrink? The reservation is the worst case for the grid (every cell a
+    // full colour escape); the actual frame is usually far smaller.
+    char* text = (char*)realloc(loop->pending, used ? used : 1);
+    LoopFrame* frame = &loop->frames[loop->count++];
+    frame->text = text ? text : loop->pending;
+    frame->size = used;
+    frame->delay_us = delay_us;
+    loop->bytes += used;
+    loop->pending = NULL;
+}
+
+void frame_loop_discard(FrameLoop* loop) {
+    if (!loop) return;
+    drop_frames(loop);
+    loop->recording = 0;
+}
+
+int frame_loop_complete(const FrameLoop* loop) {
+    return loop && loop->recording && loop->count > 0;
+}
+
+int frame_loop_capped(const FrameLoop* loop) {
+    return loop && loop->capped;
+}
+
+static void write_all(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        size -= (size_t)n;
+    }
+}
+
+// Why absolute deadlines? Sleeping "delay" after each write adds the write
+// time to every frame, and the drift accumulates over an endless loop.
+void frame_loop_replay(FrameLoop* loop, volatile sig_atomic_t* stop, volatile sig_atomic_t* resized) {
+    if (!frame_loop_complete(loop)) return;
+    fflush(stdout);
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (!*stop && !*resized) {
+        for (int i = 0; i < loop->count && !*stop && !*resized; i++) {
+            write_all(loop->frames[i].text, loop->frames[i].size);
+            long long ns = deadline.tv_nsec + (long long)loop->frames[i].delay_us * 1000LL;
+            deadline.tv_sec += (time_t)(ns / 1000000000LL);
+            deadline.tv_nsec = (long)(ns % 1000000000LL);
+            // A signal (resize, Ctrl-C) interrupts the sleep so the flags are seen at once.
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+    }
+}
+
+void frame_loop_free(FrameLoop** loop) {
+    if (!loop || !*loop) return;
+    drop_frames(*loop);
+    free((*loop)->frames);
+    free(*loop);
+    *loop = NULL;
+}
@@ -0,0 +1,22 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  json_writer.c
+ *
+ * =====================================================================================
+ */
+
+#include "json_writer.h"
+
+void json_write_string(FILE* f, const char* s) {
+    if (!s) {
+        fputs("null", f);
+        return;
+    }
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
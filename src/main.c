@@ -15,6 +15,21 @@
 #include <signal.h>
 
 #include "ascii_engine.h"
+#include "shard.h"
+#include "checkpoint.h"
+#include "sequence.h"
+#include "server.h"
+#include "shm_ring.h"
+#include "broadcast.h"
+#include "farm.h"
+#include "cache.h"
+#include "frame_loop.h"
+#include "tune.h"
+#include "throughput.h"
+#include "stats_report.h"
+#include "verify.h"
+#include "autotune.h"
+#include "playback_timing.h"
 #include <libavcodec/avcodec.h>
 
 // Why volatile sig_atomic_t? This is the only correct way to handle signal flags
@@ -22,12 +37,20 @@
 // and 'sig_atomic_t' guarantees that reads and writes to it are atomic,
 // preventing race conditions between the main loop and the signal handler.
 volatile sig_atomic_t terminal_resized_flag = 0;
+volatile sig_atomic_t stop_requested = 0;
+volatile sig_atomic_t report_requested = 0;
 
 void handle_resize_signal(int sig) {
     (void)sig;
     terminal_resized_flag = 1;
 }
 
+// SIGUSR1 asks for the --jitter report mid-playback; it is written between frames.
+void handle_report_signal(int sig) {
+    (void)sig;
+    report_requested = 1;
+}
+
 void hide_cursor() {
     printf("\x1b[?25l");
 }
@@ -36,13 +59,14 @@ void show_cursor() {
     printf("\x1b[?25h");
 }
 
-// Why this handler? A standard signal handler must accept an integer argument.
-// This function wraps our cursor-showing logic and ensures a clean exit,
-// which is the expected behavior for a SIGINT (Ctrl+C).
+// Why only set a flag? Exiting from inside the handler skips the encoder flush
+// and the container trailer, leaving an unplayable file behind. The main loops
+// poll this flag and unwind normally, restoring the cursor on the way out. A
+// second signal means the user really wants out, right now.
 void handle_interrupt(int sig) {
     (void)sig;
-    show_cursor();
-    exit(0);
+    if (stop_requested) _exit(130);
+    stop_requested = 1;
 }
 
 void fit_to_terminal(ProcessingContext* ctx, const EngineConfig* config) {
@@ -78,9 +102,702 @@ void fit_to_terminal(ProcessingContext* ctx, const EngineConfig* config) {
 }
 
 
+// Why a separate entry point? Concat never decodes anything, so it needs no
+// engine context. Everything after "--concat" up to the next option is a manifest.
+static int run_concat(int argc, char* argv[]) {
+    const char* output = NULL;
+    int first = 2, count = 0;
+    while (first + count < argc && strncmp(argv[first + count], "--", 2) != 0) count++;
+    for (int i = first + count; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) output = argv[++i];
+    }
+    if (count == 0 || !output) {
+        fprintf(stderr, "Usage: %s --concat <manifest>... --output <file>\n", argv[0]);
+        return 1;
+    }
+    char* error = NULL;
+    if (shard_concat((const char* const*)&argv[first], count, output, &error) != 0) {
+        fprintf(stderr, "Concat failed: %s\n", error ? error : "Unknown error");
+        return 1;
+    }
+    printf("Stitched %d segment(s) into %s\n", count, output);
+    return 0;
+}
+static int run_serve(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s --serve <socket> [--jobs <n>] [--queue <n>] [--threads <n>]\n", argv[0]);
+        return 1;
+    }
+    ServerOptions options = { .socket_path = argv[2] };
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.max_jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+            options.queue_depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads_per_job = atoi(argv[++i]);
+        }
+    }
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    char* error = NULL;
+    if (server_run(&options, &stop_requested, &error) != 0) {
+        fprintf(stderr, "Server failed: %s\n", error ? error : "Unknown error");
+        return 1;
+    }
+    return 0;
+}
+
+static int run_client(int argc, char* argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s --client <socket> <input> [--format ansi|text|png] [--output <file>] [--inline]"
+                        " [--max-frames <n>] [--width <n>] [--edge <f>] [--brightness <f>] [--saturate <f>]\n", argv[0]);
+        return 1;
+    }
+    EngineConfig config = {
+        .output_width = 120,
+        .edge_strength = 0.4f,
+        .brightness_factor = 1.0f,
+        .saturation_factor = 1.0f,
+    };
+    const char* format = "ansi";
+    const char* output = NULL;
+    int send_inline = 0;
+    long max_frames = 0;
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--inline") == 0) {
+            send_inline = 1;
+        } else if (strcmp(argv[i], "--max-frames") == 0 && i + 1 < argc) {
+            max_frames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            config.output_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--edge") == 0 && i + 1 < argc) {
+            config.edge_strength = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--brightness") == 0 && i + 1 < argc) {
+            config.brightness_factor = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--saturate") == 0 && i + 1 < argc) {
+            config.saturation_factor = strtof(argv[++i], NULL);
+        }
+    }
+    char message[256];
+    char* error = NULL;
+    if (client_run(argv[2], argv[3], &config, format, send_inline, max_frames, output,
+                   message, sizeof(message), &error) != 0) {
+        fprintf(stderr, "Job failed: %s\n", error ? error : "Unknown error");
+        return 1;
+    }
+    return 0;
+}
+
+// Why write in place? shm_ring_begin hands out the slot itself, so the grid
+// (or the rasterised frame) is produced straight into shared memory; readers
+// see it without any intermediate buffer.
+static void publish_to_ring(ShmRingWriter* ring, ProcessingContext* ctx, const EngineConfig* config,
+                            int raster, int64_t pts) {
+    EngineCellGrid grid;
+    if (engine_get_cell_grid(ctx, &grid) != 0) return;
+    if (raster) {
+        size_t size = (size_t)grid.width * 8 * grid.height * 8 * 3;
+        unsigned char* slot = shm_ring_begin(ring, size);
+        if (!slot || engine_render_to_rgb(ctx, config, slot, size) != 0) return;
+        shm_ring_commit(ring, SHM_FRAME_RGB24, grid.width * 8, grid.height * 8, size, pts);
+        return;
+    }
+    size_t cells = (size_t)grid.width * grid.height;
+    unsigned char* slot = shm_ring_begin(ring, cells * 4);
+    if (!slot) return;
+    for (int y = 0; y < grid.height; y++) {
+        memcpy(slot + (size_t)y * grid.width, grid.chars + (size_t)y * grid.char_stride, grid.width);
+        memcpy(slot + cells + (size_t)y * grid.width * 3, grid.colors + (size_t)y * grid.color_stride, (size_t)grid.width * 3);
+    }
+    shm_ring_commit(ring, SHM_FRAME_CELLS, grid.width, grid.height, cells * 4, pts);
+}
+
+// A reference consumer for --shm: it reports throughput, drops and
+// publish-to-read latency rather than drawing, so it measures the ring itself.
+static int run_shm_reader(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s --shm-read <name>\n", argv[0]);
+        return 1;
+    }
+    char* error = NULL;
+    ShmRingReader* reader = shm_ring_open(argv[2], &error);
+    if (!reader) {
+        fprintf(stderr, "Could not open ring: %s\n", error);
+        return 1;
+    }
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+
+    ShmFrame frame;
+    uint64_t dropped = 0, frames = 0, checksum = 0;
+    double latency_sum_ms = 0.0, latency_max_ms = 0.0;
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ret;
+    while (!stop_requested && (ret = shm_ring_next(reader, &frame, 200, &dropped)) >= 0) {
+        if (ret == 0) continue;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double latency_ms = ((int64_t)now.tv_sec * 1000000000LL + now.tv_nsec - frame.published_ns) / 1e6;
+        // Touch every byte, as a real consumer would, before validating.
+        uint64_t sum = 0;
+        for (size_t i = 0; i < frame.size; i++) sum += frame.data[i];
+        if (!shm_ring_reader_check(reader, &frame)) { dropped++; continue; }
+        checksum += sum;
+        frames++;
+        latency_sum_ms += latency_ms;
+        if (latency_ms > latency_max_ms) latency_max_ms = latency_ms;
+        fprintf(stderr, "frame %llu: %dx%d %s, %zu bytes, latency %.3f ms\r", (unsigned long long)frame.seq,
+                frame.width, frame.height, frame.format == SHM_FRAME_RGB24 ? "rgb24" : "cells", frame.size, latency_ms);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double secs = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "\nRead %llu frame(s), dropped %llu, %.1f frames/s, latency mean %.3f ms max %.3f ms (checksum %llx)\n",
+            (unsigned long long)frames, (unsigned long long)dropped, secs > 0 ? frames / secs : 0.0,
+            frames ? latency_sum_ms / frames : 0.0, latency_max_ms, (unsigned long long)checksum);
+    shm_ring_reader_close(&reader);
+    return 0;
+}
+
+// Formats the frame straight into the loop recording, so the bytes written
+// now are the bytes replayed later. Falls back to the normal path once the
+// pass is no longer being recorded.
+static void render_and_record(ProcessingContext* ctx, const EngineConfig* config, FrameLoop* frame_loop, long delay_us) {
+    static const char home[] = "\x1b[H";
+    size_t size = engine_format_ansi(ctx, config, NULL, 0) + sizeof(home) - 1;
+    char* text = frame_loop_reserve(frame_loop, size);
+    if (!text) {
+        engine_render_to_console(ctx, config);
+        return;
+    }
+    memcpy(text, home, sizeof(home) - 1);
+    size_t used = engine_format_ansi(ctx, config, text + sizeof(home) - 1, size - (sizeof(home) - 1)) + sizeof(home) - 1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fwrite(text, 1, used, stdout);
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    engine_record_stage(ctx, ENGINE_STAGE_OUTPUT,
+                        (int64_t)(end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec), (int64_t)used);
+    frame_loop_commit(frame_loop, used, delay_us);
+}
+
+static void report_broadcast(const Broadcaster* broadcaster) {
+    static time_t last_report = 0;
+    time_t now = time(NULL);
+    if (now == last_report) return;
+    last_report = now;
+    BroadcastStats st;
+    broadcast_get_stats(broadcaster, &st);
+    printf("\rframe %ld: %d viewer(s), delta %zu B, keyframes sent %ld, frames skipped %ld   ",
+           st.frames, st.viewers, st.last_delta_bytes, st.keyframes_sent, st.frames_skipped);
+    fflush(stdout);
+}
+
+static void write_shard_manifest(ProcessingContext* ctx, const EngineConfig* config, const char* input_file) {
+    ShardManifest manifest = {0};
+    snprintf(manifest.input, sizeof(manifest.input), "%s", input_file);
+    snprintf(manifest.segment, sizeof(manifest.segment), "%s", config->output_filename);
+    manifest.index = config->shard_index;
+    manifest.count = config->shard_count;
+    manifest.frames = engine_get_encoded_frame_count(ctx);
+    engine_get_range(ctx, &manifest.start_pts, &manifest.end_pts, &manifest.tb_num, &manifest.tb_den);
+    char manifest_path[SHARD_PATH_MAX + 16];
+    snprintf(manifest_path, sizeof(manifest_path), "%s.manifest", config->output_filename);
+    if (shard_write_manifest(manifest_path, &manifest) != 0) {
+        fprintf(stderr, "ERROR: Could not write shard manifest %s\n", manifest_path);
+    } else {
+        printf("Wrote shard %d/%d manifest to %s\n", config->shard_index + 1, config->shard_count, manifest_path);
+    }
+}
+
+// Why segments? A single MP4 is only playable once its trailer is written, so a
+// crash at 90% loses everything. With --checkpoint the output is produced as a
+// chain of closed segments, each starting on a source keyframe and committed
+// to a journal. A rerun with --resume seeks to the end of the last committed
+// segment and continues; the final step stitches segments and audio together.
+static int run_transcode(ProcessingContext* ctx, const EngineConfig* config, const char* input_file, int resume) {
+    int checkpointing = config->checkpoint_secs > 0.0f;
+    Checkpoint cp;
+    char segment_path[SHARD_PATH_MAX + 32];
+    int64_t segment_start = INT64_MIN;
+    double segment_start_secs = -1.0;
+    long segment_base_frames = 0;
+    int64_t last_pts = INT64_MIN;
+    int tb_num, tb_den;
+    char* error = NULL;
+    engine_get_time_base(ctx, &tb_num, &tb_den);
+
+    if (checkpointing) {
+        if (checkpoint_open(&cp, input_file, config->output_filename, resume, &error) != 0) {
+            fprintf(stderr, "Checkpoint error: %s\n", error);
+            return -1;
+        }
+        if (cp.complete) {
+            printf("Journal records a finished transcode; stitching %d segment(s)\n", cp.num_segments);
+        } else {
+            segment_start = checkpoint_resume_pts(&cp);
+            if (segment_start != INT64_MIN) {
+                if (engine_seek_to_pts(ctx, segment_start) != 0) {
+                    fprintf(stderr, "Could not seek to the last checkpoint\n");
+                    checkpoint_close(&cp);
+                    return -1;
+                }
+                printf("Resuming after %d committed segment(s)\n", cp.num_segments);
+            }
+            checkpoint_segment_path(&cp, cp.num_segments, segment_path, sizeof(segment_path));
+            if (engine_open_segment(ctx, config, segment_path, &error) != 0) {
+                fprintf(stderr, "Could not open segment %s: %s\n", segment_path, error);
+                checkpoint_close(&cp);
+                return -1;
+            }
+        }
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    int frame_count = 0;
+    int interrupted = 0;
+    int failed = 0;
+    printf("Transcoding... (Audio will be passed through)\n");
+    while (!(checkpointing && cp.complete) && engine_get_next_packet(ctx, packet) >= 0) {
+        if (stop_requested) {
+            interrupted = 1;
+            av_packet_unref(packet);
+            break;
+        }
+        if (packet->stream_index == engine_get_video_stream_idx(ctx)) {
+            struct AVFrame* frame = NULL;
+            if (engine_decode_video_packet(ctx, packet, &frame) == 0) {
+                int in_range = engine_frame_in_range(ctx, frame);
+                if (in_range > 0) {
+                    av_packet_unref(packet);
+                    break;
+                }
+                if (in_range < 0) {
+                    av_packet_unref(packet);
+                    continue;
+                }
+                if (checkpointing) {
+                    int64_t pts = engine_get_frame_pts(frame);
+                    double t = (double)pts * tb_num / tb_den;
+                    if (segment_start_secs < 0.0) {
+                        segment_start_secs = t;
+                    } else if (engine_frame_is_keyframe(frame) && t - segment_start_secs >= config->checkpoint_secs) {
+                        engine_close_segment(ctx);
+                        long frames = engine_get_encoded_frame_count(ctx) - segment_base_frames;
+                        if (checkpoint_commit(&cp, segment_path, segment_start, pts, frames, tb_num, tb_den) != 0) {
+                            fprintf(stderr, "\nCould not commit checkpoint\n");
+                            failed = 1;
+                            av_packet_unref(packet);
+                            break;
+                        }
+                        segment_start = pts;
+                        segment_start_secs = t;
+                        segment_base_frames += frames;
+                        checkpoint_segment_path(&cp, cp.num_segments, segment_path, sizeof(segment_path));
+                        if (engine_open_segment(ctx, config, segment_path, &error) != 0) {
+                            fprintf(stderr, "\nCould not open segment %s: %s\n", segment_path, error);
+                            failed = 1;
+                            av_packet_unref(packet);
+                            break;
+                        }
+                    }
+                    last_pts = pts;
+                }
+                engine_process_frame_to_ascii(ctx, frame, config);
+                if (engine_encode_video_frame(ctx, frame, config) != 0) {
+                    fprintf(stderr, "\nError encoding frame\n");
+                    failed = 1;
+                    av_packet_unref(packet);
+                    break;
+                }
+                printf("Encoded video frame %d\r", ++frame_count);
+                fflush(stdout);
+            }
+        } else if (packet->stream_index == engine_get_audio_stream_idx(ctx)) {
+            if (engine_remux_packet(ctx, packet) < 0) {
+                fprintf(stderr, "\nError writing audio packet. Stopping.\n");
+                failed = 1;
+                av_packet_unref(packet);
+                break;
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    if (!checkpointing) {
+        engine_finalize_video_encoder(ctx);
+        if (interrupted) {
+            printf("\nInterrupted; the partial output in %s is finalized and playable\n", config->output_filename);
+        } else {
+            printf("\nFinished encoding video to %s\n", config->output_filename);
+        }
+        if (config->shard_count > 0 && !interrupted && !failed) {
+            write_shard_manifest(ctx, config, input_file);
+        }
+        return failed ? -1 : 0;
+    }
+
+    // Why commit on interrupt? The segment was closed cleanly, so it is as good
+    // as any other. Resume then continues from the frame after the last one
+    // encoded instead of throwing the partial segment away.
+    int finished = cp.complete;
+    if (!cp.complete) {
+        engine_close_segment(ctx);
+        long frames = engine_get_encoded_frame_count(ctx) - segment_base_frames;
+        int stopped_early = interrupted || failed;
+        if (frames > 0 || !stopped_early) {
+            int64_t end_pts = stopped_early ? last_pts + 1 : INT64_MAX;
+            if (checkpoint_commit(&cp, segment_path, segment_start, end_pts, frames, tb_num, tb_den) != 0) {
+                fprintf(stderr, "\nCould not commit checkpoint\n");
+                failed = 1;
+            }
+        } else {
+            unlink(segment_path);
+        }
+        finished = !stopped_early && !failed;
+    }
+
+    int ret = failed ? -1 : 0;
+    if (cp.num_segments > 0) {
+        if (checkpoint_stitch(&cp, config->output_filename, &error) != 0) {
+            fprintf(stderr, "\nCould not stitch segments: %s\n", error);
+            ret = -1;
+        } else if (finished) {
+            printf("\nFinished encoding video to %s\n", config->output_filename);
+            checkpoint_remove(&cp);
+        } else {
+            printf("\nStopped early; %s holds everything up to the last checkpoint. Rerun with --resume to continue.\n",
+                   config->output_filename);
+        }
+    }
+    checkpoint_close(&cp);
+    return ret;
+}
+
+// --cache state for one conversion. cache stays NULL when the input cannot be
+// content-addressed: sequences, shards, anything that is not a regular file.
+typedef struct {
+    RenderCache* cache;
+    uint8_t digest[32];
+    int grid_hit;
+} CachedRun;
+
+static void cached_run_begin(CachedRun* run, RenderCache* cache, const char* input_file, const EngineConfig* config) {
+    memset(run, 0, sizeof(*run));
+    if (!cache || config->mode == MODE_SEQUENCE || config->shard_count > 0) return;
+    if (cache_hash_input(input_file, run->digest) == 0) run->cache = cache;
+}
+
+// A finished output found in the cache is copied into place; nothing is decoded.
+static int restore_cached_output(CachedRun* run, const EngineConfig* config) {
+    if (!run->cache || !config->output_filename) return -1;
+    CacheKey key;
+    cache_output_key(run->digest, config, config->output_filename, &key);
+    return cache_fetch_file(run->cache, &key, config->output_filename);
+}
+
+// Why a raw context on a grid hit? engine_init decodes a still image while it
+// initialises. Rendering a cached grid needs no source at all, so the raw
+// context gets a placeholder geometry and none of the source-side settings.
+static ProcessingContext* init_engine(const char* input_file, const EngineConfig* config, CachedRun* run, char** error) {
+    if (run->cache && config->mode == MODE_IMAGE) {
+        CacheKey key;
+        cache_grid_key(run->digest, config, &key);
+        EngineConfig raw_config = *config;
+        raw_config.crop_w = raw_config.crop_h = 0;
+        raw_config.autocrop = 0;
+        raw_config.lowres = 0;
+        ProcessingContext* ctx = engine_init_raw(64, 64, ENGINE_PIX_RGB24, &raw_config, error);
+        if (ctx && cache_fetch_grid(run->cache, &key, ctx) == 0) {
+            run->grid_hit = 1;
+            return ctx;
+        }
+        engine_cleanup(&ctx);
+    }
+    return engine_init(input_file, config, error);
+}
+
+static void write_jitter_report(const PlaybackTiming* timing, const ProcessingContext* ctx, const char* path) {
+    int cols, rows;
+    char* error = NULL;
+    engine_get_output_dims(ctx, &cols, &rows);
+    if (playback_timing_write_json(timing, path, cols, rows, &error) != 0) fprintf(stderr, "--jitter: %s\n", error);
+}
+
+static void store_in_cache(CachedRun* run, ProcessingContext* ctx, const EngineConfig* config) {
+    if (!run->cache) return;
+    CacheKey key;
+    EngineCellGrid grid;
+    if (config->mode == MODE_IMAGE && !run->grid_hit && engine_get_cell_grid(ctx, &grid) == 0) {
+        cache_grid_key(run->digest, config, &key);
+        cache_store_grid(run->cache, &key, &grid);
+    }
+    if (config->output_filename) {
+        cache_output_key(run->digest, config, config->output_filename, &key);
+        cache_store_file(run->cache, &key, config->output_filename);
+    }
+}
+
+typedef struct {
+    EngineConfig config;
+    int use_cache;
+    const char* cache_dir;
+    long long cache_max_bytes;
+} FarmSettings;
+
+// Runs inside a farm worker process: one manifest line, start to finish. A
+// retried checkpointed transcode resumes from the attempt that crashed.
+static int convert_file(const char* input, const char* output, int attempt, void* user, char** error) {
+    const FarmSettings* settings = (const FarmSettings*)user;
+    // Opened on the first job, after the fork, so each worker has its own
+    // handle; entries are published atomically, so they can share the directory.
+    static RenderCache* cache = NULL;
+    if (settings->use_cache && !cache) {
+        char* cache_error = NULL;
+        cache = cache_open(settings->cache_dir, settings->cache_max_bytes, &cache_error);
+    }
+    EngineConfig config = settings->config;
+    config.output_filename = (char*)output;
+    if (is_sequence_input(input)) {
+        config.mode = MODE_SEQUENCE;
+    } else if (is_animated_file(input)) {
+        config.mode = strstr(input, ".gif") ? MODE_ANIMATED_GIF : MODE_VIDEO;
+    } else {
+        config.mode = MODE_IMAGE;
+    }
+    if (config.mode != MODE_VIDEO && config.mode != MODE_ANIMATED_GIF) config.checkpoint_secs = 0.0f;
+    if (!is_animated_file(output)) config.checkpoint_secs = 0.0f;
+
+    CachedRun run;
+    cached_run_begin(&run, cache, input, &config);
+    if (restore_cached_output(&run, &config) == 0) return 0;
+
+    ProcessingContext* ctx = init_engine(input, &config, &run, error);
+    if (!ctx) return -1;
+    int ret;
+    if (config.mode == MODE_IMAGE) {
+        struct AVFrame* frame = NULL;
+        ret = run.grid_hit || engine_decode_video_packet(ctx, NULL, &frame) == 0 ? 0 : -1;
+        if (ret == 0) {
+            if (!run.grid_hit) engine_process_frame_to_ascii(ctx, frame, &config);
+            ret = engine_render_to_image_file(ctx, &config);
+        }
+        if (ret != 0) *error = "Could not decode the image or write the output";
+    } else {
+        ret = run_transcode(ctx, &config, input, attempt > 1);
+        if (ret != 0) *error = "Transcode failed";
+    }
+    if (ret == 0) store_in_cache(&run, ctx, &config);
+    engine_cleanup(&ctx);
+    return ret;
+}
+
+static int run_farm(int argc, char* argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s --farm <manifest> [--workers <n>] [--retries <n>] [--job-timeout <secs>]"
+                        " [--report <file>] [--width <n>] [--edge <f>] [--brightness <f>] [--saturate <f>]"
+                        " [--crf <n>] [--threads <n>] [--checkpoint <secs>] [--no-simd]"
+                        " [--cache] [--cache-dir <dir>] [--cache-max <MiB>]\n", argv[0]);
+        return 1;
+    }
+    FarmOptions options = { .manifest_path = argv[2] };
+    FarmSettings settings = {0};
+    // Why 1.0 aspect correction? Every farm job writes an image or video file,
+    // where each cell becomes an 8x8 square of pixels.
+    EngineConfig config = {
+        .output_width = 120,
+        .edge_strength = 0.4f,
+        .aspect_correction = 1.0f,
+        .brightness_factor = 1.0f,
+        .saturation_factor = 1.0f,
+        .use_color = 1,
+        .use_simd = 1,
+        .crf = 23
+    };
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            options.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            options.max_attempts = atoi(argv[++i]) + 1;
+        } else if (strcmp(argv[i], "--job-timeout") == 0 && i + 1 < argc) {
+            options.job_timeout_secs = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            options.report_path = argv[++i];
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            config.output_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--edge") == 0 && i + 1 < argc) {
+            config.edge_strength = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--brightness") == 0 && i + 1 < argc) {
+            config.brightness_factor = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--saturate") == 0 && i + 1 < argc) {
+            config.saturation_factor = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--crf") == 0 && i + 1 < argc) {
+            config.crf = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            config.checkpoint_secs = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--no-simd") == 0) {
+            config.use_simd = 0;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            settings.use_cache = 1;
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            settings.use_cache = 1;
+            settings.cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc) {
+            settings.cache_max_bytes = atoll(argv[++i]) * 1024 * 1024;
+        }
+    }
+    // Why split the cores? Each worker is a whole process; letting every one
+    // of them size its pool to the machine would oversubscribe it N times.
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    if (config.num_threads == 0) {
+        int workers = options.workers > 0 ? options.workers : (int)cores;
+        config.num_threads = cores / workers > 1 ? (int)(cores / workers) : 1;
+    }
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    char* error = NULL;
+    settings.config = config;
+    int ret = farm_run(&options, convert_file, &settings, &stop_requested, &error);
+    if (ret < 0) {
+        fprintf(stderr, "Farm failed: %s\n", error ? error : "Unknown error");
+        return 1;
+    }
+    return ret;
+}
+
+static int run_throughput(int argc, char* argv[]) {
+    ThroughputOptions options = {0};
+    EngineConfig config = {
+        .edge_strength = 0.4f,
+        .brightness_factor = 1.0f,
+        .saturation_factor = 1.0f,
+        .use_color = 1,
+        .use_simd = 1,
+        .crf = 23
+    };
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            options.max_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &options.source_width, &options.source_height) != 2 ||
+                options.source_width < 64 || options.source_height < 64) {
+                fprintf(stderr, "Invalid --source spec '%s' (expected WxH, e.g. 1280x720)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            options.runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            options.base_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "transcode") == 0) {
+                options.pipelines = THROUGHPUT_TRANSCODE;
+            } else if (strcmp(argv[i], "playback") == 0) {
+                options.pipelines = THROUGHPUT_PLAYBACK;
+            } else {
+                fprintf(stderr, "Unknown --pipeline '%s' (expected transcode or playback)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--media-dir") == 0 && i + 1 < argc) {
+            options.media_dir = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.json_path = argv[++i];
+        } else if (strcmp(argv[i], "--edge") == 0 && i + 1 < argc) {
+            config.edge_strength = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--crf") == 0 && i + 1 < argc) {
+            config.crf = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-simd") == 0) {
+            config.use_simd = 0;
+        }
+    }
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    char* error = NULL;
+    if (throughput_run(&options, &config, &stop_requested, &error) != 0) {
+        fprintf(stderr, "\nThroughput benchmark failed: %s\n", error ? error : "Unknown error");
+        return 1;
+    }
+    return 0;
+}
+
+static int run_verify(int argc, char* argv[]) {
+    VerifyOptions options = { .synthetic = 1 };
+    EngineConfig config = {
+        .edge_strength = 0.4f,
+        .aspect_correction = 0.5f,
+        .brightness_factor = 1.0f,
+        .saturation_factor = 1.0f,
+        .use_color = 1
+    };
+    const char** inputs = (const char**)calloc((size_t)argc, sizeof(char*));
+    if (!inputs) return 1;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            options.max_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            options.width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--edge") == 0 && i + 1 < argc) {
+            config.edge_strength = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            options.golden_path = argv[++i];
+        } else if (strcmp(argv[i], "--record-golden") == 0 && i + 1 < argc) {
+            options.golden_path = argv[++i];
+            options.record_golden = 1;
+        } else if (strcmp(argv[i], "--no-synthetic") == 0) {
+            options.synthetic = 0;
+        } else {
+            inputs[options.input_count++] = argv[i];
+        }
+    }
+    options.inputs = inputs;
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    char* error = NULL;
+    int ret = verify_run(&options, &config, &stop_requested, &error);
+    free(inputs);
+    if (ret < 0) {
+        fprintf(stderr, "Verification failed to run: %s\n", error ? error : "Unknown error");
+        return 2;
+    }
+    return ret;
+}
+
 int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--concat") == 0) {
+        return run_concat(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+        return run_serve(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--client") == 0) {
+        return run_client(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--farm") == 0) {
+        return run_farm(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--throughput") == 0) {
+        return run_throughput(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--verify") == 0) {
+        return run_verify(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--shm-read") == 0) {
+        return run_shm_reader(argc, argv);
+    }
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <input_file> [options]\n", argv[0]);
+        fprintf(stderr, "  <input_file> may be an image, a video, a directory of images or a pattern like shot_%%05d.png\n");
         fprintf(stderr, "Options:\n");
         fprintf(stderr, "  --width <n>          Set output width in characters (e.g., 120)\n");
         fprintf(stderr, "  --edge <f>           Set edge detection threshold (e.g., 0.4)\n");
@@ -91,6 +808,44 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "  --threads <n>        Number of threads to use (0=auto)\n");
         fprintf(stderr, "  --crf <n>            Video quality (Constant Rate Factor, 0-51, lower is better, 18-28 is sane)\n");
         fprintf(stderr, "  --no-simd            Disable SIMD optimizations\n");
+        fprintf(stderr, "  --autotune           Pick threads, row bands and kernel by measurement (cached per CPU and size)\n");
+        fprintf(stderr, "  --checkpoint <secs>  Commit the transcode as keyframe-aligned segments every <secs> of media time\n");
+        fprintf(stderr, "  --resume             Continue a checkpointed transcode from its last committed segment\n");
+        fprintf(stderr, "  --contact-sheet <CxR> Render a CxR grid of keyframe thumbnails sampled across a video\n");
+        fprintf(stderr, "  --lowres <n>         Decode at 1/2^n resolution where the codec supports it\n");
+        fprintf(stderr, "  --crop <x:y:w:h>     Convert only this region of the source frame\n");
+        fprintf(stderr, "  --autocrop           Detect and remove black letterbox/pillarbox bars\n");
+        fprintf(stderr, "  --fps <f>            Frame rate for image-sequence input (default 25)\n");
+        fprintf(stderr, "  --shard <i/N>        Transcode only the i-th of N GOP-aligned slices (writes <output>.manifest)\n");
+        fprintf(stderr, "  --shm <name>         Publish playback frames to a shared-memory ring instead of the console\n");
+        fprintf(stderr, "  --shm-raster         Publish rasterised RGB24 frames rather than cell grids\n");
+        fprintf(stderr, "  --shm-slots <n>      Frames the ring holds (default 8)\n");
+        fprintf(stderr, "  --broadcast <addr>   Serve playback to many viewers on a Unix socket or tcp:<port> (localhost)\n");
+        fprintf(stderr, "  --loop               Loop playback, replaying the first pass from memory\n");
+        fprintf(stderr, "  --loop-cache <MiB>   Memory cap for the recorded pass (default 256)\n");
+        fprintf(stderr, "  --tune               Tune --width, --edge, --brightness and --saturate on a still, live\n");
+        fprintf(stderr, "  --stats              Print per-stage timings (latency percentiles, share of wall time) at exit\n");
+        fprintf(stderr, "  --stats-json <file>  Also write them, per thread, as JSON\n");
+        fprintf(stderr, "  --counters           Add hardware counters (IPC, cache and branch misses) to --stats\n");
+        fprintf(stderr, "  --trace <file>       Write per-thread stage spans as Chrome trace JSON (Perfetto) at exit\n");
+        fprintf(stderr, "  --trace-spans <n>    Spans kept per thread; older ones are overwritten (default 65536)\n");
+        fprintf(stderr, "  --jitter <file>      Write frame lateness against PTS deadlines as JSON at exit and on SIGUSR1 (- = stderr)\n");
+        fprintf(stderr, "  --cache              Reuse cached outputs and cell grids (~/.cache/pixel-ripper)\n");
+        fprintf(stderr, "  --cache-dir <dir>    Cache in <dir> instead\n");
+        fprintf(stderr, "  --cache-max <MiB>    Evict least recently used entries beyond this size (default 1024)\n");
+        fprintf(stderr, "Other modes:\n");
+        fprintf(stderr, "  %s --concat <manifest>... --output <file>   Stitch shard segments and the source audio\n", argv[0]);
+        fprintf(stderr, "  %s --serve <socket> [--jobs n] [--queue n] [--threads n]   Run a render daemon\n", argv[0]);
+        fprintf(stderr, "  %s --client <socket> <input> [options]   Submit one job to a running daemon\n", argv[0]);
+        fprintf(stderr, "  %s --shm-read <name>   Consume a --shm ring and report throughput and latency\n", argv[0]);
+        fprintf(stderr, "  %s --farm <manifest> [--workers <n>] [--retries <n>] [--job-timeout <secs>] [--report <file>]\n"
+                        "      Convert every <input><TAB><output> line in crash-isolated worker processes\n", argv[0]);
+        fprintf(stderr, "  %s --throughput [--max-threads <n>] [--source <WxH>] [--frames <n>] [--runs <n>] [--width <n>]\n"
+                        "      [--pipeline transcode|playback] [--media-dir <dir>] [--json <file>]\n"
+                        "      Time transcode and playback on generated media at 1..N threads\n", argv[0]);
+        fprintf(stderr, "  %s --verify [image...] [--max-threads <n>] [--width <n>] [--golden <file>] [--record-golden <file>]\n"
+                        "      [--no-synthetic]\n"
+                        "      Check that every kernel and thread count renders the same output\n", argv[0]);
         return 1;
     }
 
@@ -108,6 +863,25 @@ int main(int argc, char *argv[]) {
         .crf = 23 // A sane default for good quality and reasonable file size.
     };
     int fit_terminal = 0;
+    int resume = 0;
+    int sheet_cols = 0, sheet_rows = 0;
+    const char* shm_name = NULL;
+    int shm_raster = 0;
+    int shm_slots = 8;
+    const char* broadcast_address = NULL;
+    int use_cache = 0;
+    int loop = 0;
+    int loop_cache_mb = 256;
+    int tune = 0;
+    int autotune = 0;
+    int stats = 0;
+    int counters = 0;
+    const char* stats_json = NULL;
+    const char* trace_path = NULL;
+    long trace_spans = 65536;
+    const char* jitter_path = NULL;
+    const char* cache_dir = NULL;
+    long long cache_max_bytes = 0;
 
     for (int i = 2; i < argc; i++) {
         if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
@@ -128,11 +902,76 @@ int main(int argc, char *argv[]) {
             config.crf = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--no-simd") == 0) {
             config.use_simd = 0;
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            config.checkpoint_secs = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume = 1;
+        } else if (strcmp(argv[i], "--contact-sheet") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &sheet_cols, &sheet_rows) != 2 || sheet_cols <= 0 || sheet_rows <= 0) {
+                fprintf(stderr, "Invalid --contact-sheet spec '%s' (expected CxR, e.g. 4x3)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--lowres") == 0 && i + 1 < argc) {
+            config.lowres = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--crop") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%d:%d:%d:%d", &config.crop_x, &config.crop_y, &config.crop_w, &config.crop_h) != 4 ||
+                config.crop_x < 0 || config.crop_y < 0 || config.crop_w <= 0 || config.crop_h <= 0) {
+                fprintf(stderr, "Invalid --crop spec '%s' (expected x:y:w:h)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            config.sequence_fps = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--autocrop") == 0) {
+            config.autocrop = 1;
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (strcmp(argv[i], "--shm-raster") == 0) {
+            shm_raster = 1;
+        } else if (strcmp(argv[i], "--shm-slots") == 0 && i + 1 < argc) {
+            shm_slots = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--broadcast") == 0 && i + 1 < argc) {
+            broadcast_address = argv[++i];
+        } else if (strcmp(argv[i], "--loop") == 0) {
+            loop = 1;
+        } else if (strcmp(argv[i], "--loop-cache") == 0 && i + 1 < argc) {
+            loop_cache_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tune") == 0) {
+            tune = 1;
+        } else if (strcmp(argv[i], "--autotune") == 0) {
+            autotune = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            stats = 1;
+            stats_json = argv[++i];
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            stats = 1;
+            counters = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace-spans") == 0 && i + 1 < argc) {
+            trace_spans = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) {
+            jitter_path = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            use_cache = 1;
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            use_cache = 1;
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc) {
+            cache_max_bytes = atoll(argv[++i]) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            if (shard_parse_spec(argv[++i], &config.shard_index, &config.shard_count) != 0) {
+                fprintf(stderr, "Invalid --shard spec '%s' (expected i/N with 1 <= i <= N)\n", argv[i]);
+                return 1;
+            }
         }
     }
 
     const char* input_file = argv[1];
-    if (is_animated_file(input_file)) {
+    if (is_sequence_input(input_file)) {
+        config.mode = MODE_SEQUENCE;
+    } else if (is_animated_file(input_file)) {
         if (strstr(input_file, ".gif")) {
             config.mode = MODE_ANIMATED_GIF;
         } else {
@@ -142,6 +981,49 @@ int main(int argc, char *argv[]) {
         config.mode = MODE_IMAGE;
     }
 
+    int seekable_video = (config.mode == MODE_VIDEO || config.mode == MODE_ANIMATED_GIF);
+    if (config.shard_count > 0 && (!seekable_video || !config.output_filename || !is_animated_file(config.output_filename))) {
+        fprintf(stderr, "--shard needs a video input and a video --output segment\n");
+        return 1;
+    }
+
+    if (sheet_cols > 0 && (!seekable_video || (config.output_filename && is_animated_file(config.output_filename)))) {
+        fprintf(stderr, "--contact-sheet needs a video input and renders to the console or an image --output\n");
+        return 1;
+    }
+    if (shm_name && (config.mode == MODE_IMAGE || config.output_filename || sheet_cols > 0)) {
+        fprintf(stderr, "--shm publishes video playback; it needs a video or sequence input and no --output\n");
+        return 1;
+    }
+    if (broadcast_address && (config.mode == MODE_IMAGE || config.output_filename || sheet_cols > 0 || shm_name)) {
+        fprintf(stderr, "--broadcast serves video playback; it needs a video or sequence input, no --output and no --shm\n");
+        return 1;
+    }
+    if (loop && (config.mode == MODE_IMAGE || config.output_filename || sheet_cols > 0)) {
+        fprintf(stderr, "--loop applies to video playback; it needs a video or sequence input and no --output\n");
+        return 1;
+    }
+    if (jitter_path && (config.mode == MODE_IMAGE || config.output_filename || sheet_cols > 0 || shm_name ||
+                        broadcast_address)) {
+        fprintf(stderr, "--jitter measures console playback; it needs a video or sequence input and no --output, --shm or --broadcast\n");
+        return 1;
+    }
+    if (tune && (config.mode != MODE_IMAGE || config.output_filename)) {
+        fprintf(stderr, "--tune works on a still image in the console; it needs an image input and no --output\n");
+        return 1;
+    }
+    // Why no cache with --tune? A cached grid skips the decode, and tuning
+    // needs the decoded picture and its planes.
+    if (tune) use_cache = 0;
+    if (resume && config.checkpoint_secs <= 0.0f) {
+        config.checkpoint_secs = 10.0f;
+    }
+    if (config.checkpoint_secs > 0.0f && (config.shard_count > 0 || !seekable_video ||
+                                         !config.output_filename || !is_animated_file(config.output_filename))) {
+        fprintf(stderr, "--checkpoint needs a video input and a video --output, and cannot be combined with --shard\n");
+        return 1;
+    }
+
     if (config.output_filename) {
         // Why 1.0 aspect correction for file output? Because the output is a pixel-based
         // image or video, not a character grid. Each character will be rendered into
@@ -151,97 +1033,268 @@ int main(int argc, char *argv[]) {
     }
 
     char* error = NULL;
-    ProcessingContext* ctx = engine_init(input_file, &config, &error);
+    RenderCache* cache = NULL;
+    if (use_cache) {
+        cache = cache_open(cache_dir, cache_max_bytes, &error);
+        if (!cache) fprintf(stderr, "Cache disabled: %s\n", error);
+    }
+    CachedRun run;
+    cached_run_begin(&run, cache, input_file, &config);
+    if (restore_cached_output(&run, &config) == 0) {
+        printf("Restored %s from the cache without decoding\n", config.output_filename);
+        cache_close(&cache);
+        return 0;
+    }
+
+    ProcessingContext* ctx = init_engine(input_file, &config, &run, &error);
     if (!ctx) {
         fprintf(stderr, "Engine initialization failed: %s\n", error ? error : "Unknown error");
+        cache_close(&cache);
         return 1;
     }
+    if (run.grid_hit) printf("Cell grid restored from the cache; rendering only\n");
+    // Why after init? The grid size comes from the source's aspect, which is
+    // known only once it is open. A different thread count means a new
+    // context, since the workers are sized at init.
+    if (autotune && !run.grid_hit) {
+        int cols, rows;
+        engine_get_output_dims(ctx, &cols, &rows);
+        AutotuneResult tuned;
+        if (autotune_resolve(&config, cols, rows, engine_get_video_aspect(ctx), cache_dir, &tuned, &error) != 0) {
+            fprintf(stderr, "--autotune: %s; keeping the defaults\n", error);
+        } else {
+            char split[32] = "contiguous slices";
+            if (tuned.band_rows > 0) snprintf(split, sizeof(split), "%d-row bands", tuned.band_rows);
+            printf("Autotune (%s): %d thread(s), %s, %s kernel, %.2f ms/frame\n", tuned.cached ? "cached" : "measured",
+                   tuned.threads, split, tuned.use_simd ? "SSE" : "scalar", tuned.frame_ms);
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            int engine_threads = config.num_threads > 0 ? config.num_threads : (cores > 0 ? (int)cores : 1);
+            config.band_rows = tuned.band_rows;
+            config.use_simd = tuned.use_simd;
+            if (tuned.threads != engine_threads) {
+                config.num_threads = tuned.threads;
+                engine_cleanup(&ctx);
+                ctx = engine_init(input_file, &config, &error);
+                if (!ctx) {
+                    fprintf(stderr, "Engine initialization failed: %s\n", error ? error : "Unknown error");
+                    cache_close(&cache);
+                    return 1;
+                }
+            }
+        }
+    }
+    if (stats && engine_enable_stats(ctx, 1) != 0) fprintf(stderr, "--stats: could not allocate the timing tables\n");
+    // Why ignore a failure? Perf events are often forbidden (containers,
+    // perf_event_paranoid); the timings are still worth having without them.
+    if (counters) engine_enable_counters(ctx, 1);
+    if (trace_path && engine_enable_trace(ctx, trace_spans > 0 ? (size_t)trace_spans : 65536) != 0) {
+        fprintf(stderr, "--trace: could not allocate the span buffers\n");
+        trace_path = NULL;
+    }
+
+    if (config.autocrop && config.output_filename && !run.grid_hit) {
+        int cx, cy, cw, ch;
+        engine_get_crop(ctx, &cx, &cy, &cw, &ch);
+        printf("Autocrop region: %d:%d:%d:%d\n", cx, cy, cw, ch);
+    }
+
+    // Why size slots from the grid now? Dimensions are fixed for the whole run
+    // (no terminal to resize to), so every slot fits every frame exactly.
+    ShmRingWriter* ring = NULL;
+    if (shm_name) {
+        int cols, rows;
+        engine_get_output_dims(ctx, &cols, &rows);
+        size_t slot_bytes = shm_raster ? (size_t)cols * 8 * rows * 8 * 3 : (size_t)cols * rows * 4;
+        ring = shm_ring_create(shm_name, shm_slots, slot_bytes, &error);
+        if (!ring) {
+            fprintf(stderr, "Could not create ring: %s\n", error);
+            engine_cleanup(&ctx);
+            return 1;
+        }
+        printf("Publishing %dx%d %s frames to shared memory /%s\n", cols, rows,
+               shm_raster ? "rasterised" : "cell", shm_name[0] == '/' ? shm_name + 1 : shm_name);
+    }
+
+    Broadcaster* broadcaster = NULL;
+    if (broadcast_address) {
+        broadcaster = broadcast_open(broadcast_address, &error);
+        if (!broadcaster) {
+            fprintf(stderr, "Could not start broadcast: %s\n", error);
+            engine_cleanup(&ctx);
+            return 1;
+        }
+        printf("Broadcasting on %s (watch with: socat -u %s%s -)\n", broadcast_address,
+               strncmp(broadcast_address, "tcp:", 4) == 0 ? "TCP:127.0.0.1:" : "UNIX-CONNECT:",
+               strncmp(broadcast_address, "tcp:", 4) == 0 ? broadcast_address + 4 : broadcast_address);
+    }
+    int headless = ring || broadcaster;
 
-    if (fit_terminal) {
+    if (fit_terminal && !headless) {
         fit_to_terminal(ctx, &config);
         if (!config.output_filename) {
             signal(SIGWINCH, handle_resize_signal);
         }
     }
 
-    if (!config.output_filename) {
+    // Why trap SIGINT and SIGTERM? In the console, so we can restore the cursor
+    // if the user hits Ctrl+C; leaving it hidden after exit is poor form. When
+    // transcoding, so a Ctrl+C or a preemption still closes the container and
+    // leaves a playable file.
+    signal(SIGINT, handle_interrupt);
+    signal(SIGTERM, handle_interrupt);
+    if (jitter_path) signal(SIGUSR1, handle_report_signal);
+    if (!config.output_filename && !headless) {
         hide_cursor();
-        // Why trap SIGINT? So we can restore the cursor if the user hits Ctrl+C.
-        // Leaving the cursor hidden after exit is poor form.
-        signal(SIGINT, handle_interrupt);
     }
 
-    if (config.mode == MODE_VIDEO || config.mode == MODE_ANIMATED_GIF) {
+    PlaybackTiming* timing = NULL;
+
+    if (sheet_cols > 0) {
+        if (engine_render_contact_sheet(ctx, &config, sheet_cols, sheet_rows) != 0) {
+            fprintf(stderr, "ERROR: Could not build the contact sheet (unknown duration or undecodable keyframes).\n");
+        } else if (config.output_filename) {
+            if (engine_render_to_image_file(ctx, &config) == 0) {
+                printf("Rendered %dx%d contact sheet to %s\n", sheet_cols, sheet_rows, config.output_filename);
+            } else {
+                fprintf(stderr, "ERROR: Could not write image to disk. Check permissions or path.\n");
+            }
+        } else {
+            engine_render_to_console(ctx, &config);
+            printf("\n");
+        }
+    } else if (config.mode == MODE_VIDEO || config.mode == MODE_ANIMATED_GIF || config.mode == MODE_SEQUENCE) {
         if (config.output_filename) {
-            AVPacket* packet = av_packet_alloc();
-            int frame_count = 0;
-            printf("Transcoding... (Audio will be passed through)\n");
-            while(engine_get_next_packet(ctx, packet) >= 0) {
-                if (packet->stream_index == engine_get_video_stream_idx(ctx)) {
-                    struct AVFrame* frame = NULL;
-                    if (engine_decode_video_packet(ctx, packet, &frame) == 0) {
-                        engine_process_frame_to_ascii(ctx, frame, &config);
-                        if (engine_encode_video_frame(ctx, frame, &config) != 0) {
-                            fprintf(stderr, "\nError encoding frame\n");
-                            break;
-                        }
-                        printf("Encoded video frame %d\r", ++frame_count);
-                        fflush(stdout);
-                    }
-                } else if (packet->stream_index == engine_get_audio_stream_idx(ctx)) {
-                    if (engine_remux_packet(ctx, packet) < 0) {
-                        fprintf(stderr, "\nError writing audio packet. Stopping.\n");
-                        break;
-                    }
-                }
-                av_packet_unref(packet);
+            if (run_transcode(ctx, &config, input_file, resume) != 0) {
+                engine_cleanup(&ctx);
+                cache_close(&cache);
+                return 1;
             }
-            engine_finalize_video_encoder(ctx);
-            printf("\nFinished encoding video to %s\n", config.output_filename);
-            av_packet_free(&packet);
+            if (!stop_requested) store_in_cache(&run, ctx, &config);
         } else { // Real-time playback
             struct AVFrame* frame = NULL;
             AVPacket* packet = av_packet_alloc();
-            while (engine_get_next_packet(ctx, packet) >= 0) {
-                 if (terminal_resized_flag) {
-                    printf("\x1b[2J"); // Clear screen
+            FrameLoop* frame_loop = (loop && !headless) ? frame_loop_create((size_t)loop_cache_mb * 1024 * 1024) : NULL;
+            int64_t first_pts = AV_NOPTS_VALUE;
+            int tb_num, tb_den;
+            engine_get_time_base(ctx, &tb_num, &tb_den);
+            // Ring and broadcast consumers pace themselves; only the console
+            // is held to the source's timestamps.
+            if (!headless) timing = playback_timing_create();
+            for (;;) {
+                frame_loop_begin_pass(frame_loop);
+                while (!stop_requested && engine_get_next_packet(ctx, packet) >= 0) {
+                     if (terminal_resized_flag && !headless) {
+                        printf("\x1b[2J"); // Clear screen
+                        fit_to_terminal(ctx, &config);
+                        terminal_resized_flag = 0;
+                        frame_loop_discard(frame_loop);
+                     }
+                     if (packet->stream_index == engine_get_video_stream_idx(ctx)) {
+                        if (engine_decode_video_packet(ctx, packet, &frame) == 0 && frame) {
+                            double frame_delay_secs = engine_get_frame_delay_secs(ctx, frame);
+                            long frame_delay_us = (long)(frame_delay_secs * 1000000.0);
+                            if (first_pts == AV_NOPTS_VALUE) first_pts = engine_get_frame_pts(frame);
+                            engine_process_frame_to_ascii(ctx, frame, &config);
+                            int late = playback_timing_wait(timing, engine_get_frame_pts(frame), tb_num, tb_den,
+                                                            frame_delay_secs, &stop_requested);
+                            // A pass being recorded for --loop keeps every frame,
+                            // so the replay has no holes.
+                            if (late && !frame_loop) {
+                                playback_timing_skipped(timing);
+                            } else if (frame_loop) {
+                                render_and_record(ctx, &config, frame_loop, frame_delay_us);
+                            } else if (ring) {
+                                publish_to_ring(ring, ctx, &config, shm_raster, engine_get_frame_pts(frame));
+                            } else if (broadcaster) {
+                                EngineCellGrid grid;
+                                if (engine_get_cell_grid(ctx, &grid) == 0) broadcast_frame(broadcaster, &grid, config.use_color);
+                                report_broadcast(broadcaster);
+                            } else {
+                                engine_render_to_console(ctx, &config);
+                            }
+                            playback_timing_presented(timing);
+                            if (report_requested && jitter_path) {
+                                report_requested = 0;
+                                write_jitter_report(timing, ctx, jitter_path);
+                            }
+                            // Why pump instead of sleeping? The frame interval is when
+                            // viewers join and slow sockets drain.
+                            if (broadcaster) {
+                                broadcast_pump(broadcaster, (int)(frame_delay_us / 1000));
+                            } else if (!timing) {
+                                usleep(frame_delay_us);
+                            }
+                        }
+                     }
+                     av_packet_unref(packet);
+                }
+                if (!loop || stop_requested) break;
+                // A fully recorded pass replays from memory; it returns only on
+                // Ctrl-C or a resize, after which the next pass records anew.
+                if (frame_loop_complete(frame_loop)) {
+                    frame_loop_replay(frame_loop, &stop_requested, &terminal_resized_flag);
+                    if (stop_requested) break;
+                    printf("\x1b[2J");
                     fit_to_terminal(ctx, &config);
                     terminal_resized_flag = 0;
-                 }
-                 if (packet->stream_index == engine_get_video_stream_idx(ctx)) {
-                    if (engine_decode_video_packet(ctx, packet, &frame) == 0 && frame) {
-                        long frame_delay_us = (long)(engine_get_frame_delay_secs(ctx, frame) * 1000000.0);
-                        engine_process_frame_to_ascii(ctx, frame, &config);
-                        engine_render_to_console(ctx, &config);
-                        usleep(frame_delay_us);
-                    }
-                 }
-                 av_packet_unref(packet);
+                }
+                playback_timing_restart(timing);
+                if (first_pts == AV_NOPTS_VALUE || engine_seek_to_pts(ctx, first_pts) != 0) {
+                    fprintf(stderr, "\n--loop: this input cannot be rewound; stopping after one pass\n");
+                    break;
+                }
             }
+            frame_loop_free(&frame_loop);
             av_packet_free(&packet);
         }
     } else { // Image mode
         struct AVFrame* frame = NULL;
-        if (engine_decode_video_packet(ctx, NULL, &frame) == 0) {
-            engine_process_frame_to_ascii(ctx, frame, &config);
-            if (config.output_filename) {
+        if (tune) engine_retain_planes(ctx, 1);
+        if (run.grid_hit || engine_decode_video_packet(ctx, NULL, &frame) == 0) {
+            if (!run.grid_hit) engine_process_frame_to_ascii(ctx, frame, &config);
+            if (tune) {
+                if (tune_run(ctx, &config, &stop_requested, &error) != 0) {
+                    fprintf(stderr, "--tune: %s\n", error);
+                }
+            } else if (config.output_filename) {
                 if (engine_render_to_image_file(ctx, &config) == 0) {
                     printf("Rendered ASCII art to %s\n", config.output_filename);
+                    store_in_cache(&run, ctx, &config);
                 } else {
                     fprintf(stderr, "ERROR: Could not write image to disk. Check permissions or path.\n");
                 }
             } else {
                 engine_render_to_console(ctx, &config);
                 printf("\n");
+                store_in_cache(&run, ctx, &config);
             }
         }
     }
 
-    if (!config.output_filename) {
+    if (!config.output_filename && !headless) {
         show_cursor();
     }
+    if (broadcaster) printf("\n");
+    if (stats) {
+        stats_report_print(ctx, stderr);
+        if (stats_json && stats_report_write_json(ctx, stats_json, &error) != 0) {
+            fprintf(stderr, "--stats-json: %s\n", error);
+        }
+    }
+    if (trace_path) {
+        if (engine_write_trace(ctx, trace_path, &error) == 0) {
+            fprintf(stderr, "Trace written to %s (open it in ui.perfetto.dev)\n", trace_path);
+        } else {
+            fprintf(stderr, "--trace: %s\n", error);
+        }
+    }
+    if (jitter_path && timing) write_jitter_report(timing, ctx, jitter_path);
+    playback_timing_free(&timing);
 
+    shm_ring_close(&ring);
+    broadcast_close(&broadcaster);
     engine_cleanup(&ctx);
+    cache_close(&cache);
     return 0;
 }
 
@@ -0,0 +1,182 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  perf_counters.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.h"
+
+static const uint64_t kEventConfigs[PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+typedef struct {
+    int64_t samples;
+    uint64_t totals[PERF_COUNTER_COUNT];
+} CounterAccumulator;
+
+typedef struct {
+    int fds[PERF_COUNTER_COUNT]; // fds[0] leads the group; -1 where an event is unsupported.
+    int index[PERF_COUNTER_COUNT]; // Position of each event in a group read, or -1.
+    int members;
+    pid_t owner;                 // Thread the group counts; 0 when closed.
+    int present[PERF_COUNTER_COUNT];
+    CounterAccumulator stages[ENGINE_STAGE_COUNT];
+} CounterSlot;
+
+struct PerfCounters {
+    int num_slots;
+    CounterSlot* slots;
+};
+
+static int open_event(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    // Why user space only? perf_event_paranoid 2, the common default, refuses
+    // kernel counting to unprivileged users, and the stages are user code.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void close_group(CounterSlot* slot) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (slot->fds[i] >= 0) close(slot->fds[i]);
+        slot->fds[i] = -1;
+        slot->index[i] = -1;
+    }
+    slot->members = 0;
+    slot->owner = 0;
+}
+
+// Why a group? Members are scheduled onto the PMU together, so every ratio
+// (IPC, misses per instruction) compares counts over the same instructions.
+// Cycles must open; any other event the CPU lacks is just left out.
+static int open_group(CounterSlot* slot) {
+    close_group(slot);
+    slot->fds[0] = open_event(kEventConfigs[0], -1);
+    if (slot->fds[0] < 0) return -1;
+    slot->index[0] = slot->members++;
+    for (int i = 1; i < PERF_COUNTER_COUNT; i++) {
+        slot->fds[i] = open_event(kEventConfigs[i], slot->fds[0]);
+        if (slot->fds[i] >= 0) slot->index[i] = slot->members++;
+    }
+    ioctl(slot->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(slot->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    slot->owner = (pid_t)syscall(SYS_gettid);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) slot->present[i] = slot->index[i] >= 0;
+    return 0;
+}
+
+PerfCounters* perf_counters_create(int slots) {
+    if (slots < 1) return NULL;
+    PerfCounters* counters = (PerfCounters*)calloc(1, sizeof(PerfCounters));
+    if (!counters) return NULL;
+    counters->slots = (CounterSlot*)calloc((size_t)slots, sizeof(CounterSlot));
+    if (!counters->slots) {
+        free(counters);
+        return NULL;
+    }
+    counters->num_slots = slots;
+    for (int s = 0; s < slots; s++) {
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            counters->slots[s].fds[i] = -1;
+            counters->slots[s].index[i] = -1;
+        }
+    }
+    CounterSlot probe;
+    memset(&probe, 0, sizeof(probe));
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) probe.fds[i] = -1;
+    if (open_group(&probe) != 0) {
+        perf_counters_free(&counters);
+        return NULL;
+    }
+    close_group(&probe);
+    return counters;
+}
+
+void perf_counters_free(PerfCounters** counters) {
+    if (!counters || !*counters) return;
+    for (int s = 0; s < (*counters)->num_slots; s++) close_group(&(*counters)->slots[s]);
+    free((*counters)->slots);
+    free(*counters);
+    *counters = NULL;
+}
+
+int perf_counters_read(PerfCounters* counters, int slot, uint64_t values[PERF_COUNTER_COUNT]) {
+    if (!counters || slot < 0 || slot >= counters->num_slots) return -1;
+    CounterSlot* s = &counters->slots[slot];
+    // A group counts only the thread that opened it, so a slot taken over by
+    // another thread needs a group of its own.
+    if (s->owner != (pid_t)syscall(SYS_gettid) && open_group(s) != 0) return -1;
+
+    uint64_t data[3 + PERF_COUNTER_COUNT];
+    ssize_t want = (ssize_t)((3 + s->members) * sizeof(uint64_t));
+    if (read(s->fds[0], data, (size_t)want) != want) return -1;
+    // data: members, time enabled, time running, then one value per member.
+    // When the PMU is shared and the group was switched out part of the time,
+    // scale up to the full interval.
+    double scale = data[2] > 0 ? (double)data[1] / (double)data[2] : 0.0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        values[i] = s->index[i] >= 0 ? (uint64_t)((double)data[3 + s->index[i]] * scale) : 0;
+    }
+    return 0;
+}
+
+void perf_counters_release(PerfCounters* counters, int slot) {
+    if (!counters || slot < 0 || slot >= counters->num_slots) return;
+    close_group(&counters->slots[slot]);
+}
+
+void perf_counters_add(PerfCounters* counters, int slot, int stage,
+                       const uint64_t before[PERF_COUNTER_COUNT], const uint64_t after[PERF_COUNTER_COUNT]) {
+    if (!counters || slot < 0 || slot >= counters->num_slots || stage < 0 || stage >= ENGINE_STAGE_COUNT) return;
+    CounterAccumulator* acc = &counters->slots[slot].stages[stage];
+    acc->samples++;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (after[i] > before[i]) acc->totals[i] += after[i] - before[i];
+    }
+}
+
+void perf_counters_summarize(const PerfCounters* counters, int slot, int stage, EngineStageCounters* out) {
+    memset(out, 0, sizeof(*out));
+    out->cycles = out->instructions = out->cache_misses = out->branch_misses = -1;
+    if (!counters || slot >= counters->num_slots || stage < 0 || stage >= ENGINE_STAGE_COUNT) return;
+    int first = slot < 0 ? 0 : slot;
+    int last = slot < 0 ? counters->num_slots - 1 : slot;
+
+    uint64_t totals[PERF_COUNTER_COUNT] = { 0 };
+    int present[PERF_COUNTER_COUNT] = { 0 };
+    for (int s = first; s <= last; s++) {
+        const CounterSlot* cs = &counters->slots[s];
+        const CounterAccumulator* acc = &cs->stages[stage];
+        if (acc->samples == 0) continue;
+        out->samples += acc->samples;
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            totals[i] += acc->totals[i];
+            present[i] |= cs->present[i];
+        }
+    }
+    if (out->samples == 0) return;
+    int64_t* fields[PERF_COUNTER_COUNT] = { &out->cycles, &out->instructions, &out->cache_misses, &out->branch_misses };
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (present[i]) *fields[i] = (int64_t)totals[i];
+    }
+}
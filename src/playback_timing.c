@@ -0,0 +1,211 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  playback_timing.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "playback_timing.h"
+#include "latency_histogram.h"
+#include "json_writer.h"
+#include <libavutil/avutil.h>
+
+// The published histogram: frames no later than 1, 2, 4 ... 1024 ms, then the rest.
+#define COARSE_BUCKETS 12
+// A timestamp this far past the expected one is a discontinuity, not a wait.
+#define JUMP_NS 10000000000LL
+// However late playback runs, a frame is shown at least this often.
+#define MAX_SKIP_GAP_NS 250000000LL
+
+struct PlaybackTiming {
+    int64_t origin_ns;        // When the first frame of the schedule was due; 0 = restart pending.
+    int64_t origin_pts;       // Its timestamp (AV_NOPTS_VALUE if it had none).
+    int64_t deadline_ns;      // Of the frame being presented.
+    int64_t duration_ns;      // Its duration.
+    int pending;              // A frame has been waited for but not yet presented.
+    int64_t first_present_ns;
+    int64_t last_present_ns;  // 0 after a restart, so the gap across it is not counted.
+    int64_t frames;
+    int64_t dropped;
+    int64_t stall_ns;
+    int64_t stall_frame;
+    LatencyHistogram lateness;
+    LatencyHistogram interval;
+    int64_t coarse[COARSE_BUCKETS];
+};
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double percentile_ms(const LatencyHistogram* h, double q) {
+    return latency_percentile_ns(h, q) / 1e6;
+}
+
+static int coarse_of(int64_t ns) {
+    int bucket = 0;
+    while (bucket < COARSE_BUCKETS - 1 && ns > (1000000LL << bucket)) bucket++;
+    return bucket;
+}
+
+PlaybackTiming* playback_timing_create(void) {
+    PlaybackTiming* timing = (PlaybackTiming*)calloc(1, sizeof(PlaybackTiming));
+    if (timing) timing->origin_pts = AV_NOPTS_VALUE;
+    return timing;
+}
+
+void playback_timing_free(PlaybackTiming** timing) {
+    if (!timing || !*timing) return;
+    free(*timing);
+    *timing = NULL;
+}
+
+void playback_timing_restart(PlaybackTiming* timing) {
+    if (!timing) return;
+    timing->origin_ns = 0;
+    timing->origin_pts = AV_NOPTS_VALUE;
+    timing->pending = 0;
+    timing->last_present_ns = 0;
+}
+
+int playback_timing_wait(PlaybackTiming* timing, int64_t pts, int tb_num, int tb_den, double duration_secs,
+                         volatile sig_atomic_t* stop) {
+    if (!timing) return 0;
+    int has_pts = pts != AV_NOPTS_VALUE && tb_num > 0 && tb_den > 0;
+    if (timing->origin_ns == 0) {
+        timing->origin_ns = monotonic_ns();
+        timing->origin_pts = has_pts ? pts : AV_NOPTS_VALUE;
+        timing->deadline_ns = timing->origin_ns;
+    } else {
+        int64_t next = timing->deadline_ns + timing->duration_ns;
+        int64_t due = next;
+        if (has_pts && timing->origin_pts != AV_NOPTS_VALUE) {
+            due = timing->origin_ns + (int64_t)((double)(pts - timing->origin_pts) * 1e9 * tb_num / tb_den);
+        }
+        // Why re-anchor on a backwards or far-forward timestamp? A spliced
+        // stream or a wrapped clock would otherwise stall playback for the
+        // size of the jump, or rush through frames to catch up with it.
+        if (due < timing->deadline_ns || due > next + JUMP_NS) {
+            timing->origin_ns = next;
+            timing->origin_pts = has_pts ? pts : AV_NOPTS_VALUE;
+            due = next;
+        }
+        timing->deadline_ns = due;
+    }
+    timing->duration_ns = duration_secs > 0.0 ? (int64_t)(duration_secs * 1e9) : 1000000000LL / 24;
+    timing->pending = 1;
+
+    // Why skip rather than show it late? Writing a frame whose slot is already
+    // over only pushes every later frame further behind; skipping it is how
+    // playback catches up with a terminal or decoder that fell behind.
+    int64_t now = monotonic_ns();
+    if (now - timing->deadline_ns >= timing->duration_ns && timing->last_present_ns > 0 &&
+        now - timing->last_present_ns < MAX_SKIP_GAP_NS) {
+        return 1;
+    }
+
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)(timing->deadline_ns / 1000000000LL);
+    deadline.tv_nsec = (long)(timing->deadline_ns % 1000000000LL);
+    // A signal (resize, SIGUSR1) interrupts the sleep; only Ctrl-C cuts it short.
+    while (!*stop && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+    return 0;
+}
+
+void playback_timing_skipped(PlaybackTiming* timing) {
+    if (!timing || !timing->pending) return;
+    timing->pending = 0;
+    timing->dropped++;
+}
+
+void playback_timing_presented(PlaybackTiming* timing) {
+    if (!timing || !timing->pending) return;
+    timing->pending = 0;
+    int64_t now = monotonic_ns();
+    int64_t late = now - timing->deadline_ns;
+    if (late < 0) late = 0;
+    latency_record(&timing->lateness, late);
+    timing->coarse[coarse_of(late)]++;
+    if (timing->last_present_ns > 0) {
+        int64_t gap = now - timing->last_present_ns;
+        latency_record(&timing->interval, gap);
+        if (gap > timing->stall_ns) {
+            timing->stall_ns = gap;
+            timing->stall_frame = timing->frames;
+        }
+    }
+    if (timing->frames == 0) timing->first_present_ns = now;
+    timing->last_present_ns = now;
+    timing->frames++;
+}
+
+static void write_report(const PlaybackTiming* t, FILE* f, int cols, int rows) {
+    const LatencyHistogram* late = &t->lateness;
+    double wall = t->frames > 1 ? (double)(t->last_present_ns - t->first_present_ns) / 1e9 : 0.0;
+    fprintf(f, "{\n  \"term\": ");
+    json_write_string(f, getenv("TERM"));
+    fprintf(f, ",\n  \"term_program\": ");
+    json_write_string(f, getenv("TERM_PROGRAM"));
+    fprintf(f, ",\n  \"grid\": {\"cols\": %d, \"rows\": %d},\n", cols, rows);
+    fprintf(f, "  \"frames\": %lld,\n  \"dropped\": %lld,\n  \"wall_secs\": %.6f,\n",
+            (long long)t->frames, (long long)t->dropped, wall);
+    fprintf(f, "  \"lateness_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p99_9\": %.3f, "
+               "\"max\": %.3f},\n",
+            late->count ? (double)late->total_ns / 1e6 / (double)late->count : 0.0, percentile_ms(late, 0.50),
+            percentile_ms(late, 0.90), percentile_ms(late, 0.99), percentile_ms(late, 0.999),
+            (double)late->max_ns / 1e6);
+    fprintf(f, "  \"interval_ms\": {\"p50\": %.3f, \"p99\": %.3f, \"p99_9\": %.3f, \"max\": %.3f},\n",
+            percentile_ms(&t->interval, 0.50), percentile_ms(&t->interval, 0.99),
+            percentile_ms(&t->interval, 0.999), (double)t->interval.max_ns / 1e6);
+    fprintf(f, "  \"longest_stall\": {\"ms\": %.3f, \"frame\": %lld},\n", (double)t->stall_ns / 1e6,
+            (long long)t->stall_frame);
+    fprintf(f, "  \"lateness_histogram\": [");
+    for (int b = 0; b < COARSE_BUCKETS; b++) {
+        if (b < COARSE_BUCKETS - 1) {
+            fprintf(f, "%s{\"le_ms\": %d, \"frames\": %lld}", b ? ", " : "", 1 << b, (long long)t->coarse[b]);
+        } else {
+            fprintf(f, ", {\"le_ms\": null, \"frames\": %lld}", (long long)t->coarse[b]);
+        }
+    }
+    fprintf(f, "]\n}\n");
+}
+
+int playback_timing_write_json(const PlaybackTiming* timing, const char* path, int cols, int rows, char** error) {
+    if (!timing) {
+        *error = "playback timing was not recorded";
+        return -1;
+    }
+    if (strcmp(path, "-") == 0) {
+        write_report(timing, stderr, cols, rows);
+        return 0;
+    }
+    char tmp[4096];
+    if (strlen(path) + 16 >= sizeof(tmp)) {
+        *error = "the report path is too long";
+        return -1;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        *error = "could not open the jitter report for writing";
+        return -1;
+    }
+    write_report(timing, f, cols, rows);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        *error = "could not write the jitter report";
+        return -1;
+    }
+    return 0;
+}
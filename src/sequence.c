@@ -0,0 +1,328 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  sequence.c
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE // strverscmp
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stb_image.h"
+#include "sequence.h"
+
+typedef struct {
+    int index;             // Position in the sequence this slot holds, -1 if empty.
+    unsigned char* pixels; // NULL with index set means the decode failed.
+    const char* failure;   // Why, as stb_image told the decoding thread.
+    int width;
+    int height;
+} PrefetchSlot;
+
+struct SequenceReader {
+    char** paths;
+    int count;
+
+    PrefetchSlot* slots;
+    int depth;
+    pthread_t* threads;
+    int num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t slot_ready;
+    pthread_cond_t slot_free;
+    int next_to_decode;
+    int next_to_deliver;
+    int stop;
+    int pool_started;
+};
+
+static int has_image_extension(const char* name) {
+    const char* ext = strrchr(name, '.');
+    if (!ext) return 0;
+    return strcasecmp(ext, ".png") == 0 || strcasecmp(ext, ".jpg") == 0 ||
+           strcasecmp(ext, ".jpeg") == 0 || strcasecmp(ext, ".bmp") == 0 ||
+           strcasecmp(ext, ".tga") == 0;
+}
+
+// A numbered pattern split around its one conversion, with %% already
+// turned back into %.
+typedef struct {
+    char prefix[2048];
+    char suffix[2048];
+    int digits; // Zero-padded width; 0 for a plain %d.
+} NumberPattern;
+
+// Why parse rather than hand the pattern to snprintf? It is user text. A
+// stray %s or %n in a file name would read or write through a pointer that
+// was never passed. Only %d, %0Nd and %% are accepted, and exactly one number.
+static int parse_number_pattern(const char* pattern, NumberPattern* out) {
+    char* dst = out->prefix;
+    size_t room = sizeof(out->prefix);
+    int conversions = 0;
+    out->digits = 0;
+    for (const char* p = pattern; *p; p++) {
+        char c = *p;
+        if (c == '%') {
+            p++;
+            if (*p == '%') {
+                c = '%';
+            } else {
+                int digits = 0;
+                if (*p == '0') {
+                    p++;
+                    if (*p < '1' || *p > '9') return -1;
+                    while (*p >= '0' && *p <= '9') {
+                        digits = digits * 10 + (*p - '0');
+                        if (digits > 16) return -1;
+                        p++;
+                    }
+                }
+                if (*p != 'd' || conversions++ > 0) return -1;
+                out->digits = digits;
+                *dst = '\0';
+                dst = out->suffix;
+                room = sizeof(out->suffix);
+                continue;
+            }
+        }
+        if (room <= 1) return -1;
+        *dst++ = c;
+        room--;
+    }
+    *dst = '\0';
+    return conversions == 1 ? 0 : -1;
+}
+
+static void format_number_path(const NumberPattern* pattern, int n, char* path, size_t size) {
+    snprintf(path, size, "%s%0*d%s", pattern->prefix, pattern->digits, n, pattern->suffix);
+}
+
+int is_sequence_input(const char* input) {
+    struct stat st;
+    if (stat(input, &st) == 0) return S_ISDIR(st.st_mode);
+    NumberPattern pattern;
+    return parse_number_pattern(input, &pattern) == 0 || strpbrk(input, "*?[") != NULL;
+}
+
+static int push_path(SequenceReader* r, int* capacity, const char* path) {
+    if (r->count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 256;
+        char** grown = (char**)realloc(r->paths, new_capacity * sizeof(char*));
+        if (!grown) return -1;
+        r->paths = grown;
+        *capacity = new_capacity;
+    }
+    r->paths[r->count] = strdup(path);
+    return r->paths[r->count++] ? 0 : -1;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    // Why strverscmp? It sorts "frame2.png" before "frame10.png", which is what
+    // anyone naming files without zero padding expects.
+    return strverscmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Why probe start numbers 0..4? That is what FFmpeg's image2 demuxer does, so
+// patterns that work there work here: sequences commonly start at 0 or 1.
+static int expand_number_pattern(SequenceReader* r, const NumberPattern* pattern) {
+    char path[4096];
+    int capacity = 0;
+    int start = -1;
+    for (int n = 0; n <= 4 && start < 0; n++) {
+        format_number_path(pattern, n, path, sizeof(path));
+        if (access(path, R_OK) == 0) start = n;
+    }
+    if (start < 0) return 0;
+    for (int n = start;; n++) {
+        format_number_path(pattern, n, path, sizeof(path));
+        if (access(path, R_OK) != 0) break;
+        if (push_path(r, &capacity, path) != 0) return -1;
+    }
+    return 0;
+}
+
+static int expand_directory(SequenceReader* r, const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return -1;
+    int capacity = 0;
+    char path[4096];
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!has_image_extension(entry->d_name)) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        if (push_path(r, &capacity, path) != 0) { closedir(dir); return -1; }
+    }
+    closedir(dir);
+    qsort(r->paths, r->count, sizeof(char*), compare_paths);
+    return 0;
+}
+
+static int expand_glob(SequenceReader* r, const char* pattern) {
+    glob_t g;
+    if (glob(pattern, 0, NULL, &g) != 0) return 0;
+    int capacity = 0;
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+        if (!has_image_extension(g.gl_pathv[i])) continue;
+        if (push_path(r, &capacity, g.gl_pathv[i]) != 0) { globfree(&g); return -1; }
+    }
+    globfree(&g);
+    qsort(r->paths, r->count, sizeof(char*), compare_paths);
+    return 0;
+}
+
+// Why a fixed ring of slots? It bounds memory to `depth` decoded images no
+// matter how fast the decoders outrun the consumer. Image i always lands in
+// slot i % depth, and a worker may only start image i once image i - depth has
+// been handed out, so a slot is never overwritten while still in use.
+static void* prefetch_worker(void* arg) {
+    SequenceReader* r = (SequenceReader*)arg;
+    for (;;) {
+        pthread_mutex_lock(&r->lock);
+        while (!r->stop && r->next_to_decode < r->count &&
+               r->next_to_decode - r->next_to_deliver >= r->depth) {
+            pthread_cond_wait(&r->slot_free, &r->lock);
+        }
+        if (r->stop || r->next_to_decode >= r->count) {
+            pthread_mutex_unlock(&r->lock);
+            return NULL;
+        }
+        int index = r->next_to_decode++;
+        pthread_mutex_unlock(&r->lock);
+
+        int width = 0, height = 0, channels = 0;
+        unsigned char* pixels = stbi_load(r->paths[index], &width, &height, &channels, 3);
+        // The reason is thread-local to this worker; the consumer cannot ask for it later.
+        const char* failure = pixels ? NULL : stbi_failure_reason();
+
+        pthread_mutex_lock(&r->lock);
+        PrefetchSlot* slot = &r->slots[index % r->depth];
+        slot->index = index;
+        slot->pixels = pixels;
+        slot->failure = failure;
+        slot->width = width;
+        slot->height = height;
+        pthread_cond_broadcast(&r->slot_ready);
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+SequenceReader* sequence_open(const char* input, int prefetch_threads, int prefetch_depth, char** error) {
+    SequenceReader* r = (SequenceReader*)calloc(1, sizeof(SequenceReader));
+    if (!r) { *error = "Failed to allocate sequence reader"; return NULL; }
+
+    struct stat st;
+    NumberPattern pattern;
+    int ret;
+    if (stat(input, &st) == 0 && S_ISDIR(st.st_mode)) ret = expand_directory(r, input);
+    else if (parse_number_pattern(input, &pattern) == 0) ret = expand_number_pattern(r, &pattern);
+    else ret = expand_glob(r, input);
+    if (ret != 0 || r->count == 0) {
+        *error = "Image sequence matched no readable images";
+        sequence_close(&r);
+        return NULL;
+    }
+
+    r->num_threads = prefetch_threads > 0 ? prefetch_threads : 1;
+    r->depth = prefetch_depth > r->num_threads ? prefetch_depth : r->num_threads;
+    r->slots = (PrefetchSlot*)calloc(r->depth, sizeof(PrefetchSlot));
+    r->threads = (pthread_t*)calloc(r->num_threads, sizeof(pthread_t));
+    if (!r->slots || !r->threads) {
+        *error = "Failed to allocate prefetch pool";
+        sequence_close(&r);
+        return NULL;
+    }
+    for (int i = 0; i < r->depth; i++) r->slots[i].index = -1;
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->slot_ready, NULL);
+    pthread_cond_init(&r->slot_free, NULL);
+    r->pool_started = 1;
+    for (int i = 0; i < r->num_threads; i++) {
+        if (pthread_create(&r->threads[i], NULL, prefetch_worker, r) != 0) {
+            r->num_threads = i;
+            break;
+        }
+    }
+    if (r->num_threads == 0) {
+        *error = "Failed to start prefetch threads";
+        sequence_close(&r);
+        return NULL;
+    }
+    return r;
+}
+
+int sequence_frame_count(const SequenceReader* r) {
+    return r ? r->count : 0;
+}
+
+int sequence_has_more(const SequenceReader* r) {
+    return r && r->next_to_deliver < r->count;
+}
+
+int sequence_next(SequenceReader* r, unsigned char** rgb, int* width, int* height) {
+    if (!sequence_has_more(r)) return SEQUENCE_EOF;
+
+    pthread_mutex_lock(&r->lock);
+    int index = r->next_to_deliver;
+    PrefetchSlot* slot = &r->slots[index % r->depth];
+    while (slot->index != index) {
+        pthread_cond_wait(&r->slot_ready, &r->lock);
+    }
+    unsigned char* pixels = slot->pixels;
+    const char* failure = slot->failure;
+    *width = slot->width;
+    *height = slot->height;
+    slot->index = -1;
+    slot->pixels = NULL;
+    slot->failure = NULL;
+    r->next_to_deliver++;
+    pthread_cond_broadcast(&r->slot_free);
+    pthread_mutex_unlock(&r->lock);
+
+    if (!pixels) {
+        fprintf(stderr, "WARNING: Could not decode %s: %s\n", r->paths[index],
+                failure ? failure : "unknown error");
+        return SEQUENCE_DECODE_ERROR;
+    }
+    *rgb = pixels;
+    return 0;
+}
+
+void sequence_free_pixels(unsigned char* rgb) {
+    if (rgb) stbi_image_free(rgb);
+}
+
+void sequence_close(SequenceReader** reader_ptr) {
+    if (!reader_ptr || !*reader_ptr) return;
+    SequenceReader* r = *reader_ptr;
+
+    if (r->pool_started) {
+        pthread_mutex_lock(&r->lock);
+        r->stop = 1;
+        pthread_cond_broadcast(&r->slot_free);
+        pthread_mutex_unlock(&r->lock);
+        for (int i = 0; i < r->num_threads; i++) pthread_join(r->threads[i], NULL);
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->slot_ready);
+        pthread_cond_destroy(&r->slot_free);
+    }
+    if (r->slots) {
+        for (int i = 0; i < r->depth; i++) sequence_free_pixels(r->slots[i].pixels);
+    }
+    for (int i = 0; i < r->count; i++) free(r->paths[i]);
+    free(r->paths);
+    free(r->slots);
+    free(r->threads);
+    free(r);
+    *reader_ptr = NULL;
+}
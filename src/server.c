@@ -0,0 +1,565 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  server.c
+ *
+ * =====================================================================================
+ */
+
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include <libavcodec/avcodec.h>
+
+#include "stb_image.h"
+#include "sequence.h"
+#include "server.h"
+#include "wire.h"
+
+#define HEADER_MAX 8192
+#define WARM_CONTEXTS 4
+
+// --- Jobs ---
+typedef struct {
+    char input[4096];
+    size_t inline_bytes;
+    char format[8];
+    long max_frames;
+    EngineConfig config;
+} JobRequest;
+
+typedef struct {
+    ProcessingContext* ctx;
+    int src_width;
+    int src_height;
+    int output_width;
+    float aspect;
+    double last_used;
+} WarmContext;
+
+typedef struct {
+    const ServerOptions* options;
+    int threads_per_job;
+    WarmContext warm[WARM_CONTEXTS];
+    char* text;          // Scratch for formatted frames, grown on demand.
+    size_t text_capacity;
+} Worker;
+
+typedef struct {
+    int fd;
+    double accepted_ms;
+} PendingJob;
+
+typedef struct {
+    PendingJob* jobs;
+    int capacity;
+    int head;
+    int count;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} JobQueue;
+
+typedef struct {
+    Worker worker;
+    JobQueue* queue;
+    pthread_t thread;
+} WorkerThread;
+
+static int parse_request(const char* block, JobRequest* job, const Worker* w) {
+    memset(job, 0, sizeof(*job));
+    snprintf(job->format, sizeof(job->format), "ansi");
+    job->config.output_width = 120;
+    job->config.edge_strength = 0.4f;
+    job->config.aspect_correction = -1.0f;
+    job->config.brightness_factor = 1.0f;
+    job->config.saturation_factor = 1.0f;
+    job->config.use_color = 1;
+    job->config.use_simd = 1;
+    job->config.dither_mode = DITHER_NONE;
+    job->config.num_threads = w->threads_per_job;
+
+    const char* v;
+    if ((v = wire_block_value(block, "input"))) wire_copy_value(job->input, sizeof(job->input), v);
+    if ((v = wire_block_value(block, "bytes"))) job->inline_bytes = strtoull(v, NULL, 10);
+    if ((v = wire_block_value(block, "format"))) wire_copy_value(job->format, sizeof(job->format), v);
+    if ((v = wire_block_value(block, "width"))) job->config.output_width = atoi(v);
+    if ((v = wire_block_value(block, "edge"))) job->config.edge_strength = strtof(v, NULL);
+    if ((v = wire_block_value(block, "brightness"))) job->config.brightness_factor = strtof(v, NULL);
+    if ((v = wire_block_value(block, "saturate"))) job->config.saturation_factor = strtof(v, NULL);
+    if ((v = wire_block_value(block, "aspect"))) job->config.aspect_correction = strtof(v, NULL);
+    if ((v = wire_block_value(block, "max_frames"))) job->max_frames = atol(v);
+
+    int png = strcmp(job->format, "png") == 0;
+    if (!png && strcmp(job->format, "ansi") != 0 && strcmp(job->format, "text") != 0) return -1;
+    if (strcmp(job->format, "text") == 0) job->config.use_color = 0;
+    // Same rule as the CLI: pixel output has square cells, terminals do not.
+    if (job->config.aspect_correction <= 0.0f) job->config.aspect_correction = png ? 1.0f : 0.5f;
+    if (job->config.output_width <= 0 || job->config.output_width > 4096) return -1;
+    if (job->inline_bytes == 0 && job->input[0] == '\0') return -1;
+    return 0;
+}
+
+static void destroy_warm(WarmContext* warm) {
+    engine_cleanup(&warm->ctx);
+    memset(warm, 0, sizeof(*warm));
+}
+
+// Why key on geometry? A raw context's buffers and cell grid are sized from
+// the source dimensions and output width at init; everything else (edge,
+// brightness, colour) is taken from each job's config. Thumbnail workloads
+// repeat a handful of sizes, so a tiny LRU keeps nearly every job warm.
+static ProcessingContext* acquire_raw_context(Worker* w, int width, int height, const EngineConfig* config, int* warm_hit) {
+    WarmContext* victim = &w->warm[0];
+    for (int i = 0; i < WARM_CONTEXTS; i++) {
+        WarmContext* c = &w->warm[i];
+        if (c->ctx && c->src_width == width && c->src_height == height &&
+            c->output_width == config->output_width && c->aspect == config->aspect_correction) {
+            c->last_used = wire_now_ms();
+            *warm_hit = 1;
+            return c->ctx;
+        }
+        if (!c->ctx || (victim->ctx && c->last_used < victim->last_used)) victim = c;
+    }
+    *warm_hit = 0;
+    destroy_warm(victim);
+    char* error = NULL;
+    victim->ctx = engine_init_raw(width, height, ENGINE_PIX_RGB24, config, &error);
+    if (!victim->ctx) return NULL;
+    victim->src_width = width;
+    victim->src_height = height;
+    victim->output_width = config->output_width;
+    victim->aspect = config->aspect_correction;
+    victim->last_used = wire_now_ms();
+    return victim->ctx;
+}
+
+// Formats the current grid and sends it as one frame block.
+static int send_frame(int fd, Worker* w, ProcessingContext* ctx, const JobRequest* job,
+                      long index, double convert_ms, double* output_ms) {
+    double start = wire_now_ms();
+    const void* payload;
+    size_t payload_size;
+    unsigned char* png = NULL;
+    if (strcmp(job->format, "png") == 0) {
+        int png_size = 0;
+        if (engine_render_to_png_memory(ctx, &job->config, &png, &png_size) != 0) return -1;
+        payload = png;
+        payload_size = (size_t)png_size;
+    } else {
+        size_t needed = engine_format_ansi(ctx, &job->config, NULL, 0);
+        if (needed > w->text_capacity) {
+            char* grown = (char*)realloc(w->text, needed);
+            if (!grown) return -1;
+            w->text = grown;
+            w->text_capacity = needed;
+        }
+        payload_size = engine_format_ansi(ctx, &job->config, w->text, w->text_capacity);
+        payload = w->text;
+    }
+    *output_ms += wire_now_ms() - start;
+
+    EngineCellGrid grid;
+    engine_get_cell_grid(ctx, &grid);
+    char header[256];
+    int n = snprintf(header, sizeof(header), "status=frame\nindex=%ld\nwidth=%d\nheight=%d\nconvert_ms=%.3f\nbytes=%zu\n\n",
+                     index, grid.width, grid.height, convert_ms, payload_size);
+    int ret = (wire_send_all(fd, header, (size_t)n) == 0 && wire_send_all(fd, payload, payload_size) == 0) ? 0 : -1;
+    free(png);
+    return ret;
+}
+
+static void send_status(int fd, const char* status, const char* message) {
+    char block[512];
+    int n = snprintf(block, sizeof(block), "status=%s\nmessage=%s\n\n", status, message);
+    wire_send_all(fd, block, (size_t)n);
+}
+
+typedef struct {
+    long frames;
+    int warm;
+    double setup_ms;
+    double convert_ms;
+    double output_ms;
+} JobStats;
+
+static const char* run_image_job(int fd, Worker* w, const JobRequest* job, unsigned char* inline_data, JobStats* st) {
+    double start = wire_now_ms();
+    int width = 0, height = 0, channels = 0;
+    unsigned char* rgb = inline_data
+        ? stbi_load_from_memory(inline_data, (int)job->inline_bytes, &width, &height, &channels, 3)
+        : stbi_load(job->input, &width, &height, &channels, 3);
+    if (!rgb) return "Could not decode image";
+    ProcessingContext* ctx = acquire_raw_context(w, width, height, &job->config, &st->warm);
+    st->setup_ms = wire_now_ms() - start;
+    if (!ctx) { stbi_image_free(rgb); return "Engine initialization failed"; }
+
+    const uint8_t* planes[1] = { rgb };
+    const int strides[1] = { width * 3 };
+    start = wire_now_ms();
+    int ret = engine_process_buffer(ctx, planes, strides, 0, &job->config);
+    st->convert_ms = wire_now_ms() - start;
+    stbi_image_free(rgb);
+    if (ret != 0) return "Conversion failed";
+    st->frames = 1;
+    if (send_frame(fd, w, ctx, job, 0, st->convert_ms, &st->output_ms) != 0) return "Client went away";
+    return NULL;
+}
+
+// Why no warm context for video? A decoder is bound to its file; opening the
+// input is inherent to the job. The frames still stream back as they convert.
+static const char* run_video_job(int fd, Worker* w, const JobRequest* job, JobStats* st) {
+    double start = wire_now_ms();
+    EngineConfig config = job->config;
+    config.mode = strstr(job->input, ".gif") ? MODE_ANIMATED_GIF : MODE_VIDEO;
+    char* error = NULL;
+    ProcessingContext* ctx = engine_init(job->input, &config, &error);
+    st->setup_ms = wire_now_ms() - start;
+    if (!ctx) return error ? error : "Engine initialization failed";
+
+    // A PNG per frame is never what a thumbnail client wants; send the first.
+    long max_frames = strcmp(job->format, "png") == 0 ? 1 : job->max_frames;
+    const char* result = NULL;
+    AVPacket* packet = av_packet_alloc();
+    while (packet && engine_get_next_packet(ctx, packet) >= 0) {
+        if (packet->stream_index == engine_get_video_stream_idx(ctx)) {
+            struct AVFrame* frame = NULL;
+            if (engine_decode_video_packet(ctx, packet, &frame) == 0 && frame) {
+                double frame_start = wire_now_ms();
+                engine_process_frame_to_ascii(ctx, frame, &config);
+                double frame_ms = wire_now_ms() - frame_start;
+                st->convert_ms += frame_ms;
+                if (send_frame(fd, w, ctx, job, st->frames, frame_ms, &st->output_ms) != 0) {
+                    result = "Client went away";
+                    av_packet_unref(packet);
+                    break;
+                }
+                st->frames++;
+            }
+        }
+        av_packet_unref(packet);
+        if (max_frames > 0 && st->frames >= max_frames) break;
+    }
+    av_packet_free(&packet);
+    engine_cleanup(&ctx);
+    return result;
+}
+
+static void serve_connection(Worker* w, int fd, double accepted_ms) {
+    double picked_ms = wire_now_ms();
+    // Why timeouts? A stalled client must not pin a worker forever; the
+    // concurrency limit would otherwise be exhausted by idle connections.
+    struct timeval tv = { .tv_sec = 30, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    WireBuffer* r = (WireBuffer*)malloc(sizeof(WireBuffer));
+    char* block = (char*)malloc(HEADER_MAX);
+    JobRequest job;
+    if (!r || !block) { free(r); free(block); send_status(fd, "error", "Out of memory"); return; }
+    r->len = r->pos = 0;
+    if (wire_read_block(fd, r, block, HEADER_MAX) != 1 || parse_request(block, &job, w) != 0) {
+        send_status(fd, "error", "Malformed request");
+        free(r); free(block);
+        return;
+    }
+
+    unsigned char* inline_data = NULL;
+    size_t max_inline = w->options->max_inline_bytes ? w->options->max_inline_bytes : (size_t)64 << 20;
+    if (job.inline_bytes > 0) {
+        if (job.inline_bytes > max_inline || job.inline_bytes > (size_t)0x7fffffff) {
+            send_status(fd, "error", "Inline payload too large");
+            free(r); free(block);
+            return;
+        }
+        inline_data = (unsigned char*)malloc(job.inline_bytes);
+        if (!inline_data || wire_read_payload(fd, r, inline_data, job.inline_bytes) != 0) {
+            send_status(fd, "error", "Could not read inline payload");
+            free(inline_data); free(r); free(block);
+            return;
+        }
+    }
+    free(r);
+    free(block);
+
+    JobStats st = {0};
+    const char* failure;
+    if (!inline_data && (is_sequence_input(job.input) || is_animated_file(job.input))) {
+        failure = is_animated_file(job.input) ? run_video_job(fd, w, &job, &st) : "Image sequences are not served";
+    } else {
+        failure = run_image_job(fd, w, &job, inline_data, &st);
+    }
+    free(inline_data);
+
+    char summary[512];
+    int n = snprintf(summary, sizeof(summary),
+                     "status=%s\nmessage=%s\nframes=%ld\nwarm=%d\nqueue_ms=%.3f\nsetup_ms=%.3f\n"
+                     "convert_ms=%.3f\noutput_ms=%.3f\ntotal_ms=%.3f\n\n",
+                     failure ? "error" : "done", failure ? failure : "ok", st.frames, st.warm,
+                     picked_ms - accepted_ms, st.setup_ms, st.convert_ms, st.output_ms, wire_now_ms() - accepted_ms);
+    wire_send_all(fd, summary, (size_t)n);
+}
+
+static void* worker_main(void* arg) {
+    WorkerThread* t = (WorkerThread*)arg;
+    JobQueue* q = t->queue;
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (!q->stop && q->count == 0) pthread_cond_wait(&q->ready, &q->lock);
+        if (q->count == 0) { pthread_mutex_unlock(&q->lock); break; }
+        PendingJob job = q->jobs[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_mutex_unlock(&q->lock);
+
+        serve_connection(&t->worker, job.fd, job.accepted_ms);
+        close(job.fd);
+    }
+    for (int i = 0; i < WARM_CONTEXTS; i++) destroy_warm(&t->worker.warm[i]);
+    free(t->worker.text);
+    return NULL;
+}
+
+// Why connect before unlinking? A socket that still accepts connections
+// belongs to a running daemon; deleting it would orphan that daemon. Only a
+// socket nobody answers on is stale.
+int unix_socket_reclaim(const char* path, char** error) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        if (errno == ENOENT) return 0;
+        *error = "Could not inspect the socket path";
+        return -1;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        *error = "Socket path exists and is not a socket; refusing to replace it";
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { *error = "Socket path too long"; return -1; }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { *error = "Could not create socket"; return -1; }
+    int live = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    close(fd);
+    if (live) {
+        *error = "Another process is already listening on this socket";
+        return -1;
+    }
+    if (unlink(path) != 0 && errno != ENOENT) {
+        *error = "Could not remove the stale socket";
+        return -1;
+    }
+    return 0;
+}
+
+static int open_listener(const char* path, char** error) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { *error = "Socket path too long"; return -1; }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    // Why reclaim first? A daemon that was killed leaves its socket file
+    // behind, and bind refuses to reuse it.
+    if (unix_socket_reclaim(path, error) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) { *error = "Could not create socket"; return -1; }
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        *error = "Could not bind or listen on socket";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_run(const ServerOptions* options, volatile sig_atomic_t* stop, char** error) {
+    int max_jobs = options->max_jobs > 0 ? options->max_jobs : 2;
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int threads_per_job = options->threads_per_job > 0 ? options->threads_per_job
+                                                      : (cores / max_jobs > 0 ? cores / max_jobs : 1);
+
+    int listen_fd = open_listener(options->socket_path, error);
+    if (listen_fd < 0) return -1;
+
+    JobQueue queue = {0};
+    queue.capacity = options->queue_depth > 0 ? options->queue_depth : 16;
+    queue.jobs = (PendingJob*)calloc(queue.capacity, sizeof(PendingJob));
+    WorkerThread* workers = (WorkerThread*)calloc(max_jobs, sizeof(WorkerThread));
+    if (!queue.jobs || !workers) {
+        *error = "Failed to allocate worker pool";
+        free(queue.jobs); free(workers);
+        close(listen_fd);
+        unlink(options->socket_path);
+        return -1;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.ready, NULL);
+
+    int started = 0;
+    for (; started < max_jobs; started++) {
+        workers[started].worker.options = options;
+        workers[started].worker.threads_per_job = threads_per_job;
+        workers[started].queue = &queue;
+        if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) break;
+    }
+    printf("Serving on %s: %d concurrent job(s), %d engine thread(s) each, queue of %d\n",
+           options->socket_path, started, threads_per_job, queue.capacity);
+    fflush(stdout);
+
+    // Why poll with a timeout? accept() is restarted after our signal handler
+    // returns, so it would never notice a shutdown request on its own.
+    struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+    while (!*stop && started > 0) {
+        if (poll(&pfd, 1, 250) <= 0) continue;
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            // Why pause? Out of descriptors, the pending connection stays
+            // queued and poll reports it ready again at once; retrying
+            // immediately would spin a core until a job finishes.
+            if (errno == EMFILE || errno == ENFILE) poll(NULL, 0, 100);
+            continue;
+        }
+
+        pthread_mutex_lock(&queue.lock);
+        int full = queue.count == queue.capacity;
+        if (!full) {
+            PendingJob* slot = &queue.jobs[(queue.head + queue.count) % queue.capacity];
+            slot->fd = fd;
+            slot->accepted_ms = wire_now_ms();
+            queue.count++;
+            pthread_cond_signal(&queue.ready);
+        }
+        pthread_mutex_unlock(&queue.lock);
+        // Why refuse instead of queueing without bound? A clear "busy" lets the
+        // caller retry elsewhere; an ever-growing queue only hides overload
+        // behind ever-growing latency.
+        if (full) {
+            send_status(fd, "busy", "Too many jobs in flight");
+            close(fd);
+        }
+    }
+
+    close(listen_fd);
+    pthread_mutex_lock(&queue.lock);
+    queue.stop = 1;
+    pthread_cond_broadcast(&queue.ready);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < started; i++) pthread_join(workers[i].thread, NULL);
+    while (queue.count > 0) {
+        close(queue.jobs[queue.head].fd);
+        queue.head = (queue.head + 1) % queue.capacity;
+        queue.count--;
+    }
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.ready);
+    free(queue.jobs);
+    free(workers);
+    unlink(options->socket_path);
+    if (started == 0) { *error = "Could not start worker threads"; return -1; }
+    return 0;
+}
+
+// --- Client ---
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    unsigned char* data = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long len = ftell(f);
+        if (len > 0 && fseek(f, 0, SEEK_SET) == 0 && (data = (unsigned char*)malloc((size_t)len))) {
+            if (fread(data, 1, (size_t)len, f) != (size_t)len) { free(data); data = NULL; }
+            else *size = (size_t)len;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+int client_run(const char* socket_path, const char* input, const EngineConfig* config,
+               const char* format, int send_inline, long max_frames, const char* output_path,
+               char* message, size_t message_size, char** error) {
+    if (strcmp(format, "png") == 0 && !output_path) { *error = "PNG results need --output"; return -1; }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        *error = "Could not connect to server";
+        return -1;
+    }
+
+    unsigned char* data = NULL;
+    size_t data_size = 0;
+    if (send_inline && !(data = read_file(input, &data_size))) {
+        close(fd);
+        *error = "Could not read input file";
+        return -1;
+    }
+
+    double start = wire_now_ms();
+    char header[HEADER_MAX];
+    int n = snprintf(header, sizeof(header), "format=%s\nwidth=%d\nedge=%g\nbrightness=%g\nsaturate=%g\nmax_frames=%ld\n",
+                     format, config->output_width, config->edge_strength, config->brightness_factor,
+                     config->saturation_factor, max_frames);
+    if (data) n += snprintf(header + n, sizeof(header) - n, "bytes=%zu\n\n", data_size);
+    else n += snprintf(header + n, sizeof(header) - n, "input=%s\n\n", input);
+    if (n >= (int)sizeof(header)) { free(data); close(fd); *error = "Request too long"; return -1; }
+    // Why keep going when the send fails? A busy server answers and hangs up
+    // before reading the request; its reply is still waiting to be read.
+    int sent = wire_send_all(fd, header, (size_t)n) == 0 && (!data || wire_send_all(fd, data, data_size) == 0);
+    free(data);
+
+    WireBuffer* r = (WireBuffer*)malloc(sizeof(WireBuffer));
+    char* block = (char*)malloc(HEADER_MAX);
+    if (!r || !block) { free(r); free(block); close(fd); *error = "Out of memory"; return -1; }
+    r->len = r->pos = 0;
+    int ret = -1;
+    *error = sent ? "Connection closed before the job finished" : "Could not send request";
+    while (wire_read_block(fd, r, block, HEADER_MAX) == 1) {
+        const char* status = wire_block_value(block, "status");
+        if (status && strncmp(status, "frame", 5) == 0) {
+            const char* bytes = wire_block_value(block, "bytes");
+            size_t size = bytes ? strtoull(bytes, NULL, 10) : 0;
+            unsigned char* payload = (unsigned char*)malloc(size ? size : 1);
+            if (!payload || wire_read_payload(fd, r, payload, size) != 0) { free(payload); *error = "Truncated frame"; break; }
+            if (output_path) {
+                FILE* f = fopen(output_path, "wb");
+                if (f) { fwrite(payload, 1, size, f); fclose(f); }
+            } else {
+                printf("\x1b[H");
+                fwrite(payload, 1, size, stdout);
+                fflush(stdout);
+            }
+            free(payload);
+            continue;
+        }
+        if (status && strncmp(status, "done", 4) == 0) {
+            fprintf(stderr, "%s", block);
+            fprintf(stderr, "round_trip_ms=%.3f\n", wire_now_ms() - start);
+            ret = 0;
+        } else {
+            const char* msg = wire_block_value(block, "message");
+            wire_copy_value(message, message_size, msg ? msg : "");
+            *error = message;
+        }
+        break;
+    }
+    free(r);
+    free(block);
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,388 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  shard.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+
+#include "shard.h"
+
+int shard_parse_spec(const char* spec, int* index, int* count) {
+    // Why 1-based on the command line? "--shard 1/4 ... --shard 4/4" reads the
+    // way people talk about render farm jobs. Internally we count from zero.
+    int i = 0, n = 0;
+    char trailing;
+    if (!spec || sscanf(spec, "%d/%d%c", &i, &n, &trailing) != 2) return -1;
+    if (n <= 0 || i < 1 || i > n) return -1;
+    *index = i - 1;
+    *count = n;
+    return 0;
+}
+
+int shard_write_manifest(const char* path, const ShardManifest* m) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "# pixel-ripper shard manifest v1\n");
+    fprintf(f, "input=%s\n", m->input);
+    fprintf(f, "segment=%s\n", m->segment);
+    fprintf(f, "index=%d\n", m->index);
+    fprintf(f, "count=%d\n", m->count);
+    fprintf(f, "time_base=%d/%d\n", m->tb_num, m->tb_den);
+    fprintf(f, "start_pts=%" PRId64 "\n", m->start_pts);
+    fprintf(f, "end_pts=%" PRId64 "\n", m->end_pts);
+    fprintf(f, "frames=%ld\n", m->frames);
+    return (fclose(f) == 0) ? 0 : -1;
+}
+
+// Why so strict? A manifest is written by this program and nothing else, so
+// anything unexpected in one means it was truncated or edited by hand. A
+// number with junk after it, or a key given twice, would otherwise stitch the
+// wrong range without a word.
+static int parse_int64(const char* value, int64_t* out) {
+    char* end;
+    errno = 0;
+    long long v = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE) return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_int(const char* value, int* out) {
+    int64_t v;
+    if (parse_int64(value, &v) != 0 || v < INT_MIN || v > INT_MAX) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+static int copy_path(char* dst, const char* value) {
+    if (!*value || strlen(value) >= SHARD_PATH_MAX) return -1;
+    memcpy(dst, value, strlen(value) + 1);
+    return 0;
+}
+
+enum { KEY_INPUT, KEY_SEGMENT, KEY_INDEX, KEY_COUNT, KEY_TIME_BASE, KEY_START_PTS, KEY_END_PTS, KEY_FRAMES,
+       MANIFEST_KEY_COUNT };
+static const char* const MANIFEST_KEYS[MANIFEST_KEY_COUNT] = { "input", "segment", "index", "count", "time_base",
+                                                               "start_pts", "end_pts", "frames" };
+
+static int parse_manifest_line(ShardManifest* m, char* line, unsigned* seen) {
+    char* eq = strchr(line, '=');
+    if (!eq) return -1;
+    *eq = '\0';
+    const char* value = eq + 1;
+    int key = 0;
+    while (key < MANIFEST_KEY_COUNT && strcmp(line, MANIFEST_KEYS[key]) != 0) key++;
+    if (key == MANIFEST_KEY_COUNT) return 0; // A key from a newer writer.
+    if (*seen & (1u << key)) return -1;
+    *seen |= 1u << key;
+
+    int64_t v;
+    char trailing;
+    switch (key) {
+    case KEY_INPUT: return copy_path(m->input, value);
+    case KEY_SEGMENT: return copy_path(m->segment, value);
+    case KEY_INDEX: return parse_int(value, &m->index);
+    case KEY_COUNT: return parse_int(value, &m->count);
+    case KEY_TIME_BASE: return sscanf(value, "%d/%d%c", &m->tb_num, &m->tb_den, &trailing) == 2 ? 0 : -1;
+    case KEY_START_PTS: return parse_int64(value, &m->start_pts);
+    case KEY_END_PTS: return parse_int64(value, &m->end_pts);
+    default: // KEY_FRAMES
+        if (parse_int64(value, &v) != 0 || v < 0 || v > LONG_MAX) return -1;
+        m->frames = (long)v;
+        return 0;
+    }
+}
+
+int shard_read_manifest(const char* path, ShardManifest* m) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    memset(m, 0, sizeof(*m));
+    m->index = -1;
+
+    char line[SHARD_PATH_MAX + 32];
+    unsigned seen = 0;
+    int bad = 0;
+    while (!bad && fgets(line, sizeof(line), f)) {
+        size_t len = strcspn(line, "\n");
+        // A line too long for the buffer arrives without its newline.
+        if (line[len] != '\n' && !feof(f)) { bad = 1; break; }
+        line[len] = '\0';
+        if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+        bad = parse_manifest_line(m, line, &seen) != 0;
+    }
+    fclose(f);
+
+    if (bad || m->index < 0 || m->count <= 0 || m->index >= m->count || m->tb_num <= 0 || m->tb_den <= 0 ||
+        !m->segment[0] || !m->input[0]) {
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_manifests(const void* a, const void* b) {
+    return ((const ShardManifest*)a)->index - ((const ShardManifest*)b)->index;
+}
+
+// --- Concat ---
+typedef struct {
+    AVFormatContext* out_fmt_ctx;
+    AVStream* out_video_stream;
+    AVStream* out_audio_stream;
+    AVFormatContext* seg_fmt_ctx;
+    AVFormatContext* src_fmt_ctx;
+    int src_audio_idx;
+    int64_t last_video_dts;
+    int64_t video_end;    // End (pts + duration) of the video written so far, in the output time base.
+    int64_t seg_offset;   // Added to every timestamp of the current segment.
+    int seg_fresh;        // The current segment's offset is not known yet.
+} ConcatState;
+
+static void concat_cleanup(ConcatState* st) {
+    if (st->seg_fmt_ctx) avformat_close_input(&st->seg_fmt_ctx);
+    if (st->src_fmt_ctx) avformat_close_input(&st->src_fmt_ctx);
+    if (st->out_fmt_ctx) {
+        if (!(st->out_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&st->out_fmt_ctx->pb);
+        }
+        avformat_free_context(st->out_fmt_ctx);
+        st->out_fmt_ctx = NULL;
+    }
+}
+
+static int open_segment(ConcatState* st, const char* path) {
+    if (st->seg_fmt_ctx) avformat_close_input(&st->seg_fmt_ctx);
+    st->seg_fresh = 1;
+    if (avformat_open_input(&st->seg_fmt_ctx, path, NULL, NULL) != 0) return -1;
+    if (avformat_find_stream_info(st->seg_fmt_ctx, NULL) < 0) return -1;
+    if (st->seg_fmt_ctx->nb_streams < 1 ||
+        st->seg_fmt_ctx->streams[0]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) return -1;
+    return 0;
+}
+
+// Why one offset per segment? Rewriting timestamps packet by packet breaks
+// the reordering of B-frames and the frame durations at every join. Shifting
+// a whole segment keeps both intact. Segments that already carry source
+// timestamps get an offset of 0, so the video stays in sync with the source
+// audio. Segments that restart at zero are placed after the previous ones.
+//
+// Each segment's encoder starts with its own B-frame delay, so the first DTS
+// of a segment can dip below the last DTS of the previous one, which muxers
+// reject. The whole segment is then pushed later by the dip. Nudging only the
+// offending DTS would cascade into later packets and put DTS after PTS.
+static void shift_segment_packet(ConcatState* st, AVPacket* pkt) {
+    AVStream* in = st->seg_fmt_ctx->streams[0];
+    AVRational out_tb = st->out_video_stream->time_base;
+    if (st->seg_fresh) {
+        int64_t start = in->start_time != AV_NOPTS_VALUE ? av_rescale_q(in->start_time, in->time_base, out_tb) : pkt->pts;
+        st->seg_offset = (st->video_end != AV_NOPTS_VALUE && start != AV_NOPTS_VALUE) ? st->video_end - start : 0;
+        if (st->last_video_dts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE &&
+            pkt->dts + st->seg_offset <= st->last_video_dts) {
+            st->seg_offset = st->last_video_dts + 1 - pkt->dts;
+        }
+        st->seg_fresh = 0;
+    }
+    if (pkt->pts != AV_NOPTS_VALUE) pkt->pts += st->seg_offset;
+    if (pkt->dts != AV_NOPTS_VALUE) pkt->dts += st->seg_offset;
+    if (pkt->pts == AV_NOPTS_VALUE) return;
+    int64_t duration = pkt->duration;
+    if (duration <= 0 && in->avg_frame_rate.num > 0) duration = av_rescale_q(1, av_inv_q(in->avg_frame_rate), out_tb);
+    if (st->video_end == AV_NOPTS_VALUE || pkt->pts + duration > st->video_end) st->video_end = pkt->pts + duration;
+}
+
+// Reads the next packet of the current segment, moving on to the next non-empty
+// segment at EOF. Returns 0 with a packet, AVERROR_EOF when all are exhausted.
+static int next_video_packet(ConcatState* st, const ShardManifest* manifests, int count, int* seg_idx, AVPacket* pkt) {
+    while (*seg_idx < count) {
+        if (st->seg_fmt_ctx) {
+            int ret = av_read_frame(st->seg_fmt_ctx, pkt);
+            if (ret >= 0) {
+                if (pkt->stream_index == 0) {
+                    av_packet_rescale_ts(pkt, st->seg_fmt_ctx->streams[0]->time_base, st->out_video_stream->time_base);
+                    shift_segment_packet(st, pkt);
+                    return 0;
+                }
+                av_packet_unref(pkt);
+                continue;
+            }
+            avformat_close_input(&st->seg_fmt_ctx);
+            (*seg_idx)++;
+        }
+        while (*seg_idx < count && manifests[*seg_idx].frames <= 0) (*seg_idx)++;
+        if (*seg_idx >= count) break;
+        if (open_segment(st, manifests[*seg_idx].segment) < 0) return AVERROR_INVALIDDATA;
+    }
+    return AVERROR_EOF;
+}
+
+// Reads the next source audio packet that falls inside the stitched range.
+static int next_audio_packet(ConcatState* st, int64_t start_pts, int64_t end_pts, AVRational range_tb, AVPacket* pkt) {
+    AVRational audio_tb = st->src_fmt_ctx->streams[st->src_audio_idx]->time_base;
+    while (av_read_frame(st->src_fmt_ctx, pkt) >= 0) {
+        if (pkt->stream_index != st->src_audio_idx || pkt->pts == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (start_pts != INT64_MIN && av_compare_ts(pkt->pts, audio_tb, start_pts, range_tb) < 0) {
+            av_packet_unref(pkt);
+            continue;
+        }
+        if (end_pts != INT64_MAX && av_compare_ts(pkt->pts, audio_tb, end_pts, range_tb) >= 0) {
+            av_packet_unref(pkt);
+            return AVERROR_EOF;
+        }
+        av_packet_rescale_ts(pkt, audio_tb, st->out_audio_stream->time_base);
+        pkt->stream_index = st->out_audio_stream->index;
+        return 0;
+    }
+    return AVERROR_EOF;
+}
+
+int shard_concat(const char* const* manifest_paths, int num_manifests, const char* output_filename, char** error) {
+    if (num_manifests <= 0) { *error = "No manifests given"; return -1; }
+    ShardManifest* manifests = (ShardManifest*)calloc(num_manifests, sizeof(ShardManifest));
+    if (!manifests) { *error = "Failed to allocate manifests"; return -1; }
+
+    for (int i = 0; i < num_manifests; i++) {
+        if (shard_read_manifest(manifest_paths[i], &manifests[i]) != 0) {
+            *error = "Could not read shard manifest"; free(manifests); return -1;
+        }
+    }
+    int ret = shard_concat_manifests(manifests, num_manifests, output_filename, error);
+    free(manifests);
+    return ret;
+}
+
+int shard_concat_manifests(ShardManifest* manifests, int num_manifests, const char* output_filename, char** error) {
+    if (num_manifests <= 0) { *error = "No manifests given"; return -1; }
+    qsort(manifests, num_manifests, sizeof(ShardManifest), compare_manifests);
+
+    // Why insist on contiguity? A missing or duplicated shard would silently
+    // produce a video with a jump or a stutter. Refusing is the honest answer.
+    for (int i = 0; i < num_manifests; i++) {
+        const ShardManifest* m = &manifests[i];
+        if (strcmp(m->input, manifests[0].input) != 0 || m->count != manifests[0].count ||
+            m->tb_num != manifests[0].tb_num || m->tb_den != manifests[0].tb_den) {
+            *error = "Manifests come from different shard runs"; return -1;
+        }
+        if (i > 0 && m->index == manifests[i - 1].index) {
+            *error = "Two manifests are for the same shard"; return -1;
+        }
+        if (i > 0 && (m->index != manifests[i - 1].index + 1 || m->start_pts != manifests[i - 1].end_pts)) {
+            *error = "Shards are not contiguous"; return -1;
+        }
+    }
+
+    int first_segment = 0;
+    while (first_segment < num_manifests && manifests[first_segment].frames <= 0) first_segment++;
+    if (first_segment == num_manifests) { *error = "All segments are empty"; return -1; }
+
+    ConcatState st = { .src_audio_idx = -1, .last_video_dts = AV_NOPTS_VALUE, .video_end = AV_NOPTS_VALUE };
+    AVRational range_tb = { manifests[0].tb_num, manifests[0].tb_den };
+    int64_t range_start = manifests[0].start_pts;
+    int64_t range_end = manifests[num_manifests - 1].end_pts;
+    AVPacket* vpkt = NULL;
+    AVPacket* apkt = NULL;
+    int ret = -1;
+
+    if (open_segment(&st, manifests[first_segment].segment) < 0) { *error = "Could not open segment"; goto done; }
+
+    avformat_alloc_output_context2(&st.out_fmt_ctx, NULL, NULL, output_filename);
+    if (!st.out_fmt_ctx) { *error = "Could not create output context"; goto done; }
+
+    AVStream* seg_video = st.seg_fmt_ctx->streams[0];
+    st.out_video_stream = avformat_new_stream(st.out_fmt_ctx, NULL);
+    if (!st.out_video_stream) { *error = "Failed to create new video stream"; goto done; }
+    if (avcodec_parameters_copy(st.out_video_stream->codecpar, seg_video->codecpar) < 0) {
+        *error = "Failed to copy video parameters"; goto done;
+    }
+    st.out_video_stream->codecpar->codec_tag = 0;
+    st.out_video_stream->time_base = seg_video->time_base;
+
+    // Why reopen the source? The audio was never touched by the shards. Copying
+    // its packets straight from the original keeps it bit-exact.
+    if (avformat_open_input(&st.src_fmt_ctx, manifests[0].input, NULL, NULL) == 0 &&
+        avformat_find_stream_info(st.src_fmt_ctx, NULL) >= 0) {
+        for (unsigned int i = 0; i < st.src_fmt_ctx->nb_streams; i++) {
+            if (st.src_fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+                st.src_audio_idx = (int)i;
+                break;
+            }
+        }
+    } else {
+        fprintf(stderr, "WARNING: Could not open %s; stitching without audio.\n", manifests[0].input);
+    }
+    if (st.src_audio_idx >= 0) {
+        AVStream* in_audio = st.src_fmt_ctx->streams[st.src_audio_idx];
+        st.out_audio_stream = avformat_new_stream(st.out_fmt_ctx, NULL);
+        if (!st.out_audio_stream) { *error = "Failed to create new audio stream"; goto done; }
+        if (avcodec_parameters_copy(st.out_audio_stream->codecpar, in_audio->codecpar) < 0) {
+            *error = "Failed to copy audio parameters"; goto done;
+        }
+        st.out_audio_stream->codecpar->codec_tag = 0;
+        st.out_audio_stream->time_base = in_audio->time_base;
+        if (range_start != INT64_MIN) {
+            av_seek_frame(st.src_fmt_ctx, st.src_audio_idx,
+                          av_rescale_q(range_start, range_tb, in_audio->time_base), AVSEEK_FLAG_BACKWARD);
+        }
+    }
+
+    if (!(st.out_fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        if (avio_open(&st.out_fmt_ctx->pb, output_filename, AVIO_FLAG_WRITE) < 0) { *error = "Could not open output file"; goto done; }
+    }
+    if (avformat_write_header(st.out_fmt_ctx, NULL) < 0) { *error = "Error occurred when opening output file"; goto done; }
+
+    vpkt = av_packet_alloc();
+    apkt = av_packet_alloc();
+    if (!vpkt || !apkt) { *error = "Failed to allocate packets"; goto done; }
+
+    // Why a two-way merge? Feeding all video and then all audio would make the
+    // muxer buffer the entire file to interleave it. Picking whichever pending
+    // packet has the lower DTS keeps the interleaver's queue tiny.
+    int seg_idx = first_segment;
+    int have_video = (next_video_packet(&st, manifests, num_manifests, &seg_idx, vpkt) == 0);
+    int have_audio = (st.src_audio_idx >= 0) &&
+                     (next_audio_packet(&st, range_start, range_end, range_tb, apkt) == 0);
+
+    while (have_video || have_audio) {
+        int take_video = have_video;
+        if (have_video && have_audio) {
+            take_video = av_compare_ts(vpkt->dts, st.out_video_stream->time_base,
+                                       apkt->dts, st.out_audio_stream->time_base) <= 0;
+        }
+        if (take_video) {
+            if (st.last_video_dts != AV_NOPTS_VALUE && vpkt->dts != AV_NOPTS_VALUE && vpkt->dts <= st.last_video_dts) {
+                *error = "Segment decode timestamps go backwards"; goto done;
+            }
+            if (vpkt->dts != AV_NOPTS_VALUE) st.last_video_dts = vpkt->dts;
+            vpkt->stream_index = st.out_video_stream->index;
+            if (av_interleaved_write_frame(st.out_fmt_ctx, vpkt) < 0) { *error = "Error writing video packet"; goto done; }
+            int next = next_video_packet(&st, manifests, num_manifests, &seg_idx, vpkt);
+            if (next == AVERROR_INVALIDDATA) { *error = "Could not open segment"; goto done; }
+            have_video = (next == 0);
+        } else {
+            if (av_interleaved_write_frame(st.out_fmt_ctx, apkt) < 0) { *error = "Error writing audio packet"; goto done; }
+            have_audio = (next_audio_packet(&st, range_start, range_end, range_tb, apkt) == 0);
+        }
+    }
+
+    if (av_write_trailer(st.out_fmt_ctx) < 0) { *error = "Error writing trailer"; goto done; }
+    ret = 0;
+
+done:
+    av_packet_free(&vpkt);
+    av_packet_free(&apkt);
+    concat_cleanup(&st);
+    return ret;
+}
@@ -0,0 +1,282 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  shm_ring.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shm_ring.h"
+
+#define SHM_RING_MAGIC 0x52525850u // "PXRR"
+#define SHM_ALIGN 64
+// Longest single futex sleep; between sleeps the reader checks the writer is alive.
+#define SHM_WAIT_SLICE_NS 250000000LL
+
+// Why fixed-width fields and explicit padding? Writer and readers are separate
+// programs, possibly built by different compilers. The layout is the contract.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t closed;
+    uint64_t slot_bytes;  // Payload capacity of every slot.
+    uint64_t slot_stride; // Bytes from one slot header to the next.
+    uint64_t published;   // Sequence number of the newest complete frame.
+    uint32_t futex;       // Bumped on every publish and on close.
+    uint32_t waiters;     // Readers sleeping on the futex; lets the writer skip the wake syscall.
+    uint32_t writer_pid;  // Lets readers notice a writer that died without closing the ring.
+    uint8_t pad[12];
+} RingHeader;
+
+typedef struct {
+    uint64_t lock; // 2*seq - 1 while frame seq is being written, 2*seq once complete.
+    int64_t pts;
+    int64_t published_ns;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pad0;
+    uint64_t size;
+    uint8_t pad[16];
+} RingSlot;
+
+_Static_assert(sizeof(RingHeader) == SHM_ALIGN, "RingHeader must fill one cache line");
+_Static_assert(sizeof(RingSlot) == SHM_ALIGN, "RingSlot must fill one cache line");
+
+struct ShmRingWriter {
+    char name[256];
+    RingHeader* hdr;
+    size_t map_size;
+    uint64_t writing; // Sequence number reserved by shm_ring_begin, 0 if none.
+};
+
+struct ShmRingReader {
+    RingHeader* hdr;
+    size_t map_size;
+    uint64_t next_seq;
+};
+
+static RingSlot* slot_for(RingHeader* hdr, uint64_t seq) {
+    uint64_t index = (seq - 1) % hdr->slot_count;
+    return (RingSlot*)((unsigned char*)hdr + sizeof(RingHeader) + index * hdr->slot_stride);
+}
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void normalize_name(char* out, size_t size, const char* name) {
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+// Why the shared (non-private) futex ops? The word lives in a mapping that
+// other processes share; a private futex would key on this process only.
+//
+// Why sequentially consistent? The writer stores futex then loads waiters,
+// and a reader stores waiters then loads futex. With weaker orderings each
+// load may be satisfied before the other side's store is visible: the writer
+// skips the wake while the reader sleeps on the old value. In a single total
+// order at least one side sees the other's store.
+static void ring_wake(RingHeader* hdr) {
+    __atomic_add_fetch(&hdr->futex, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST) > 0) {
+        syscall(SYS_futex, &hdr->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+ShmRingWriter* shm_ring_create(const char* name, int slot_count, size_t slot_bytes, char** error) {
+    if (slot_count < 2 || slot_bytes == 0) { *error = "A ring needs at least two non-empty slots"; return NULL; }
+    ShmRingWriter* w = (ShmRingWriter*)calloc(1, sizeof(ShmRingWriter));
+    if (!w) { *error = "Failed to allocate ring writer"; return NULL; }
+    normalize_name(w->name, sizeof(w->name), name);
+
+    size_t stride = (sizeof(RingSlot) + slot_bytes + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+    w->map_size = sizeof(RingHeader) + stride * (size_t)slot_count;
+
+    // Why unlink first? A writer that crashed leaves its segment behind; a
+    // fresh ring must not inherit its sequence numbers.
+    shm_unlink(w->name);
+    int fd = shm_open(w->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) { *error = "Could not create shared memory segment"; free(w); return NULL; }
+    if (ftruncate(fd, (off_t)w->map_size) != 0) {
+        *error = "Could not size shared memory segment";
+        close(fd); shm_unlink(w->name); free(w);
+        return NULL;
+    }
+    void* map = mmap(NULL, w->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { *error = "Could not map shared memory segment"; shm_unlink(w->name); free(w); return NULL; }
+
+    w->hdr = (RingHeader*)map;
+    w->hdr->version = SHM_RING_VERSION;
+    w->hdr->slot_count = (uint32_t)slot_count;
+    w->hdr->slot_bytes = slot_bytes;
+    w->hdr->slot_stride = stride;
+    w->hdr->writer_pid = (uint32_t)getpid();
+    // The magic goes last: a reader that sees it sees a fully set-up header.
+    __atomic_store_n(&w->hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return w;
+}
+
+unsigned char* shm_ring_begin(ShmRingWriter* w, size_t size) {
+    if (!w || size > w->hdr->slot_bytes) return NULL;
+    w->writing = w->hdr->published + 1;
+    RingSlot* slot = slot_for(w->hdr, w->writing);
+    // Why the fence? Readers must observe the odd lock before any payload byte
+    // changes, or they could validate a frame that is being overwritten.
+    __atomic_store_n(&slot->lock, 2 * w->writing - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return (unsigned char*)(slot + 1);
+}
+
+void shm_ring_commit(ShmRingWriter* w, ShmFrameFormat format, int width, int height, size_t size, int64_t pts) {
+    if (!w || !w->writing) return;
+    RingSlot* slot = slot_for(w->hdr, w->writing);
+    slot->pts = pts;
+    slot->published_ns = monotonic_ns();
+    slot->format = (uint32_t)format;
+    slot->width = (uint32_t)width;
+    slot->height = (uint32_t)height;
+    slot->size = size;
+    __atomic_store_n(&slot->lock, 2 * w->writing, __ATOMIC_RELEASE);
+    __atomic_store_n(&w->hdr->published, w->writing, __ATOMIC_RELEASE);
+    w->writing = 0;
+    ring_wake(w->hdr);
+}
+
+void shm_ring_close(ShmRingWriter** w_ptr) {
+    if (!w_ptr || !*w_ptr) return;
+    ShmRingWriter* w = *w_ptr;
+    __atomic_store_n(&w->hdr->closed, 1, __ATOMIC_RELEASE);
+    ring_wake(w->hdr);
+    munmap(w->hdr, w->map_size);
+    // Readers keep their mappings; unlinking only removes the name.
+    shm_unlink(w->name);
+    free(w);
+    *w_ptr = NULL;
+}
+
+ShmRingReader* shm_ring_open(const char* name, char** error) {
+    char path[256];
+    normalize_name(path, sizeof(path), name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) { *error = "No such frame ring"; return NULL; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RingHeader)) {
+        close(fd);
+        *error = "Frame ring is not initialised";
+        return NULL;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { *error = "Could not map frame ring"; return NULL; }
+
+    RingHeader* hdr = (RingHeader*)map;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC || hdr->version != SHM_RING_VERSION ||
+        sizeof(RingHeader) + hdr->slot_stride * hdr->slot_count > (size_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        *error = "Frame ring has an unknown layout";
+        return NULL;
+    }
+    ShmRingReader* r = (ShmRingReader*)calloc(1, sizeof(ShmRingReader));
+    if (!r) { munmap(map, (size_t)st.st_size); *error = "Failed to allocate ring reader"; return NULL; }
+    r->hdr = hdr;
+    r->map_size = (size_t)st.st_size;
+    return r;
+}
+
+int shm_ring_next(ShmRingReader* r, ShmFrame* frame, int timeout_ms, uint64_t* dropped) {
+    RingHeader* hdr = r->hdr;
+    int64_t deadline = timeout_ms >= 0 ? monotonic_ns() + (int64_t)timeout_ms * 1000000LL : 0;
+    for (;;) {
+        // Why read the futex word first? If the writer publishes between this
+        // load and FUTEX_WAIT, the word has moved on and the wait returns at
+        // once; reading it afterwards could sleep through that frame.
+        uint32_t futex_value = __atomic_load_n(&hdr->futex, __ATOMIC_ACQUIRE);
+        uint64_t published = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+
+        // A reader that joins late starts at the newest frame, not at history.
+        if (r->next_seq == 0) r->next_seq = published ? published : 1;
+
+        if (published >= r->next_seq) {
+            if (published - r->next_seq >= hdr->slot_count) {
+                uint64_t oldest = published - hdr->slot_count + 1;
+                if (dropped) *dropped += oldest - r->next_seq;
+                r->next_seq = oldest;
+            }
+            RingSlot* slot = slot_for(hdr, r->next_seq);
+            if (__atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE) != 2 * r->next_seq) {
+                // Lapped between the two loads above; this frame is gone.
+                if (dropped) (*dropped)++;
+                r->next_seq++;
+                continue;
+            }
+            frame->seq = r->next_seq;
+            frame->pts = slot->pts;
+            frame->format = (ShmFrameFormat)slot->format;
+            frame->width = (int)slot->width;
+            frame->height = (int)slot->height;
+            frame->size = (size_t)slot->size;
+            frame->data = (const unsigned char*)(slot + 1);
+            frame->published_ns = slot->published_ns;
+            r->next_seq++;
+            if (!shm_ring_reader_check(r, frame)) {
+                if (dropped) (*dropped)++;
+                continue;
+            }
+            return 1;
+        }
+        if (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE)) return -1;
+
+        // Why check the writer? A writer that crashed never sets closed, and a
+        // reader waiting for its next frame would sleep forever.
+        if (hdr->writer_pid && kill((pid_t)hdr->writer_pid, 0) != 0 && errno == ESRCH) return -1;
+
+        int64_t left = SHM_WAIT_SLICE_NS;
+        if (timeout_ms >= 0) {
+            left = deadline - monotonic_ns();
+            if (left <= 0) return 0;
+            if (left > SHM_WAIT_SLICE_NS) left = SHM_WAIT_SLICE_NS;
+        }
+        struct timespec ts;
+        ts.tv_sec = left / 1000000000LL;
+        ts.tv_nsec = left % 1000000000LL;
+        __atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+        // See ring_wake: a publish that missed our waiters count is seen here.
+        if (__atomic_load_n(&hdr->futex, __ATOMIC_SEQ_CST) == futex_value) {
+            syscall(SYS_futex, &hdr->futex, FUTEX_WAIT, futex_value, &ts, NULL, 0);
+        }
+        __atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+int shm_ring_reader_check(const ShmRingReader* r, const ShmFrame* frame) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const RingSlot* slot = (const RingSlot*)frame->data - 1;
+    (void)r;
+    return __atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == 2 * frame->seq;
+}
+
+void shm_ring_reader_close(ShmRingReader** r_ptr) {
+    if (!r_ptr || !*r_ptr) return;
+    munmap((*r_ptr)->hdr, (*r_ptr)->map_size);
+    free(*r_ptr);
+    *r_ptr = NULL;
+}
@@ -0,0 +1,140 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  stage_stats.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stage_stats.h"
+#include "latency_histogram.h"
+
+// Why log-linear buckets? Stage times span from a few hundred nanoseconds (a
+// demuxed packet) to hundreds of milliseconds (a 4K encode). Linear buckets
+// would need millions of entries for that range, and storing every sample
+// grows without bound. Sixteen sub-buckets per power of two cover 1 ns to over
+// an hour in 640 counters, at a fixed 3% resolution.
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+
+typedef struct {
+    LatencyHistogram time;
+    int64_t bytes;
+} StageAccumulator;
+
+// Why align each slot to a cache line? A slot's size is not a multiple of 64,
+// so without it the tail of one thread's counters shares a line with the head
+// of the next, and every record on either side bounces that line.
+typedef struct {
+    StageAccumulator stages[ENGINE_STAGE_COUNT];
+} __attribute__((aligned(64))) StatsSlot;
+
+struct StageStats {
+    int num_slots;
+    StatsSlot* slots;
+};
+
+static int bucket_of(int64_t ns) {
+    if (ns < SUB_COUNT) return ns < 0 ? 0 : (int)ns;
+    int exponent = 63 - __builtin_clzll((unsigned long long)ns);
+    int sub = (int)((ns >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+    int bucket = (exponent - SUB_BITS + 1) * SUB_COUNT + sub;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// The midpoint of the bucket's range.
+static double bucket_value(int bucket) {
+    if (bucket < SUB_COUNT) return (double)bucket;
+    int exponent = bucket / SUB_COUNT + SUB_BITS - 1;
+    int sub = bucket % SUB_COUNT;
+    double width = (double)(1LL << (exponent - SUB_BITS));
+    return (double)(SUB_COUNT + sub) * width + width / 2.0;
+}
+
+void latency_record(LatencyHistogram* h, int64_t ns) {
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->buckets[bucket_of(ns)]++;
+}
+
+void latency_merge(LatencyHistogram* into, const LatencyHistogram* from) {
+    into->count += from->count;
+    into->total_ns += from->total_ns;
+    if (from->max_ns > into->max_ns) into->max_ns = from->max_ns;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) into->buckets[b] += from->buckets[b];
+}
+
+double latency_percentile_ns(const LatencyHistogram* h, double q) {
+    if (h->count == 0) return 0.0;
+    int64_t target = (int64_t)(q * (double)h->count + 0.999999);
+    if (target < 1) target = 1;
+    int64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= target) {
+            // A bucket midpoint can overshoot the largest sample it holds.
+            double ns = bucket_value(b);
+            return ns < (double)h->max_ns ? ns : (double)h->max_ns;
+        }
+    }
+    return 0.0;
+}
+
+StageStats* stage_stats_create(int slots) {
+    if (slots < 1) return NULL;
+    StageStats* stats = (StageStats*)calloc(1, sizeof(StageStats));
+    if (!stats) return NULL;
+    void* memory = NULL;
+    if (posix_memalign(&memory, 64, (size_t)slots * sizeof(StatsSlot)) != 0) {
+        free(stats);
+        return NULL;
+    }
+    stats->slots = (StatsSlot*)memory;
+    memset(stats->slots, 0, (size_t)slots * sizeof(StatsSlot));
+    stats->num_slots = slots;
+    return stats;
+}
+
+void stage_stats_free(StageStats** stats) {
+    if (!stats || !*stats) return;
+    free((*stats)->slots);
+    free(*stats);
+    *stats = NULL;
+}
+
+int stage_stats_slots(const StageStats* stats) {
+    return stats ? stats->num_slots : 0;
+}
+
+void stage_stats_record(StageStats* stats, int slot, int stage, int64_t elapsed_ns, int64_t bytes) {
+    if (!stats || slot < 0 || slot >= stats->num_slots || stage < 0 || stage >= ENGINE_STAGE_COUNT) return;
+    StageAccumulator* acc = &stats->slots[slot].stages[stage];
+    latency_record(&acc->time, elapsed_ns);
+    acc->bytes += bytes;
+}
+
+void stage_stats_summarize(const StageStats* stats, int slot, int stage, EngineStageStats* out) {
+    memset(out, 0, sizeof(*out));
+    if (!stats || slot >= stats->num_slots || stage < 0 || stage >= ENGINE_STAGE_COUNT) return;
+    int first = slot < 0 ? 0 : slot;
+    int last = slot < 0 ? stats->num_slots - 1 : slot;
+
+    LatencyHistogram merged;
+    memset(&merged, 0, sizeof(merged));
+    for (int s = first; s <= last; s++) {
+        const StageAccumulator* acc = &stats->slots[s].stages[stage];
+        latency_merge(&merged, &acc->time);
+        out->bytes += acc->bytes;
+    }
+    out->count = merged.count;
+    if (out->count == 0) return;
+    out->total_ms = (double)merged.total_ns / 1e6;
+    out->mean_ms = out->total_ms / (double)out->count;
+    out->max_ms = (double)merged.max_ns / 1e6;
+    out->p50_ms = latency_percentile_ns(&merged, 0.50) / 1e6;
+    out->p99_ms = latency_percentile_ns(&merged, 0.99) / 1e6;
+}
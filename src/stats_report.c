@@ -0,0 +1,165 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  stats_report.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+
+#include "stats_report.h"
+
+// Why the busiest thread? Kernel slices run side by side, so a frame costs
+// the longest slice, not the sum. For the serial stages only one thread
+// records, and the busiest thread is simply that one.
+static double busiest_thread_ms(const ProcessingContext* ctx, EngineStage stage) {
+    double busiest = 0.0;
+    int threads = engine_get_stats_threads(ctx);
+    for (int t = 0; t < threads; t++) {
+        EngineStageStats s;
+        if (engine_get_stage_stats(ctx, t, stage, &s) == 0 && s.total_ms > busiest) busiest = s.total_ms;
+    }
+    return busiest;
+}
+
+static double fps_alone(const ProcessingContext* ctx, EngineStage stage, int64_t frames) {
+    double busiest = busiest_thread_ms(ctx, stage);
+    return busiest > 0.0 ? (double)frames / (busiest / 1000.0) : 0.0;
+}
+
+// Per thousand instructions, or -1 when either count is missing.
+static double per_kilo_instruction(int64_t events, int64_t instructions) {
+    return events >= 0 && instructions > 0 ? 1000.0 * (double)events / (double)instructions : -1.0;
+}
+
+static void print_ratio(FILE* out, double value, const char* format) {
+    if (value < 0.0) fprintf(out, "%10s", "-");
+    else fprintf(out, format, value);
+}
+
+// Why misses per thousand instructions? Raw miss counts grow with the frame
+// size and the run length; per instruction they compare across both.
+static void print_counters(const ProcessingContext* ctx, FILE* out) {
+    EngineStageCounters c;
+    if (engine_get_stage_counters(ctx, -1, ENGINE_STAGE_KERNEL, &c) != 0) return;
+    fprintf(out, "Hardware counters (user space):\n");
+    fprintf(out, "%-8s %8s %12s %10s %10s %10s\n", "stage", "calls", "Mcycles", "IPC", "LLC MPKI", "br MPKI");
+    for (int stage = 0; stage < ENGINE_STAGE_COUNT; stage++) {
+        if (engine_get_stage_counters(ctx, -1, (EngineStage)stage, &c) != 0 || c.samples == 0) continue;
+        fprintf(out, "%-8s %8lld ", engine_stage_name((EngineStage)stage), (long long)c.samples);
+        if (c.cycles >= 0) fprintf(out, "%12.1f", (double)c.cycles / 1e6);
+        else fprintf(out, "%12s", "-");
+        print_ratio(out, c.cycles > 0 && c.instructions >= 0 ? (double)c.instructions / (double)c.cycles : -1.0, " %9.2f");
+        print_ratio(out, per_kilo_instruction(c.cache_misses, c.instructions), " %9.2f");
+        print_ratio(out, per_kilo_instruction(c.branch_misses, c.instructions), " %9.2f");
+        fprintf(out, "\n");
+    }
+}
+
+void stats_report_print(const ProcessingContext* ctx, FILE* out) {
+    int64_t frames = 0;
+    double wall = 0.0;
+    if (engine_get_stats_span(ctx, &frames, &wall) != 0) return;
+
+    fprintf(out, "\nStage timings: %lld frames in %.2f s (%.1f fps)\n", (long long)frames, wall,
+            wall > 0.0 ? (double)frames / wall : 0.0);
+    fprintf(out, "%-8s %8s %9s %9s %9s %9s %10s %7s %10s %9s\n",
+            "stage", "calls", "mean ms", "p50 ms", "p99 ms", "max ms", "total ms", "wall", "fps alone", "MB");
+    EngineStage bottleneck = ENGINE_STAGE_COUNT;
+    double lowest_fps = 0.0;
+    for (int stage = 0; stage < ENGINE_STAGE_COUNT; stage++) {
+        EngineStageStats s;
+        if (engine_get_stage_stats(ctx, -1, (EngineStage)stage, &s) != 0 || s.count == 0) continue;
+        double alone = fps_alone(ctx, (EngineStage)stage, frames);
+        if (frames > 0 && (bottleneck == ENGINE_STAGE_COUNT || alone < lowest_fps)) {
+            bottleneck = (EngineStage)stage;
+            lowest_fps = alone;
+        }
+        fprintf(out, "%-8s %8lld %9.3f %9.3f %9.3f %9.3f %10.1f %6.1f%% %10.1f %9.1f\n",
+                engine_stage_name((EngineStage)stage), (long long)s.count, s.mean_ms, s.p50_ms, s.p99_ms,
+                s.max_ms, s.total_ms, wall > 0.0 ? 100.0 * busiest_thread_ms(ctx, (EngineStage)stage) / 1000.0 / wall : 0.0,
+                alone, (double)s.bytes / (1024.0 * 1024.0));
+    }
+    if (bottleneck != ENGINE_STAGE_COUNT) {
+        fprintf(out, "Bottleneck: %s (%.1f fps if it were the only work)\n", engine_stage_name(bottleneck), lowest_fps);
+    }
+
+    int threads = engine_get_stats_threads(ctx);
+    double sum = 0.0, slowest = 0.0;
+    int workers = 0;
+    fprintf(out, "Kernel per worker (ms):");
+    for (int t = 2; t < threads; t++) {
+        EngineStageStats s;
+        if (engine_get_stage_stats(ctx, t, ENGINE_STAGE_KERNEL, &s) != 0 || s.count == 0) continue;
+        fprintf(out, " %.1f", s.total_ms);
+        sum += s.total_ms;
+        if (s.total_ms > slowest) slowest = s.total_ms;
+        workers++;
+    }
+    if (workers > 0) {
+        fprintf(out, "  (slowest/mean %.2f)\n", slowest / (sum / workers));
+    } else {
+        fprintf(out, " none\n");
+    }
+    print_counters(ctx, out);
+}
+
+static void write_stage_json(FILE* f, const ProcessingContext* ctx, int thread, EngineStage stage,
+                             const EngineStageStats* s) {
+    fprintf(f, "\"count\": %lld, \"total_ms\": %.4f, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p99_ms\": %.4f, "
+               "\"max_ms\": %.4f, \"bytes\": %lld",
+            (long long)s->count, s->total_ms, s->mean_ms, s->p50_ms, s->p99_ms, s->max_ms, (long long)s->bytes);
+    EngineStageCounters c;
+    if (engine_get_stage_counters(ctx, thread, stage, &c) == 0 && c.samples > 0) {
+        fprintf(f, ", \"counters\": {\"samples\": %lld, \"cycles\": %lld, \"instructions\": %lld, "
+                   "\"cache_misses\": %lld, \"branch_misses\": %lld}",
+                (long long)c.samples, (long long)c.cycles, (long long)c.instructions, (long long)c.cache_misses,
+                (long long)c.branch_misses);
+    }
+}
+
+int stats_report_write_json(const ProcessingContext* ctx, const char* path, char** error) {
+    int64_t frames = 0;
+    double wall = 0.0;
+    if (engine_get_stats_span(ctx, &frames, &wall) != 0) {
+        *error = "stage timing was not enabled";
+        return -1;
+    }
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        *error = "could not open the stats file for writing";
+        return -1;
+    }
+    fprintf(f, "{\n  \"engine_version\": %d,\n  \"frames\": %lld,\n  \"wall_secs\": %.6f,\n  \"fps\": %.3f,\n",
+            engine_version(), (long long)frames, wall, wall > 0.0 ? (double)frames / wall : 0.0);
+    fprintf(f, "  \"stages\": [\n");
+    int threads = engine_get_stats_threads(ctx);
+    int first = 1;
+    for (int stage = 0; stage < ENGINE_STAGE_COUNT; stage++) {
+        EngineStageStats s;
+        if (engine_get_stage_stats(ctx, -1, (EngineStage)stage, &s) != 0 || s.count == 0) continue;
+        fprintf(f, "%s    {\"stage\": \"%s\", ", first ? "" : ",\n", engine_stage_name((EngineStage)stage));
+        write_stage_json(f, ctx, -1, (EngineStage)stage, &s);
+        fprintf(f, ", \"fps_alone\": %.3f, \"threads\": [", fps_alone(ctx, (EngineStage)stage, frames));
+        int first_thread = 1;
+        for (int t = 0; t < threads; t++) {
+            EngineStageStats ts;
+            if (engine_get_stage_stats(ctx, t, (EngineStage)stage, &ts) != 0 || ts.count == 0) continue;
+            char label[24];
+            engine_stats_thread_name(t, label, sizeof(label));
+            fprintf(f, "%s{\"thread\": \"%s\", ", first_thread ? "" : ", ", label);
+            write_stage_json(f, ctx, t, (EngineStage)stage, &ts);
+            fprintf(f, "}");
+            first_thread = 0;
+        }
+        fprintf(f, "]}");
+        first = 0;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    if (fclose(f) != 0) {
+        *error = "could not write the stats file";
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,406 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  throughput.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "throughput.h"
+#include <libavcodec/avcodec.h>
+
+#define THROUGHPUT_MAX_RUNS 32
+#define THROUGHPUT_PATH_MAX 4096
+
+typedef struct {
+    int pipeline;   // THROUGHPUT_TRANSCODE or THROUGHPUT_PLAYBACK.
+    int weak;       // 0 for the strong-scaling table, 1 for weak.
+    int threads;
+    int width;      // Cells per row.
+    int height;     // Rows.
+    long frames;
+    double fps;     // Median over the runs.
+    double samples_fps[THROUGHPUT_MAX_RUNS];
+    int runs;
+} ThroughputPoint;
+
+static double now_secs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// --- Test media ---
+// Why this pattern? Scrolling colour ramps and a ring field that drifts every
+// frame keep the encoder and the cell kernel honest: no frame repeats, edges
+// run in every direction, and a strip of seeded noise keeps the bitrate, and
+// with it the decode cost, close to real footage.
+
+static uint32_t lcg_next(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 24;
+}
+
+static void fill_pattern(uint8_t* rgb, int width, int height, int index) {
+    int cx = width / 4 + (index * 7) % (width / 2 + 1);
+    int cy = height / 2;
+    int spacing = width / 24 + 1;
+    uint32_t seed = (uint32_t)index + 1;
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = rgb + (size_t)y * width * 3;
+        for (int x = 0; x < width; x++) {
+            int dx = x - cx, dy = y - cy;
+            int ring = ((int)sqrtf((float)(dx * dx + dy * dy)) / spacing) & 1;
+            uint8_t r = (uint8_t)((x + index * 4) * 255 / (width + 1));
+            uint8_t g = (uint8_t)(y * 255 / height);
+            uint8_t b = ring ? 220 : 30;
+            if (y >= height - height / 8) r = g = b = (uint8_t)lcg_next(&seed);
+            row[x * 3 + 0] = r;
+            row[x * 3 + 1] = g;
+            row[x * 3 + 2] = b;
+        }
+    }
+}
+
+// Why through the engine? It is the one encoder this build is sure to have.
+// Each 8x8 glyph cell becomes 8x8 pixels, so a clip W pixels wide is rendered
+// from W/8 cells at an aspect correction of 1.
+static int generate_clip(const char* path, int width, int height, int frames, const EngineConfig* base,
+                         volatile sig_atomic_t* stop, char** error) {
+    char tmp_path[THROUGHPUT_PATH_MAX];
+    // The extension must stay last: it is how libavformat picks the muxer.
+    snprintf(tmp_path, sizeof(tmp_path), "%.*s.partial.mp4", (int)strlen(path) - 4, path);
+
+    EngineConfig config = *base;
+    config.mode = MODE_VIDEO;
+    config.output_width = width / 8;
+    config.aspect_correction = 1.0f;
+    config.output_filename = tmp_path;
+    config.checkpoint_secs = 0.0f;
+    config.shard_count = 0;
+    config.crop_w = 0;
+    config.autocrop = 0;
+    config.sequence_fps = 25.0f;
+    ProcessingContext* ctx = engine_init_raw(width, height, ENGINE_PIX_RGB24, &config, error);
+    if (!ctx) return -1;
+
+    uint8_t* rgb = (uint8_t*)malloc((size_t)width * height * 3);
+    AVFrame* frame = av_frame_alloc();
+    if (!rgb || !frame) {
+        free(rgb);
+        av_frame_free(&frame);
+        engine_cleanup(&ctx);
+        *error = "Out of memory generating test media";
+        return -1;
+    }
+
+    printf("Generating %s (%dx%d, %d frames)...\n", path, width, height, frames);
+    fflush(stdout);
+    int status = 0;
+    for (int i = 0; i < frames && !*stop; i++) {
+        fill_pattern(rgb, width, height, i);
+        const uint8_t* planes[1] = { rgb };
+        int strides[1] = { width * 3 };
+        frame->pts = i;
+        if (engine_process_buffer(ctx, planes, strides, i, &config) != 0 ||
+            engine_encode_video_frame(ctx, frame, &config) != 0) {
+            *error = "Encoding the test media failed";
+            status = -1;
+            break;
+        }
+    }
+    if (*stop && status == 0) {
+        *error = "Interrupted";
+        status = -1;
+    }
+    engine_finalize_video_encoder(ctx);
+    engine_cleanup(&ctx);
+    av_frame_free(&frame);
+    free(rgb);
+
+    if (status == 0 && rename(tmp_path, path) != 0) {
+        *error = "Could not move the generated clip into place";
+        status = -1;
+    }
+    if (status != 0) unlink(tmp_path);
+    return status;
+}
+
+// --- Pipelines ---
+
+// Times one pass over the clip and returns frames per second, or -1.
+static double run_pipeline(const char* input, const char* output, int pipeline, const EngineConfig* base,
+                           int threads, int width, int* height_out, long* frames_out, int devnull,
+                           volatile sig_atomic_t* stop) {
+    EngineConfig config = *base;
+    config.mode = MODE_VIDEO;
+    config.num_threads = threads;
+    config.output_width = width;
+    // Why these aspects? They mirror the CLI: a file gets square 8x8 cells,
+    // a terminal's cells are about twice as tall as they are wide.
+    if (pipeline == THROUGHPUT_TRANSCODE) {
+        config.output_filename = (char*)output;
+        config.aspect_correction = 1.0f;
+    } else {
+        config.output_filename = NULL;
+        config.aspect_correction = 0.5f;
+    }
+
+    char* error = NULL;
+    ProcessingContext* ctx = engine_init(input, &config, &error);
+    if (!ctx) {
+        fprintf(stderr, "Could not open %s: %s\n", input, error ? error : "Unknown error");
+        return -1.0;
+    }
+    int cols, rows;
+    engine_get_output_dims(ctx, &cols, &rows);
+    if (height_out) *height_out = rows;
+
+    char* text = NULL;
+    size_t text_capacity = 0;
+    AVPacket* packet = av_packet_alloc();
+    long frames = 0;
+    int failed = !packet;
+    double start = now_secs();
+    while (!failed && !*stop && engine_get_next_packet(ctx, packet) >= 0) {
+        if (packet->stream_index == engine_get_video_stream_idx(ctx)) {
+            AVFrame* frame = NULL;
+            if (engine_decode_video_packet(ctx, packet, &frame) == 0 && frame) {
+                engine_process_frame_to_ascii(ctx, frame, &config);
+                if (pipeline == THROUGHPUT_TRANSCODE) {
+                    failed = engine_encode_video_frame(ctx, frame, &config) != 0;
+                } else {
+                    size_t size = engine_format_ansi(ctx, &config, NULL, 0);
+                    if (size > text_capacity) {
+                        char* grown = (char*)realloc(text, size);
+                        if (!grown) { failed = 1; av_packet_unref(packet); break; }
+                        text = grown;
+                        text_capacity = size;
+                    }
+                    size_t used = engine_format_ansi(ctx, &config, text, text_capacity);
+                    if (write(devnull, text, used) < 0) failed = 1;
+                }
+                frames++;
+            }
+        }
+        av_packet_unref(packet);
+    }
+    if (pipeline == THROUGHPUT_TRANSCODE) engine_finalize_video_encoder(ctx);
+    double elapsed = now_secs() - start;
+
+    av_packet_free(&packet);
+    free(text);
+    engine_cleanup(&ctx);
+    if (frames_out) *frames_out = frames;
+    if (failed || *stop || frames == 0 || elapsed <= 0.0) return -1.0;
+    return (double)frames / elapsed;
+}
+
+static int measure_point(ThroughputPoint* point, const char* input, const char* output, const ThroughputOptions* options,
+                         const EngineConfig* config, int devnull, volatile sig_atomic_t* stop) {
+    point->runs = options->runs;
+    for (int r = 0; r < options->runs; r++) {
+        double fps = run_pipeline(input, output, point->pipeline, config, point->threads, point->width,
+                                  &point->height, &point->frames, devnull, stop);
+        if (fps < 0.0) return -1;
+        point->samples_fps[r] = fps;
+    }
+    double sorted[THROUGHPUT_MAX_RUNS];
+    memcpy(sorted, point->samples_fps, (size_t)point->runs * sizeof(double));
+    qsort(sorted, (size_t)point->runs, sizeof(double), compare_doubles);
+    point->fps = (point->runs % 2) ? sorted[point->runs / 2]
+                                   : 0.5 * (sorted[point->runs / 2 - 1] + sorted[point->runs / 2]);
+    return 0;
+}
+
+// --- Reporting ---
+
+static double spread_percent(const ThroughputPoint* p) {
+    double lo = p->samples_fps[0], hi = p->samples_fps[0];
+    for (int r = 1; r < p->runs; r++) {
+        if (p->samples_fps[r] < lo) lo = p->samples_fps[r];
+        if (p->samples_fps[r] > hi) hi = p->samples_fps[r];
+    }
+    return p->fps > 0.0 ? 100.0 * (hi - lo) / p->fps : 0.0;
+}
+
+// Why measure speedup in cells per second? Under strong scaling the grid is
+// fixed, so it is the plain fps ratio. Under weak scaling the grid grows with
+// the threads, and the cell rate is what should grow with them. Either way
+// efficiency is the speedup per thread, and 100% is perfect scaling.
+static double speedup(const ThroughputPoint* p, const ThroughputPoint* one) {
+    return (p->fps * p->width * p->height) / (one->fps * one->width * one->height);
+}
+
+static void print_table(const ThroughputPoint* points, int count, int pipeline, int weak) {
+    const ThroughputPoint* one = NULL;
+    for (int i = 0; i < count; i++) {
+        if (points[i].pipeline == pipeline && points[i].weak == weak) { one = &points[i]; break; }
+    }
+    if (!one) return;
+    printf("\n%s scaling, %s:\n", weak ? "Weak" : "Strong", pipeline == THROUGHPUT_TRANSCODE ? "transcode" : "playback to /dev/null");
+    printf("%8s %10s %10s %8s %10s %10s %11s\n", "threads", "grid", "fps", "spread", "Mcells/s", "speedup", "efficiency");
+    for (int i = 0; i < count; i++) {
+        const ThroughputPoint* p = &points[i];
+        if (p->pipeline != pipeline || p->weak != weak) continue;
+        char grid[24];
+        snprintf(grid, sizeof(grid), "%dx%d", p->width, p->height);
+        double s = speedup(p, one);
+        printf("%8d %10s %10.1f %7.1f%% %10.2f %9.2fx %10.0f%%\n", p->threads, grid, p->fps, spread_percent(p),
+               p->fps * p->width * p->height / 1e6, s, 100.0 * s / p->threads);
+    }
+}
+
+static int write_json(const char* path, const ThroughputPoint* points, int count, const ThroughputOptions* options,
+                      const char* clip) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    fprintf(f, "{\n  \"suite\": \"throughput\",\n  \"engine_version\": %d,\n  \"online_cpus\": %ld,\n",
+            engine_version(), cores);
+    fprintf(f, "  \"source\": {\"path\": \"%s\", \"width\": %d, \"height\": %d, \"frames\": %d},\n",
+            clip, options->source_width, options->source_height, options->frames);
+    fprintf(f, "  \"runs\": %d,\n  \"results\": [\n", options->runs);
+    for (int i = 0; i < count; i++) {
+        const ThroughputPoint* p = &points[i];
+        const ThroughputPoint* one = NULL;
+        for (int k = 0; k < count; k++) {
+            if (points[k].pipeline == p->pipeline && points[k].weak == p->weak) { one = &points[k]; break; }
+        }
+        fprintf(f, "    {\"pipeline\": \"%s\", \"scaling\": \"%s\", \"threads\": %d, \"width\": %d, \"height\": %d, ",
+                p->pipeline == THROUGHPUT_TRANSCODE ? "transcode" : "playback", p->weak ? "weak" : "strong",
+                p->threads, p->width, p->height);
+        fprintf(f, "\"frames\": %ld, \"fps\": %.3f, \"speedup\": %.4f, \"efficiency\": %.4f, \"samples_fps\": [",
+                p->frames, p->fps, speedup(p, one), speedup(p, one) / p->threads);
+        for (int r = 0; r < p->runs; r++) fprintf(f, "%s%.3f", r ? ", " : "", p->samples_fps[r]);
+        fprintf(f, "]}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f);
+}
+
+// 1, 2, 4, ... below the maximum, then the maximum itself.
+static int thread_counts(int max_threads, int* counts, int capacity) {
+    int n = 0;
+    for (int t = 1; t < max_threads && n < capacity - 1; t *= 2) counts[n++] = t;
+    counts[n++] = max_threads;
+    return n;
+}
+
+int throughput_run(const ThroughputOptions* in_options, const EngineConfig* config,
+                   volatile sig_atomic_t* stop, char** error) {
+    ThroughputOptions options = *in_options;
+    if (options.max_threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        options.max_threads = cores > 0 ? (int)cores : 1;
+    }
+    if (options.source_width <= 0 || options.source_height <= 0) {
+        options.source_width = 1920;
+        options.source_height = 1080;
+    }
+    // Whole 8x8 cells, which also keeps both sides even for 4:2:0.
+    options.source_width = (options.source_width + 7) / 8 * 8;
+    options.source_height = (options.source_height + 7) / 8 * 8;
+    if (options.frames <= 0) options.frames = 120;
+    if (options.runs <= 0) options.runs = 3;
+    if (options.runs > THROUGHPUT_MAX_RUNS) options.runs = THROUGHPUT_MAX_RUNS;
+    if (options.base_width <= 0) options.base_width = 120;
+    if (options.pipelines == 0) options.pipelines = THROUGHPUT_TRANSCODE | THROUGHPUT_PLAYBACK;
+    if (!options.media_dir) options.media_dir = "bench-media";
+
+    if (mkdir(options.media_dir, 0755) != 0 && errno != EEXIST) {
+        *error = "Could not create the media directory";
+        return -1;
+    }
+    char clip[THROUGHPUT_PATH_MAX];
+    char output[THROUGHPUT_PATH_MAX];
+    snprintf(clip, sizeof(clip), "%.*s/synthetic-%dx%d-%df.mp4", THROUGHPUT_PATH_MAX - 64, options.media_dir,
+             options.source_width, options.source_height, options.frames);
+    snprintf(output, sizeof(output), "%.*s/throughput-out.mp4", THROUGHPUT_PATH_MAX - 64, options.media_dir);
+    struct stat st;
+    if (stat(clip, &st) != 0 || st.st_size == 0) {
+        if (generate_clip(clip, options.source_width, options.source_height, options.frames, config, stop, error) != 0) {
+            return -1;
+        }
+    } else {
+        printf("Reusing %s\n", clip);
+    }
+
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devnull < 0) {
+        *error = "Could not open /dev/null";
+        return -1;
+    }
+
+    int counts[32];
+    int num_counts = thread_counts(options.max_threads, counts, 32);
+    ThroughputPoint* points = (ThroughputPoint*)calloc((size_t)num_counts * 4, sizeof(ThroughputPoint));
+    if (!points) {
+        close(devnull);
+        *error = "Out of memory";
+        return -1;
+    }
+    int count = 0;
+    int status = 0;
+    static const int kPipelines[2] = { THROUGHPUT_TRANSCODE, THROUGHPUT_PLAYBACK };
+    for (int p = 0; p < 2 && status == 0; p++) {
+        if (!(options.pipelines & kPipelines[p])) continue;
+        for (int weak = 0; weak <= 1 && status == 0; weak++) {
+            for (int c = 0; c < num_counts && status == 0; c++) {
+                ThroughputPoint* point = &points[count];
+                point->pipeline = kPipelines[p];
+                point->weak = weak;
+                point->threads = counts[c];
+                // Why the square root? Rows follow the width, so the cell count
+                // grows with its square; this keeps cells per thread constant.
+                point->width = weak ? (int)lround(options.base_width * sqrt((double)counts[c])) : options.base_width;
+                printf("\r%-60s", "");
+                printf("\r%s %s, %d thread(s), %d cells wide...", kPipelines[p] == THROUGHPUT_TRANSCODE ? "transcode" : "playback",
+                       weak ? "weak" : "strong", point->threads, point->width);
+                fflush(stdout);
+                if (measure_point(point, clip, output, &options, config, devnull, stop) != 0) {
+                    *error = *stop ? "Interrupted" : "A pipeline run failed";
+                    status = -1;
+                    break;
+                }
+                count++;
+            }
+        }
+    }
+    printf("\r%-60s\r", "");
+    close(devnull);
+    unlink(output);
+
+    if (count > 0) {
+        printf("Source: %s, %d runs per point, median fps\n", clip, options.runs);
+        for (int p = 0; p < 2; p++) {
+            print_table(points, count, kPipelines[p], 0);
+            print_table(points, count, kPipelines[p], 1);
+        }
+    }
+    if (status == 0 && options.json_path) {
+        if (write_json(options.json_path, points, count, &options, clip) != 0) {
+            *error = "Could not write the JSON report";
+            status = -1;
+        } else {
+            printf("\nResults written to %s\n", options.json_path);
+        }
+    }
+    free(points);
+    return status;
+}
@@ -0,0 +1,120 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  trace.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+typedef struct {
+    int64_t start_ns;
+    int64_t end_ns;
+    int64_t frame;
+    int32_t stage;
+} TraceSpan;
+
+// Why pad each slot to a cache line? The write cursor changes on every span.
+// Two workers bumping cursors on one line would bounce it between cores for
+// every kernel slice, which is the very stall the trace is meant to show.
+typedef struct {
+    TraceSpan* spans;
+    uint64_t next;  // Spans ever recorded; the ring holds the last `capacity`.
+    char pad[64 - sizeof(TraceSpan*) - sizeof(uint64_t)];
+} TraceSlot;
+
+struct TraceBuffer {
+    int num_slots;
+    size_t capacity;
+    TraceSlot* slots;
+};
+
+TraceBuffer* trace_create(int slots, size_t spans_per_slot) {
+    if (slots < 1 || spans_per_slot == 0) return NULL;
+    TraceBuffer* trace = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+    if (!trace) return NULL;
+    void* memory = NULL;
+    if (posix_memalign(&memory, 64, (size_t)slots * sizeof(TraceSlot)) != 0) {
+        free(trace);
+        return NULL;
+    }
+    trace->slots = (TraceSlot*)memory;
+    memset(trace->slots, 0, (size_t)slots * sizeof(TraceSlot));
+    trace->num_slots = slots;
+    trace->capacity = spans_per_slot;
+    for (int s = 0; s < slots; s++) {
+        trace->slots[s].spans = (TraceSpan*)malloc(spans_per_slot * sizeof(TraceSpan));
+        if (!trace->slots[s].spans) {
+            trace_free(&trace);
+            return NULL;
+        }
+    }
+    return trace;
+}
+
+void trace_free(TraceBuffer** trace) {
+    if (!trace || !*trace) return;
+    for (int s = 0; s < (*trace)->num_slots; s++) free((*trace)->slots[s].spans);
+    free((*trace)->slots);
+    free(*trace);
+    *trace = NULL;
+}
+
+void trace_record(TraceBuffer* trace, int slot, int stage, int64_t frame, int64_t start_ns, int64_t end_ns) {
+    if (!trace || slot < 0 || slot >= trace->num_slots) return;
+    TraceSlot* s = &trace->slots[slot];
+    TraceSpan* span = &s->spans[s->next % trace->capacity];
+    span->start_ns = start_ns;
+    span->end_ns = end_ns;
+    span->frame = frame;
+    span->stage = stage;
+    s->next++;
+}
+
+int trace_write_json(const TraceBuffer* trace, const char* path, const char* const* stage_names,
+                     void (*slot_name)(int slot, char* name, size_t size), int64_t origin_ns, char** error) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        *error = "could not open the trace file for writing";
+        return -1;
+    }
+    int pid = (int)getpid();
+    uint64_t dropped = 0;
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"pixel-ripper\"}}", pid);
+    for (int s = 0; s < trace->num_slots; s++) {
+        const TraceSlot* slot = &trace->slots[s];
+        if (slot->next == 0) continue;
+        char name[32];
+        slot_name(s, name, sizeof(name));
+        fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                pid, s, name);
+        fprintf(f, ",\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"sort_index\": %d}}",
+                pid, s, s);
+
+        uint64_t first = slot->next > trace->capacity ? slot->next - trace->capacity : 0;
+        dropped += first;
+        for (uint64_t i = first; i < slot->next; i++) {
+            const TraceSpan* span = &slot->spans[i % trace->capacity];
+            // Chrome trace timestamps are microseconds; the fraction keeps
+            // sub-microsecond spans from collapsing to zero width.
+            fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"engine\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                       "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %lld}}",
+                    stage_names[span->stage], pid, s, (double)(span->start_ns - origin_ns) / 1000.0,
+                    (double)(span->end_ns - span->start_ns) / 1000.0, (long long)span->frame);
+        }
+    }
+    fprintf(f, "\n], \"otherData\": {\"spans_per_thread\": %zu, \"dropped_spans\": %llu}}\n",
+            trace->capacity, (unsigned long long)dropped);
+    if (fclose(f) != 0) {
+        *error = "could not write the trace file";
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  tune.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "tune.h"
+
+#define TUNE_EDGE_STEP 0.02f
+#define TUNE_BRIGHTNESS_STEP 0.05f
+#define TUNE_SATURATION_STEP 0.1f
+#define TUNE_WIDTH_STEP 4
+#define TUNE_MIN_WIDTH 8
+
+// What a keypress invalidates, cheapest first.
+typedef enum { REDO_RENDER, REDO_CLASSIFY, REDO_KERNEL } RedoLevel;
+
+typedef struct {
+    char* text;
+    size_t capacity;
+} FrameText;
+
+static double elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static float clampf(float v, float lo, float hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Why not engine_render_to_console? It formats into the frame arena, which is
+// only reset when a new grid is allocated. A session of edge and colour tweaks
+// never allocates one, so it would fill the arena. One reused buffer here does not.
+static int format_frame(ProcessingContext* ctx, const EngineConfig* config, FrameText* frame) {
+    size_t size = engine_format_ansi(ctx, config, NULL, 0);
+    if (size > frame->capacity) {
+        char* grown = (char*)realloc(frame->text, size);
+        if (!grown) return -1;
+        frame->text = grown;
+        frame->capacity = size;
+    }
+    return engine_format_ansi(ctx, config, frame->text, frame->capacity) == 0 ? -1 : 0;
+}
+
+static void draw_status(const EngineConfig* config, int width, int height, RedoLevel redo, double ms) {
+    static const char* const redo_names[] = { "render", "reclassify", "kernel" };
+    printf("\x1b[0m\x1b[K\rwidth %d (%dx%d)  edge %.2f  brightness %.2f  saturate %.2f  |  %s %.1f ms  "
+           "[e/E b/B s/S w/W r q]",
+           config->output_width, width, height, config->edge_strength, config->brightness_factor,
+           config->saturation_factor, redo_names[redo], ms);
+    fflush(stdout);
+}
+
+static RedoLevel apply_key(char key, EngineConfig* config, const EngineConfig* initial, int* quit) {
+    switch (key) {
+        case 'e': config->edge_strength = clampf(config->edge_strength - TUNE_EDGE_STEP, 0.0f, 2.0f); return REDO_CLASSIFY;
+        case 'E': config->edge_strength = clampf(config->edge_strength + TUNE_EDGE_STEP, 0.0f, 2.0f); return REDO_CLASSIFY;
+        case 'b': config->brightness_factor = clampf(config->brightness_factor - TUNE_BRIGHTNESS_STEP, 0.0f, 4.0f); return REDO_RENDER;
+        case 'B': config->brightness_factor = clampf(config->brightness_factor + TUNE_BRIGHTNESS_STEP, 0.0f, 4.0f); return REDO_RENDER;
+        case 's': config->saturation_factor = clampf(config->saturation_factor - TUNE_SATURATION_STEP, 0.0f, 4.0f); return REDO_RENDER;
+        case 'S': config->saturation_factor = clampf(config->saturation_factor + TUNE_SATURATION_STEP, 0.0f, 4.0f); return REDO_RENDER;
+        case 'w':
+            if (config->output_width - TUNE_WIDTH_STEP < TUNE_MIN_WIDTH) return REDO_RENDER;
+            config->output_width -= TUNE_WIDTH_STEP;
+            return REDO_KERNEL;
+        case 'W': config->output_width += TUNE_WIDTH_STEP; return REDO_KERNEL;
+        case 'r': {
+            int width_changed = config->output_width != initial->output_width;
+            *config = *initial;
+            return width_changed ? REDO_KERNEL : REDO_CLASSIFY;
+        }
+        case 'q': case 'Q': case 27: *quit = 1; return REDO_RENDER;
+        default: return REDO_RENDER;
+    }
+}
+
+// Why keep the initial height on width changes? The height follows from the
+// width by the same rule fit_to_terminal uses, so the picture keeps its shape.
+static int resize_grid(ProcessingContext* ctx, const EngineConfig* config) {
+    float corrected_aspect = engine_get_video_aspect(ctx) / config->aspect_correction;
+    int height = (int)((float)config->output_width / corrected_aspect);
+    if (height < 1) height = 1;
+    engine_update_output_dims(ctx, config->output_width, height);
+    return engine_reprocess(ctx, config);
+}
+
+int tune_run(ProcessingContext* ctx, EngineConfig* config, volatile sig_atomic_t* stop, char** error) {
+    if (!isatty(STDIN_FILENO)) {
+        if (error) *error = "--tune reads keys from a terminal";
+        return -1;
+    }
+    if (engine_reclassify(ctx, config) != 0) {
+        if (error) *error = "the still was processed without retained planes";
+        return -1;
+    }
+
+    // Why keep ISIG? Ctrl-C must still reach handle_interrupt, which sets
+    // *stop; the loop below then restores the terminal on the way out.
+    struct termios saved, raw;
+    if (tcgetattr(STDIN_FILENO, &saved) != 0) {
+        if (error) *error = "could not read the terminal mode";
+        return -1;
+    }
+    raw = saved;
+    raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+    EngineConfig initial = *config;
+    FrameText frame = { NULL, 0 };
+    int width, height;
+    int quit = 0;
+    int status = 0;
+    RedoLevel redo = REDO_RENDER;
+    double ms = 0.0;
+
+    printf("\x1b[2J");
+    int formatted = format_frame(ctx, config, &frame) == 0;
+    while (!*stop && !quit) {
+        if (!formatted) {
+            if (error) *error = "out of memory formatting the frame";
+            status = -1;
+            break;
+        }
+        engine_get_output_dims(ctx, &width, &height);
+        printf("\x1b[H%s", frame.text);
+        draw_status(config, width, height, redo, ms);
+
+        // Why poll with a timeout? signal() installs handlers with SA_RESTART,
+        // so a blocking read() would swallow Ctrl-C. poll() is never restarted.
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+        int ready = poll(&pfd, 1, 250);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+        char key;
+        if (read(STDIN_FILENO, &key, 1) != 1) break;
+
+        int old_width = config->output_width;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        redo = apply_key(key, config, &initial, &quit);
+        if (quit) break;
+        if (redo == REDO_KERNEL) {
+            if (resize_grid(ctx, config) != 0) {
+                // The arena could not hold a grid this size; step back.
+                config->output_width = old_width;
+                resize_grid(ctx, config);
+            }
+            printf("\x1b[2J");
+        } else if (redo == REDO_CLASSIFY) {
+            engine_reclassify(ctx, config);
+        }
+        // Timed up to the formatted frame; the terminal's own drawing is not ours.
+        formatted = format_frame(ctx, config, &frame) == 0;
+        ms = elapsed_ms(&start);
+    }
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    free(frame.text);
+    printf("\x1b[0m\n");
+    if (status == 0) {
+        printf("Equivalent flags: --width %d --edge %.2f --brightness %.2f --saturate %.2f\n",
+               config->output_width, config->edge_strength, config->brightness_factor,
+               config->saturation_factor);
+    }
+    return status;
+}
@@ -0,0 +1,480 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  verify.c
+ *
+ * =====================================================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "verify.h"
+
+#define VERIFY_MAX_THREADS 8
+#define VERIFY_MAX_CASES 256
+#define VERIFY_NAME_MAX 512
+
+enum {
+    PATTERN_RAMP,
+    PATTERN_CHECKER,
+    PATTERN_RINGS,
+    PATTERN_NOISE,
+    PATTERN_HAIRLINES,
+    PATTERN_COUNT
+};
+
+// Odd sizes on purpose: cell columns that do not divide into lanes of four,
+// and source pixels that do not divide into cells.
+static const struct {
+    const char* name;
+    int width;
+    int height;
+} kPatterns[PATTERN_COUNT] = {
+    { "ramp", 640, 360 },
+    { "checker", 333, 199 },
+    { "rings", 500, 281 },
+    { "noise", 257, 143 },
+    { "hairlines", 721, 405 }
+};
+
+// Everything one conversion produced, copied out of the context.
+typedef struct {
+    int width;
+    int height;
+    char* chars;
+    unsigned char* colors;
+    float* magnitude;
+    unsigned char* orientation;
+    unsigned char* level;
+    unsigned char* raster;
+    size_t raster_size;
+} Snapshot;
+
+typedef struct {
+    int failures;          // Comparisons that differ.
+    char first[256];       // Description of the first failure.
+} CaseResult;
+
+static void snapshot_free(Snapshot* snap) {
+    free(snap->chars);
+    free(snap->colors);
+    free(snap->magnitude);
+    free(snap->orientation);
+    free(snap->level);
+    free(snap->raster);
+    memset(snap, 0, sizeof(*snap));
+}
+
+static uint32_t xorshift(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint32_t isqrt(uint32_t n) {
+    uint32_t root = 0, bit = 1u << 30;
+    while (bit > n) bit >>= 2;
+    while (bit) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Why integer maths only? The golden file pins these renders, and sin() or
+// pow() may round differently in another libm.
+static void fill_pattern(int pattern, uint8_t* rgb, int width, int height) {
+    uint32_t seed = 0x9e3779b9u;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* p = rgb + ((size_t)y * width + x) * 3;
+            switch (pattern) {
+            case PATTERN_RAMP: // Every grey level, with a colour ramp down the frame.
+                p[0] = (uint8_t)(x * 255 / (width - 1));
+                p[1] = (uint8_t)(x * 255 / (width - 1));
+                p[2] = (uint8_t)(y < height / 2 ? x * 255 / (width - 1) : y * 255 / (height - 1));
+                break;
+            case PATTERN_CHECKER: {
+                int on = ((x / 7) + (y / 5)) & 1;
+                p[0] = on ? 230 : 20;
+                p[1] = (uint8_t)(on ? 40 + y : 200 - y / 2);
+                p[2] = (uint8_t)(on ? x : 255 - x / 2);
+                break;
+            }
+            case PATTERN_RINGS: { // Edges in every direction: a triangle wave over the radius.
+                int dx = 2 * x - width, dy = 2 * y - height;
+                int phase = (int)(isqrt((uint32_t)(dx * dx + dy * dy)) / 2 % 38);
+                int v = (phase < 19 ? phase : 38 - phase) * 255 / 19;
+                p[0] = (uint8_t)v;
+                p[1] = (uint8_t)(255 - v);
+                p[2] = (uint8_t)(v / 2 + 64);
+                break;
+            }
+            case PATTERN_NOISE: {
+                uint32_t r = xorshift(&seed);
+                p[0] = (uint8_t)r;
+                p[1] = (uint8_t)(r >> 8);
+                p[2] = (uint8_t)(r >> 16);
+                break;
+            }
+            default: { // One-pixel diagonal and vertical lines on grey.
+                int line = ((x + y) % 11 == 0) || (x % 17 == 0);
+                p[0] = p[1] = p[2] = line ? 250 : 96;
+                break;
+            }
+            }
+        }
+    }
+}
+
+static int take_snapshot(ProcessingContext* ctx, const EngineConfig* config, Snapshot* snap) {
+    EngineCellGrid grid;
+    EngineCellPlanes planes;
+    if (engine_get_cell_grid(ctx, &grid) != 0 || engine_get_cell_planes(ctx, &planes) != 0) return -1;
+    size_t cells = (size_t)grid.width * grid.height;
+    snap->width = grid.width;
+    snap->height = grid.height;
+    snap->chars = (char*)malloc(cells);
+    snap->colors = (unsigned char*)malloc(cells * 3);
+    snap->magnitude = (float*)malloc(cells * sizeof(float));
+    snap->orientation = (unsigned char*)malloc(cells);
+    snap->level = (unsigned char*)malloc(cells);
+    snap->raster_size = cells * 8 * 8 * 3;
+    snap->raster = (unsigned char*)malloc(snap->raster_size);
+    if (!snap->chars || !snap->colors || !snap->magnitude || !snap->orientation || !snap->level || !snap->raster) return -1;
+    for (int y = 0; y < grid.height; y++) {
+        memcpy(snap->chars + (size_t)y * grid.width, grid.chars + (size_t)y * grid.char_stride, (size_t)grid.width);
+        memcpy(snap->colors + (size_t)y * grid.width * 3, grid.colors + (size_t)y * grid.color_stride,
+               (size_t)grid.width * 3);
+    }
+    memcpy(snap->magnitude, planes.magnitude, cells * sizeof(float));
+    memcpy(snap->orientation, planes.orientation, cells);
+    memcpy(snap->level, planes.level, cells);
+    return engine_render_to_rgb(ctx, config, snap->raster, snap->raster_size);
+}
+
+// One conversion: an image file through the decoder, or a pattern through the
+// raw-buffer entry point.
+static int convert(const char* path, const uint8_t* pattern_rgb, int pattern_w, int pattern_h,
+                   const EngineConfig* base, int width, int threads, int simd, Snapshot* snap, char** error) {
+    EngineConfig config = *base;
+    config.output_width = width;
+    config.num_threads = threads;
+    config.use_simd = simd;
+    config.output_filename = NULL;
+    config.mode = MODE_IMAGE;
+
+    ProcessingContext* ctx = path ? engine_init(path, &config, error)
+                                  : engine_init_raw(pattern_w, pattern_h, ENGINE_PIX_RGB24, &config, error);
+    if (!ctx) return -1;
+    engine_retain_planes(ctx, 1);
+    int status;
+    if (path) {
+        struct AVFrame* frame = NULL;
+        status = engine_decode_video_packet(ctx, NULL, &frame) == 0 && frame ? 0 : -1;
+        if (status == 0) engine_process_frame_to_ascii(ctx, frame, &config);
+    } else {
+        const uint8_t* const planes[4] = { pattern_rgb, NULL, NULL, NULL };
+        const int strides[4] = { pattern_w * 3, 0, 0, 0 };
+        status = engine_process_buffer(ctx, planes, strides, 0, &config);
+    }
+    if (status == 0) status = take_snapshot(ctx, &config, snap);
+    if (status != 0) *error = "conversion failed";
+    engine_cleanup(&ctx);
+    return status;
+}
+
+static void note_failure(CaseResult* result, const char* format, const char* kernel, int threads, int x, int y,
+                         const char* what) {
+    if (result->failures++ == 0) {
+        snprintf(result->first, sizeof(result->first), format, kernel, threads, x, y, what);
+    }
+}
+
+// Compares one conversion with the reference and records any failure.
+static void compare(const Snapshot* ref, const Snapshot* got, const char* kernel, int threads, CaseResult* result) {
+    static const char kCell[] = "%s, %d thread(s), cell (%d,%d): %s";
+    if (got->width != ref->width || got->height != ref->height) {
+        note_failure(result, kCell, kernel, threads, 0, 0, "grid size differs");
+        return;
+    }
+    size_t cells = (size_t)ref->width * ref->height;
+    for (size_t i = 0; i < cells; i++) {
+        int x = (int)(i % (size_t)ref->width), y = (int)(i / (size_t)ref->width);
+        if (memcmp(ref->colors + i * 3, got->colors + i * 3, 3) != 0) {
+            note_failure(result, kCell, kernel, threads, x, y, "colour differs");
+        } else if (ref->level[i] != got->level[i]) {
+            note_failure(result, kCell, kernel, threads, x, y, "brightness level differs");
+        } else if (memcmp(&ref->magnitude[i], &got->magnitude[i], sizeof(float)) != 0) {
+            note_failure(result, kCell, kernel, threads, x, y, "edge magnitude differs");
+        } else if (ref->orientation[i] != got->orientation[i]) {
+            note_failure(result, kCell, kernel, threads, x, y, "edge orientation differs");
+        } else if (ref->chars[i] != got->chars[i]) {
+            note_failure(result, kCell, kernel, threads, x, y, "glyph differs with identical planes");
+        }
+    }
+
+    int raster_width = ref->width * 8;
+    for (size_t p = 0; p < ref->raster_size / 3; p++) {
+        if (memcmp(ref->raster + p * 3, got->raster + p * 3, 3) == 0) continue;
+        int cx = (int)(p % (size_t)raster_width) / 8, cy = (int)(p / (size_t)raster_width) / 8;
+        note_failure(result, kCell, kernel, threads, cx, cy, "raster differs");
+        break;
+    }
+}
+
+static void digest_u32(uint32_t* hash, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        *hash ^= (value >> (8 * i)) & 0xff;
+        *hash *= 16777619u;
+    }
+}
+
+static void digest_float(uint32_t* hash, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    digest_u32(hash, bits);
+}
+
+// Why digest the settings? The same pattern renders differently with another
+// edge threshold or colour mode, so a golden hash is only meaningful next to
+// the settings it was recorded with. Width, threads and kernel are left out:
+// width is in the case name and the other two must not change the output.
+static uint32_t config_digest(const EngineConfig* config) {
+    uint32_t hash = 2166136261u;
+    digest_float(&hash, config->edge_strength);
+    digest_float(&hash, config->aspect_correction);
+    digest_float(&hash, config->brightness_factor);
+    digest_float(&hash, config->saturation_factor);
+    digest_u32(&hash, (uint32_t)config->use_color);
+    digest_u32(&hash, (uint32_t)config->dither_mode);
+    digest_u32(&hash, (uint32_t)config->crop_x);
+    digest_u32(&hash, (uint32_t)config->crop_y);
+    digest_u32(&hash, (uint32_t)config->crop_w);
+    digest_u32(&hash, (uint32_t)config->crop_h);
+    digest_u32(&hash, (uint32_t)config->autocrop);
+    return hash;
+}
+
+// FNV-1a over everything the reference rendered.
+static uint64_t snapshot_hash(const Snapshot* snap) {
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* parts[3] = { (const unsigned char*)snap->chars, snap->colors, snap->raster };
+    size_t sizes[3] = { (size_t)snap->width * snap->height, (size_t)snap->width * snap->height * 3, snap->raster_size };
+    for (int k = 0; k < 3; k++) {
+        for (size_t i = 0; i < sizes[k]; i++) {
+            hash ^= parts[k][i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+typedef struct {
+    char names[VERIFY_MAX_CASES][VERIFY_NAME_MAX];
+    uint64_t hashes[VERIFY_MAX_CASES];
+    int count;
+} GoldenTable;
+
+static int golden_load(GoldenTable* table, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char line[VERIFY_NAME_MAX + 64];
+    while (table->count < VERIFY_MAX_CASES && fgets(line, sizeof(line), f)) {
+        unsigned long long hash;
+        char* space = strrchr(line, ' ');
+        if (!space || sscanf(space + 1, "%llx", &hash) != 1) continue;
+        *space = '\0';
+        size_t length = strlen(line);
+        if (length >= VERIFY_NAME_MAX) continue;
+        memcpy(table->names[table->count], line, length + 1);
+        table->hashes[table->count++] = hash;
+    }
+    fclose(f);
+    return 0;
+}
+
+static const uint64_t* golden_find(const GoldenTable* table, const char* name) {
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(table->names[i], name) == 0) return &table->hashes[i];
+    }
+    return NULL;
+}
+
+// Whether the case was recorded under any settings: names end in "#digest".
+static int golden_has_case(const GoldenTable* table, const char* name) {
+    size_t length = strcspn(name, "#");
+    for (int i = 0; i < table->count; i++) {
+        if (strncmp(table->names[i], name, length) == 0 && table->names[i][length] == '#') return 1;
+    }
+    return 0;
+}
+
+static int run_case(const char* name, const char* path, int pattern, const VerifyOptions* options,
+                    const EngineConfig* config, int width, GoldenTable* golden, volatile sig_atomic_t* stop,
+                    char** error) {
+    uint8_t* rgb = NULL;
+    int pw = 0, ph = 0;
+    if (!path) {
+        pw = kPatterns[pattern].width;
+        ph = kPatterns[pattern].height;
+        rgb = (uint8_t*)malloc((size_t)pw * ph * 3);
+        if (!rgb) {
+            *error = "out of memory";
+            return -1;
+        }
+        fill_pattern(pattern, rgb, pw, ph);
+    }
+
+    char case_name[VERIFY_NAME_MAX];
+    snprintf(case_name, sizeof(case_name), "%s@%d", name, width);
+    char golden_name[VERIFY_NAME_MAX];
+    snprintf(golden_name, sizeof(golden_name), "%s@%d#%08x", name, width, (unsigned)config_digest(config));
+    Snapshot ref = { 0 };
+    if (convert(path, rgb, pw, ph, config, width, 1, 0, &ref, error) != 0) {
+        snapshot_free(&ref);
+        free(rgb);
+        return -1;
+    }
+
+    CaseResult result = { 0 };
+    for (int simd = 0; simd <= 1 && !*stop; simd++) {
+        for (int threads = 1; threads <= options->max_threads && !*stop; threads++) {
+            if (!simd && threads == 1) continue; // The reference itself.
+            Snapshot got = { 0 };
+            if (convert(path, rgb, pw, ph, config, width, threads, simd, &got, error) != 0) {
+                snapshot_free(&got);
+                snapshot_free(&ref);
+                free(rgb);
+                return -1;
+            }
+            compare(&ref, &got, simd ? "sse" : "scalar", threads, &result);
+            snapshot_free(&got);
+        }
+    }
+
+    // Why only the patterns? An image's reference depends on the FFmpeg build
+    // that decoded and converted it. A pattern is drawn with integer maths,
+    // goes in as RGB24 that sws_scale only copies, and meets no libm call in
+    // the engine, so its hash depends only on the engine and the settings.
+    const char* golden_note = "";
+    if (golden && !path) {
+        uint64_t hash = snapshot_hash(&ref);
+        const uint64_t* recorded = golden_find(golden, golden_name);
+        const char* golden_failure = NULL;
+        if (options->record_golden) {
+            if (golden->count < VERIFY_MAX_CASES) {
+                snprintf(golden->names[golden->count], VERIFY_NAME_MAX, "%s", golden_name);
+                golden->hashes[golden->count++] = hash;
+                golden_note = ", recorded";
+            }
+        } else if (!recorded && golden_has_case(golden, golden_name)) {
+            golden_failure = "the golden file was recorded with other settings";
+        } else if (!recorded) {
+            golden_failure = "missing from the golden file";
+        } else if (*recorded != hash) {
+            golden_failure = "reference differs from the golden file";
+        } else {
+            golden_note = ", matches golden";
+        }
+        if (golden_failure && result.failures++ == 0) {
+            snprintf(result.first, sizeof(result.first), "%s", golden_failure);
+        }
+    }
+
+    printf("%-32s %4dx%-4d ", case_name, ref.width, ref.height);
+    if (result.failures > 0) {
+        printf("FAIL (%d): %s\n", result.failures, result.first);
+    } else {
+        printf("ok, identical%s\n", golden_note);
+    }
+    fflush(stdout);
+    snapshot_free(&ref);
+    free(rgb);
+    return result.failures > 0;
+}
+
+static int golden_save(const GoldenTable* table, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    for (int i = 0; i < table->count; i++) {
+        fprintf(f, "%s %016llx\n", table->names[i], (unsigned long long)table->hashes[i]);
+    }
+    return fclose(f);
+}
+
+int verify_run(const VerifyOptions* in_options, const EngineConfig* config,
+               volatile sig_atomic_t* stop, char** error) {
+    VerifyOptions options = *in_options;
+    if (options.max_threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        options.max_threads = cores > VERIFY_MAX_THREADS ? VERIFY_MAX_THREADS : (cores > 0 ? (int)cores : 1);
+    }
+    static const int kDefaultWidths[] = { 61, 80, 157 };
+    int widths[3] = { options.width, 0, 0 };
+    int width_count = 1;
+    if (options.width <= 0) {
+        memcpy(widths, kDefaultWidths, sizeof(widths));
+        width_count = 3;
+    }
+
+    GoldenTable* golden = NULL;
+    if (options.golden_path) {
+        golden = (GoldenTable*)calloc(1, sizeof(GoldenTable));
+        if (!golden) {
+            *error = "out of memory";
+            return -1;
+        }
+        // Why not record a missing file? A check that writes its own answers
+        // passes on any build, including the one it was meant to catch.
+        if (!options.record_golden && golden_load(golden, options.golden_path) != 0) {
+            free(golden);
+            *error = "the golden file is missing (record it with --record-golden)";
+            return -1;
+        }
+    }
+
+    printf("Checking scalar and SSE kernels at 1..%d threads against scalar on one thread\n", options.max_threads);
+    int failed = 0, status = 0;
+    for (int w = 0; w < width_count && status >= 0 && !*stop; w++) {
+        for (int i = 0; i < options.input_count && status >= 0 && !*stop; i++) {
+            const char* name = strrchr(options.inputs[i], '/');
+            status = run_case(name ? name + 1 : options.inputs[i], options.inputs[i], 0, &options, config,
+                              widths[w], golden, stop, error);
+            if (status > 0) failed++;
+        }
+        for (int p = 0; options.synthetic && p < PATTERN_COUNT && status >= 0 && !*stop; p++) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s-%dx%d", kPatterns[p].name, kPatterns[p].width, kPatterns[p].height);
+            status = run_case(name, NULL, p, &options, config, widths[w], golden, stop, error);
+            if (status > 0) failed++;
+        }
+    }
+
+    if (golden && options.record_golden && status >= 0 && !*stop) {
+        if (failed) {
+            *error = "not recording the golden file: the kernels disagree";
+            status = -1;
+        } else if (golden_save(golden, options.golden_path) != 0) {
+            *error = "could not write the golden file";
+            status = -1;
+        }
+    }
+    free(golden);
+    if (status < 0) return -1;
+    if (*stop) {
+        *error = "interrupted";
+        return -1;
+    }
+    printf("%s\n", failed ? "FAILED" : "All outputs agree");
+    return failed ? 1 : 0;
+}
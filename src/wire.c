@@ -0,0 +1,105 @@
+/*
+ * =====================================================================================
+ *
+ * Filename:  wire.c
+ *
+ * =====================================================================================
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "wire.h"
+
+double wire_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int wire_send_all(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+int wire_take_block(WireBuffer* in, char* block, size_t size) {
+    for (size_t i = in->pos; i + 1 < in->len; i++) {
+        if (in->buf[i] == '\n' && in->buf[i + 1] == '\n') {
+            size_t n = i + 1 - in->pos;
+            if (n >= size) return -1;
+            memcpy(block, in->buf + in->pos, n);
+            block[n] = '\0';
+            in->pos = i + 2;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+ssize_t wire_fill(int fd, WireBuffer* in) {
+    // Why compact here? Consumed bytes sit at the front; sliding the rest
+    // down only when more room is needed keeps a burst of small blocks from
+    // being moved once per block.
+    if (in->pos > 0) {
+        memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+        in->len -= in->pos;
+        in->pos = 0;
+    }
+    if (in->len == sizeof(in->buf)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    ssize_t n = recv(fd, in->buf + in->len, sizeof(in->buf) - in->len, 0);
+    if (n > 0) in->len += (size_t)n;
+    return n;
+}
+
+int wire_read_block(int fd, WireBuffer* in, char* block, size_t size) {
+    for (;;) {
+        int got = wire_take_block(in, block, size);
+        if (got != 0) return got;
+        ssize_t n = wire_fill(fd, in);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) return 0;
+    }
+}
+
+int wire_read_payload(int fd, WireBuffer* in, unsigned char* out, size_t size) {
+    size_t buffered = in->len - in->pos;
+    size_t take = buffered < size ? buffered : size;
+    memcpy(out, in->buf + in->pos, take);
+    in->pos += take;
+    size_t got = take;
+    while (got < size) {
+        ssize_t n = recv(fd, out + got, size - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += (size_t)n;
+    }
+    return 0;
+}
+
+const char* wire_block_value(const char* block, const char* key) {
+    size_t key_len = strlen(key);
+    for (const char* line = block; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == '=') return line + key_len + 1;
+    }
+    return NULL;
+}
+
+void wire_copy_value(char* out, size_t size, const char* value) {
+    size_t n = strcspn(value, "\n");
+    if (n >= size) n = size - 1;
+    memcpy(out, value, n);
+    out[n] = '\0';
+}